@@ -5,29 +5,83 @@
 #include <string.h>
 
 #include "device.h"
+#include "roofline.h"
 
 #define BYTES_IN_KB 1024
 #define BYTES_IN_MB (1024 * 1024)
 
-OclPlatformProp *platforms = NULL;
+const OclPlatformProp *platforms = NULL;
 cl_uint num_platforms;
 cl_int status;
 
-int main(void)
+// Measures the roofline of every device and saves it where the assignments
+// look for it (OclRooflinePath)
+static int Bench(void)
 {
-    // Print this out so that we can tell if this software ran.
-    printf("Finding OpenCL Platforms...\n");
+    for (int i = 0; i < num_platforms; i++)
+    {
+        for (int j = 0; j < platforms[i].num_devices; j++)
+        {
+            const OclDeviceProp *device = &platforms[i].devices[j];
+            OclRuntime runtime;
+            OclRoofline roofline;
+            char path[1024];
+
+            printf("Platform %d, Device %d: %s\n", i, j, device->name);
+            status = OclRuntimeCreateForDevice(&runtime, device->device_id);
+            if (status == CL_SUCCESS)
+            {
+                status = OclMeasureRoofline(&runtime, &roofline);
+                OclRuntimeRelease(&runtime);
+            }
+            if (status != CL_SUCCESS)
+            {
+                printf("\t- Benchmark failed: %d\n\n", status);
+                continue;
+            }
+
+            OclPrintRoofline(stdout, &roofline);
+            OclRooflinePath(device, path, sizeof(path));
+            if (OclSaveRoofline(device, &roofline) == CL_SUCCESS)
+                printf("\t- Saved to %s\n\n", path);
+            else
+                printf("\t- Could not save to %s\n\n", path);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = argc > 1 && strcmp(argv[1], "--json") == 0;
+    bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    if (argc > 2 || (argc == 2 && !json && !bench))
+    {
+        fprintf(stderr, "Usage: %s [--json | --bench]\n", argv[0]);
+        return -1;
+    }
 
     // Find all OpenCL platforms and devices on host machine
-    status = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
+    status = OclGetPlatforms(&platforms, &num_platforms);
     if (status != CL_SUCCESS)
     {
-        printf("Error getting OpenCL platforms\n");
+        fprintf(stderr, "Error getting OpenCL platforms\n");
         return -1;
     }
 
+    // Machine-readable: only the JSON goes to stdout
+    if (json)
+    {
+        OclPrintPlatformsJson(stdout, platforms, num_platforms);
+        return 0;
+    }
+
+    // Print this out so that we can tell if this software ran.
     printf("Found %d platforms!\n", num_platforms);
 
+    if (bench)
+        return Bench();
+
     for (int i = 0; i < num_platforms; i++)
     {
         printf("Platform %d\n", i);
@@ -38,35 +92,51 @@ int main(void)
 
         for (int j = 0; j < platforms[i].num_devices; j++)
         {
-            OclDeviceProp device = platforms[i].devices[j];
+            const OclDeviceProp *device = &platforms[i].devices[j];
             printf("\tDevice: %d\n", j);
-            printf("\t- Name: %s\n", device.name);
-            printf("\t- Type: %s\n", OclDeviceTypeString(*device.type));
-            printf("\t- Compute units: %u\n", *device.max_compute_units);
-            printf("\t- Global memory size: %lu bytes (%lu MB)\n",
-                   *device.global_mem_size, *device.global_mem_size / BYTES_IN_MB);
-            printf("\t- Max constant buffer size: %lu bytes (%lu MB)\n",
-                   *device.max_constant_buffer_size, *device.max_constant_buffer_size / BYTES_IN_MB);
-            printf("\t- Max local memory size per Compute Unit: %lu bytes (%lu KB)\n",
-                   *device.local_mem_size, *device.local_mem_size / BYTES_IN_KB);
-            printf("\t- Max Work Item Dimensions: %u\n", *device.max_work_item_dimensions);
+            printf("\t- Name: %s\n", device->name);
+            printf("\t- Type: %s\n", OclDeviceTypeString(device->type));
+            printf("\t- Version: %s (driver %s)\n", device->version, device->driver_version);
+            printf("\t- Compute units: %u\n", device->max_compute_units);
+            printf("\t- Max clock frequency: %u MHz\n", device->max_clock_frequency);
+            printf("\t- Global memory size: %llu bytes (%llu MB)\n",
+                   (unsigned long long)device->global_mem_size,
+                   (unsigned long long)device->global_mem_size / BYTES_IN_MB);
+            printf("\t- Max allocation size: %llu bytes (%llu MB)\n",
+                   (unsigned long long)device->max_mem_alloc_size,
+                   (unsigned long long)device->max_mem_alloc_size / BYTES_IN_MB);
+            printf("\t- Global memory cache: %llu bytes (%llu KB), %u byte lines\n",
+                   (unsigned long long)device->global_mem_cache_size,
+                   (unsigned long long)device->global_mem_cache_size / BYTES_IN_KB,
+                   device->global_mem_cacheline_size);
+            printf("\t- Max constant buffer size: %llu bytes (%llu MB)\n",
+                   (unsigned long long)device->max_constant_buffer_size,
+                   (unsigned long long)device->max_constant_buffer_size / BYTES_IN_MB);
+            printf("\t- Max local memory size per Compute Unit: %llu bytes (%llu KB)\n",
+                   (unsigned long long)device->local_mem_size,
+                   (unsigned long long)device->local_mem_size / BYTES_IN_KB);
+            printf("\t- Max Work Item Dimensions: %u\n", device->max_work_item_dimensions);
             printf("\t- Max Work Item size: ");
-            for (int d = 0; d < *device.max_work_item_dimensions; d++)
+            for (int d = 0; d < device->max_work_item_dimensions && d < OCL_DEVICE_MAX_DIMENSIONS; d++)
             {
                 if (d == 0)
                 {
-                    printf("%lu ", device.max_work_item_sizes[d]);
+                    printf("%zu ", device->max_work_item_sizes[d]);
                 }
                 else
                 {
-                    printf("x %lu ", device.max_work_item_sizes[d]);
+                    printf("x %zu ", device->max_work_item_sizes[d]);
                 }
             }
             printf("\n");
-            printf("\t- Max group size: %lu\n", *device.max_work_group_size);
+            printf("\t- Max group size: %zu\n", device->max_work_group_size);
+            printf("\t- Preferred vector width: char %u, int %u, float %u, double %u\n",
+                   device->preferred_vector_width_char, device->preferred_vector_width_int,
+                   device->preferred_vector_width_float, device->preferred_vector_width_double);
+            printf("\t- Max sub-groups per group: %u\n", device->max_num_sub_groups);
+            printf("\t- Extensions: %s\n", device->extensions);
             printf("\n");
         }
-        OclFreePlatformProp(&platforms[i]); // Free memory after printing
     }
     return 0;
-}
\ No newline at end of file
+}
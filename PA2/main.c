@@ -1,10 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-#include "kernel.h"
 #include "matrix.h"
 #include "device.h"
+#include "elementwise.h"
+#include "bench.h"
 
 #define CHECK_ERR(err, msg)                           \
     if (err != CL_SUCCESS)                            \
@@ -13,323 +15,189 @@
         exit(EXIT_FAILURE);                           \
     }
 
-#define VECTOR_ADD_2_KERNEL_PATH "vector_add_2.cl"
-#define VECTOR_ADD_4_KERNEL_PATH "vector_add_4.cl"
-
-void initializeOpenCL(cl_device_id* device_id, cl_context* context, cl_command_queue* queue) {
-    cl_int err;
-
-    // Find platforms and devices
-    OclPlatformProp *platforms = NULL;
-    cl_uint num_platforms;
-    err = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
-    CHECK_ERR(err, "OclFindPlatforms");
-
-    // Get the ID for the specified kind of device type.
-    err = OclGetDeviceWithFallback(device_id, OCL_DEVICE_TYPE);
-    CHECK_ERR(err, "OclGetDeviceWithFallback");
-
-    // Create a context
-    *context = clCreateContext(0, 1, device_id, NULL, NULL, &err);
-    CHECK_ERR(err, "clCreateContext");
-
-    // Create a command queue
-# if __APPLE__
-    *queue = clCreateCommandQueue(*context, *device_id, 0, &err);
-# else
-    *queue = clCreateCommandQueueWithProperties(*context, *device_id, 0, &err);
-# endif
-    CHECK_ERR(err, "clCreateCommandQueueWithProperties");
-}
-
-void callVectorAdd2Kernel(Matrix* a, Matrix* b, Matrix* out, cl_context* context, cl_command_queue* queue) {
-    //printf("in vectoradd2kernel\n");
-    //a, b, out are all cpu 
-    //everything else that we allocate are on gpu 
-
-    // OpenCL objects
-    cl_program program;                 // program
-    cl_kernel kernel;         // kernel
-
-    // OpenCL setup variables
-    size_t global_item_size, local_item_size;
+// Program 1 adds the vectors pairwise, a + b, then + c, then + d, as in the
+// chained two-input version, but every input is uploaded once and the
+// partial sums stay on the device; only the final sum is read back. Inputs
+// larger than the device can hold go through in chunks.
+void part1(Matrix* host_input_1, Matrix* host_input_2, Matrix* host_input_3, Matrix* host_input_4, Matrix* host_output, Matrix* answer, const char* output_file) {
+    OclRuntime runtime;
     cl_int err;
 
-    // Device input and output vectors
-    cl_mem device_input_1, device_input_2, device_output;
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
 
-    // Load external OpenCL kernel code
-    char *kernel_source = OclLoadKernel(VECTOR_ADD_2_KERNEL_PATH);
+    Matrix* inputs[4] = { host_input_1, host_input_2, host_input_3, host_input_4 };
+    const size_t size = (size_t)host_output->shape[0] * host_output->shape[1];
+    if (runtime.native)
+    {
+        // no device buffers: the same three additions on the host matrices
+        for (int k = 1; k < 4; k++)
+        {
+            Matrix* pair[2] = { k == 1 ? host_input_1 : host_output, inputs[k] };
+            err = OclElementwise(&runtime, "a + b", pair, 2, host_output);
+            CHECK_ERR(err, "OclElementwise a + b");
+        }
+    }
+    else
+    {
+        const size_t chunk_size = OclElementwiseChunkSize(&runtime, 4);
+        for (size_t first = 0; first < size; first += chunk_size)
+        {
+            // the chunk as a count x 1 view of each matrix
+            unsigned int count = first + chunk_size <= size ? chunk_size : size - first;
+            cl_mem device_inputs[4], device_output;
+            for (int k = 0; k < 4; k++)
+            {
+                Matrix chunk = { inputs[k]->data + first, { count, 1 } };
+                err = OclRuntimeUpload(&runtime, &chunk, CL_MEM_READ_ONLY, &device_inputs[k]);
+                CHECK_ERR(err, "OclRuntimeUpload");
+            }
+            device_output = clCreateBuffer(runtime.context, CL_MEM_READ_WRITE,
+                                           count * sizeof(int), NULL, &err);
+            CHECK_ERR(err, "clCreateBuffer out");
+
+            // the same cached "a + b" kernel runs all three additions
+            cl_mem sum_12[2] = { device_inputs[0], device_inputs[1] };
+            err = OclElementwiseDevice(&runtime, "a + b", sum_12, 2, device_output, count);
+            CHECK_ERR(err, "OclElementwiseDevice a + b");
+            cl_mem sum_3[2] = { device_output, device_inputs[2] };
+            err = OclElementwiseDevice(&runtime, "a + b", sum_3, 2, device_output, count);
+            CHECK_ERR(err, "OclElementwiseDevice + c");
+            cl_mem sum_4[2] = { device_output, device_inputs[3] };
+            err = OclElementwiseDevice(&runtime, "a + b", sum_4, 2, device_output, count);
+            CHECK_ERR(err, "OclElementwiseDevice + d");
+
+            Matrix output_chunk = { host_output->data + first, { count, 1 } };
+            err = OclRuntimeDownload(&runtime, device_output, &output_chunk);
+            CHECK_ERR(err, "OclRuntimeDownload");
+
+            for (int k = 0; k < 4; k++)
+                clReleaseMemObject(device_inputs[k]);
+            clReleaseMemObject(device_output);
+        }
+    }
 
-    // Create the program from the source buffer
-    program = clCreateProgramWithSource(*context, 1, (const char **)&kernel_source, NULL, &err);
-    CHECK_ERR(err, "clCreateProgramWithSource");
+    // Check whether the answer matches the output
+    CheckMatrix(answer, host_output);
+    SaveMatrix(output_file, host_output);
 
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    CHECK_ERR(err, "clBuildProgram");
-    
-    kernel = clCreateKernel(program, "vectorAdd", &err);
-    CHECK_ERR(err, "clCreateKernel");
-
-    // Allocate GPU memory
-    // Create memory buffers for input and output vectors
-    device_input_1 = clCreateBuffer(*context,
-                              CL_MEM_READ_ONLY,
-                              a->shape[0] * a->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer a");
-
-    //like malloc which allocates space for us
-    device_input_2 = clCreateBuffer(*context,
-                              CL_MEM_READ_ONLY,
-                              b->shape[0] * b->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer b");
-
-    device_output = clCreateBuffer(*context,
-                              CL_MEM_WRITE_ONLY,
-                              out->shape[0] * out->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer out");
-
-    //@@ Copy memory to the GPU here
-    //todo: 1. copy the input data to the device, using device_input_1 and device_input_2
-    //does each device_input_1 contain one matrix?
-    //printf ("======ENQUEUEWRITEBUFFER===== \n");
-    clEnqueueWriteBuffer(*queue, device_input_1, CL_FALSE, 0, sizeof(int) * a->shape[0], a->data, 0, NULL, NULL);
-    clEnqueueWriteBuffer(*queue, device_input_2, CL_FALSE, 0, sizeof(int) * b->shape[0], b->data, 0, NULL, NULL);
-
-
-    //@@ define local and global work sizes
-    //todo:defines size of the ND range kernel, 1 dimensional and == to size of vector
-    // size as in memory? or size as in dimensions? for the matrix --> number of elements not the memory size 
-    // do we need size_b as well for that matrix? --> same as size_b
-    unsigned int size_a = a->shape[0]; 
-
-    // Set the arguments to the kernel alr done for us
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_input_1);
-    CHECK_ERR(err, "clSetKernelArg 0");
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_input_2);
-    CHECK_ERR(err, "clSetKernelArg 1");
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_output);
-    CHECK_ERR(err, "clSetKernelArg 2");
-    err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &size_a);
-    CHECK_ERR(err, "clSetKernelArg 3");
-
-    //@@ Launch the GPU Kernel here
-    // todo: 1. set the dimensions for the NDRange
-    // todo: 2. enqueue the kernel
-    // size_t global_work_size[2] if it was a 2d work group and then assign each element 
-    // global_work_size[0] = 10, global_work_size[1] = 2 so num work items = 20
-    //device output buffer has the solution from kernel code 
-    //calls the kernel and runs the func
-
-    global_item_size = a->shape[0]; 
-    //printf ("======ND_RANGE_KERNEL===== \n");
-    clEnqueueNDRangeKernel(*queue, kernel, 1, NULL, &global_item_size, NULL, 0, NULL, NULL);   
-
-    //@@ Copy the GPU memory back to the CPU here
-    //device_output = GPU and out = CPU
-    // todo: output is stored device_output copy back from gpu device memory using clenqueue read buffer
-    clEnqueueReadBuffer(*queue, device_output, CL_TRUE, 0, a->shape[0] * sizeof(int), out->data, 0, NULL, NULL);
-
-    //@@ Free the GPU memory here
-    // todo: 1. free the gpu
-    //? r the steps for add2kernel and add4kernel the same for set up?
-
-    //printf ("======FREEING DEVICE INPUTS/OUTPUTS BUFFERS===== \n");
-    clReleaseMemObject(device_input_1);
-    clReleaseMemObject(device_input_2);
-    clReleaseMemObject(device_output);
-
-   // printf ("======FREEING KERNEL===== \n");
-
-    // Release Host Memory
-    free(kernel_source);
+    OclRuntimeRelease(&runtime);
 }
 
-void part1(Matrix* host_input_1, Matrix* host_input_2, Matrix* host_input_3, Matrix* host_input_4, Matrix* host_output, Matrix* answer, const char* output_file) {
-    // Start of program one
-
-    // OpenCL objects
-    //CREATING CONTEXT & COMMAND QUEUE
-    cl_device_id device_id;             // device ID
-    cl_context context;                 // context
-    cl_command_queue queue;             // command queue
-
-    initializeOpenCL(&device_id, &context, &queue);
-    //printf("STARTING VECTORADD2KERNEL CALLS\n");
-
-    callVectorAdd2Kernel(host_input_1, host_input_2, host_output, &context, &queue);
-   // printf("CALL 1 DONE\n");
-
-    callVectorAdd2Kernel(host_output, host_input_3, host_output, &context, &queue);
-    //printf("CALL 2 DONE\n");
+// Program 2 evaluates a + b + c + d as one generated kernel: one read of
+// each input and one write of the output, streamed through the device in
+// double-buffered chunks so transfers overlap with the kernel.
+void part2(Matrix* host_input_1, Matrix* host_input_2, Matrix* host_input_3, Matrix* host_input_4, Matrix* host_output, Matrix* answer, const char* output_file) {
+    OclRuntime runtime;
+    cl_int err;
 
-    callVectorAdd2Kernel(host_output, host_input_4, host_output, &context, &queue);
-    //printf("FINISHED VECTORADD2KERNEL CALLS\n");
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
 
-    // Prints the results
-    // for (unsigned int i = 0; i < host_output.shape[0] * host_output.shape[1]; i++)
-    // {
-    //     printf("C[%u]: %d == %d\n", i, host_output.data[i], answer.data[i]);
-    // }
+    Matrix* inputs[4] = { host_input_1, host_input_2, host_input_3, host_input_4 };
+    err = OclElementwise(&runtime, "a + b + c + d", inputs, 4, host_output);
+    CHECK_ERR(err, "OclElementwise");
 
     // Check whether the answer matches the output
-
-    
     CheckMatrix(answer, host_output);
-    //printf("saving matrix\n");
     SaveMatrix(output_file, host_output);
 
-    //@@ Release OpenCL objects here
-    //? do we also have to release the inputs and outputs?
-   // printf("RELEASING COMMAND QUEUE\n");
-    clReleaseContext(context); 
-    clReleaseCommandQueue(queue); 
-    //printf("RELEASING CONTEXT\n");
-   
-
+    OclRuntimeRelease(&runtime);
 }
 
-void callVectorAdd4Kernel(Matrix* a, Matrix* b, Matrix* c, Matrix* d, Matrix* out, cl_context* context, cl_command_queue* queue) {
-    // OpenCL objects
-    cl_program program;       // program
-    cl_kernel kernel;         // kernel
+// --bench: the four inputs of a dataset, loaded once and summed by part 2's
+// fused kernel on every run
+typedef struct
+{
+    Matrix inputs[4];
+    Matrix output;
+} VectorAddBench;
 
-    // OpenCL setup variables
-    size_t global_item_size, local_item_size;
-    cl_int err;
+static cl_int VectorAddSetup(void *user, const char *dataset, void **state, double *ops,
+                             double *bytes)
+{
+    char path[4096];
+    for (int k = 0; k < 4; k++)
+    {
+        snprintf(path, sizeof(path), "input%d.raw", k);
+        if (!OclBenchDatasetHas(dataset, path))
+        {
+            return OCL_BENCH_SKIPPED;
+        }
+    }
 
-    // Device input and output vectors
-    cl_mem device_input_1, device_input_2, device_input_3, device_input_4, device_output;
+    VectorAddBench *bench = (VectorAddBench *)calloc(1, sizeof(VectorAddBench));
+    cl_int err = CL_SUCCESS;
 
-    // Load external OpenCL kernel code
-    char *kernel_source = OclLoadKernel(VECTOR_ADD_4_KERNEL_PATH);
+    *state = bench;
+    if (bench == NULL)
+    {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
 
-    // Create the program from the source buffer
-    program = clCreateProgramWithSource(*context, 1, (const char **)&kernel_source, NULL, &err);
-    CHECK_ERR(err, "clCreateProgramWithSource");
+    for (int k = 0; k < 4 && err == CL_SUCCESS; k++)
+    {
+        snprintf(path, sizeof(path), "%s/input%d.raw", dataset, k);
+        err = LoadMatrix(path, &bench->inputs[k]);
+    }
+    if (err == CL_SUCCESS)
+    {
+        const size_t size = (size_t)bench->inputs[0].shape[0] * bench->inputs[0].shape[1];
+        bench->output.shape[0] = bench->inputs[0].shape[0];
+        bench->output.shape[1] = bench->inputs[0].shape[1];
+        bench->output.data = (int *)malloc(sizeof(int) * size);
+        if (bench->output.data == NULL)
+        {
+            return CL_OUT_OF_HOST_MEMORY;
+        }
+        // three additions per element; four ints read and one written
+        *ops = 3.0 * size;
+        *bytes = 5.0 * sizeof(int) * size;
+    }
 
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    CHECK_ERR(err, "clBuildProgram");
-    
-    kernel = clCreateKernel(program, "vectorAdd", &err);
-    CHECK_ERR(err, "clCreateKernel");
-
-    // Allocate GPU memory
-    // Create memory buffers for input and output vectors
-    device_input_1 = clCreateBuffer(*context,
-                              CL_MEM_READ_ONLY,
-                              a->shape[0] * a->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer a");
-
-    device_input_2 = clCreateBuffer(*context,
-                              CL_MEM_READ_ONLY,
-                              b->shape[0] * b->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer b");
-
-    device_input_3 = clCreateBuffer(*context,
-                              CL_MEM_READ_ONLY,
-                              c->shape[0] * c->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer c");
-
-    device_input_4 = clCreateBuffer(*context,
-                              CL_MEM_READ_ONLY,
-                              d->shape[0] * d->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer d");
-
-    device_output = clCreateBuffer(*context,
-                              CL_MEM_WRITE_ONLY,
-                              out->shape[0] * out->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer out");
-
-    //@@ Copy memory to the GPU here
-    clEnqueueWriteBuffer(*queue, device_input_1, CL_FALSE, 0, sizeof(int) * a->shape[0], a->data, 0, NULL, NULL);
-    clEnqueueWriteBuffer(*queue, device_input_2, CL_FALSE, 0, sizeof(int) * b->shape[0], b->data, 0, NULL, NULL);
-    clEnqueueWriteBuffer(*queue, device_input_3, CL_FALSE, 0, sizeof(int) * c->shape[0], c->data, 0, NULL, NULL);
-    clEnqueueWriteBuffer(*queue, device_input_4, CL_FALSE, 0, sizeof(int) * d->shape[0], d->data, 0, NULL, NULL);
-
-
-    //@@ define local and global work sizes
-    unsigned int size_a = a->shape[0];// @@ replace this with sizeof(a)
-
-    // Set the arguments to the kernel
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_input_1);
-    CHECK_ERR(err, "clSetKernelArg 0");
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_input_2);
-    CHECK_ERR(err, "clSetKernelArg 1");
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_input_3);
-    CHECK_ERR(err, "clSetKernelArg 2");
-    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &device_input_4);
-    CHECK_ERR(err, "clSetKernelArg 3");
-    err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &device_output);
-    CHECK_ERR(err, "clSetKernelArg 4");
-    err |= clSetKernelArg(kernel, 5, sizeof(unsigned int), &size_a);
-    CHECK_ERR(err, "clSetKernelArg 5");
-
-    //@@ Launch the GPU Kernel here
-    global_item_size = a->shape[0];
-    clEnqueueNDRangeKernel(*queue, kernel, 1, NULL, &global_item_size, NULL, 0, NULL, NULL);   
-
-    //@@ Copy the GPU memory back to the CPU here
-    clEnqueueReadBuffer(*queue, device_output, CL_TRUE, 0, a->shape[0] * sizeof(int), out->data, 0, NULL, NULL);
-
-    //@@ Free the GPU memory here
-    clReleaseMemObject(device_input_1);
-    clReleaseMemObject(device_input_2);
-    clReleaseMemObject(device_input_3);
-    clReleaseMemObject(device_input_4);
-    clReleaseMemObject(device_output);
-
-    // Release Host Memory
-    free(kernel_source);
+    return err;
 }
 
-void part2(Matrix* host_input_1, Matrix* host_input_2, Matrix* host_input_3, Matrix* host_input_4, Matrix* host_output, Matrix* answer, const char* output_file) {
-    // Start of program two
+static cl_int VectorAddRun(void *user, void *state)
+{
+    VectorAddBench *bench = (VectorAddBench *)state;
+    Matrix *inputs[4] = { &bench->inputs[0], &bench->inputs[1], &bench->inputs[2],
+                          &bench->inputs[3] };
+    return OclElementwise((OclRuntime *)user, "a + b + c + d", inputs, 4, &bench->output);
+}
 
-    // OpenCL objects
-    cl_device_id device_id;             // device ID
-    cl_context context;                 // context
-    cl_command_queue queue;             // command queue
+static void VectorAddTeardown(void *user, void *state)
+{
+    VectorAddBench *bench = (VectorAddBench *)state;
+    for (int k = 0; k < 4; k++)
+        free(bench->inputs[k].data);
+    free(bench->output.data);
+    free(bench);
+}
 
-    initializeOpenCL(&device_id, &context, &queue);
+static int Bench(int argc, char *argv[])
+{
+    OclRuntime runtime;
+    cl_int err;
 
-    callVectorAdd4Kernel(host_input_1, host_input_2, host_input_3, host_input_4, host_output, &context, &queue);
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
 
-    // Prints the results
-    // for (unsigned int i = 0; i < host_output.shape[0] * host_output.shape[1]; i++)
-    // {
-    //     printf("C[%u]: %d == %d\n", i, host_output.data[i], answer.data[i]);
-    // }
+    OclBenchSetDevice(runtime.device->name);
+    OclBenchRegister("vector_add4", VectorAddSetup, VectorAddRun, VectorAddTeardown, &runtime);
+    int status = OclBenchMain(argc, argv);
 
-    // Check whether the answer matches the output
-    CheckMatrix(answer, host_output);
-    SaveMatrix(output_file, host_output);
-
-    //@@ Release OpenCL objects here
-    //clReleaseCommandQueue(queue); 
-    clReleaseContext(context);    
+    OclRuntimeRelease(&runtime);
+    return status;
 }
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+    {
+        return Bench(argc, argv);
+    }
+
     if (argc != 8)
     {
         fprintf(stderr, "Usage: %s <input_file_0> <input_file_1> <input_file_2> <input_file_3> <answer_file> <output_file_program_1> <output_file_program_2>\n", argv[0]);
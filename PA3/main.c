@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "bench_gemm.h"
 #include "device.h"
-#include "kernel.h"
+#include "gemm.h"
 #include "matrix.h"
 
 #define CHECK_ERR(err, msg)                           \
@@ -12,135 +14,130 @@
         exit(EXIT_FAILURE);                           \
     }
 
-#define KERNEL_PATH "kernel.cl"
-
+// C = A^T B: A is read transposed through the GEMM's local-memory tiles,
+// never copied into a transposed matrix
 void OpenCLMatrixMultiply(Matrix *input0, Matrix *input1, Matrix *result)
 {
-    // Load external OpenCL kernel code
-    char *kernel_source = OclLoadKernel(KERNEL_PATH); // Load kernel source
+    OclRuntime runtime;
+    cl_int err;
+
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
+
+    err = OclGemm(&runtime, OCL_TRANS, OCL_NO_TRANS, 1, input0, input1, 0, result);
+    CHECK_ERR(err, "OclGemm");
+
+    OclRuntimeRelease(&runtime);
+}
+
+// --bench: A^T B on each dataset, the matrices loaded and allocated once by
+// OclBenchGemmSetup
+static cl_int GemmSetup(void *user, const char *dataset, void **state, double *ops,
+                        double *bytes)
+{
+    return OclBenchGemmSetup(OCL_TRANS, dataset, state, ops, bytes);
+}
+
+static cl_int GemmRun(void *user, void *state)
+{
+    OclBenchGemm *gemm = (OclBenchGemm *)state;
+    return OclGemm((OclRuntime *)user, OCL_TRANS, OCL_NO_TRANS, 1, &gemm->a, &gemm->b, 0,
+                   &gemm->c);
+}
+
+// --bench gemm_batched: GEMM_BATCH copies of the dataset's A^T B in one
+// OclGemmBatched launch. Its ops and bytes are those of every copy, so its
+// rates compare with gemm_at_b's, which pays a launch and transfers per call
+#define GEMM_BATCH 256
 
-    // Device input and output buffers
-    cl_mem device_a, device_b, device_c;
+typedef struct _GemmBatchBench
+{
+    OclBenchGemm *gemm; // A and B shared by every product
+    int *outputs;       // the GEMM_BATCH results, one after another
+    Matrix a[GEMM_BATCH];
+    Matrix b[GEMM_BATCH];
+    Matrix c[GEMM_BATCH];
+} GemmBatchBench;
+
+static cl_int GemmBatchedSetup(void *user, const char *dataset, void **state, double *ops,
+                               double *bytes)
+{
+    GemmBatchBench *bench = (GemmBatchBench *)calloc(1, sizeof(GemmBatchBench));
 
+    *state = bench;
+    if (bench == NULL)
+    {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+
+    cl_int err = OclBenchGemmSetup(OCL_TRANS, dataset, (void **)&bench->gemm, ops, bytes);
+    if (err != CL_SUCCESS)
+    {
+        return err;
+    }
+
+    const size_t size = (size_t)bench->gemm->c.shape[0] * bench->gemm->c.shape[1];
+    bench->outputs = (int *)malloc(sizeof(int) * size * GEMM_BATCH);
+    if (bench->outputs == NULL)
+    {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    for (unsigned int i = 0; i < GEMM_BATCH; i++)
+    {
+        bench->a[i] = bench->gemm->a;
+        bench->b[i] = bench->gemm->b;
+        bench->c[i] = bench->gemm->c;
+        bench->c[i].data = bench->outputs + i * size;
+    }
+    *ops *= GEMM_BATCH;
+    *bytes *= GEMM_BATCH;
+
+    return CL_SUCCESS;
+}
+
+static cl_int GemmBatchedRun(void *user, void *state)
+{
+    GemmBatchBench *bench = (GemmBatchBench *)state;
+    return OclGemmBatched((OclRuntime *)user, OCL_TRANS, OCL_NO_TRANS, 1, bench->a, bench->b, 0,
+                          bench->c, GEMM_BATCH);
+}
+
+static void GemmBatchedTeardown(void *user, void *state)
+{
+    GemmBatchBench *bench = (GemmBatchBench *)state;
+    if (bench->gemm != NULL)
+    {
+        OclBenchGemmTeardown(user, bench->gemm);
+    }
+    free(bench->outputs);
+    free(bench);
+}
+
+static int Bench(int argc, char *argv[])
+{
+    OclRuntime runtime;
     cl_int err;
 
-    cl_device_id device_id;    // device ID
-    cl_context context;        // context
-    cl_command_queue queue;    // command queue
-    cl_program program;        // program
-    cl_kernel kernel;          // kernel
-
-    // Find platforms and devices
-    OclPlatformProp *platforms = NULL;
-    cl_uint num_platforms;
-
-    err = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
-    CHECK_ERR(err, "OclFindPlatforms");
-
-    // Get the ID for the specified kind of device type.
-    err = OclGetDeviceWithFallback(&device_id, OCL_DEVICE_TYPE);
-    CHECK_ERR(err, "OclGetDeviceWithFallback");
-
-    // Create a context
-    context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
-    CHECK_ERR(err, "clCreateContext");
-
-    // Create a command queue
-# if __APPLE__
-    queue = clCreateCommandQueue(context, device_id, 0, &err);
-#else
-    queue = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
-#endif
-    CHECK_ERR(err, "clCreateCommandQueueWithProperties");
-
-    // Create the program from the source buffer
-    program = clCreateProgramWithSource(context, 1, (const char **)&kernel_source, NULL, &err);
-    CHECK_ERR(err, "clCreateProgramWithSource");
-
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    CHECK_ERR(err, "clBuildProgram");
-
-    // Create the compute kernel in the program we wish to run
-    kernel = clCreateKernel(program, "matrixMultiply", &err);
-    CHECK_ERR(err, "clCreateKernel");
-
-    //@@Allocate GPU memory here
-    device_a = clCreateBuffer(context,
-                              CL_MEM_READ_ONLY,
-                              input0->shape[0] * input0->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device a");
-
-    device_b = clCreateBuffer(context,
-                              CL_MEM_READ_ONLY,
-                              input1->shape[0] * input1->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device b");
-
-    device_c = clCreateBuffer(context,
-                              CL_MEM_WRITE_ONLY,
-                              result->shape[0] * result->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device c");
-
-
-    // @@  Copy memory to the GPU here
-    // PrintMatrix(input0); 
-    // PrintMatrix(input1);
-
-    clEnqueueWriteBuffer(queue, device_a, CL_TRUE, 0, sizeof(int) * input0->shape[0] * input0->shape[1], input0->data, 0, NULL, NULL);
-    clEnqueueWriteBuffer(queue, device_b, CL_TRUE, 0, sizeof(int) * input1->shape[0] * input1->shape[1], input1->data, 0, NULL, NULL);
-    
-    // @@  define local and global work sizes
-    const size_t global_work_size[2] = {input0->shape[1], input1->shape[1]}; // OUTPUT [x,y] //! set to result matrix in the future
-    const size_t local_work_size[2] = {1,1}; // OUTPUT [x,y]
-
-
-    // Set the arguments to our compute kernel
-    // __global const int *A, __global const int *B, __global int *C,
-    // const unsigned int numARows, const unsigned int numAColumns,
-    // const unsigned int numBRows, const unsigned int numBColumns,
-    // const unsigned int numCRows, const unsigned int numCColumns
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_a);
-    CHECK_ERR(err, "clSetKernelArg 0");
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_b);
-    CHECK_ERR(err, "clSetKernelArg 1");
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_c);
-    CHECK_ERR(err, "clSetKernelArg 2");
-    err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &input0->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 3");
-    err |= clSetKernelArg(kernel, 4, sizeof(unsigned int), &input0->shape[1]);
-    CHECK_ERR(err, "clSetKernelArg 4");
-    err |= clSetKernelArg(kernel, 5, sizeof(unsigned int), &input1->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 5");
-    err |= clSetKernelArg(kernel, 6, sizeof(unsigned int), &input1->shape[1]);
-    CHECK_ERR(err, "clSetKernelArg 6");
-    err |= clSetKernelArg(kernel, 7, sizeof(unsigned int), &result->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 7");
-    err |= clSetKernelArg(kernel, 8, sizeof(unsigned int), &result->shape[1]);
-    CHECK_ERR(err, "clSetKernelArg 8");
-
-    // @@  Launch the GPU Kernel here
-    clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, NULL, 0, NULL, NULL);   
-
-    // @@  Copy the GPU memory back to the CPU here
-    clEnqueueReadBuffer(queue, device_c, CL_TRUE, 0, result->shape[0] * result->shape[1] * sizeof(int), result->data, 0, NULL, NULL);
-    
-    //PrintMatrix(&device_c);
-    //PrintMatrix(result->data);
-    // @@  Free the GPU memory here
-    clReleaseMemObject(device_a);
-    clReleaseMemObject(device_b);
-    clReleaseMemObject(device_c);
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
+
+    OclBenchSetDevice(runtime.device->name);
+    OclBenchRegister("gemm_at_b", GemmSetup, GemmRun, OclBenchGemmTeardown, &runtime);
+    OclBenchRegister("gemm_batched", GemmBatchedSetup, GemmBatchedRun, GemmBatchedTeardown,
+                     &runtime);
+    int status = OclBenchMain(argc, argv);
 
+    OclRuntimeRelease(&runtime);
+    return status;
 }
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+    {
+        return Bench(argc, argv);
+    }
+
     if (argc != 5)
     {
         fprintf(stderr, "Usage: %s <input_file_0> <input_file_1> <answer_file> <output_file>\n", argv[0]);
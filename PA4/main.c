@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "bench_gemm.h"
 #include "device.h"
-#include "kernel.h"
+#include "gemm.h"
 #include "matrix.h"
+#include "roofline.h"
 
 #define CHECK_ERR(err, msg)                           \
     if (err != CL_SUCCESS)                            \
@@ -12,139 +16,224 @@
         exit(EXIT_FAILURE);                           \
     }
 
-#define KERNEL_PATH "kernel.cl"
+// Milliseconds of wall time since start; the GEMM calls block until the
+// device is done, so this includes the kernels and not just host time
+static double ElapsedMs(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000.0 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
 
+// C = A B with the Strassen driver, which hands matrices below its crossover
+// to the tiled GEMM
 void OpenCLMatrixMultiply(Matrix *input0, Matrix *input1, Matrix *result)
 {
-    // Load external OpenCL kernel code
-    char *kernel_source = OclLoadKernel(KERNEL_PATH); // Load kernel source
+    OclRuntime runtime;
+    cl_int err;
 
-    // Device input and output buffers
-    cl_mem device_a, device_b, device_c;
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
 
+    err = OclGemmStrassen(&runtime, OCL_NO_TRANS, OCL_NO_TRANS, 1, input0, input1, 0, result, 0);
+    CHECK_ERR(err, "OclGemmStrassen");
+
+    OclRuntimeRelease(&runtime);
+}
+
+// --compare: times the tiled GEMM and the Strassen driver on A B (after a
+// warm-up that builds their kernels), reports the speedup and checks that
+// both agree with result
+static void CompareMatrixMultiply(Matrix *input0, Matrix *input1, const Matrix *result)
+{
+    OclRuntime runtime;
     cl_int err;
+    struct timespec start;
+    const size_t size = (size_t)result->shape[0] * result->shape[1];
 
-    cl_device_id device_id;    // device ID
-    cl_context context;        // context
-    cl_command_queue queue;    // command queue
-    cl_program program;        // program
-    cl_kernel kernel;          // kernel
-
-    // Find platforms and devices
-    OclPlatformProp *platforms = NULL;
-    cl_uint num_platforms;
-
-    err = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
-    CHECK_ERR(err, "OclFindPlatforms");
-
-    // Get the ID for the specified kind of device type.
-    err = OclGetDeviceWithFallback(&device_id, OCL_DEVICE_TYPE);
-    CHECK_ERR(err, "OclGetDeviceWithFallback");
-
-    // Create a context
-    context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
-    CHECK_ERR(err, "clCreateContext");
-
-    // Create a command queue
-    # if __APPLE__
-        queue = clCreateCommandQueue(context, device_id, 0, &err);
-    #else
-        queue = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
-    #endif
-        CHECK_ERR(err, "clCreateCommandQueueWithProperties");
-        
-    // Create the program from the source buffer
-    program = clCreateProgramWithSource(context, 1, (const char **)&kernel_source, NULL, &err);
-    CHECK_ERR(err, "clCreateProgramWithSource");
-
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    CHECK_ERR(err, "clBuildProgram");
-
-    // Create the compute kernel in the program we wish to run
-    kernel = clCreateKernel(program, "matrixMultiply", &err);
-    CHECK_ERR(err, "clCreateKernel");
-
-    //@@ Allocate GPU memory here
-    device_a = clCreateBuffer(context,
-                              CL_MEM_READ_ONLY,
-                              input0->shape[0] * input0->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device a");
-
-    device_b = clCreateBuffer(context,
-                              CL_MEM_READ_ONLY,
-                              input1->shape[0] * input1->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device b");
-
-    device_c = clCreateBuffer(context,
-                              CL_MEM_WRITE_ONLY,
-                              result->shape[0] * result->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device c");
-
-    //@@ Copy memory to the GPU here
-    clEnqueueWriteBuffer(queue, device_a, CL_TRUE, 0, sizeof(int) * input0->shape[0] * input0->shape[1], input0->data, 0, NULL, NULL);
-    clEnqueueWriteBuffer(queue, device_b, CL_TRUE, 0, sizeof(int) * input1->shape[0] * input1->shape[1], input1->data, 0, NULL, NULL);
-    
-    // Set the arguments to our compute kernel
-    // __global const int *A, __global const int *B, __global int *C,
-    // const unsigned int numARows, const unsigned int numAColumns,
-    // const unsigned int numBRows, const unsigned int numBColumns,
-    // const unsigned int numCRows, const unsigned int numCColumns
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_a);
-    CHECK_ERR(err, "clSetKernelArg 0");
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_b);
-    CHECK_ERR(err, "clSetKernelArg 1");
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_c);
-    CHECK_ERR(err, "clSetKernelArg 2");
-    err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &input0->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 3");
-    err |= clSetKernelArg(kernel, 4, sizeof(unsigned int), &input0->shape[1]);
-    CHECK_ERR(err, "clSetKernelArg 4");
-    err |= clSetKernelArg(kernel, 5, sizeof(unsigned int), &input1->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 5");
-    err |= clSetKernelArg(kernel, 6, sizeof(unsigned int), &input1->shape[1]);
-    CHECK_ERR(err, "clSetKernelArg 6");
-    err |= clSetKernelArg(kernel, 7, sizeof(unsigned int), &result->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 7");
-    err |= clSetKernelArg(kernel, 8, sizeof(unsigned int), &result->shape[1]);
-    CHECK_ERR(err, "clSetKernelArg 8");
-
-    // @@ define local and global work sizes
-    const int TILE_SIZE = 16; 
-    size_t local_work_size[2] = {TILE_SIZE, TILE_SIZE}; 
-    //total area size
-    //size_t global_work_size[2] = {result->shape[0], result->shape[1]}; //total size of output matrix
-    size_t global_work_rows = ((result->shape[0] + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE;
-    size_t global_work_cols = ((result->shape[1] + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE;
-    size_t global_work_size[2] = {global_work_rows, global_work_cols};
-    //@@ Launch the GPU Kernel here
-    clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);   
-
-    //@@ Copy the GPU memory back to the CPU here
-    clEnqueueReadBuffer(queue, device_c, CL_TRUE, 0, result->shape[0] * result->shape[1] * sizeof(int), result->data, 0, NULL, NULL);
-
-    //@@ Free the GPU memory here
-    clReleaseMemObject(device_a);
-    clReleaseMemObject(device_b);
-    clReleaseMemObject(device_c);
-
-    clReleaseKernel(kernel); 
-    // clReleaseProgram(program); 
-    // clReleaseCommandQueue(queue); 
-    // clReleaseContext(context);
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
+
+    Matrix tiled = { (int *)malloc(sizeof(int) * size), { result->shape[0], result->shape[1] } };
+    Matrix strassen = { (int *)malloc(sizeof(int) * size), { result->shape[0], result->shape[1] } };
+    if (tiled.data == NULL || strassen.data == NULL)
+    {
+        CHECK_ERR(CL_OUT_OF_HOST_MEMORY, "malloc");
+    }
+
+    err = OclGemm(&runtime, OCL_NO_TRANS, OCL_NO_TRANS, 1, input0, input1, 0, &tiled);
+    CHECK_ERR(err, "OclGemm");
+    err = OclGemmStrassen(&runtime, OCL_NO_TRANS, OCL_NO_TRANS, 1, input0, input1, 0, &strassen, 0);
+    CHECK_ERR(err, "OclGemmStrassen");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    err = OclGemm(&runtime, OCL_NO_TRANS, OCL_NO_TRANS, 1, input0, input1, 0, &tiled);
+    CHECK_ERR(err, "OclGemm");
+    double tiled_ms = ElapsedMs(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    err = OclGemmStrassen(&runtime, OCL_NO_TRANS, OCL_NO_TRANS, 1, input0, input1, 0, &strassen, 0);
+    CHECK_ERR(err, "OclGemmStrassen");
+    double strassen_ms = ElapsedMs(&start);
+
+    printf("Tiled GEMM: %.2fms, Strassen (crossover %d): %.2fms, speedup %.2fx\n",
+           tiled_ms, OCL_GEMM_STRASSEN_CROSSOVER, strassen_ms, tiled_ms / strassen_ms);
+
+    // Against the peaks device_query --bench saved for this device, if any.
+    // The times include the transfers, so this is a lower bound.
+    OclRoofline roofline;
+    if (OclLoadRoofline(runtime.device, &roofline) == CL_SUCCESS)
+    {
+        const double m = input0->shape[0], k = input0->shape[1], n = input1->shape[1];
+        const double ops = 2 * m * n * k;
+        const double bytes = sizeof(int) * (m * k + k * n + m * n);
+        const double attainable = OclRooflineAttainable(&roofline, roofline.int32_gops, ops, bytes);
+        const double achieved = ops / (tiled_ms < strassen_ms ? tiled_ms : strassen_ms) / 1e6;
+        printf("Best: %.1f GOPS, %.1f%% of the roofline (%.1f GOPS attainable)\n", achieved,
+               100 * achieved / attainable, attainable);
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (tiled.data[i] != result->data[i] || strassen.data[i] != result->data[i])
+        {
+            printf("Tiled GEMM or Strassen differs from the result at element %zu\n", i);
+            break;
+        }
+    }
+
+    free(tiled.data);
+    free(strassen.data);
+    OclRuntimeRelease(&runtime);
+}
+
+// --to-mat: writes a dataset's text matrix to the binary file MapMatrix maps
+static int ConvertToMapped(const char *raw_path, const char *mat_path)
+{
+    Matrix text, mapped;
+    cl_int err;
+
+    err = LoadMatrix(raw_path, &text);
+    CHECK_ERR(err, "LoadMatrix");
+    err = CreateMappedMatrix(mat_path, text.shape[0], text.shape[1], &mapped);
+    CHECK_ERR(err, "CreateMappedMatrix");
+
+    memcpy(mapped.data, text.data, sizeof(int) * text.shape[0] * text.shape[1]);
+
+    err = UnmapMatrix(&mapped);
+    CHECK_ERR(err, "UnmapMatrix");
+    free(text.data);
+
+    return 0;
+}
+
+// --out-of-core: C = A B with A and B mapped from binary files and C mapped
+// to a new one, streamed through the device by OclGemmOutOfCore, so none of
+// the three has to fit in RAM. The answer is a text matrix, as for the
+// datasets.
+static int MappedMatrixMultiply(const char *a_path, const char *b_path, const char *answer_path,
+                                const char *c_path)
+{
+    OclRuntime runtime;
+    Matrix a, b, c, answer;
+    cl_int err;
+
+    err = MapMatrix(a_path, &a, 0);
+    CHECK_ERR(err, "MapMatrix");
+    err = MapMatrix(b_path, &b, 0);
+    CHECK_ERR(err, "MapMatrix");
+    err = CreateMappedMatrix(c_path, a.shape[0], b.shape[1], &c);
+    CHECK_ERR(err, "CreateMappedMatrix");
+
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
+    err = OclGemmOutOfCore(&runtime, OCL_NO_TRANS, OCL_NO_TRANS, 1, &a, &b, 0, &c, 0);
+    CHECK_ERR(err, "OclGemmOutOfCore");
+    OclRuntimeRelease(&runtime);
+
+    err = LoadMatrix(answer_path, &answer);
+    CHECK_ERR(err, "LoadMatrix");
+    CheckMatrix(&answer, &c);
+    free(answer.data);
+
+    err = UnmapMatrix(&a);
+    CHECK_ERR(err, "UnmapMatrix");
+    err = UnmapMatrix(&b);
+    CHECK_ERR(err, "UnmapMatrix");
+    err = UnmapMatrix(&c);
+    CHECK_ERR(err, "UnmapMatrix");
+
+    return 0;
+}
+
+// --bench: A B on each dataset by each path separately, the matrices loaded
+// and allocated once by OclBenchGemmSetup
+static cl_int GemmSetup(void *user, const char *dataset, void **state, double *ops,
+                        double *bytes)
+{
+    return OclBenchGemmSetup(OCL_NO_TRANS, dataset, state, ops, bytes);
+}
+
+static cl_int GemmTiledRun(void *user, void *state)
+{
+    OclBenchGemm *gemm = (OclBenchGemm *)state;
+    return OclGemm((OclRuntime *)user, OCL_NO_TRANS, OCL_NO_TRANS, 1, &gemm->a, &gemm->b, 0,
+                   &gemm->c);
+}
+
+static cl_int GemmStrassenRun(void *user, void *state)
+{
+    OclBenchGemm *gemm = (OclBenchGemm *)state;
+    return OclGemmStrassen((OclRuntime *)user, OCL_NO_TRANS, OCL_NO_TRANS, 1, &gemm->a,
+                           &gemm->b, 0, &gemm->c, 0);
+}
+
+static int Bench(int argc, char *argv[])
+{
+    OclRuntime runtime;
+    cl_int err;
+
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
+
+    OclBenchSetDevice(runtime.device->name);
+    OclBenchRegister("gemm_tiled", GemmSetup, GemmTiledRun, OclBenchGemmTeardown, &runtime);
+    OclBenchRegister("gemm_strassen", GemmSetup, GemmStrassenRun, OclBenchGemmTeardown, &runtime);
+    int status = OclBenchMain(argc, argv);
+
+    OclRuntimeRelease(&runtime);
+    return status;
 }
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+    {
+        return Bench(argc, argv);
+    }
+    if (argc == 4 && !strcmp(argv[1], "--to-mat"))
+    {
+        return ConvertToMapped(argv[2], argv[3]);
+    }
+    if (argc == 6 && !strcmp(argv[1], "--out-of-core"))
+    {
+        return MappedMatrixMultiply(argv[2], argv[3], argv[4], argv[5]);
+    }
+
+    // --compare also times the tiled GEMM against the Strassen driver
+    const int compare = argc > 1 && !strcmp(argv[1], "--compare");
+    if (compare)
+    {
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+
     if (argc != 5)
     {
-        fprintf(stderr, "Usage: %s <input_file_0> <input_file_1> <answer_file> <output_file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--compare] <input_file_0> <input_file_1> <answer_file> <output_file>\n", argv[0]);
+        fprintf(stderr, "       %s --to-mat <input_file> <mat_file>\n", argv[0]);
+        fprintf(stderr, "       %s --out-of-core <mat_file_0> <mat_file_1> <answer_file> <mat_output_file>\n", argv[0]);
         return -1;
     }
 
@@ -180,6 +269,10 @@ int main(int argc, char *argv[])
 
     // Call your matrix multiply.
     OpenCLMatrixMultiply(&host_a, &host_b, &host_c);
+    if (compare)
+    {
+        CompareMatrixMultiply(&host_a, &host_b, &host_c);
+    }
 
     // // Call to print the matrix
     // PrintMatrix(&host_c);
@@ -4,10 +4,13 @@
 #include <libgen.h>
 #include <string.h>
 
+#include "bench.h"
+#include "cpu.h"
 #include "device.h"
 #include "kernel.h"
 #include "matrix.h"
 #include "img.h"
+#include "runtime.h"
 
 #define CHECK_ERR(err, msg)                           \
     if (err != CL_SUCCESS)                            \
@@ -22,135 +25,209 @@
 #define COMPUTE_OUTUT_DIM(input_dim, kernel_size, stride) \
     ((input_dim - kernel_size) / stride + 1)
 
-void OpenCLConvolution2D(Image *input0, Matrix *input1, Image *result, int stride)
+// Output size of a valid convolution of input with mask at stride
+static void AllocateOutput(const Image *input, const Matrix *mask, int stride, Image *output)
 {
-    //? input0 is iag
-    // Load external OpenCL kernel code
-    char *kernel_source = OclLoadKernel(KERNEL_PATH); // Load kernel source
+    //@@ Update these values for the output rows and cols of the output
+    //@@ Do not use the results from the answer image
+    output->shape[0] = (input->shape[0] - (mask->shape[0] - 1)) / stride;
+    output->shape[1] = (input->shape[1] - (mask->shape[1] - 1)) / stride;
+    output->shape[2] = input->shape[2];
+    output->data =
+        (int *)malloc(sizeof(int) * output->shape[0] * output->shape[1] * IMAGE_CHANNELS);
+}
 
+// The kernel is built on the first call and cached in the runtime, so
+// repeated calls pay only for the buffers, transfers and launch. A native
+// runtime convolves on the host instead
+cl_int OpenCLConvolution2D(OclRuntime *runtime, const char *kernel_source, Image *input0,
+                           Matrix *input1, Image *result, int stride)
+{
     // Device input and output buffers
-    cl_mem device_a, device_b, device_c;
-
+    cl_mem device_a = NULL, device_b = NULL, device_c = NULL;
+    cl_kernel kernel;
+    int imageChannels = IMAGE_CHANNELS;
     cl_int err;
 
-    cl_device_id device_id;    // device ID
-    cl_context context;        // context
-    cl_command_queue queue;    // command queue
-    cl_program program;        // program
-    cl_kernel kernel;          // kernel
+    const size_t input_size = sizeof(int) * input0->shape[0] * input0->shape[1] * IMAGE_CHANNELS;
+    const size_t mask_size = sizeof(int) * input1->shape[0] * input1->shape[1];
+    const size_t result_size = sizeof(int) * result->shape[0] * result->shape[1] * IMAGE_CHANNELS;
 
-    // Find platforms and devices
-    OclPlatformProp *platforms = NULL;
-    cl_uint num_platforms;
+    if (runtime->native)
+    {
+        OclCpuConvolution2D(input0->data, input0->shape[1], IMAGE_CHANNELS, input1->data,
+                            input1->shape[0], stride, result->data, result->shape[0],
+                            result->shape[1]);
+        return CL_SUCCESS;
+    }
 
-    err = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
-    CHECK_ERR(err, "OclFindPlatforms");
+    err = OclRuntimeGetKernel(runtime, kernel_source, "convolution2D", &kernel);
 
-    // Get the ID for the specified kind of device type.
-    err = OclGetDeviceWithFallback(&device_id, OCL_DEVICE_TYPE);
-    CHECK_ERR(err, "OclGetDeviceWithFallback");
+    //@@ Allocate GPU memory here
+    if (err == CL_SUCCESS)
+        device_a = clCreateBuffer(runtime->context, CL_MEM_READ_ONLY, input_size, NULL, &err);
+    if (err == CL_SUCCESS)
+        device_b = clCreateBuffer(runtime->context, CL_MEM_READ_ONLY, mask_size, NULL, &err);
+    if (err == CL_SUCCESS)
+        device_c = clCreateBuffer(runtime->context, CL_MEM_WRITE_ONLY, result_size, NULL, &err);
 
-    // Create a context
-    context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
-    CHECK_ERR(err, "clCreateContext");
+    //@@ Copy memory to the GPU here
+    if (err == CL_SUCCESS)
+        err = clEnqueueWriteBuffer(runtime->queue, device_a, CL_FALSE, 0, input_size, input0->data,
+                                   0, NULL, NULL);
+    if (err == CL_SUCCESS)
+        err = clEnqueueWriteBuffer(runtime->queue, device_b, CL_FALSE, 0, mask_size, input1->data,
+                                   0, NULL, NULL);
 
-    // Create a command queue
-    # if __APPLE__
-        queue = clCreateCommandQueue(context, device_id, 0, &err);
-    #else
-        queue = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
-    #endif
-        CHECK_ERR(err, "clCreateCommandQueueWithProperties");
-        
+    // Set the arguments to our compute kernel
+    // __global int * inputData, __global int * outputData, __constant int * maskData,
+    // int width, int height, int maskWidth, int imageChannels, int stride
+    if (err == CL_SUCCESS)
+    {
+        err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_a);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_c);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_b);
+        err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &input0->shape[1]);
+        err |= clSetKernelArg(kernel, 4, sizeof(unsigned int), &input0->shape[0]);
+        err |= clSetKernelArg(kernel, 5, sizeof(unsigned int), &input1->shape[0]);
+        err |= clSetKernelArg(kernel, 6, sizeof(unsigned int), &imageChannels);
+        err |= clSetKernelArg(kernel, 7, sizeof(unsigned int), &stride);
+    }
 
-    // Create the program from the source buffer
-    program = clCreateProgramWithSource(context, 1, (const char **)&kernel_source, NULL, &err);
-    CHECK_ERR(err, "clCreateProgramWithSource");
+    //@@ Launch the GPU Kernel here
+    if (err == CL_SUCCESS)
+    {
+        size_t global_work_size[2] = { result->shape[1], result->shape[0] };
+        size_t local_work_size[2] = { TILE_SIZE, TILE_SIZE };
+        err = clEnqueueNDRangeKernel(runtime->queue, kernel, 2, NULL, global_work_size,
+                                     local_work_size, 0, NULL, NULL);
+    }
 
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    CHECK_ERR(err, "clBuildProgram");
+    //@@ Copy the GPU memory back to the CPU here
+    if (err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(runtime->queue, device_c, CL_TRUE, 0, result_size, result->data,
+                                  0, NULL, NULL);
 
-    // Create the compute kernel in the program we wish to run
-    kernel = clCreateKernel(program, "convolution2D", &err);
-    CHECK_ERR(err, "clCreateKernel");
+    //@@ Free the GPU memory here
+    if (device_a != NULL)
+        clReleaseMemObject(device_a);
+    if (device_b != NULL)
+        clReleaseMemObject(device_b);
+    if (device_c != NULL)
+        clReleaseMemObject(device_c);
+
+    return err;
+}
 
-    //@@ Allocate GPU memory here
-    device_a = clCreateBuffer(context,
-                              CL_MEM_READ_ONLY,
-                              input0->shape[0] * input0->shape[1] * IMAGE_CHANNELS * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device a");
-
-    device_b = clCreateBuffer(context,
-                              CL_MEM_READ_ONLY,
-                              input1->shape[0] * input1->shape[1] * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device b");
-
-    device_c = clCreateBuffer(context,
-                              CL_MEM_WRITE_ONLY,
-                              result->shape[0] * result->shape[1] * IMAGE_CHANNELS * sizeof(int),
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device c");
+// --bench: the image, mask and stride of a dataset, loaded once and
+// convolved on every run with the runtime and kernel source of the context
+typedef struct
+{
+    OclRuntime runtime;
+    char *kernel_source;
+} ConvolutionContext;
 
+typedef struct
+{
+    Image input;
+    Matrix mask;
+    Image output;
+    int stride;
+} ConvolutionBench;
 
-    //@@ Copy memory to the GPU here
-    err = clEnqueueWriteBuffer(queue, device_a, CL_TRUE, 0, sizeof(int) * input0->shape[0] * input0->shape[1] * IMAGE_CHANNELS, input0->data, 0, NULL, NULL);
-    CHECK_ERR(err, "writing fgor input 1");
+static cl_int ConvolutionSetup(void *user, const char *dataset, void **state, double *ops,
+                               double *bytes)
+{
+    if (!OclBenchDatasetHas(dataset, "input0.raw") || !OclBenchDatasetHas(dataset, "kernel0.raw") ||
+        !OclBenchDatasetHas(dataset, "stride.raw"))
+    {
+        return OCL_BENCH_SKIPPED;
+    }
 
-    err = clEnqueueWriteBuffer(queue, device_b, CL_TRUE, 0, sizeof(int) * input1->shape[0] * input1->shape[1], input1->data, 0, NULL, NULL);
-    CHECK_ERR(err, "writing fgor input 1");
+    ConvolutionBench *bench = (ConvolutionBench *)calloc(1, sizeof(ConvolutionBench));
+    char path[4096];
+    cl_int err;
 
-    // Set the arguments to our compute kernel
-    // __global float * inputData, __global float * outputData, __constant float * maskData,
-    // int width, int height, int maskWidth,  int imageChannels
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_a);
-    CHECK_ERR(err, "clSetKernelArg 0");
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_c);
-    CHECK_ERR(err, "clSetKernelArg 1");
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_b);
-    CHECK_ERR(err, "clSetKernelArg 2");
-    err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &input0->shape[1]);
-    CHECK_ERR(err, "clSetKernelArg 3");
-    err |= clSetKernelArg(kernel, 4, sizeof(unsigned int), &input0->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 4");
-    err |= clSetKernelArg(kernel, 5, sizeof(unsigned int), &input1->shape[0]);
-    CHECK_ERR(err, "clSetKernelArg 5");
-    int imageChannels = IMAGE_CHANNELS;
-    err |= clSetKernelArg(kernel, 6, sizeof(unsigned int), &imageChannels);
-    CHECK_ERR(err, "clSetKernelArg 6");
-    err |= clSetKernelArg(kernel, 7, sizeof(unsigned int), &stride);
-    CHECK_ERR(err, "clSetKernelArg 7");
-
-    // Compute the output dim 
-    // @@ define local and global work sizes
-    // Execute the OpenCL kernel on the list
-    size_t global_work_size[2] = {result->shape[1], result->shape[0]}; 
-    printf("My Result dimensions: (%d, %d, %d)", result->shape[0], result->shape[1], result->shape[2]);
-    size_t local_work_size [2] = {TILE_SIZE, TILE_SIZE}; 
-    //@@ Launch the GPU Kernel here
-    // Execute the OpenCL kernel on the array
-    err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);   
-    CHECK_ERR(err , "Kernel run");
-    //@@ Copy the GPU memory back to the CPU here
-    // Read the memory buffer output_mem_obj to the local variable result
-    err = clEnqueueReadBuffer(queue, device_c, CL_TRUE, 0, result->shape[0] * result->shape[1] * IMAGE_CHANNELS * sizeof(int), result->data, 0, NULL, NULL);
-    CHECK_ERR(err , "Kernel run");
+    *state = bench;
+    if (bench == NULL)
+    {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
 
-    //@@ Free the GPU memory here
-    // Release OpenCL resources
-    clReleaseMemObject(device_a);
-    clReleaseMemObject(device_b);
-    clReleaseMemObject(device_c);
-    clReleaseKernel(kernel); 
+    snprintf(path, sizeof(path), "%s/input0.raw", dataset);
+    err = LoadImgRaw(path, &bench->input);
+    if (err == CL_SUCCESS)
+    {
+        snprintf(path, sizeof(path), "%s/kernel0.raw", dataset);
+        err = LoadMatrix(path, &bench->mask);
+    }
+    if (err == CL_SUCCESS)
+        err = LoadStride(dataset, &bench->stride);
+    if (err == CL_SUCCESS)
+    {
+        AllocateOutput(&bench->input, &bench->mask, bench->stride, &bench->output);
+        if (bench->output.data == NULL)
+        {
+            return CL_OUT_OF_HOST_MEMORY;
+        }
+        const Image *input = &bench->input, *output = &bench->output;
+        const double inputs = (double)input->shape[0] * input->shape[1] * IMAGE_CHANNELS;
+        const double outputs = (double)output->shape[0] * output->shape[1] * IMAGE_CHANNELS;
+        const double taps = (double)bench->mask.shape[0] * bench->mask.shape[1];
+        *ops = 2 * taps * outputs;
+        *bytes = sizeof(int) * (inputs + taps + outputs);
+    }
+
+    return err;
+}
+
+static cl_int ConvolutionRun(void *user, void *state)
+{
+    ConvolutionContext *context = (ConvolutionContext *)user;
+    ConvolutionBench *bench = (ConvolutionBench *)state;
+    return OpenCLConvolution2D(&context->runtime, context->kernel_source, &bench->input,
+                               &bench->mask, &bench->output, bench->stride);
+}
+
+static void ConvolutionTeardown(void *user, void *state)
+{
+    ConvolutionBench *bench = (ConvolutionBench *)state;
+    free(bench->input.data);
+    free(bench->mask.data);
+    free(bench->output.data);
+    free(bench);
+}
+
+static int Bench(int argc, char *argv[])
+{
+    ConvolutionContext context;
+    cl_int err;
+
+    context.kernel_source = OclLoadKernel(KERNEL_PATH);
+    if (context.kernel_source == NULL)
+    {
+        fprintf(stderr, "Cannot load %s\n", KERNEL_PATH);
+        return 1;
+    }
+    err = OclRuntimeCreate(&context.runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
+
+    OclBenchSetDevice(context.runtime.device->name);
+    OclBenchRegister("conv2d", ConvolutionSetup, ConvolutionRun, ConvolutionTeardown, &context);
+    int status = OclBenchMain(argc, argv);
+
+    OclRuntimeRelease(&context.runtime);
+    free(context.kernel_source);
+    return status;
 }
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+    {
+        return Bench(argc, argv);
+    }
+
     if (argc != 5)
     {
         fprintf(stderr, "Usage: %s <input_file_0> <input_file_1> <answer_file> <output_file>\n", argv[0]);
@@ -187,19 +264,20 @@ int main(int argc, char *argv[])
     err = LoadStride(dir, &stride);
     CHECK_ERR(err, "LoadStride");
 
-    int rows, cols;
-    //@@ Update these values for the output rows and cols of the output
-    //@@ Do not use the results from the answer image
-    rows = (host_a.shape[0] - (host_b.shape[0] - 1))/stride; 
-    cols = (host_a.shape[1] - (host_b.shape[1] - 1))/stride; 
-    
     // Allocate the memory for the target.
-    host_c.shape[0] = rows;
-    host_c.shape[1] = cols;
-    host_c.shape[2] = host_a.shape[2]; //? do we need to set for image channels?
-    host_c.data = (int *)malloc(sizeof(int) * host_c.shape[0] * host_c.shape[1] * IMAGE_CHANNELS);
+    AllocateOutput(&host_a, &host_b, stride, &host_c);
+    printf("My Result dimensions: (%d, %d, %d)", host_c.shape[0], host_c.shape[1], host_c.shape[2]);
+
+    OclRuntime runtime;
+    char *kernel_source = OclLoadKernel(KERNEL_PATH); // Load kernel source
+
+    err = OclRuntimeCreate(&runtime, OCL_DEVICE_TYPE);
+    CHECK_ERR(err, "OclRuntimeCreate");
+    err = OpenCLConvolution2D(&runtime, kernel_source, &host_a, &host_b, &host_c, stride);
+    CHECK_ERR(err, "OpenCLConvolution2D");
+    OclRuntimeRelease(&runtime);
+    free(kernel_source);
 
-    OpenCLConvolution2D(&host_a, &host_b, &host_c, stride);
     // printf("MY OUTPUT\n:");
     // PrintMatrix(&host_c);
     // printf("ANSWER \n:");
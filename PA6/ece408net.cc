@@ -10,9 +10,52 @@
 
  #include "ece408net.h"
 
+ void buildNetwork_CPU(Network* dnn)
+ {
+   Layer* conv1 = new Conv(1, 86, 86, 4, 7, 7);
+   Layer* pool1 = new MaxPooling(4, 80, 80, 2, 2, 2);
+   Layer* conv2 = new Conv(4, 40, 40, 16, 7, 7);
+   Layer* pool2 = new MaxPooling(16, 34, 34, 4, 4, 4);
+   Layer* fc3 = new FullyConnected(pool2->output_dim(), 32);
+   Layer* fc4 = new FullyConnected(32, 10);
+   Layer* relu1 = new ReLU;
+   Layer* relu2 = new ReLU;
+   Layer* relu3 = new ReLU;
+   Layer* softmax = new Softmax;
+   dnn->add_layer(conv1);
+   dnn->add_layer(relu1);
+   dnn->add_layer(pool1);
+   dnn->add_layer(conv2);
+   dnn->add_layer(relu2);
+   dnn->add_layer(pool2);
+   dnn->add_layer(fc3);
+   dnn->add_layer(relu3);
+   dnn->add_layer(fc4);
+   dnn->add_layer(softmax);
+   // loss
+   Loss* loss = new SoftmaxCrossEntropy;
+   dnn->add_loss(loss);
+ }
+
+ Network createNetwork_CPU(bool customCPUConv)
+ {
+   // There is no separate custom CPU convolution in this tree, so both
+   // variants use the thread-pooled Conv layer.
+   Network dnn;
+   buildNetwork_CPU(&dnn);
+ 
+   //load weights
+   dnn.load_parameters("./build/weights-86.bin");
+ 
+   return dnn;
+ }
+
  Network createNetwork_OpenCL(OpenCL* opencl)
  {
    Network dnn;
+   // natively only the convolutions have a backend of their own; the fully
+   // connected layers and the loss take their CPU paths
+   OpenCL* device = opencl->native ? NULL : opencl;
  
    Layer* conv1 = new Conv_Custom(1, 86, 86, 4, 7, 7);
    ((Conv_Custom*)conv1)->opencl = opencl;
@@ -22,6 +65,8 @@
    Layer* pool2 = new MaxPooling(16, 34, 34, 4, 4, 4);
    Layer* fc3 = new FullyConnected(pool2->output_dim(), 32);
    Layer* fc4 = new FullyConnected(32, 10);
+   ((FullyConnected*)fc3)->opencl = device;
+   ((FullyConnected*)fc4)->opencl = device;
    Layer* relu1 = new ReLU;
    Layer* relu2 = new ReLU;
    Layer* relu3 = new ReLU;
@@ -37,7 +82,8 @@
    dnn.add_layer(fc4);
    dnn.add_layer(softmax);
    // loss
-   Loss* loss = new CrossEntropy;
+   SoftmaxCrossEntropy* loss = new SoftmaxCrossEntropy;
+   loss->opencl = device;
    dnn.add_loss(loss);
  
    //load weights
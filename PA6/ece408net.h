@@ -25,12 +25,16 @@
  #include "src/loss.h"
  #include "src/loss/mse_loss.h"
  #include "src/loss/cross_entropy_loss.h"
+ #include "src/loss/softmax_cross_entropy_loss.h"
  #include "src/mnist.h"
  #include "src/network.h"
  #include "src/optimizer.h"
  #include "src/optimizer/sgd.h"
  #include "src/layer/custom/opencl.h"
+ #include "src/thread_pool.h"
  
+ // Adds the (untrained) CPU layers and loss to an empty network.
+ void buildNetwork_CPU(Network* dnn);
  Network createNetwork_CPU(bool customCPUConv = false);
  Network createNetwork_OpenCL(OpenCL* opencl);
  
\ No newline at end of file
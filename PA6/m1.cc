@@ -2,8 +2,7 @@
 
 void inference_only(int batch_size) {
 
-  OpenCL opencl;
-  opencl.setup(CL_DEVICE_TYPE_CPU);
+  std::cout<<"CPU threads: "<<ThreadPool::global().size()<<std::endl;
 
   std::cout<<"Loading fashion-mnist data...";
   MNIST dataset("./data/");
@@ -11,7 +10,9 @@ void inference_only(int batch_size) {
   std::cout<<"Done"<<std::endl;
   
   std::cout<<"Loading model...";
-  Network dnn = createNetwork_OpenCL(&opencl);
+  Network dnn = createNetwork_CPU();
+  dnn.training(false);
+  dnn.sparsify();
   std::cout<<"Done"<<std::endl;
 
   dnn.forward(dataset.test_data);
@@ -19,8 +20,6 @@ void inference_only(int batch_size) {
   std::cout<<std::endl;
   std::cout<<"Test Accuracy: "<<acc<< std::endl;
   std::cout<<std::endl;
-
-  opencl.teardown();
 }
 
 int main(int argc, char* argv[]) {
@@ -1,12 +1,18 @@
 #include "ece408net.h"
 
+#include "bench.h"
+#include "cpu.h"
 #include "device.h"
 #include "src/layer/custom/opencl.h"
 
-void inference_only(int batch_size) {
+void inference_only(int batch_size, bool half_storage) {
 
   OpenCL opencl;
   opencl.setup(CL_DEVICE_TYPE_GPU);
+  opencl.half_storage = half_storage;
+  if (half_storage)
+    std::cout<<"Half storage: "<<(opencl.fp16 ? "fp16 products" : "storage only")
+             <<", fp32 accumulation"<<std::endl;
 
   std::cout<<"Loading fashion-mnist data...";
   MNIST dataset("./data/");
@@ -15,6 +21,8 @@ void inference_only(int batch_size) {
   
   std::cout<<"Loading model...";
   Network dnn = createNetwork_OpenCL(&opencl);
+  dnn.training(false);
+  dnn.sparsify();
   std::cout<<"Done"<<std::endl;
 
   dnn.forward(dataset.test_data);
@@ -26,16 +34,71 @@ void inference_only(int batch_size) {
   opencl.teardown();
 }
 
+// --bench: a test batch of the MNIST files in a dataset directory (./data)
+// and the network, loaded once; each run is one forward pass. The work of a
+// pass is not counted, so only times are reported.
+static const int bench_batch_size = 1000;
+
+struct CnnBench {
+  MNIST dataset;
+  Network dnn;
+  CnnBench(const std::string& dir, OpenCL* opencl)
+      : dataset(dir + "/"), dnn(createNetwork_OpenCL(opencl)) {}
+};
+
+static cl_int cnn_setup(void* user, const char* dir, void** state,
+                        double* ops, double* bytes) {
+  CnnBench* bench = new CnnBench(dir, (OpenCL*)user);
+  *state = bench;
+  bench->dataset.read_test_data(bench_batch_size);
+  bench->dnn.training(false);
+  bench->dnn.sparsify();
+  return bench->dataset.test_data.cols() > 0 ? CL_SUCCESS : CL_INVALID_VALUE;
+}
+
+static cl_int cnn_run(void* user, void* state) {
+  CnnBench* bench = (CnnBench*)state;
+  bench->dnn.forward(bench->dataset.test_data);
+  return CL_SUCCESS;
+}
+
+static void cnn_teardown(void* user, void* state) {
+  delete (CnnBench*)state;
+}
+
+int bench(int argc, char* argv[]) {
+  OpenCL opencl;
+  opencl.setup(CL_DEVICE_TYPE_GPU);
+
+  const OclDeviceProp* device =
+      opencl.native ? OclCpuDeviceProp() : OclGetDeviceProp(opencl.device);
+  if (device)
+    OclBenchSetDevice(device->name);
+  OclBenchRegister("cnn_forward", cnn_setup, cnn_run, cnn_teardown, &opencl);
+  int status = OclBenchMain(argc, argv);
+
+  opencl.teardown();
+  return status;
+}
+
 int main(int argc, char* argv[]) {
 
+  if (argc >= 2 && std::string(argv[1]) == "--bench") {
+    return bench(argc, argv);
+  }
+
   int batch_size = 10000;
+  bool half_storage = false;
   
-  if(argc == 2){
+  if(argc >= 2){
     batch_size = atoi(argv[1]);
   }
+  if(argc >= 3){
+    half_storage = std::string(argv[2]) == "half";
+  }
 
   std::cout<<"Test batch size: "<<batch_size<<std::endl;
-  inference_only(batch_size);
+  inference_only(batch_size, half_storage);
 
   return 0;
 }
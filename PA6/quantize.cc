@@ -0,0 +1,92 @@
+#include "ece408net.h"
+
+#include <chrono>
+
+// Runs data through dnn `reps` times; returns the accuracy and stores the
+// fastest pass in best_ms.
+static float evaluate(Network& dnn, const Matrix& data, const Matrix& labels,
+                      int reps, float& best_ms) {
+  best_ms = 0;
+  for (int r = 0; r < reps; r++) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    dnn.forward(data);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<float, std::milli> duration = (end_time - start_time);
+    if (r == 0 || duration.count() < best_ms)
+      best_ms = duration.count();
+  }
+  return compute_accuracy(dnn.output(), labels);
+}
+
+// Post-training quantization: calibrates activation ranges on the first
+// n_calib test images, converts conv/FC weights to int8 with per-channel
+// scales and compares accuracy and speed against fp32 on n_eval images.
+void quantize_model(int n_calib, int n_eval, bool use_opencl) {
+
+  std::cout<<"CPU threads: "<<ThreadPool::global().size()<<std::endl;
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_test_data(n_eval);
+  std::cout<<"Done"<<std::endl;
+  if (dataset.test_data.cols() == 0) {
+    std::cerr<<"No test data found in ./data/"<<std::endl;
+    return;
+  }
+
+  OpenCL opencl;
+  if (use_opencl)
+    opencl.setup(CL_DEVICE_TYPE_GPU);
+
+  std::cout<<"Loading model...";
+  Network fp32 = use_opencl ? createNetwork_OpenCL(&opencl) : createNetwork_CPU();
+  Network int8 = use_opencl ? createNetwork_OpenCL(&opencl) : createNetwork_CPU();
+  fp32.training(false);
+  int8.training(false);
+  std::cout<<"Done"<<std::endl;
+
+  n_calib = std::min<int>(n_calib, dataset.test_data.cols());
+  std::cout<<"Calibrating on "<<n_calib<<" images...";
+  int n_quantized = int8.quantize(dataset.test_data.leftCols(n_calib));
+  std::cout<<"Done, "<<n_quantized<<" layers quantized"<<std::endl;
+
+  const int reps = 3;
+  float fp32_ms, int8_ms;
+  float fp32_acc = evaluate(fp32, dataset.test_data, dataset.test_labels,
+                            reps, fp32_ms);
+  float int8_acc = evaluate(int8, dataset.test_data, dataset.test_labels,
+                            reps, int8_ms);
+
+  std::cout<<std::endl;
+  std::cout<<"         accuracy   forward (ms)"<<std::endl;
+  std::cout<<"fp32     "<<fp32_acc<<"      "<<fp32_ms<<std::endl;
+  std::cout<<"int8     "<<int8_acc<<"      "<<int8_ms<<std::endl;
+  std::cout<<"Accuracy delta: "<<int8_acc - fp32_acc
+           <<", speedup: "<<fp32_ms / int8_ms<<"x"<<std::endl;
+  std::cout<<std::endl;
+
+  int8.save_parameters("./build/weights-86-int8.bin");
+
+  if (use_opencl)
+    opencl.teardown();
+}
+
+int main(int argc, char* argv[]) {
+
+  int n_calib = 1000;
+  int n_eval = 10000;
+  bool use_opencl = false;
+
+  if (argc > 1)
+    n_calib = atoi(argv[1]);
+  if (argc > 2)
+    n_eval = atoi(argv[2]);
+  if (argc > 3)
+    use_opencl = std::string(argv[3]) == "opencl";
+
+  std::cout<<"Calibration images: "<<n_calib<<", test images: "<<n_eval
+           <<(use_opencl ? " (OpenCL)" : " (CPU)")<<std::endl;
+  quantize_model(n_calib, n_eval, use_opencl);
+
+  return 0;
+}
@@ -0,0 +1,259 @@
+#include "ece408net.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include "src/inference_server.h"
+
+// Line protocol, one request or reply per line:
+//
+//   <id> idx <n>            classify image n of the t10k test set
+//   <id> px <v1> ... <vD>   classify D = 86*86 raw pixel values (0..255)
+//   stats                   print the server counters
+//   quit                    close this connection
+//
+// Every image request is answered with "<id> <label> <latency_ms>" or
+// "<id> error <reason>". Image replies on one connection come back in
+// request order, so a client can pipeline as many requests as it likes;
+// "stats" is answered right away, ahead of replies still in flight.
+
+static const int kImageDim = 86 * 86;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int) { stop_requested = 1; }
+
+// One client. Replies are written from the batching thread as well as from
+// the reader, so writes are serialized; the reader waits for all of its
+// requests to be answered before the connection is closed.
+struct Connection {
+  int in_fd;
+  int out_fd;
+  std::mutex mutex;
+  std::condition_variable idle;
+  int pending;
+
+  Connection(int in_fd, int out_fd) : in_fd(in_fd), out_fd(out_fd), pending(0) {}
+
+  void reply(const std::string& line) {
+    std::string buf = line + "\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    const char* p = buf.data();
+    size_t left = buf.size();
+    while (left > 0) {
+      ssize_t n = write(out_fd, p, left);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return;  // client went away; drop the reply
+      p += n;
+      left -= n;
+    }
+  }
+};
+
+static std::string format_stats(const ServerStats& s) {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "stats requests=%ld batches=%ld mean_batch=%.2f p50_ms=%.3f "
+           "p99_ms=%.3f max_ms=%.3f throughput=%.1f",
+           s.requests, s.batches, s.mean_batch, s.p50_ms, s.p99_ms, s.max_ms,
+           s.throughput);
+  return buf;
+}
+
+// Reads requests from conn until EOF or "quit" and hands images to server.
+static void serve_connection(InferenceServer& server,
+                             std::shared_ptr<Connection> conn,
+                             const IdxFile& test_images) {
+  FILE* in = fdopen(dup(conn->in_fd), "r");
+  if (!in)
+    return;
+  char* line = NULL;
+  size_t capacity = 0;
+  std::vector<float> image(kImageDim);
+  while (getline(&line, &capacity, in) > 0) {
+    std::istringstream request(line);
+    std::string id, kind;
+    if (!(request >> id))
+      continue;
+    if (id == "quit")
+      break;
+    if (id == "stats") {
+      conn->reply(format_stats(server.stats()));
+      continue;
+    }
+    request >> kind;
+    if (kind == "idx") {
+      int n = -1;
+      request >> n;
+      if (n < 0 || n >= test_images.count()) {
+        conn->reply(id + " error no such test image");
+        continue;
+      }
+      const unsigned char* pixels = test_images.item(n);
+      std::copy(pixels, pixels + kImageDim, image.begin());
+    } else if (kind == "px") {
+      int n = 0;
+      while (n < kImageDim && request >> image[n])
+        n++;
+      if (n != kImageDim) {
+        conn->reply(id + " error expected " + std::to_string(kImageDim)
+                    + " pixel values");
+        continue;
+      }
+    } else {
+      conn->reply(id + " error unknown request");
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(conn->mutex);
+      conn->pending++;
+    }
+    server.submit(image.data(), [conn, id](int label, float latency_ms) {
+      char buf[64];
+      snprintf(buf, sizeof(buf), " %d %.3f", label, latency_ms);
+      conn->reply(id + buf);
+      std::lock_guard<std::mutex> lock(conn->mutex);
+      if (--conn->pending == 0)
+        conn->idle.notify_all();
+    });
+  }
+  free(line);
+  fclose(in);
+  std::unique_lock<std::mutex> lock(conn->mutex);
+  conn->idle.wait(lock, [&conn] { return conn->pending == 0; });
+}
+
+// Accepts clients on a Unix socket until SIGINT/SIGTERM, one reader thread
+// per client.
+static int serve_socket(InferenceServer& server, const std::string& path,
+                        const IdxFile& test_images) {
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (listen_fd < 0 || path.size() >= sizeof(addr.sun_path)) {
+    std::cerr<<path<<": cannot create socket"<<std::endl;
+    return 1;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(path.c_str());
+  if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0
+      || listen(listen_fd, 64) != 0) {
+    std::cerr<<path<<": "<<strerror(errno)<<std::endl;
+    close(listen_fd);
+    return 1;
+  }
+  std::cerr<<"Listening on "<<path<<std::endl;
+
+  // Reader threads are keyed by a serial number rather than their fd, which
+  // is closed, and may be reused, before the thread is joined. A finished
+  // reader adds itself to `finished` and is joined at the next accept.
+  std::mutex clients_mutex;
+  std::vector<int> client_fds;
+  std::map<long, std::thread> clients;
+  std::vector<long> finished;
+  long next_client = 0;
+  while (!stop_requested) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;  // EINTR from the stop signal, or a failed handshake
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (long id : finished) {
+      clients[id].join();
+      clients.erase(id);
+    }
+    finished.clear();
+    const long id = next_client++;
+    client_fds.push_back(fd);
+    clients[id] = std::thread([&server, &test_images, &clients_mutex,
+                               &client_fds, &finished, fd, id] {
+      serve_connection(server, std::make_shared<Connection>(fd, fd),
+                       test_images);
+      std::lock_guard<std::mutex> lock(clients_mutex);
+      client_fds.erase(std::find(client_fds.begin(), client_fds.end(), fd));
+      close(fd);
+      finished.push_back(id);
+    });
+  }
+  close(listen_fd);
+  unlink(path.c_str());
+  {
+    // readers see EOF, answer what they have queued and exit
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (int fd : client_fds) {
+      shutdown(fd, SHUT_RD);
+    }
+  }
+  for (auto& client : clients) {
+    client.second.join();
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+
+  int max_batch = 64;
+  float max_delay_ms = 2.0f;
+  bool use_opencl = false;
+  std::string socket_path;  // "-" or none: stdin/stdout
+  int n_stream = 1;
+
+  if (argc > 1)
+    max_batch = atoi(argv[1]);
+  if (argc > 2)
+    max_delay_ms = atof(argv[2]);
+  if (argc > 3)
+    use_opencl = std::string(argv[3]) == "opencl";
+  if (argc > 4 && std::string(argv[4]) != "-")
+    socket_path = argv[4];
+  if (argc > 5)
+    n_stream = atoi(argv[5]);
+
+  // stdout carries the replies in stdin mode; layer logging goes to stderr
+  std::cout.rdbuf(std::cerr.rdbuf());
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_stop;  // no SA_RESTART: accept() returns EINTR
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  std::cerr<<"Max batch: "<<max_batch<<", max delay: "<<max_delay_ms<<" ms, "
+           <<n_stream<<" stream(s)"<<(use_opencl ? " (OpenCL)" : " (CPU)")<<std::endl;
+
+  IdxFile test_images;
+  test_images.open("./data/t10k-86-images-idx3-ubyte", 3);
+
+  OpenCL opencl;
+  if (use_opencl)
+    opencl.setup(CL_DEVICE_TYPE_GPU);
+  Network dnn = use_opencl ? createNetwork_OpenCL(&opencl) : createNetwork_CPU();
+  dnn.training(false);
+
+  InferenceServer server(dnn, kImageDim, max_batch, max_delay_ms);
+  server.start(n_stream, use_opencl ? &opencl : NULL);
+  int status = 0;
+  if (socket_path.empty()) {
+    serve_connection(server, std::make_shared<Connection>(0, 1), test_images);
+  } else {
+    status = serve_socket(server, socket_path, test_images);
+  }
+  server.stop();
+  std::cerr<<format_stats(server.stats())<<std::endl;
+
+  if (use_opencl)
+    opencl.teardown();
+  return status;
+}
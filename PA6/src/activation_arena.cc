@@ -0,0 +1,60 @@
+#include "./activation_arena.h"
+#include <stdint.h>
+#include <algorithm>
+#include <stdexcept>
+
+static size_t align_up(size_t n) {
+  return (n + ActivationArena::kAlign - 1) / ActivationArena::kAlign
+         * ActivationArena::kAlign;
+}
+
+// Greedy by size: the largest tensors are placed first, each at the lowest
+// offset that does not overlap a placed tensor whose lifetime overlaps its
+// own. For the chain of a Network this comes down to two alternating
+// regions; it does not assume a chain, though.
+void ActivationArena::plan(const std::vector<int>& rows_in,
+                           const std::vector<int>& first,
+                           const std::vector<int>& last) {
+  const int n = rows_in.size();
+  if (static_cast<int>(first.size()) != n || static_cast<int>(last.size()) != n)
+    throw std::invalid_argument("Activation lifetimes do not match");
+  rows = rows_in;
+  offsets.assign(n, 0);
+  per_sample = 0;
+
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [this](int a, int b) { return rows[a] > rows[b]; });
+  std::vector<int> placed;  // by increasing offset
+  for (int k = 0; k < n; k++) {
+    int i = order[k];
+    size_t offset = 0;
+    for (int j : placed) {
+      if (last[j] < first[i] || last[i] < first[j])
+        continue;  // never live together
+      if (offset + rows[i] <= offsets[j])
+        break;  // fits in the gap below j
+      offset = std::max(offset, align_up(offsets[j] + rows[j]));
+    }
+    offsets[i] = offset;
+    per_sample = std::max(per_sample, align_up(offset + rows[i]));
+    placed.insert(std::upper_bound(placed.begin(), placed.end(), i,
+                      [this](int a, int b) { return offsets[a] < offsets[b]; }),
+                  i);
+  }
+  capacity = 0;  // the old buffer may be too small for the new layout
+  reserve(0);
+}
+
+void ActivationArena::reserve(int n_sample) {
+  if (n_sample <= capacity && base)
+    return;
+  buffer.resize(per_sample * n_sample + kAlign);
+  uintptr_t p = reinterpret_cast<uintptr_t>(buffer.data());
+  size_t misalign = p % (kAlign * sizeof(float)) / sizeof(float);
+  base = buffer.data() + (misalign ? kAlign - misalign : 0);
+  capacity = n_sample;
+}
@@ -0,0 +1,42 @@
+#ifndef SRC_ACTIVATION_ARENA_H_
+#define SRC_ACTIVATION_ARENA_H_
+
+#include <stddef.h>
+#include <vector>
+#include "./utils.h"
+
+// One preallocated block holding every intermediate tensor of a forward pass.
+// plan() is given each tensor's size and lifetime (the steps that write it
+// and last read it) and assigns it an offset so that tensors that are never
+// live at the same time share memory. Offsets are kept per sample: a batch of
+// n samples uses size() * n floats and one plan serves every batch size.
+// Once reserve() has seen the largest batch, nothing is allocated again.
+class ActivationArena {
+ private:
+  std::vector<int> rows;  // floats per sample of each tensor
+  std::vector<size_t> offsets;  // per sample, in floats
+  size_t per_sample;  // floats per sample over the whole arena
+  std::vector<float> buffer;
+  float* base;  // buffer.data() rounded up to kAlign floats
+  int capacity;  // samples the buffer has room for
+
+ public:
+  static const int kAlign = 16;  // floats, so every tensor is 64-byte aligned
+
+  ActivationArena() : per_sample(0), base(NULL), capacity(0) {}
+
+  // Tensor i holds rows[i] floats per sample and is live from step first[i]
+  // to step last[i], both included. Any previous plan is dropped.
+  void plan(const std::vector<int>& rows, const std::vector<int>& first,
+            const std::vector<int>& last);
+  int count() const { return static_cast<int>(rows.size()); }
+  size_t size() const { return per_sample; }
+  // Makes room for n_sample samples; the buffer only ever grows.
+  void reserve(int n_sample);
+  // Tensor i of a batch of n_sample <= the reserved number of samples
+  Eigen::Map<Matrix> get(int i, int n_sample) {
+    return Eigen::Map<Matrix>(base + offsets[i] * n_sample, rows[i], n_sample);
+  }
+};
+
+#endif  // SRC_ACTIVATION_ARENA_H_
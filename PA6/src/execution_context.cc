@@ -0,0 +1,26 @@
+#include "./execution_context.h"
+#include <stdint.h>
+#include "./thread_pool.h"
+
+ExecutionContext::ExecutionContext(ThreadPool* pool, OpenCL* opencl) :
+    pool(pool), scratch_buffers(pool ? pool->size() : 1), opencl(opencl),
+    verbose(false) {}
+
+void ExecutionContext::run(int n, const std::function<void(int, int)>& fn) {
+  if (pool) {
+    pool->parallel_for(n, fn);
+    return;
+  }
+  for (int i = 0; i < n; i++) {
+    fn(i, 0);
+  }
+}
+
+char* ExecutionContext::scratch(int tid, size_t bytes) {
+  const size_t align = 64;
+  std::vector<char>& buffer = scratch_buffers[tid];
+  if (buffer.size() < bytes + align)
+    buffer.resize(bytes + align);
+  uintptr_t p = reinterpret_cast<uintptr_t>(buffer.data());
+  return buffer.data() + (align - p % align) % align;
+}
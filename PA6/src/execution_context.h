@@ -0,0 +1,50 @@
+#ifndef SRC_EXECUTION_CONTEXT_H_
+#define SRC_EXECUTION_CONTEXT_H_
+
+#include <stddef.h>
+#include <functional>
+#include <vector>
+#include "./activation_arena.h"
+
+class ThreadPool;
+class OpenCL;
+
+// Per-call state of one inference stream: the output of every layer, the
+// scratch memory layers use while they run, the threads they may run on and
+// the OpenCL queue and kernels they submit to. Layer::infer and
+// Network::forward(input, ctx) keep everything that changes during a forward
+// pass here and leave the network untouched, so one loaded Network can serve
+// any number of concurrent streams, each with its own context, without locks.
+class ExecutionContext {
+ private:
+  ThreadPool* pool;
+  std::vector<std::vector<char> > scratch_buffers;  // one per thread
+
+  void run(int n, const std::function<void(int, int)>& fn);
+
+ public:
+  OpenCL* opencl;  // queue and kernels for Conv_Custom, or NULL
+  bool verbose;  // Conv_Custom prints its layer/op times (the m2 output)
+  // Output of every layer, planned by Network::forward(input, ctx) the first
+  // time the context is used with a network
+  ActivationArena activations;
+
+  // With pool == NULL every layer runs on the calling thread only, which is
+  // what concurrent streams want: a shared pool runs one job at a time.
+  // Likewise concurrent streams on one device each need an OpenCL stream of
+  // their own (OpenCL::create_stream).
+  explicit ExecutionContext(ThreadPool* pool = NULL, OpenCL* opencl = NULL);
+
+  int n_threads() const { return static_cast<int>(scratch_buffers.size()); }
+  // fn(i, tid) for every i in [0, n) with tid in [0, n_threads()). fn is
+  // passed on by reference, so a lambda with many captures is not copied to
+  // the heap as it would be when converted to a std::function.
+  template <typename Fn>
+  void parallel_for(int n, const Fn& fn) { run(n, std::cref(fn)); }
+  // At least `bytes` of 64-byte aligned scratch memory owned by thread tid.
+  // It is kept between calls, so steady-state passes allocate nothing; its
+  // contents do not survive from one layer to the next.
+  char* scratch(int tid, size_t bytes);
+};
+
+#endif  // SRC_EXECUTION_CONTEXT_H_
@@ -0,0 +1,166 @@
+#include "./inference_server.h"
+#include <algorithm>
+#include "./thread_pool.h"
+#include "./layer/custom/opencl.h"
+
+InferenceServer::InferenceServer(const Network& dnn, int dim_in, int max_batch,
+                                 float max_delay_ms)
+    : dnn(dnn), dim_in(dim_in), max_batch(std::max(1, max_batch)),
+      max_delay(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<float, std::milli>(max_delay_ms))),
+      running(false), stopping(false), n_request(0), n_batch(0),
+      latency_next(0) {}
+
+void InferenceServer::start(int n_stream, OpenCL* opencl) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (running)
+    return;
+  running = true;
+  stopping = false;
+  start_time = Clock::now();
+  n_stream = std::max(1, n_stream);
+  for (int i = 0; i < n_stream; i++) {
+    if (n_stream == 1) {
+      contexts.emplace_back(new ExecutionContext(&ThreadPool::global(), opencl));
+    } else {
+      OpenCL* stream = NULL;
+      if (opencl) {
+        streams.emplace_back(new OpenCL);
+        stream = streams.back().get();
+        opencl->create_stream(stream);
+      }
+      contexts.emplace_back(new ExecutionContext(NULL, stream));
+    }
+    batchers.push_back(std::thread(&InferenceServer::batch_loop, this,
+                                   contexts.back().get()));
+  }
+}
+
+void InferenceServer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running)
+      return;
+    stopping = true;
+  }
+  request_ready.notify_all();
+  for (size_t i = 0; i < batchers.size(); i++) {
+    batchers[i].join();
+  }
+  for (size_t i = 0; i < streams.size(); i++) {
+    streams[i]->teardown();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  batchers.clear();
+  contexts.clear();
+  streams.clear();
+  running = false;
+}
+
+void InferenceServer::submit(const float* image, const Callback& done) {
+  Request request;
+  request.image.assign(image, image + dim_in);
+  request.done = done;
+  request.arrival = Clock::now();
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(std::move(request));
+    // the batcher only needs waking for a new batch or a full one
+    wake = queue.size() == 1 || static_cast<int>(queue.size()) >= max_batch;
+  }
+  if (wake)
+    request_ready.notify_one();
+}
+
+void InferenceServer::batch_loop(ExecutionContext* ctx) {
+  std::vector<Request> batch;
+  Matrix input;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    request_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+    if (queue.empty())
+      break;  // stopping with nothing left
+    // hold the batch open until it is full or its oldest request is due
+    Clock::time_point deadline = queue.front().arrival + max_delay;
+    request_ready.wait_until(lock, deadline, [this] {
+      return stopping || static_cast<int>(queue.size()) >= max_batch;
+    });
+    if (queue.empty())
+      continue;  // another stream took the batch
+    int n = std::min<int>(queue.size(), max_batch);
+    batch.clear();
+    for (int i = 0; i < n; i++) {
+      batch.push_back(std::move(queue.front()));
+      queue.pop_front();
+    }
+    // let another stream start collecting the next batch
+    if (!queue.empty())
+      request_ready.notify_one();
+    lock.unlock();
+    run_batch(batch, input, *ctx);
+    lock.lock();
+  }
+}
+
+void InferenceServer::run_batch(std::vector<Request>& batch, Matrix& input,
+                                ExecutionContext& ctx) {
+  const int n = batch.size();
+  input.resize(dim_in, n);
+  for (int i = 0; i < n; i++) {
+    std::copy(batch[i].image.begin(), batch[i].image.end(),
+              input.col(i).data());
+  }
+  Eigen::Map<const Matrix> output = dnn.forward(input, ctx);
+
+  std::vector<float> done_ms(n);
+  for (int i = 0; i < n; i++) {
+    Matrix::Index label;
+    output.col(i).maxCoeff(&label);
+    std::chrono::duration<float, std::milli> elapsed =
+        Clock::now() - batch[i].arrival;
+    done_ms[i] = elapsed.count();
+    batch[i].done(static_cast<int>(label), done_ms[i]);
+  }
+
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  n_request += n;
+  n_batch += 1;
+  for (int i = 0; i < n; i++) {
+    if (latency.size() < static_cast<size_t>(kLatencyWindow)) {
+      latency.push_back(done_ms[i]);
+    } else {
+      latency[latency_next] = done_ms[i];
+      latency_next = (latency_next + 1) % kLatencyWindow;
+    }
+  }
+}
+
+// Value below which a fraction q of the sorted samples fall (nearest rank).
+static double percentile(std::vector<float>& samples, double q) {
+  if (samples.empty())
+    return 0;
+  size_t k = std::min(samples.size() - 1,
+                      static_cast<size_t>(q * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+ServerStats InferenceServer::stats() {
+  std::vector<float> samples;
+  ServerStats res;
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    samples = latency;
+    res.requests = n_request;
+    res.batches = n_batch;
+  }
+  std::chrono::duration<double> uptime = Clock::now() - start_time;
+  res.mean_batch = res.batches ? double(res.requests) / res.batches : 0;
+  res.p50_ms = percentile(samples, 0.50);
+  res.p99_ms = percentile(samples, 0.99);
+  res.max_ms = samples.empty()
+      ? 0 : *std::max_element(samples.begin(), samples.end());
+  res.throughput = uptime.count() > 0 ? res.requests / uptime.count() : 0;
+  return res;
+}
@@ -0,0 +1,90 @@
+#ifndef SRC_INFERENCE_SERVER_H_
+#define SRC_INFERENCE_SERVER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "./network.h"
+
+// Counters exported by InferenceServer::stats(). Latency percentiles cover
+// the most recent kLatencyWindow requests, from submit() to the callback.
+struct ServerStats {
+  long requests;       // completed requests
+  long batches;        // forward passes
+  double mean_batch;   // requests per forward pass
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+  double throughput;   // completed requests per second since start()
+};
+
+// Dynamic batching front end for a loaded Network. Any number of threads
+// submit single images; a batching thread collects them into a batch that is
+// closed as soon as it holds max_batch images or its oldest image has waited
+// max_delay_ms, runs one forward pass and reports the arg-max class of every
+// image through its callback. With several streams, each batching thread
+// runs Network::forward(input, ctx) with an ExecutionContext (and OpenCL
+// queue) of its own, so the one resident model serves them all without
+// locking.
+class InferenceServer {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  // label is the predicted class, latency_ms the time since submit()
+  typedef std::function<void(int label, float latency_ms)> Callback;
+
+  static const int kLatencyWindow = 1 << 16;
+
+  InferenceServer(const Network& dnn, int dim_in, int max_batch,
+                  float max_delay_ms);
+  ~InferenceServer() { stop(); }
+
+  // Starts n_stream batching threads. One stream uses the global thread pool
+  // and opencl as is; more streams run single-threaded, each on a queue of
+  // its own created from opencl (if given).
+  void start(int n_stream = 1, OpenCL* opencl = NULL);
+  // Finishes every request already submitted, then joins the batching threads.
+  void stop();
+
+  // Queues one image of dim_in values; the data is copied.
+  void submit(const float* image, const Callback& done);
+  ServerStats stats();
+
+ private:
+  struct Request {
+    std::vector<float> image;
+    Callback done;
+    Clock::time_point arrival;
+  };
+
+  const Network& dnn;
+  const int dim_in;
+  const int max_batch;
+  const Clock::duration max_delay;
+
+  std::vector<std::thread> batchers;
+  std::vector<std::unique_ptr<ExecutionContext> > contexts;
+  std::vector<std::unique_ptr<OpenCL> > streams;  // per-stream OpenCL queues
+  std::mutex mutex;
+  std::condition_variable request_ready;
+  std::deque<Request> queue;
+  bool running;
+  bool stopping;
+
+  std::mutex stats_mutex;
+  Clock::time_point start_time;
+  long n_request;
+  long n_batch;
+  std::vector<float> latency;  // ring buffer of the last kLatencyWindow
+  size_t latency_next;
+
+  void batch_loop(ExecutionContext* ctx);
+  void run_batch(std::vector<Request>& batch, Matrix& input,
+                 ExecutionContext& ctx);
+};
+
+#endif  // SRC_INFERENCE_SERVER_H_
@@ -2,29 +2,124 @@
 #define SRC_LAYER_H_
 
 #include "Eigen/Core"
+#include <algorithm>
+#include <new>
 #include <vector>
 #include "./utils.h"
-#include "./optimizer.h"
+#include "./execution_context.h"
+
+// Elementwise activations a layer can apply to its own output in place of a
+// separate activation layer (see Layer::fuse_activation)
+enum Activation { kActivationNone, kActivationReLU };
+
+inline float activate(float z, Activation a) {
+  return a == kActivationReLU ? std::max(z, 0.0f) : z;
+}
+
+// The weight (rows x cols) and bias (cols) views of a layer, with their
+// gradients, placed at param and grad: weight first, then bias.
+inline void place_weight_bias(float* param, float* grad, int rows, int cols,
+                              MatrixView& weight, VectorView& bias,
+                              MatrixView& grad_weight, VectorView& grad_bias) {
+  new (&weight) MatrixView(param, rows, cols);
+  new (&bias) VectorView(param + rows * cols, cols);
+  new (&grad_weight) MatrixView(grad, rows, cols);
+  new (&grad_bias) VectorView(grad + rows * cols, cols);
+}
+
+// Layer::bind_parameters for such a layer: copies the values over, then
+// moves the views.
+inline void bind_weight_bias(float* param, float* grad, MatrixView& weight,
+                             VectorView& bias, MatrixView& grad_weight,
+                             VectorView& grad_bias) {
+  const int n_weight = weight.size();
+  if (param != weight.data()) {
+    std::copy(weight.data(), weight.data() + n_weight, param);
+    std::copy(bias.data(), bias.data() + bias.size(), param + n_weight);
+    std::copy(grad_weight.data(), grad_weight.data() + n_weight, grad);
+    std::copy(grad_bias.data(), grad_bias.data() + bias.size(),
+              grad + n_weight);
+  }
+  place_weight_bias(param, grad, weight.rows(), weight.cols(), weight, bias,
+                    grad_weight, grad_bias);
+}
 
 class Layer {
  protected:
   Matrix top;  // layer output
   Matrix grad_bottom;  // gradient w.r.t input
+  bool training;  // false: forward may skip state that only backward needs
 
  public:
+  Layer() : training(true) {}
   virtual ~Layer() {}
 
+  // Inference mode (training == false) lets forward skip bookkeeping that
+  // only backward needs, e.g. MaxPooling's arg-max indices, and drops the
+  // output and input gradient kept from the last training step. backward
+  // must not be called until training mode is set again.
+  virtual void set_training(bool training) {
+    this->training = training;
+    if (!training) {
+      top.resize(0, 0);
+      grad_bottom.resize(0, 0);
+    }
+  }
+
   virtual void forward(const Matrix& bottom) = 0;
+  // Re-entrant inference: writes the output for bottom to top, keeping every
+  // piece of per-call state in ctx. The layer itself is not modified, so
+  // threads may call this concurrently, each with its own context. top comes
+  // sized (output_dim(), or bottom.rows() for -1, by bottom.cols()) and may be
+  // a view into an activation arena; both are contiguous column-major.
+  virtual void infer(const ConstMatrixRef& bottom, MatrixRef top,
+                     ExecutionContext& ctx) const = 0;
   virtual void backward(const Matrix& bottom, const Matrix& grad_top) = 0;
-  virtual void update(Optimizer& opt) {}
   virtual const Matrix& output() { return top; }
   virtual const Matrix& back_gradient() { return grad_bottom; }
   virtual int output_dim() { return -1; }
+
+  // Inference-mode fusion (Network::training). A layer that is nothing but
+  // an elementwise activation says which one; the layer before it may agree
+  // to apply it to its own output in infer(), and the activation layer is
+  // then skipped. fuse_activation(kActivationNone) undoes it.
+  virtual Activation as_activation() const { return kActivationNone; }
+  virtual bool fuse_activation(Activation a) { return a == kActivationNone; }
+  // True for Softmax, which a loss that takes logits applies itself
+  // (Loss::takes_logits); Network then leaves it out while training.
+  virtual bool is_softmax() const { return false; }
+  // Switch to a sparse copy of the weights for inference if no more than
+  // max_density of them are non-zero (a pruned model); returns true if so.
+  virtual bool sparsify(float max_density) { return false; }
   virtual std::vector<float> get_parameters() const
           { return std::vector<float>(); }
   virtual std::vector<float> get_derivatives() const
           { return std::vector<float>(); }
   virtual void set_parameters(const std::vector<float>& param) {}
+  // Same from a raw buffer, e.g. a tensor of a memory-mapped weight file, so
+  // that loading does not need an intermediate std::vector.
+  virtual void set_parameters(const float* param, int size)
+          { set_parameters(std::vector<float>(param, param + size)); }
+  virtual void set_derivatives(const std::vector<float>& deriv) {}
+  // Flat storage: Network keeps the parameters of all its layers in one
+  // buffer and their gradients in another, so that an optimizer step is one
+  // pass over both. parameter_size() counts them in get_parameters() order;
+  // bind_parameters copies them to param[0..n) and the gradients to
+  // grad[0..n), after which the layer reads and writes them there.
+  virtual int parameter_size() const { return 0; }
+  virtual void bind_parameters(float* param, float* grad) {}
+
+  // Post-training int8 quantization (see layer/quantize.h). A layer that
+  // supports it switches its forward pass to int8 weights, taking
+  // [input_min, input_max] (calibrated on sample data) as its input range,
+  // and returns true. Quantized layers are inference only.
+  virtual bool quantize(float input_min, float input_max) { return false; }
+  virtual bool is_quantized() const { return false; }
+  // int8 weights plus the float scales/bias that go with them
+  virtual void get_quantized_parameters(std::vector<signed char>& q,
+                                        std::vector<float>& param) const {}
+  virtual void set_quantized_parameters(const signed char* q, int q_size,
+                                        const float* param, int size) {}
 };
 
 #endif  // SRC_LAYER_H_
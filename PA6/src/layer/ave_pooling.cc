@@ -1,6 +1,8 @@
 #include "./ave_pooling.h"
 #include <math.h>
+#include <algorithm>
 #include <iostream>
+#include "../thread_pool.h"
 
 void AvePooling::init() {
   channel_out = channel_in;
@@ -10,33 +12,41 @@ void AvePooling::init() {
 }
 
 void AvePooling::forward(const Matrix& bottom) {
+  ExecutionContext ctx(&ThreadPool::global());
+  top.resize(dim_out, bottom.cols());
+  infer(bottom, top, ctx);
+}
+
+void AvePooling::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                       ExecutionContext& ctx) const {
   int n_sample = bottom.cols();
   int hw_in = height_in * width_in;
   int hw_pool = height_pool * width_pool;
   int hw_out = height_out * width_out;
-  top.resize(dim_out, n_sample);
-  top.setZero();
-  for (int i = 0; i < n_sample; i ++) {
-    Vector image = bottom.col(i);
-    for (int c = 0; c < channel_in; c ++) {
-      for (int i_out = 0; i_out < hw_out; i_out ++) {
-        int step_h = i_out / width_out;
-        int step_w = i_out % width_out;
-        // left-top idx of window in raw image
-        int start_idx = step_h * width_in * stride + step_w * stride;
-        for (int i_pool = 0; i_pool < hw_pool; i_pool ++) {
-          if (start_idx % width_in + i_pool % width_pool >= width_in ||
-              start_idx / width_in + i_pool / width_pool >= height_in) {
-            continue;  // out of range
+  // one task per (sample, channel) plane, walked with strided loops
+  ctx.parallel_for(n_sample * channel_in, [&](int task, int tid) {
+    int i = task / channel_in;
+    int c = task % channel_in;
+    const float* image = bottom.col(i).data() + c * hw_in;  // c-th channel map
+    float* out = top.col(i).data() + c * hw_out;
+    for (int h = 0; h < height_out; h ++) {
+      // windows hanging off the bottom/right edge are clipped
+      int h_start = h * stride;
+      int h_end = std::min(h_start + height_pool, height_in);
+      for (int w = 0; w < width_out; w ++) {
+        int w_start = w * stride;
+        int w_end = std::min(w_start + width_pool, width_in);
+        float sum = 0;
+        for (int r = h_start; r < h_end; r ++) {
+          const float* row = image + r * width_in;
+          for (int s = w_start; s < w_end; s ++) {
+            sum += row[s];
           }
-          int pick_idx = start_idx + (i_pool / width_pool) * width_in
-                         + i_pool % width_pool + c * hw_in;
-          top(c * hw_out + i_out, i) += image(pick_idx);
         }
-        top(c * hw_out + i_out, i) /= hw_pool;
+        out[h * width_out + w] = sum / hw_pool;
       }
     }
-  }
+  });
 }
 
 void AvePooling::backward(const Matrix& bottom, const Matrix& grad_top) {
@@ -46,24 +56,26 @@ void AvePooling::backward(const Matrix& bottom, const Matrix& grad_top) {
   int hw_out = height_out * width_out;
   grad_bottom.resize(bottom.rows(), n_sample);
   grad_bottom.setZero();
-  for (int i = 0; i < n_sample; i ++) {
-    Vector image = bottom.col(i);
-    for (int c = 0; c < channel_in; c ++) {
-      for (int i_out = 0; i_out < hw_out; i_out ++) {
-        int step_h = i_out / width_out;
-        int step_w = i_out % width_out;
-        // left-top idx of window in raw image
-        int start_idx = step_h * width_in * stride + step_w * stride;
-        for (int i_pool = 0; i_pool < hw_pool; i_pool ++) {
-          if (start_idx % width_in + i_pool % width_pool >= width_in ||
-              start_idx / width_in + i_pool / width_pool >= height_in) {
-            continue;  // out of range
+  // each task owns one (sample, channel) plane of grad_bottom
+  ThreadPool::global().parallel_for(n_sample * channel_in, [&](int task, int tid) {
+    int i = task / channel_in;
+    int c = task % channel_in;
+    const float* grad = grad_top.col(i).data() + c * hw_out;
+    float* image = grad_bottom.col(i).data() + c * hw_in;
+    for (int h = 0; h < height_out; h ++) {
+      int h_start = h * stride;
+      int h_end = std::min(h_start + height_pool, height_in);
+      for (int w = 0; w < width_out; w ++) {
+        int w_start = w * stride;
+        int w_end = std::min(w_start + width_pool, width_in);
+        float g = grad[h * width_out + w] / hw_pool;
+        for (int r = h_start; r < h_end; r ++) {
+          float* row = image + r * width_in;
+          for (int s = w_start; s < w_end; s ++) {
+            row[s] += g;
           }
-          int pick_idx = start_idx + (i_pool / width_pool) * width_in
-                         + i_pool % width_pool + c * hw_in;
-          grad_bottom(pick_idx, i) += grad_top(c * hw_out + i_out, i) / hw_pool;
         }
       }
     }
-  }
+  });
 }
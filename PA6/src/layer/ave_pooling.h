@@ -30,6 +30,8 @@ class AvePooling : public Layer {
   { init(); }
 
   void forward(const Matrix& bottom);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
   int output_dim() { return dim_out; }
 };
@@ -1,18 +1,26 @@
 #include "conv.h"
 #include <math.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
+#include "../thread_pool.h"
 
 void Conv::init() {
   height_out = (1 + (height_in - height_kernel + 2 * pad_h) / stride);
   width_out =   (1 + (width_in - width_kernel + 2 * pad_w) / stride);
   dim_out = height_out * width_out * channel_out;
 
-  weight.resize(channel_in * height_kernel * width_kernel, channel_out);
-  bias.resize(channel_out);
-  grad_weight.resize(channel_in * height_kernel * width_kernel, channel_out);
-  grad_bias.resize(channel_out);
+  const int fan_in = channel_in * height_kernel * width_kernel;
+  const int n_param = (fan_in + 1) * channel_out;
+  storage.setZero(2 * n_param);
+  place_weight_bias(storage.data(), storage.data() + n_param, fan_in,
+                    channel_out, weight, bias, grad_weight, grad_bias);
   set_normal_random(weight.data(), weight.size(), 0, 0.01);
   set_normal_random(bias.data(), bias.size(), 0, 0.01);
+  // keep each thread's im2col chunk around 16MB
+  int sample_bytes = height_out * width_out * height_kernel * width_kernel *
+                     channel_in * sizeof(float);
+  set_chunk_size((16 << 20) / std::max(1, sample_bytes));
   //std::cout << weight.colwise().sum() << std::endl;
   //std::cout << weight.colwise().sum() + bias.transpose() << std::endl;
 }
@@ -20,115 +28,278 @@ void Conv::init() {
 // im2col, used for bottom
 // image size: Vector (height_in * width_in * channel_in)
 // data_col size: Matrix (hw_out, hw_kernel * channel_in)
-void Conv::im2col(const Vector& image, Matrix& data_col) {
+void Conv::im2col(const Vector& image, Matrix& data_col) const {
+  im2col(image.data(), data_col);
+}
+
+// Same as above on a raw column, so callers can pass bottom.col(i).data()
+// without copying the sample.
+void Conv::im2col(const float* image, Matrix& data_col) const {
+  data_col.resize(height_out * width_out,
+                  height_kernel * width_kernel * channel_in);
+  im2col(image, data_col.data(), data_col.rows());
+}
+
+// Raw im2col into a column-major buffer whose leading dimension ld may exceed
+// hw_out, so several samples can be stacked row-wise in one chunk matrix.
+// Each column (one kernel tap) is filled with strided row walks.
+void Conv::im2col(const float* image, float* data_col, int ld) const {
   int hw_in = height_in * width_in;
   int hw_kernel = height_kernel * width_kernel;
-  int hw_out = height_out * width_out;
-  // im2col
-  data_col.resize(hw_out, hw_kernel * channel_in);
   for (int c = 0; c < channel_in; c ++) {
-    Vector map = image.block(hw_in * c, 0, hw_in, 1);  // c-th channel map
-    for (int i = 0; i < hw_out; i ++) {
-      int step_h = i / width_out;
-      int step_w = i % width_out;
-      int start_idx = step_h * width_in * stride + step_w * stride;  // left-top idx of window
-      for (int j = 0; j < hw_kernel; j ++) {
-        int cur_col = start_idx % width_in + j % width_kernel - pad_w;  // col after padding
-        int cur_row = start_idx / width_in + j / width_kernel - pad_h;
-        if (cur_col < 0 || cur_col >= width_in || cur_row < 0 ||
-            cur_row >= height_in) {
-          data_col(i, c * hw_kernel + j) = 0;
-        }
-        else {
-          //int pick_idx = start_idx + (j / width_kernel) * width_in + j % width_kernel;
-          int pick_idx = cur_row * width_in + cur_col;
-          data_col(i, c * hw_kernel + j) = map(pick_idx);  // pick which pixel
+    const float* map = image + hw_in * c;  // c-th channel map
+    for (int p = 0; p < height_kernel; p ++) {
+      for (int q = 0; q < width_kernel; q ++) {
+        float* col = data_col +
+                     (size_t)ld * (c * hw_kernel + p * width_kernel + q);
+        for (int h = 0; h < height_out; h ++) {
+          float* dst = col + h * width_out;
+          int cur_row = h * stride + p - pad_h;  // row after padding
+          if (cur_row < 0 || cur_row >= height_in) {
+            std::fill(dst, dst + width_out, 0.0f);
+            continue;
+          }
+          const float* src = map + cur_row * width_in;
+          for (int w = 0; w < width_out; w ++) {
+            int cur_col = w * stride + q - pad_w;  // col after padding
+            dst[w] = (cur_col < 0 || cur_col >= width_in) ? 0 : src[cur_col];
+          }
         }
       }
     }
   }
 }
 
+// Scratch of thread tid in ctx for one chunk: the (chunk_size * hw_out) x
+// (hw_kernel * channel_in) im2col matrix followed by the (chunk_size *
+// hw_out) x channel_out GEMM result. The context keeps it between calls, so
+// steady-state forward/backward allocate nothing here.
+float* Conv::chunk_scratch(ExecutionContext& ctx, int tid) const {
+  size_t rows = (size_t)chunk_size * height_out * width_out;
+  size_t cols = height_kernel * width_kernel * channel_in;
+  return reinterpret_cast<float*>(
+      ctx.scratch(tid, rows * (cols + channel_out) * sizeof(float)));
+}
+
+void Conv::set_chunk_size(int n) {
+  chunk_size = std::max(1, n);
+}
+
 void Conv::forward(const Matrix& bottom) {
+  top.resize(dim_out, bottom.cols());
+  infer(bottom, top, context);
+}
+
+// Samples are processed in chunks of chunk_size: the chunk's im2col rows are
+// stacked in one scratch matrix and multiplied by weight with a single GEMM.
+// Chunks run in parallel, each thread reusing its own scratch buffers.
+void Conv::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                 ExecutionContext& ctx) const {
+  if (is_quantized()) {
+    forward_int8(bottom, top, ctx);
+    return;
+  }
   int n_sample = bottom.cols();
-  top.resize(height_out * width_out * channel_out, n_sample);
-  data_cols.resize(n_sample);
-  for (int i = 0; i < n_sample; i ++) {
+  int hw_out = height_out * width_out;
+  int rows = chunk_size * hw_out;
+  int cols = height_kernel * width_kernel * channel_in;
+  int n_chunk = (n_sample + chunk_size - 1) / chunk_size;
+  ctx.parallel_for(n_chunk, [&](int k, int tid) {
+    int first = k * chunk_size;
+    int n = std::min(chunk_size, n_sample - first);
+    float* scratch = chunk_scratch(ctx, tid);
+    Eigen::Map<Matrix> data_col(scratch, rows, cols);
+    Eigen::Map<Matrix> result(scratch + (size_t)rows * cols, rows, channel_out);
     // im2col
-    Matrix data_col;
-    im2col(bottom.col(i), data_col);
-    data_cols[i] = data_col;
-    // conv by product
-    Matrix result = data_col * weight;  // result: (hw_out, channel_out)
-    result.rowwise() += bias.transpose();
-    top.col(i) = Eigen::Map<Vector>(result.data(), result.size());
+    for (int s = 0; s < n; s ++) {
+      im2col(bottom.col(first + s).data(), data_col.data() + s * hw_out, rows);
+    }
+    // conv by product, result: (n * hw_out, channel_out)
+    result.topRows(n * hw_out).noalias() = data_col.topRows(n * hw_out) * weight;
+    for (int s = 0; s < n; s ++) {
+      for (int m = 0; m < channel_out; m ++) {
+        top.col(first + s).segment(m * hw_out, hw_out) =
+            result.col(m).segment(s * hw_out, hw_out).array() + bias(m);
+      }
+    }
+  });
+}
+
+// Taps of one kernel row in the quantized im2col layout, padded to whole
+// groups of 8 so that a row can be copied with 16-byte moves.
+static int int8_row_taps(int width_kernel) { return (width_kernel + 7) / 8 * 8; }
+
+// Quantized im2col (values 0..255 held as int16) with one row per output
+// pixel: every kernel row (c, p) takes int8_row_taps(width_kernel) entries
+// and the whole row is padded to int8_padded entries. Weights are zero at
+// every padded position, so whatever lands there does not matter; with
+// stride 1 the taps of a kernel row are contiguous in the image and are
+// copied 8 at a time, reading at most 7 entries past them (image needs that
+// much slack at its end).
+void Conv::im2col_int8(const short* image, short* data_col) const {
+  int hw_in = height_in * width_in;
+  int taps = int8_row_taps(width_kernel);
+  int row = int8_padded(channel_in * height_kernel * taps);
+  for (int h = 0; h < height_out; h ++) {
+    for (int w = 0; w < width_out; w ++) {
+      short* dst = data_col + (size_t)row * (h * width_out + w);
+      int col0 = w * stride - pad_w;
+      bool fast = stride == 1 && col0 >= 0 && col0 + width_kernel <= width_in;
+      for (int c = 0; c < channel_in; c ++) {
+        const short* map = image + hw_in * c;
+        for (int p = 0; p < height_kernel; p ++, dst += taps) {
+          int cur_row = h * stride + p - pad_h;
+          if (cur_row < 0 || cur_row >= height_in) {
+            std::fill(dst, dst + width_kernel, 0);
+            continue;
+          }
+          const short* src = map + cur_row * width_in;
+          if (fast) {
+            for (int q = 0; q < taps; q += 8) {
+              memcpy(dst + q, src + col0 + q, 8 * sizeof(short));
+            }
+            continue;
+          }
+          for (int q = 0; q < width_kernel; q ++) {
+            int cur_col = col0 + q;  // col after padding
+            dst[q] = (cur_col < 0 || cur_col >= width_in) ? 0 : src[cur_col];
+          }
+        }
+      }
+    }
   }
 }
 
+// Quantized forward: each sample is quantized, unrolled with im2col_int8 and
+// every output is an int32 dot product with one packed weight row, scaled
+// back to float and biased.
+void Conv::forward_int8(const ConstMatrixRef& bottom, MatrixRef top,
+                        ExecutionContext& ctx) const {
+  int n_sample = bottom.cols();
+  int hw_out = height_out * width_out;
+  int row = int8_padded(channel_in * height_kernel *
+                        int8_row_taps(width_kernel));
+  ctx.parallel_for(n_sample, [&](int i, int tid) {
+    // image (+8 entries of slack for im2col_int8), im2col rows, accumulators
+    size_t n_image = int8_padded(dim_in + 8);
+    size_t n_col = (size_t)hw_out * row;
+    char* scratch = ctx.scratch(tid, (n_image + n_col) * sizeof(short) +
+                                     channel_out * sizeof(int));
+    short* image = reinterpret_cast<short*>(scratch);
+    short* data_col = image + n_image;
+    int* acc = reinterpret_cast<int*>(data_col + n_col);
+    quantize_input(bottom.col(i).data(), dim_in, quantized.input_scale, image);
+    im2col_int8(image, data_col);
+    float* y = top.col(i).data();
+    for (int o = 0; o < hw_out; o ++) {
+      dot_rows_int16(data_col + (size_t)o * row, weight_int8.data(), row, row,
+                     channel_out, acc);
+      for (int m = 0; m < channel_out; m ++) {
+        y[m * hw_out + o] = acc[m] * scale_int8[m] + bias(m);
+      }
+    }
+  });
+}
+
 // col2im, used for grad_bottom
 // data_col size: Matrix (hw_out, hw_kernel * channel_in)
 // image size: Vector (height_in * width_in * channel_in)
-void Conv::col2im(const Matrix& data_col, Vector& image) {
+void Conv::col2im(const Matrix& data_col, Vector& image) const {
+  image.resize(height_in * width_in * channel_in);
+  col2im(data_col.data(), data_col.rows(), image.data());
+}
+
+// Raw col2im from a column-major buffer with leading dimension ld; the
+// result is written (not accumulated) into image.
+void Conv::col2im(const float* data_col, int ld, float* image) const {
   int hw_in = height_in * width_in;
   int hw_kernel = height_kernel * width_kernel;
-  int hw_out = height_out * width_out;
   // col2im
-  image.resize(hw_in * channel_in);
-  image.setZero();
+  std::fill(image, image + hw_in * channel_in, 0.0f);
   for (int c = 0; c < channel_in; c ++) {
-    for (int i = 0; i < hw_out; i ++) {
-      int step_h = i / width_out;
-      int step_w = i % width_out;
-      int start_idx = step_h * width_in * stride + step_w * stride;  // left-top idx of window
-      for (int j = 0; j < hw_kernel; j ++) {
-        int cur_col = start_idx % width_in + j % width_kernel - pad_w;  // col after padding
-        int cur_row = start_idx / width_in + j / width_kernel - pad_h;
-        if (cur_col < 0 || cur_col >= width_in || cur_row < 0 ||
-            cur_row >= height_in) {
-          continue;
-        }
-        else {
-          //int pick_idx = start_idx + (j / width_kernel) * width_in + j % width_kernel;
-          int pick_idx = cur_row * width_in + cur_col;
-          image(c * hw_in + pick_idx) += data_col(i, c * hw_kernel + j);  // pick which pixel
+    float* map = image + hw_in * c;  // c-th channel map
+    for (int p = 0; p < height_kernel; p ++) {
+      for (int q = 0; q < width_kernel; q ++) {
+        const float* col = data_col +
+                           (size_t)ld * (c * hw_kernel + p * width_kernel + q);
+        for (int h = 0; h < height_out; h ++) {
+          int cur_row = h * stride + p - pad_h;  // row after padding
+          if (cur_row < 0 || cur_row >= height_in) {
+            continue;
+          }
+          const float* src = col + h * width_out;
+          float* dst = map + cur_row * width_in;
+          for (int w = 0; w < width_out; w ++) {
+            int cur_col = w * stride + q - pad_w;  // col after padding
+            if (cur_col >= 0 && cur_col < width_in) {
+              dst[cur_col] += src[w];
+            }
+          }
         }
       }
     }
   }
 }
 
+// No im2col matrices are kept from forward: each chunk's im2col is recomputed
+// into the same scratch arena, so peak memory is bounded by
+// n_threads * chunk_size samples instead of the whole batch.
 void Conv::backward(const Matrix& bottom, const Matrix& grad_top) {
   int n_sample = bottom.cols();
-  grad_weight.setZero();
-  grad_bias.setZero();
+  int hw_out = height_out * width_out;
+  int n_thread = context.n_threads();
+  int rows = chunk_size * hw_out;
+  int cols = height_kernel * width_kernel * channel_in;
   grad_bottom.resize(height_in * width_in * channel_in, n_sample);
-  grad_bottom.setZero();
-  for (int i = 0; i < n_sample; i ++) {
-    // im2col of grad_top
-    Matrix grad_top_i = grad_top.col(i);
-    Matrix grad_top_i_col = Eigen::Map<Matrix>(grad_top_i.data(),
-                              height_out * width_out, channel_out);
+  grad_weight_partial.resize(n_thread);
+  grad_bias_partial.resize(n_thread);
+  for (int t = 0; t < n_thread; t ++) {
+    grad_weight_partial[t].setZero(weight.rows(), weight.cols());
+    grad_bias_partial[t].setZero(channel_out);
+  }
+  int n_chunk = (n_sample + chunk_size - 1) / chunk_size;
+  context.parallel_for(n_chunk, [&](int k, int tid) {
+    int first = k * chunk_size;
+    int n = std::min(chunk_size, n_sample - first);
+    int n_rows = n * hw_out;
+    float* scratch = chunk_scratch(context, tid);
+    Eigen::Map<Matrix> data_col(scratch, rows, cols);
+    Eigen::Map<Matrix> grad_top_col(scratch + (size_t)rows * cols, rows,
+                                    channel_out);
+    for (int s = 0; s < n; s ++) {
+      im2col(bottom.col(first + s).data(), data_col.data() + s * hw_out, rows);
+      for (int m = 0; m < channel_out; m ++) {
+        grad_top_col.col(m).segment(s * hw_out, hw_out) =
+            grad_top.col(first + s).segment(m * hw_out, hw_out);
+      }
+    }
     // d(L)/d(w) = \sum{ d(L)/d(z_i) * d(z_i)/d(w) }
-    grad_weight += data_cols[i].transpose() * grad_top_i_col;
+    grad_weight_partial[tid].noalias() +=
+        data_col.topRows(n_rows).transpose() * grad_top_col.topRows(n_rows);
     // d(L)/d(b) = \sum{ d(L)/d(z_i) * d(z_i)/d(b) }
-    grad_bias += grad_top_i_col.colwise().sum().transpose();
+    grad_bias_partial[tid] +=
+        grad_top_col.topRows(n_rows).colwise().sum().transpose();
     // d(L)/d(x) = \sum{ d(L)/d(z_i) * d(z_i)/d(x) } = d(L)/d(z)_col * w'
-    Matrix grad_bottom_i_col = grad_top_i_col * weight.transpose();
+    // (the im2col buffer is no longer needed and is reused for the result)
+    data_col.topRows(n_rows).noalias() = grad_top_col.topRows(n_rows) *
+                                         weight.transpose();
     // col2im of grad_bottom
-    Vector grad_bottom_i;
-    col2im(grad_bottom_i_col, grad_bottom_i);
-    grad_bottom.col(i) = grad_bottom_i;
+    for (int s = 0; s < n; s ++) {
+      col2im(data_col.data() + s * hw_out, rows,
+             grad_bottom.col(first + s).data());
+    }
+  });
+  grad_weight.setZero();
+  grad_bias.setZero();
+  for (int t = 0; t < n_thread; t ++) {
+    grad_weight += grad_weight_partial[t];
+    grad_bias += grad_bias_partial[t];
   }
 }
 
-void Conv::update(Optimizer& opt) {
-  Vector::AlignedMapType weight_vec(weight.data(), weight.size());
-  Vector::AlignedMapType bias_vec(bias.data(), bias.size());
-  Vector::ConstAlignedMapType grad_weight_vec(grad_weight.data(), grad_weight.size());
-  Vector::ConstAlignedMapType grad_bias_vec(grad_bias.data(), grad_bias.size());
-
-  opt.update(weight_vec, grad_weight_vec);
-  opt.update(bias_vec, grad_bias_vec);
+void Conv::bind_parameters(float* param, float* grad) {
+  bind_weight_bias(param, grad, weight, bias, grad_weight, grad_bias);
+  Vector().swap(storage);
 }
 
 std::vector<float> Conv::get_parameters() const {
@@ -140,10 +311,22 @@ std::vector<float> Conv::get_parameters() const {
 }
 
 void Conv::set_parameters(const std::vector<float>& param) {
-  if(static_cast<int>(param.size()) != weight.size() + bias.size())
+  set_parameters(param.data(), param.size());
+}
+
+void Conv::set_parameters(const float* param, int size) {
+  if (size != weight.size() + bias.size())
       throw std::invalid_argument("Parameter size does not match");
-  std::copy(param.begin(), param.begin() + weight.size(), weight.data());
-  std::copy(param.begin() + weight.size(), param.end(), bias.data());
+  std::copy(param, param + weight.size(), weight.data());
+  std::copy(param + weight.size(), param + size, bias.data());
+  clear_int8();
+}
+
+void Conv::set_derivatives(const std::vector<float>& deriv) {
+  if (static_cast<int>(deriv.size()) != grad_weight.size() + grad_bias.size())
+      throw std::invalid_argument("Derivative size does not match");
+  std::copy(deriv.begin(), deriv.begin() + grad_weight.size(), grad_weight.data());
+  std::copy(deriv.begin() + grad_weight.size(), deriv.end(), grad_bias.data());
 }
 
 std::vector<float> Conv::get_derivatives() const {
@@ -154,3 +337,40 @@ std::vector<float> Conv::get_derivatives() const {
             res.begin() + grad_weight.size());
   return res;
 }
+
+bool Conv::quantize(float input_min, float input_max) {
+  if (input_min < 0)
+    return false;  // inputs are quantized as uint8
+  quantized.quantize(weight, input_max);
+  prepare_int8();
+  return true;
+}
+
+void Conv::prepare_int8() {
+  // same layout as im2col_int8: kernel rows padded to 8-byte words, the
+  // whole row padded to a multiple of kInt8Block
+  int taps = int8_row_taps(width_kernel);
+  int row = int8_padded(channel_in * height_kernel * taps);
+  std::vector<signed char> packed = quantized.pack(width_kernel, taps, row);
+  weight_int8.assign(packed.begin(), packed.end());
+  scale_int8 = quantized.output_scale();
+}
+
+void Conv::clear_int8() {
+  quantized = QuantizedWeights();
+  std::vector<short>().swap(weight_int8);
+  std::vector<float>().swap(scale_int8);
+}
+
+void Conv::get_quantized_parameters(std::vector<signed char>& q,
+                                    std::vector<float>& param) const {
+  q = quantized.q;
+  param = quantized.get_parameters(bias);
+}
+
+void Conv::set_quantized_parameters(const signed char* q, int q_size,
+                                    const float* param, int size) {
+  quantized.set_parameters(weight.rows(), weight.cols(), q, q_size, param,
+                           size, bias);
+  prepare_int8();
+}
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include "../layer.h"
+#include "../thread_pool.h"
+#include "./quantize.h"
 
 class Conv: public Layer {
  private:
@@ -22,14 +24,32 @@ class Conv: public Layer {
   int height_out;
   int width_out;
 
-  Matrix weight;  // weight param, size=channel_in*h_kernel*w_kernel*channel_out
-  Vector bias;  // bias param, size = channel_out
-  Matrix grad_weight;  // gradient w.r.t weight
-  Vector grad_bias;  // gradient w.r.t bias
+  MatrixView weight;  // weight param, size=channel_in*h_kernel*w_kernel*channel_out
+  VectorView bias;  // bias param, size = channel_out
+  MatrixView grad_weight;  // gradient w.r.t weight
+  VectorView grad_bias;  // gradient w.r.t bias
+  Vector storage;  // holds the four until bind_parameters
 
-  std::vector<Matrix> data_cols;
+  int chunk_size;  // samples per im2col/GEMM chunk
+  // per-thread scratch of forward/backward: the im2col of one chunk followed
+  // by its GEMM result (or grad_top), see chunk_scratch
+  ExecutionContext context;
+  // per-thread partial sums of backward, reduced after its parallel loop;
+  // kept so that steady-state training steps allocate nothing
+  std::vector<Matrix> grad_weight_partial;
+  std::vector<Vector> grad_bias_partial;
+
+  QuantizedWeights quantized;  // empty unless quantize() was called
+  std::vector<short> weight_int8;  // widened, one padded row per channel
+  std::vector<float> scale_int8;  // int32 sum -> float, per output channel
 
   void init();
+  float* chunk_scratch(ExecutionContext& ctx, int tid) const;
+  void prepare_int8();
+  void clear_int8();  // set_parameters drops the int8 copy of old weights
+  void forward_int8(const ConstMatrixRef& bottom, MatrixRef top,
+                    ExecutionContext& ctx) const;
+  void im2col_int8(const short* image, short* data_col) const;
 
  public:
   Conv(int channel_in, int height_in, int width_in, int channel_out,
@@ -38,18 +58,36 @@ class Conv: public Layer {
        dim_in(channel_in * height_in * width_in),
        channel_in(channel_in), height_in(height_in), width_in(width_in),
        channel_out(channel_out), height_kernel(height_kernel),
-       width_kernel(width_kernel), stride(stride), pad_w(pad_w), pad_h(pad_h)
+       width_kernel(width_kernel), stride(stride), pad_w(pad_w), pad_h(pad_h),
+       weight(NULL, 0, 0), bias(NULL, 0), grad_weight(NULL, 0, 0),
+       grad_bias(NULL, 0),
+       context(&ThreadPool::global())
   { init(); }
 
   void forward(const Matrix& bottom);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
-  void update(Optimizer& opt);
-  void im2col(const Vector& image, Matrix& data_col);
-  void col2im(const Matrix& data_col, Vector& image);
+  void im2col(const Vector& image, Matrix& data_col) const;
+  void im2col(const float* image, Matrix& data_col) const;
+  void im2col(const float* image, float* data_col, int ld) const;
+  void col2im(const Matrix& data_col, Vector& image) const;
+  void col2im(const float* data_col, int ld, float* image) const;
+  void set_chunk_size(int n);
   int output_dim() { return dim_out; }
   std::vector<float> get_parameters() const;
   std::vector<float> get_derivatives() const;
+  void set_derivatives(const std::vector<float>& deriv);
+  int parameter_size() const { return weight.size() + bias.size(); }
+  void bind_parameters(float* param, float* grad);
   void set_parameters(const std::vector<float>& param);
+  void set_parameters(const float* param, int size);
+  bool quantize(float input_min, float input_max);
+  bool is_quantized() const { return !quantized.empty(); }
+  void get_quantized_parameters(std::vector<signed char>& q,
+                                std::vector<float>& param) const;
+  void set_quantized_parameters(const signed char* q, int q_size,
+                                const float* param, int size);
 };
 
 #endif  // SRC_LAYER_CONV_H_
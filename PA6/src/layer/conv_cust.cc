@@ -1,16 +1,23 @@
 #include "conv_cust.h"
 #include <math.h>
 #include <iostream>
+#include "../thread_pool.h"
+#include "./custom/half.h"
+#include "cpu.h"
+
+// Kernel rows are padded to this many taps for the int8 kernel's char4 reads.
+static int padded_taps(int k) { return (k + 3) / 4 * 4; }
 
 void Conv_Custom::init() {
   height_out = (1 + (height_in - height_kernel + 2 * pad_h) / stride);
   width_out =   (1 + (width_in - width_kernel + 2 * pad_w) / stride);
   dim_out = height_out * width_out * channel_out;
 
-  weight.resize(channel_in * height_kernel * width_kernel, channel_out);
-  bias.resize(channel_out);
-  grad_weight.resize(channel_in * height_kernel * width_kernel, channel_out);
-  grad_bias.resize(channel_out);
+  const int fan_in = channel_in * height_kernel * width_kernel;
+  const int n_param = (fan_in + 1) * channel_out;
+  storage.setZero(2 * n_param);
+  place_weight_bias(storage.data(), storage.data() + n_param, fan_in,
+                    channel_out, weight, bias, grad_weight, grad_bias);
   set_normal_random(weight.data(), weight.size(), 0, 0.01);
   set_normal_random(bias.data(), bias.size(), 0, 0.01);
   //std::cout << weight.colwise().sum() << std::endl;
@@ -18,9 +25,30 @@ void Conv_Custom::init() {
 }
 
 
+// The one-shot m2 path: the shared OpenCL queue, with timings printed.
 void Conv_Custom::forward(const Matrix& bottom) {
+  ExecutionContext ctx(&ThreadPool::global(), opencl);
+  ctx.verbose = true;
+  top.resize(dim_out, bottom.cols());
+  infer(bottom, top, ctx);
+}
+
+void Conv_Custom::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                        ExecutionContext& ctx) const {
+  if ((ctx.opencl ? ctx.opencl : opencl)->native) {
+    forward_native(bottom, top, ctx);
+  } else if (is_quantized()) {
+    forward_int8(bottom, top, ctx);
+  } else if ((ctx.opencl ? ctx.opencl : opencl)->half_storage) {
+    forward_half(bottom, top, ctx);
+  } else {
+    forward_fp32(bottom, top, ctx);
+  }
+}
+
+void Conv_Custom::forward_fp32(const ConstMatrixRef& bottom, MatrixRef top,
+                               ExecutionContext& ctx) const {
   int n_sample = bottom.cols();
-  top.resize(height_out * width_out * channel_out, n_sample);
   float *x = (float*)bottom.data();
   float *y = (float*)top.data();
   float *k = (float*)weight.data();
@@ -35,9 +63,11 @@ void Conv_Custom::forward(const Matrix& bottom) {
   cl_mem y_d;
   cl_mem k_d;
 
-  std::cout<<"Conv-OpenCL=="<<std::endl;
+  if (ctx.verbose)
+    std::cout<<"Conv-OpenCL=="<<std::endl;
 
-  openclInterface.opencl = opencl;
+  OpenCLInterface openclInterface;
+  openclInterface.opencl = ctx.opencl ? ctx.opencl : opencl;
   
   // Start layer timer
   auto start_time_layer = std::chrono::high_resolution_clock::now();
@@ -57,6 +87,8 @@ void Conv_Custom::forward(const Matrix& bottom) {
   // Stop layer timer
   auto end_time_layer = std::chrono::high_resolution_clock::now();
 
+  if (!ctx.verbose)
+    return;
   std::chrono::duration<float, std::milli> duration_layer = (end_time_layer-start_time_layer);
   std::cout<<"Layer Time: " << duration_layer.count() << " ms"<<std::endl;
   
@@ -64,12 +96,173 @@ void Conv_Custom::forward(const Matrix& bottom) {
   std::cout<<"Op Time: " << duration_kernel.count() << " ms"<<std::endl;
 }
 
-void Conv_Custom::backward(const Matrix& bottom, const Matrix& grad_top) {
+// Same as forward with the batch quantized to uint8 on the host (in parallel,
+// one sample per task) and conv_forward_int8_kernel doing the convolution.
+// Like forward_fp32 and forward_half it leaves out the bias, so quantizing
+// the layer does not change the network it computes.
+void Conv_Custom::forward_int8(const ConstMatrixRef& bottom, MatrixRef top,
+                               ExecutionContext& ctx) const {
+  int n_sample = bottom.cols();
+  const int K = height_kernel;
+  const int KP = padded_taps(K);
+
+  // the batch plus KP bytes of zeros the kernel may read past its end
+  size_t n_x = (size_t)n_sample * dim_in;
+  unsigned char* x = reinterpret_cast<unsigned char*>(ctx.scratch(0, n_x + KP));
+  std::fill(x + n_x, x + n_x + KP, 0);
+  ctx.parallel_for(n_sample, [&](int i, int tid) {
+    quantize_input(bottom.col(i).data(), dim_in, quantized.input_scale,
+                   &x[(size_t)i * dim_in]);
+  });
+
+  cl_mem x_d, y_d, k_d, scale_d;
+
+  if (ctx.verbose)
+    std::cout<<"Conv-OpenCL-int8=="<<std::endl;
 
+  OpenCLInterface openclInterface;
+  openclInterface.opencl = ctx.opencl ? ctx.opencl : opencl;
+
+  auto start_time_layer = std::chrono::high_resolution_clock::now();
+  openclInterface.conv_forward_int8_opencl_prolog(x, weight_int8.data(), scale_int8.data(), &y_d, &x_d, &k_d, &scale_d, n_sample, channel_out, channel_in, height_in, width_in, K, KP);
+
+  auto start_time_kernel = std::chrono::high_resolution_clock::now();
+  openclInterface.conv_forward_int8_opencl(y_d, x_d, k_d, scale_d, n_sample, channel_out, channel_in, height_in, width_in, K, KP);
+  auto end_time_kernel = std::chrono::high_resolution_clock::now();
+
+  openclInterface.conv_forward_int8_opencl_epilog(top.data(), y_d, x_d, k_d, scale_d, n_sample, channel_out, height_in, width_in, K);
+  auto end_time_layer = std::chrono::high_resolution_clock::now();
+
+  if (!ctx.verbose)
+    return;
+  std::chrono::duration<float, std::milli> duration_layer = (end_time_layer-start_time_layer);
+  std::cout<<"Layer Time: " << duration_layer.count() << " ms"<<std::endl;
+
+  std::chrono::duration<float, std::milli> duration_kernel = (end_time_kernel-start_time_kernel);
+  std::cout<<"Op Time: " << duration_kernel.count() << " ms"<<std::endl;
 }
 
-void Conv_Custom::update(Optimizer& opt) {
+// Same as forward with x, k and y stored as half on the device. The host
+// converts the batch in parallel (one sample per task) on the way in and the
+// output on the way out, so both transfers are half the size as well.
+void Conv_Custom::forward_half(const ConstMatrixRef& bottom, MatrixRef top,
+                               ExecutionContext& ctx) const {
+  int n_sample = bottom.cols();
+  const int K = height_kernel;
+
+  // host copies of x, y and k in half, one after the other
+  size_t n_x = (size_t)n_sample * dim_in;
+  size_t n_y = (size_t)n_sample * dim_out;
+  cl_half* x = reinterpret_cast<cl_half*>(
+      ctx.scratch(0, (n_x + n_y + weight.size()) * sizeof(cl_half)));
+  cl_half* y = x + n_x;
+  cl_half* k = y + n_y;
+  for (int i = 0; i < weight.size(); i ++) {
+    k[i] = float_to_half(weight.data()[i]);
+  }
+  ctx.parallel_for(n_sample, [&](int i, int tid) {
+    const float* src = bottom.col(i).data();
+    cl_half* dst = &x[(size_t)i * dim_in];
+    for (int j = 0; j < dim_in; j ++) {
+      dst[j] = float_to_half(src[j]);
+    }
+  });
+
+  cl_mem x_d, y_d, k_d;
+
+  OpenCLInterface openclInterface;
+  openclInterface.opencl = ctx.opencl ? ctx.opencl : opencl;
+
+  if (ctx.verbose)
+    std::cout<<"Conv-OpenCL-half=="
+             <<(openclInterface.opencl->fp16 ? " (fp16 products)" : " (storage only)")<<std::endl;
+
+  auto start_time_layer = std::chrono::high_resolution_clock::now();
+  openclInterface.conv_forward_half_opencl_prolog(x, k, &y_d, &x_d, &k_d, n_sample, channel_out, channel_in, height_in, width_in, K);
+
+  auto start_time_kernel = std::chrono::high_resolution_clock::now();
+  openclInterface.conv_forward_half_opencl(y_d, x_d, k_d, n_sample, channel_out, channel_in, height_in, width_in, K);
+  auto end_time_kernel = std::chrono::high_resolution_clock::now();
+
+  openclInterface.conv_forward_half_opencl_epilog(y, y_d, x_d, k_d, n_sample, channel_out, height_in, width_in, K);
+  auto end_time_layer = std::chrono::high_resolution_clock::now();
+
+  ctx.parallel_for(n_sample, [&](int i, int tid) {
+    const cl_half* src = &y[(size_t)i * dim_out];
+    float* dst = top.col(i).data();
+    for (int j = 0; j < dim_out; j ++) {
+      dst[j] = half_to_float(src[j]);
+    }
+  });
+
+  if (!ctx.verbose)
+    return;
+  std::chrono::duration<float, std::milli> duration_layer = (end_time_layer-start_time_layer);
+  std::cout<<"Layer Time: " << duration_layer.count() << " ms"<<std::endl;
 
+  std::chrono::duration<float, std::milli> duration_kernel = (end_time_kernel-start_time_kernel);
+  std::cout<<"Op Time: " << duration_kernel.count() << " ms"<<std::endl;
+}
+
+// The convolutions on the host's cores (OclCpuConvForward): fp32 like
+// conv_forward_kernel, also for half storage, which only saves device memory.
+// A quantized layer convolves its uint8 inputs and int8 weights as floats,
+// exact while the sums stay below 2^24 as they do here, and then scales them
+// like conv_forward_int8_kernel. Neither adds a bias, as on the device.
+void Conv_Custom::forward_native(const ConstMatrixRef& bottom, MatrixRef top,
+                                 ExecutionContext& ctx) const {
+  const int B = bottom.cols();
+  const int K = height_kernel;
+  const int n_out = height_out * width_out;
+
+  if (ctx.verbose)
+    std::cout<<"Conv-Native=="<<(is_quantized() ? " (int8)" : "")<<std::endl;
+
+  auto start_time_layer = std::chrono::high_resolution_clock::now();
+  const float* x = bottom.data();
+  const float* k = weight.data();
+  if (is_quantized()) {
+    float* xq = reinterpret_cast<float*>(ctx.scratch(0, (size_t)B * dim_in * sizeof(float)));
+    ctx.parallel_for(B, [&](int i, int tid) {
+      quantize_input(bottom.col(i).data(), dim_in, quantized.input_scale,
+                     &xq[(size_t)i * dim_in]);
+    });
+    x = xq;
+    k = weight_q.data();
+  }
+
+  auto start_time_kernel = std::chrono::high_resolution_clock::now();
+  OclCpuConvForward(top.data(), x, k, B, channel_out, channel_in, height_in, width_in, K);
+  auto end_time_kernel = std::chrono::high_resolution_clock::now();
+
+  if (is_quantized()) {
+    ctx.parallel_for(B, [&](int i, int tid) {
+      float* y = top.col(i).data();
+      for (int m = 0; m < channel_out; m ++) {
+        for (int j = 0; j < n_out; j ++) {
+          y[m * n_out + j] *= scale_int8[m];
+        }
+      }
+    });
+  }
+  auto end_time_layer = std::chrono::high_resolution_clock::now();
+
+  if (!ctx.verbose)
+    return;
+  std::chrono::duration<float, std::milli> duration_layer = (end_time_layer-start_time_layer);
+  std::cout<<"Layer Time: " << duration_layer.count() << " ms"<<std::endl;
+
+  std::chrono::duration<float, std::milli> duration_kernel = (end_time_kernel-start_time_kernel);
+  std::cout<<"Op Time: " << duration_kernel.count() << " ms"<<std::endl;
+}
+
+void Conv_Custom::backward(const Matrix& bottom, const Matrix& grad_top) {
+
+}
+
+void Conv_Custom::bind_parameters(float* param, float* grad) {
+  bind_weight_bias(param, grad, weight, bias, grad_weight, grad_bias);
+  Vector().swap(storage);
 }
 
 std::vector<float> Conv_Custom::get_parameters() const {
@@ -81,10 +274,22 @@ std::vector<float> Conv_Custom::get_parameters() const {
 }
 
 void Conv_Custom::set_parameters(const std::vector<float>& param) {
-  if(static_cast<int>(param.size()) != weight.size() + bias.size())
+  set_parameters(param.data(), param.size());
+}
+
+void Conv_Custom::set_parameters(const float* param, int size) {
+  if (size != weight.size() + bias.size())
       throw std::invalid_argument("Parameter size does not match");
-  std::copy(param.begin(), param.begin() + weight.size(), weight.data());
-  std::copy(param.begin() + weight.size(), param.end(), bias.data());
+  std::copy(param, param + weight.size(), weight.data());
+  std::copy(param + weight.size(), param + size, bias.data());
+  clear_int8();
+}
+
+void Conv_Custom::set_derivatives(const std::vector<float>& deriv) {
+  if (static_cast<int>(deriv.size()) != grad_weight.size() + grad_bias.size())
+      throw std::invalid_argument("Derivative size does not match");
+  std::copy(deriv.begin(), deriv.begin() + grad_weight.size(), grad_weight.data());
+  std::copy(deriv.begin() + grad_weight.size(), deriv.end(), grad_bias.data());
 }
 
 std::vector<float> Conv_Custom::get_derivatives() const {
@@ -95,3 +300,37 @@ std::vector<float> Conv_Custom::get_derivatives() const {
             res.begin() + grad_weight.size());
   return res;
 }
+
+bool Conv_Custom::quantize(float input_min, float input_max) {
+  if (input_min < 0)
+    return false;  // inputs are quantized as uint8
+  quantized.quantize(weight, input_max);
+  prepare_int8();
+  return true;
+}
+
+void Conv_Custom::prepare_int8() {
+  weight_int8 = quantized.pack(width_kernel, padded_taps(width_kernel));
+  scale_int8 = quantized.output_scale();
+  weight_q.assign(quantized.q.begin(), quantized.q.end());
+}
+
+void Conv_Custom::clear_int8() {
+  quantized = QuantizedWeights();
+  std::vector<signed char>().swap(weight_int8);
+  std::vector<float>().swap(scale_int8);
+  std::vector<float>().swap(weight_q);
+}
+
+void Conv_Custom::get_quantized_parameters(std::vector<signed char>& q,
+                                           std::vector<float>& param) const {
+  q = quantized.q;
+  param = quantized.get_parameters(bias);
+}
+
+void Conv_Custom::set_quantized_parameters(const signed char* q, int q_size,
+                                           const float* param, int size) {
+  quantized.set_parameters(weight.rows(), weight.cols(), q, q_size, param,
+                           size, bias);
+  prepare_int8();
+}
@@ -4,6 +4,7 @@
 #include <vector>
 #include <chrono>
 #include "../layer.h"
+#include "./quantize.h"
 #include "./custom/opencl-new-forward.h"
 #include "./custom/opencl.h"
 
@@ -25,16 +26,30 @@ class Conv_Custom: public Layer {
   int height_out;
   int width_out;
 
-  Matrix weight;  // weight param, size=channel_in*h_kernel*w_kernel*channel_out
-  Vector bias;  // bias param, size = channel_out
-  Matrix grad_weight;  // gradient w.r.t weight
-  Vector grad_bias;  // gradient w.r.t bias
+  MatrixView weight;  // weight param, size=channel_in*h_kernel*w_kernel*channel_out
+  VectorView bias;  // bias param, size = channel_out
+  MatrixView grad_weight;  // gradient w.r.t weight
+  VectorView grad_bias;  // gradient w.r.t bias
+  Vector storage;  // holds the four until bind_parameters
 
-  std::vector<Matrix> data_cols;
-
-  OpenCLInterface openclInterface;
+  QuantizedWeights quantized;  // empty unless quantize() was called
+  std::vector<signed char> weight_int8;  // kernel rows padded to 4-tap vectors
+  std::vector<float> scale_int8;  // int32 sum -> float, per output map
+  std::vector<float> weight_q;  // the int8 kernel as floats, for forward_native
 
   void init();
+  void prepare_int8();
+  void clear_int8();  // set_parameters drops the int8 copy of old weights
+  // the three device paths; ctx.opencl (or else opencl) picks the queue
+  void forward_fp32(const ConstMatrixRef& bottom, MatrixRef top,
+                    ExecutionContext& ctx) const;
+  void forward_int8(const ConstMatrixRef& bottom, MatrixRef top,
+                    ExecutionContext& ctx) const;
+  void forward_half(const ConstMatrixRef& bottom, MatrixRef top,
+                    ExecutionContext& ctx) const;
+  // without an OpenCL device (OpenCL::native)
+  void forward_native(const ConstMatrixRef& bottom, MatrixRef top,
+                      ExecutionContext& ctx) const;
 
  public:
   OpenCL* opencl;
@@ -45,16 +60,29 @@ class Conv_Custom: public Layer {
        dim_in(channel_in * height_in * width_in),
        channel_in(channel_in), height_in(height_in), width_in(width_in),
        channel_out(channel_out), height_kernel(height_kernel),
-       width_kernel(width_kernel), stride(stride), pad_w(pad_w), pad_h(pad_h), opencl(0)
+       width_kernel(width_kernel), stride(stride), pad_w(pad_w), pad_h(pad_h),
+       weight(NULL, 0, 0), bias(NULL, 0), grad_weight(NULL, 0, 0),
+       grad_bias(NULL, 0), opencl(0)
   { init(); }
 
   void forward(const Matrix& bottom);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
-  void update(Optimizer& opt);
   int output_dim() { return dim_out; }
   std::vector<float> get_parameters() const;
   std::vector<float> get_derivatives() const;
+  void set_derivatives(const std::vector<float>& deriv);
+  int parameter_size() const { return weight.size() + bias.size(); }
+  void bind_parameters(float* param, float* grad);
   void set_parameters(const std::vector<float>& param);
+  void set_parameters(const float* param, int size);
+  bool quantize(float input_min, float input_max);
+  bool is_quantized() const { return !quantized.empty(); }
+  void get_quantized_parameters(std::vector<signed char>& q,
+                                std::vector<float>& param) const;
+  void set_quantized_parameters(const signed char* q, int q_size,
+                                const float* param, int size);
 };
 
 #endif  // SRC_LAYER_CONV_CUST_H_
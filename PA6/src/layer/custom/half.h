@@ -0,0 +1,49 @@
+#ifndef SRC_LAYER_CUSTOM_HALF_H_
+#define SRC_LAYER_CUSTOM_HALF_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// IEEE 754 binary16 on the host, bit-compatible with vload_half/vstore_half
+// on the device. float_to_half rounds to nearest even like vstore_half.
+
+inline uint16_t float_to_half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t abs = x & 0x7fffffff;
+  if (abs >= 0x7f800000)  // inf or nan, keeping nan quiet
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  if (abs >= 0x477ff000)  // rounds past 65504
+    return sign | 0x7c00;
+  if (abs < 0x38800000) {  // below 2^-14: subnormal, in units of 2^-24
+    float v;
+    memcpy(&v, &abs, sizeof(v));
+    return sign | static_cast<uint16_t>(lrintf(v * 16777216.0f));
+  }
+  // rebias the exponent from 127 to 15 and round the 13 dropped bits
+  abs += 0xc8000fff + ((abs >> 13) & 1);
+  return sign | (abs >> 13);
+}
+
+inline float half_to_float(uint16_t h) {
+  uint32_t sign = uint32_t(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+  if (exp == 0) {
+    float v = mant * (1.0f / 16777216.0f);
+    memcpy(&x, &v, sizeof(x));
+    x |= sign;
+  } else if (exp == 31) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else {
+    x = sign | ((exp + 112) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+#endif  // SRC_LAYER_CUSTOM_HALF_H_
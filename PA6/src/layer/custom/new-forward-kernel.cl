@@ -57,3 +57,161 @@ __kernel void conv_forward_kernel(__global float *y, __global float *x,
     y[y_index] = sum;
 }
 
+
+// Quantized convolution. x is uint8 with a single scale, k is int8 with one
+// scale per output feature map and each kernel row zero-padded from K to KP
+// (a multiple of 4) taps, so every row is read as KP/4 char4 vectors and
+// accumulated in int32. scale[m] turns the sum back into a float; like
+// conv_forward_kernel, no bias is added.
+// Reads run up to KP - K bytes past the last input row; the host pads x.
+#ifdef cl_khr_integer_dot_product
+#pragma OPENCL EXTENSION cl_khr_integer_dot_product : enable
+#define DOT4(a, b) dot(a, b)
+#else
+inline int dot4_u8s8(uchar4 a, char4 b)
+{
+    int4 p = convert_int4(a) * convert_int4(b);
+    return p.x + p.y + p.z + p.w;
+}
+#define DOT4(a, b) dot4_u8s8(a, b)
+#endif
+
+__kernel void conv_forward_int8_kernel(__global float *y, __global const uchar *x,
+    __global const char *k, __global const float *scale, const int B,
+    const int M, const int C, const int H, const int W, const int K, const int KP)
+{
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+
+    int w_out = get_global_id(0);
+    int h_out = get_global_id(1);
+    int bm = get_global_id(2);
+    int m = bm % M;
+    int b = bm / M;
+
+    int acc = 0;
+    for (int c = 0; c < C; c++) {
+        for (int p = 0; p < K; p++) {
+            __global const uchar *x_row = x + ((b * C + c) * H + h_out + p) * W + w_out;
+            __global const char *k_row = k + ((m * C + c) * K + p) * KP;
+            for (int q = 0; q < KP; q += 4) {
+                acc += DOT4(vload4(0, x_row + q), vload4(0, k_row + q));
+            }
+        }
+    }
+    int y_index = b * (M * H_out * W_out) + m * (H_out * W_out) + h_out * W_out + w_out;
+    y[y_index] = acc * scale[m];
+}
+
+
+// Half-storage convolution with the layout of conv_forward_kernel. x, k and y
+// are IEEE half, so the buffers and the memory traffic of this memory-bound
+// kernel are half those of the fp32 path. Values are loaded with vload_half
+// and summed in float; with cl_khr_fp16 each product is taken in half
+// precision first, which runs at twice the float rate on most GPUs.
+#ifdef cl_khr_fp16
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#define MUL_HALF(x, i, k, j) ((float)((x)[i] * (k)[j]))
+#else
+#define MUL_HALF(x, i, k, j) (vload_half(i, x) * vload_half(j, k))
+#endif
+
+__kernel void conv_forward_half_kernel(__global half *y, __global const half *x,
+    __global const half *k, const int B, const int M, const int C, const int H,
+    const int W, const int K)
+{
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+
+    int w_out = get_global_id(0);
+    int h_out = get_global_id(1);
+    int bm = get_global_id(2);
+    int m = bm % M;
+    int b = bm / M;
+
+    float sum = 0.0f;
+    for (int c = 0; c < C; c++) {
+        for (int p = 0; p < K; p++) {
+            int x_row = ((b * C + c) * H + h_out + p) * W + w_out;
+            int k_row = ((m * C + c) * K + p) * K;
+            for (int q = 0; q < K; q++) {
+                sum += MUL_HALF(x, x_row + q, k, k_row + q);
+            }
+        }
+    }
+    int y_index = b * (M * H_out * W_out) + m * (H_out * W_out) + h_out * W_out + w_out;
+    vstore_half(sum, y_index, y);
+}
+
+
+// Fully connected layer: y[n][m] = act(b[m] + sum_d w[m][d] * x[n][d]), a
+// GEMM tiled like the PA3 matrix multiply. Each work-group computes a
+// TILE_WIDTH x TILE_WIDTH block of outputs (m along dimension 0, n along 1)
+// and stages matching tiles of w and x in local memory, every load reading
+// consecutive d across the work-group. relu != 0 applies ReLU, so the bias
+// and activation cost no extra pass over y.
+__kernel void fc_forward_kernel(__global float *y, __global const float *x,
+    __global const float *w, __global const float *b, const int N, const int D,
+    const int M, const int relu)
+{
+    __local float w_tile[TILE_WIDTH][TILE_WIDTH + 1];
+    __local float x_tile[TILE_WIDTH][TILE_WIDTH + 1];
+
+    int tm = get_local_id(0);
+    int tn = get_local_id(1);
+    int m0 = get_group_id(0) * TILE_WIDTH;
+    int n0 = get_group_id(1) * TILE_WIDTH;
+    int m = m0 + tm;
+    int n = n0 + tn;
+
+    float acc = 0.0f;
+    for (int d0 = 0; d0 < D; d0 += TILE_WIDTH) {
+        // thread (tm, tn) loads entry d0 + tm of row m0 + tn of w and of x
+        int d = d0 + tm;
+        w_tile[tn][tm] = (m0 + tn < M && d < D) ? w[(m0 + tn) * D + d] : 0.0f;
+        x_tile[tn][tm] = (n0 + tn < N && d < D) ? x[(n0 + tn) * D + d] : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (int j = 0; j < TILE_WIDTH; j++) {
+            acc += w_tile[tm][j] * x_tile[tn][j];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (m < M && n < N) {
+        acc += b[m];
+        y[n * M + m] = relu ? fmax(acc, 0.0f) : acc;
+    }
+}
+
+// Softmax + cross-entropy, one work-item per sample n (C logits at z + n*C,
+// targets at y + n*C). The first pass keeps a running maximum and rescales
+// the running sum of exponentials when it moves (online softmax), the
+// second writes grad = (softmax(z) - y) / N; loss[n] is the log-softmax
+// cross-entropy of the sample, which needs no eps.
+__kernel void softmax_xent_kernel(__global float *grad, __global float *loss,
+    __global const float *z, __global const float *y, const int N, const int C)
+{
+    int n = get_global_id(0);
+    if (n >= N)
+        return;
+    z += n * C;
+    y += n * C;
+    grad += n * C;
+
+    float z_max = -INFINITY;
+    float sum = 0.0f;
+    for (int i = 0; i < C; i++) {
+        if (z[i] > z_max) {
+            sum *= exp(z_max - z[i]);
+            z_max = z[i];
+        }
+        sum += exp(z[i] - z_max);
+    }
+    float log_z = z_max + log(sum);
+    float inv_sum = 1.0f / sum;
+    float l = 0.0f;
+    for (int i = 0; i < C; i++) {
+        l += y[i] * (log_z - z[i]);
+        grad[i] = (exp(z[i] - z_max) * inv_sum - y[i]) / N;
+    }
+    loss[n] = l;
+}
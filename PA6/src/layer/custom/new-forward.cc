@@ -22,7 +22,8 @@ void OpenCLInterface::conv_forward_opencl_prolog(const float *host_y,
     //B = batch size, M = # output feature maps, H = Height input feature maps, W = width input feature maps, K = mask
 {
     //@@ Allocate OpenCL memory here
-    // Create memory buffers for input and output vectors
+    // Take memory buffers for input and output vectors from this->opencl,
+    // which keeps them between calls (OpenCL::buffer)
     // Do not create your own device/context/queue. 
     // Use this->opencl->[program, kernel, queue, context]
     // OpenCL (common for entire NN)
@@ -37,30 +38,15 @@ void OpenCLInterface::conv_forward_opencl_prolog(const float *host_y,
     cl_int err;
     //input data
     size_t size_x = B * C * H * W * sizeof(float);
-    *device_x = clCreateBuffer(this->opencl->context,
-                              CL_MEM_READ_ONLY,
-                              size_x,
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device_x");
+    *device_x = this->opencl->buffer(OpenCL::kBufferX, size_x);
     //kernel size
     size_t size_k = M * C * K * K * sizeof(float);
-    *device_k = clCreateBuffer(this->opencl->context,
-                              CL_MEM_READ_ONLY,
-                              size_k,
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device_k");
+    *device_k = this->opencl->buffer(OpenCL::kBufferK, size_k);
     //output data 
     int H_out = H - K + 1; 
     int W_out = W - K + 1;
     size_t size_y = B * M * H_out * W_out * sizeof(float);
-    *device_y = clCreateBuffer(this->opencl->context,
-                              CL_MEM_WRITE_ONLY,
-                              size_y,
-                              NULL,
-                              &err);
-    CHECK_ERR(err, "clCreateBuffer device_y");
+    *device_y = this->opencl->buffer(OpenCL::kBufferY, size_y);
 
     //@@ Copy memory to the OpenCL here
     // Copy input vectors to memory buffers
@@ -133,9 +119,210 @@ void OpenCLInterface::conv_forward_opencl_epilog(float *host_y, cl_mem device_y,
     // Use this->opencl->[program, kernel, queue, context]
 
     //@@ Free the OpenCL memory here
-    // Release OpenCL resources
+    // Nothing to release: the buffers belong to this->opencl (see
+    // OpenCL::buffer) and are reused by the next call
+}
+
+void OpenCLInterface::conv_forward_int8_opencl_prolog(const unsigned char *host_x,
+    const signed char *host_k, const float *host_scale, cl_mem *device_y,
+    cl_mem *device_x, cl_mem *device_k, cl_mem *device_scale, const int B,
+    const int M, const int C, const int H, const int W, const int K, const int KP)
+{
+    cl_int err;
+    // the kernel reads up to KP - K bytes past the last row
+    size_t size_x = (size_t)B * C * H * W + KP;
+    *device_x = this->opencl->buffer(OpenCL::kBufferX, size_x);
+    size_t size_k = (size_t)M * C * K * KP;
+    *device_k = this->opencl->buffer(OpenCL::kBufferK, size_k);
+    *device_scale = this->opencl->buffer(OpenCL::kBufferScale, M * sizeof(float));
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+    size_t size_y = (size_t)B * M * H_out * W_out * sizeof(float);
+    *device_y = this->opencl->buffer(OpenCL::kBufferY, size_y);
+
+    // host_x carries the KP bytes of padding as well
+    err = clEnqueueWriteBuffer(this->opencl->queue, *device_x, CL_FALSE, 0, size_x, host_x, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for host_x");
+    err = clEnqueueWriteBuffer(this->opencl->queue, *device_k, CL_FALSE, 0, size_k, host_k, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for kernel");
+    err = clEnqueueWriteBuffer(this->opencl->queue, *device_scale, CL_TRUE, 0, M * sizeof(float), host_scale, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for scale");
+}
+
+void OpenCLInterface::conv_forward_int8_opencl(cl_mem device_y, const cl_mem device_x,
+    const cl_mem device_k, const cl_mem device_scale, const int B, const int M,
+    const int C, const int H, const int W, const int K, const int KP)
+{
+    cl_kernel kernel = this->opencl->kernel_int8;
+    cl_int err;
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_y);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_x);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_k);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &device_scale);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &B);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &C);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &H);
+    err |= clSetKernelArg(kernel, 8, sizeof(int), &W);
+    err |= clSetKernelArg(kernel, 9, sizeof(int), &K);
+    err |= clSetKernelArg(kernel, 10, sizeof(int), &KP);
+    CHECK_ERR(err, "clSetKernelArg int8");
+
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+    size_t global_work_size[3] = { (size_t)W_out, (size_t)H_out, (size_t)(B * M) };
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel,
+                                3, NULL, global_work_size, NULL, 0, NULL, NULL);
+    CHECK_ERR(err, "Kernel run int8");
+}
+
+void OpenCLInterface::conv_forward_int8_opencl_epilog(float *host_y, cl_mem device_y,
+    cl_mem device_x, cl_mem device_k, cl_mem device_scale, const int B,
+    const int M, const int H, const int W, const int K)
+{
+    cl_int err;
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+    err = clEnqueueReadBuffer(this->opencl->queue, device_y, CL_TRUE, 0, (size_t)B * M * H_out * W_out * sizeof(float), host_y, 0, NULL, NULL);
+    CHECK_ERR(err, "Reading int8 output");
+}
+
+void OpenCLInterface::conv_forward_half_opencl_prolog(const cl_half *host_x,
+    const cl_half *host_k, cl_mem *device_y, cl_mem *device_x, cl_mem *device_k,
+    const int B, const int M, const int C, const int H, const int W, const int K)
+{
+    cl_int err;
+    size_t size_x = (size_t)B * C * H * W * sizeof(cl_half);
+    *device_x = this->opencl->buffer(OpenCL::kBufferX, size_x);
+    size_t size_k = (size_t)M * C * K * K * sizeof(cl_half);
+    *device_k = this->opencl->buffer(OpenCL::kBufferK, size_k);
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+    size_t size_y = (size_t)B * M * H_out * W_out * sizeof(cl_half);
+    *device_y = this->opencl->buffer(OpenCL::kBufferY, size_y);
+
+    err = clEnqueueWriteBuffer(this->opencl->queue, *device_x, CL_FALSE, 0, size_x, host_x, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for host_x");
+    err = clEnqueueWriteBuffer(this->opencl->queue, *device_k, CL_TRUE, 0, size_k, host_k, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for kernel");
+}
+
+void OpenCLInterface::conv_forward_half_opencl(cl_mem device_y, const cl_mem device_x,
+    const cl_mem device_k, const int B, const int M, const int C, const int H,
+    const int W, const int K)
+{
+    cl_kernel kernel = this->opencl->kernel_half;
+    cl_int err;
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_y);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_x);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_k);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &B);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &C);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &H);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &W);
+    err |= clSetKernelArg(kernel, 8, sizeof(int), &K);
+    CHECK_ERR(err, "clSetKernelArg half");
+
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+    size_t global_work_size[3] = { (size_t)W_out, (size_t)H_out, (size_t)(B * M) };
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel,
+                                3, NULL, global_work_size, NULL, 0, NULL, NULL);
+    CHECK_ERR(err, "Kernel run half");
+}
+
+void OpenCLInterface::conv_forward_half_opencl_epilog(cl_half *host_y, cl_mem device_y,
+    cl_mem device_x, cl_mem device_k, const int B, const int M, const int H,
+    const int W, const int K)
+{
+    cl_int err;
+    int H_out = H - K + 1;
+    int W_out = W - K + 1;
+    err = clEnqueueReadBuffer(this->opencl->queue, device_y, CL_TRUE, 0, (size_t)B * M * H_out * W_out * sizeof(cl_half), host_y, 0, NULL, NULL);
+    CHECK_ERR(err, "Reading half output");
+}
+
+void OpenCLInterface::fc_forward_opencl_prolog(const float *host_w,
+    const float *host_b, cl_mem *device_w, cl_mem *device_b, const int D,
+    const int M)
+{
+    cl_int err;
+    size_t size_w = (size_t)D * M * sizeof(float);
+    *device_w = this->opencl->buffer(OpenCL::kBufferK, size_w);
+    *device_b = this->opencl->buffer(OpenCL::kBufferBias, M * sizeof(float));
+
+    err = clEnqueueWriteBuffer(this->opencl->queue, *device_w, CL_FALSE, 0, size_w, host_w, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for fc weights");
+    err = clEnqueueWriteBuffer(this->opencl->queue, *device_b, CL_FALSE, 0, M * sizeof(float), host_b, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for fc bias");
+}
+
+void OpenCLInterface::fc_forward_opencl(float *host_y, const float *host_x,
+    const cl_mem device_w, const cl_mem device_b, const int N, const int D,
+    const int M, const int relu)
+{
+    cl_int err;
+    size_t size_x = (size_t)N * D * sizeof(float);
+    size_t size_y = (size_t)N * M * sizeof(float);
+    cl_mem device_x = this->opencl->buffer(OpenCL::kBufferX, size_x);
+    cl_mem device_y = this->opencl->buffer(OpenCL::kBufferY, size_y);
+    err = clEnqueueWriteBuffer(this->opencl->queue, device_x, CL_FALSE, 0, size_x, host_x, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for fc input");
+
+    cl_kernel kernel = this->opencl->kernel_fc;
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_y);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_x);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_w);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &device_b);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &D);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &relu);
+    CHECK_ERR(err, "clSetKernelArg fc");
+
+    size_t local_work_size[2] = { TILE_WIDTH, TILE_WIDTH };
+    size_t global_work_size[2] = { (size_t)(M + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH,
+                                   (size_t)(N + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH };
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel,
+                                2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    CHECK_ERR(err, "Kernel run fc");
+
+    err = clEnqueueReadBuffer(this->opencl->queue, device_y, CL_TRUE, 0, size_y, host_y, 0, NULL, NULL);
+    CHECK_ERR(err, "Reading fc output");
+}
+
+void OpenCLInterface::softmax_xent_opencl(float *host_grad, float *host_loss,
+    const float *host_z, const float *host_y, const int N, const int C)
+{
+    cl_int err;
+    size_t size = (size_t)N * C * sizeof(float);
+    cl_mem device_z = this->opencl->buffer(OpenCL::kBufferX, size);
+    cl_mem device_y = this->opencl->buffer(OpenCL::kBufferK, size);
+    cl_mem device_grad = this->opencl->buffer(OpenCL::kBufferY, size);
+    cl_mem device_loss = this->opencl->buffer(OpenCL::kBufferScale, N * sizeof(float));
+    err = clEnqueueWriteBuffer(this->opencl->queue, device_z, CL_FALSE, 0, size, host_z, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for softmax_xent logits");
+    err = clEnqueueWriteBuffer(this->opencl->queue, device_y, CL_FALSE, 0, size, host_y, 0, NULL, NULL);
+    CHECK_ERR(err, "writing for softmax_xent targets");
+
+    cl_kernel kernel = this->opencl->kernel_xent;
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_grad);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_loss);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_z);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &device_y);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &C);
+    CHECK_ERR(err, "clSetKernelArg softmax_xent");
+
+    size_t local_work_size[1] = { TILE_WIDTH * TILE_WIDTH };
+    size_t global_work_size[1] = { (size_t)(N + local_work_size[0] - 1) / local_work_size[0] * local_work_size[0] };
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel,
+                                 1, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    CHECK_ERR(err, "Kernel run softmax_xent");
 
-    clReleaseMemObject(device_y);
-    clReleaseMemObject(device_x);
-    clReleaseMemObject(device_k);
+    err = clEnqueueReadBuffer(this->opencl->queue, device_grad, CL_FALSE, 0, size, host_grad, 0, NULL, NULL);
+    CHECK_ERR(err, "Reading softmax_xent gradient");
+    err = clEnqueueReadBuffer(this->opencl->queue, device_loss, CL_TRUE, 0, N * sizeof(float), host_loss, 0, NULL, NULL);
+    CHECK_ERR(err, "Reading softmax_xent loss");
 }
@@ -12,6 +12,30 @@ class OpenCLInterface
     void conv_forward_opencl_prolog(const float *host_y, const float *host_x, const float *host_k, cl_mem *device_y, cl_mem *device_x, cl_mem *device_k, const int B, const int M, const int C, const int H, const int W, const int K);
     void conv_forward_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K);
     void conv_forward_opencl_epilog(float *host_y, cl_mem device_y, cl_mem device_x, cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K);
+
+    // Quantized convolution: uint8 input, int8 kernel with rows padded to KP
+    // taps and a per-map output scale (see conv_forward_int8_kernel).
+    void conv_forward_int8_opencl_prolog(const unsigned char *host_x, const signed char *host_k, const float *host_scale, cl_mem *device_y, cl_mem *device_x, cl_mem *device_k, cl_mem *device_scale, const int B, const int M, const int C, const int H, const int W, const int K, const int KP);
+    void conv_forward_int8_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_k, const cl_mem device_scale, const int B, const int M, const int C, const int H, const int W, const int K, const int KP);
+    void conv_forward_int8_opencl_epilog(float *host_y, cl_mem device_y, cl_mem device_x, cl_mem device_k, cl_mem device_scale, const int B, const int M, const int H, const int W, const int K);
+
+    // Half-storage convolution: x, k and y hold IEEE half values (see half.h),
+    // laid out like the fp32 buffers; the sum is accumulated in float.
+    void conv_forward_half_opencl_prolog(const cl_half *host_x, const cl_half *host_k, cl_mem *device_y, cl_mem *device_x, cl_mem *device_k, const int B, const int M, const int C, const int H, const int W, const int K);
+    void conv_forward_half_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K);
+    void conv_forward_half_opencl_epilog(cl_half *host_y, cl_mem device_y, cl_mem device_x, cl_mem device_k, const int B, const int M, const int H, const int W, const int K);
+
+    // Fully connected layer: the prolog uploads w (D weights per output, one
+    // output after the other, i.e. FullyConnected::weight as is) and b once;
+    // each fc_forward_opencl call then runs N samples of x (N x D) to y
+    // (N x M), with ReLU when relu is set (see fc_forward_kernel).
+    void fc_forward_opencl_prolog(const float *host_w, const float *host_b, cl_mem *device_w, cl_mem *device_b, const int D, const int M);
+    void fc_forward_opencl(float *host_y, const float *host_x, const cl_mem device_w, const cl_mem device_b, const int N, const int D, const int M, const int relu);
+
+    // Softmax + cross-entropy on N samples of C logits z against targets y
+    // (both N x C): writes the gradient (softmax(z) - y) / N with respect to z
+    // and the loss of each sample (see softmax_xent_kernel).
+    void softmax_xent_opencl(float *host_grad, float *host_loss, const float *host_z, const float *host_y, const int N, const int C);
 };
 
 #endif
@@ -1,8 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iostream>
 
 #include "opencl.h"
 
+#include "cpu.h"
 #include "kernel.h"
 #include "device.h"
 
@@ -13,38 +16,48 @@
         exit(EXIT_FAILURE);                           \
     }
 
-void OpenCL::setup(cl_device_type device_type)
+OpenCL::OpenCL() : fp16(false), half_storage(false), owner(false), native(false)
 {
-    // Load external OpenCL kernel code
-    char *kernel_source = OclLoadKernel(KERNEL_PATH); // Load kernel source
+    for (int i = 0; i < kBufferSlots; i++)
+    {
+        buffers[i] = nullptr;
+        buffer_sizes[i] = 0;
+    }
+}
 
+void OpenCL::setup(cl_device_type device_type)
+{
     cl_int err;
 
-    cl_device_id device_id;    // device ID
-
-    // Find platforms and devices
-    OclPlatformProp *platforms = nullptr;
-    cl_uint num_platforms;
-
-    err = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
-    CHECK_ERR(err, "OclFindPlatforms");
-
     // Get the device subject to the device_type.
-    err = OclGetDeviceWithFallback(&device_id, device_type);
+    if (getenv("OCL_NATIVE"))
+        err = CL_DEVICE_NOT_FOUND;
+    else
+        err = OclGetDeviceWithFallback(&device, device_type);
+    if (err == CL_DEVICE_NOT_FOUND || err == CL_PLATFORM_NOT_FOUND_KHR)
+    {
+        // the convolutions run on the host's cores instead, see cpu.h
+        native = true;
+        owner = true;
+        device = nullptr;
+        context = nullptr;
+        program = nullptr;
+        printf("Running on:\n\tPlatform: none\n\tDevice: %s\n\n", OclCpuDeviceProp()->name);
+        return;
+    }
     CHECK_ERR(err, "OclGetDeviceWithFallback");
 
+    // Load external OpenCL kernel code
+    char *kernel_source = OclLoadKernel(KERNEL_PATH); // Load kernel source
+
+    // Half precision arithmetic is optional; half storage is not
+    const OclDeviceProp *prop = OclGetDeviceProp(device);
+    fp16 = prop && OclDeviceHasExtension(prop, "cl_khr_fp16");
+
     // Create a context
-    context = clCreateContext(0, 1, &device_id, nullptr, nullptr, &err);
+    context = clCreateContext(0, 1, &device, nullptr, nullptr, &err);
     CHECK_ERR(err, "clCreateContext");
 
-    // Create a command queue
-    # if __APPLE__
-        queue = clCreateCommandQueue(context, device_id, 0, &err);
-    #else
-        queue = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
-    #endif
-        CHECK_ERR(err, "clCreateCommandQueueWithProperties");
-        
     // Create the program from the source buffer
     program = clCreateProgramWithSource(context, 1, (const char **)&kernel_source, nullptr, &err);
     CHECK_ERR(err, "clCreateProgramWithSource");
@@ -53,15 +66,85 @@ void OpenCL::setup(cl_device_type device_type)
     err = clBuildProgram(program, 0, nullptr, nullptr, nullptr, nullptr);
     CHECK_ERR(err, "clBuildProgram");
 
+    owner = true;
+    create_queue_and_kernels();
+}
+
+void OpenCL::create_stream(OpenCL* stream) const
+{
+    stream->program = program;
+    stream->context = context;
+    stream->device = device;
+    stream->fp16 = fp16;
+    stream->half_storage = half_storage;
+    stream->owner = false;
+    stream->native = native;
+    if (!native)
+        stream->create_queue_and_kernels();
+}
+
+void OpenCL::create_queue_and_kernels()
+{
+    cl_int err;
+
+    // Create a command queue
+    # if __APPLE__
+        queue = clCreateCommandQueue(context, device, 0, &err);
+    #else
+        queue = clCreateCommandQueueWithProperties(context, device, 0, &err);
+    #endif
+        CHECK_ERR(err, "clCreateCommandQueueWithProperties");
+
     // Create the compute kernel in the program we wish to run
     kernel = clCreateKernel(program, "conv_forward_kernel", &err);
     CHECK_ERR(err, "clCreateKernel");
+
+    kernel_int8 = clCreateKernel(program, "conv_forward_int8_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel int8");
+
+    kernel_half = clCreateKernel(program, "conv_forward_half_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel half");
+
+    kernel_fc = clCreateKernel(program, "fc_forward_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel fc");
+    kernel_xent = clCreateKernel(program, "softmax_xent_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel softmax_xent");
+}
+
+cl_mem OpenCL::buffer(BufferSlot slot, size_t bytes)
+{
+    if (buffers[slot] && buffer_sizes[slot] >= bytes)
+        return buffers[slot];
+    if (buffers[slot])
+        clReleaseMemObject(buffers[slot]);
+
+    cl_int err;
+    buffers[slot] = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, nullptr, &err);
+    CHECK_ERR(err, "clCreateBuffer");
+    buffer_sizes[slot] = bytes;
+    return buffers[slot];
 }
 
 void OpenCL::teardown()
 {
-    clReleaseProgram(this->program);
+    if (this->native)
+        return;
+    for (int i = 0; i < kBufferSlots; i++)
+    {
+        if (this->buffers[i])
+            clReleaseMemObject(this->buffers[i]);
+        this->buffers[i] = nullptr;
+        this->buffer_sizes[i] = 0;
+    }
     clReleaseKernel(this->kernel);
+    clReleaseKernel(this->kernel_int8);
+    clReleaseKernel(this->kernel_half);
+    clReleaseKernel(this->kernel_fc);
+    clReleaseKernel(this->kernel_xent);
     clReleaseCommandQueue(this->queue);
-    clReleaseContext(this->context);
+    if (this->owner)
+    {
+        clReleaseProgram(this->program);
+        clReleaseContext(this->context);
+    }
 }
\ No newline at end of file
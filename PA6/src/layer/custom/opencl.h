@@ -11,11 +11,45 @@ class OpenCL
     public:
         cl_program program;        // program
         cl_kernel kernel;          // kernel
+        cl_kernel kernel_int8;     // quantized convolution kernel
+        cl_kernel kernel_half;     // half-storage convolution kernel
+        cl_kernel kernel_fc;       // fully connected layer kernel
+        cl_kernel kernel_xent;     // fused softmax + cross-entropy kernel
         cl_command_queue queue;    // command queue
         cl_context context;        // context
+        cl_device_id device;       // device
 
+        bool fp16;                 // device reports cl_khr_fp16
+        bool half_storage;         // Conv_Custom keeps x, k and y as half
+        bool owner;                // teardown releases context and program
+        bool native;               // no OpenCL device: Conv_Custom runs on
+                                   // the CPU (cpu.h), nothing else is set up
+
+        // Device memory of this stream. Every device tensor of a layer is
+        // dead once its epilog has read the output back, so all layers share
+        // one buffer per role, grown to the largest request and kept until
+        // teardown; steady-state inference creates no device buffers.
+        enum BufferSlot { kBufferX, kBufferK, kBufferY, kBufferScale,
+                          kBufferBias, kBufferSlots };
+
+        OpenCL();
+
+        // Without an OpenCL platform or device, or with $OCL_NATIVE set,
+        // sets up the native backend instead
         void setup(cl_device_type device_type);
+        // Makes stream share this context and program with a command queue
+        // and kernel objects of its own, so threads that each use their own
+        // stream never race on clSetKernelArg or serialize on one queue.
+        void create_stream(OpenCL* stream) const;
+        // The slot's buffer, with room for at least bytes
+        cl_mem buffer(BufferSlot slot, size_t bytes);
         void teardown();
+
+    private:
+        cl_mem buffers[kBufferSlots];
+        size_t buffer_sizes[kBufferSlots];
+
+        void create_queue_and_kernels();
 };
 
 #endif
\ No newline at end of file
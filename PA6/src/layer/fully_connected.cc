@@ -1,20 +1,121 @@
 #include "./fully_connected.h"
+#include "../thread_pool.h"
+#include "./custom/opencl-new-forward.h"
+
+static const int kFcBlock = 64;  // samples per GEMM on the CPU paths
+// bytes of input per fc_forward_kernel launch, so a large batch does not
+// need one device buffer the size of the whole input
+static const size_t kFcDeviceBytes = 256 << 20;
 
 void FullyConnected::init() {
-  weight.resize(dim_in, dim_out);
-  bias.resize(dim_out);
-  grad_weight.resize(dim_in, dim_out);
-  grad_bias.resize(dim_out);
+  const int n_param = (dim_in + 1) * dim_out;
+  storage.setZero(2 * n_param);
+  place_weight_bias(storage.data(), storage.data() + n_param, dim_in, dim_out,
+                    weight, bias, grad_weight, grad_bias);
   set_normal_random(weight.data(), weight.size(), 0, 0.01);
   set_normal_random(bias.data(), bias.size(), 0, 0.01);
 }
 
 void FullyConnected::forward(const Matrix& bottom) {
-  // z = w' * x + b
+  ExecutionContext ctx(&ThreadPool::global());
+  top.resize(dim_out, bottom.cols());
+  infer(bottom, top, ctx);
+}
+
+// z = w' * x + b, followed by the fused activation if any. Quantized
+// weights take the int8 path; otherwise a layer of the OpenCL network runs
+// on the device, and a pruned one (sparsify) on its CSR weights.
+void FullyConnected::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                           ExecutionContext& ctx) const {
+  if (is_quantized())
+    forward_int8(bottom, top, ctx);
+  else if (opencl)
+    forward_opencl(bottom, top, ctx);
+  else if (!sparse.empty())
+    forward_sparse(bottom, top, ctx);
+  else
+    forward_dense(bottom, top, ctx);
+}
+
+void FullyConnected::bias_activate(MatrixRef top, int first, int n) const {
+  const float* b = bias.data();
+  for (int i = first; i < first + n; i ++) {
+    float* z = top.col(i).data();
+    for (int m = 0; m < dim_out; m ++) {
+      z[m] = activate(z[m] + b[m], activation);
+    }
+  }
+}
+
+// Blocks of kFcBlock samples run in parallel. Each is one GEMM (Eigen's
+// packed, vectorized kernel) whose output, still in cache, gets the bias and
+// activation in the same pass, rather than separate sweeps for the bias and
+// a ReLU layer.
+void FullyConnected::forward_dense(const ConstMatrixRef& bottom, MatrixRef top,
+                                   ExecutionContext& ctx) const {
+  const int n_sample = bottom.cols();
+  ctx.parallel_for((n_sample + kFcBlock - 1) / kFcBlock, [&](int k, int tid) {
+    int first = k * kFcBlock;
+    int n = std::min(kFcBlock, n_sample - first);
+    top.middleCols(first, n).noalias() =
+        weight.transpose() * bottom.middleCols(first, n);
+    bias_activate(top, first, n);
+  });
+}
+
+void FullyConnected::forward_sparse(const ConstMatrixRef& bottom,
+                                    MatrixRef top,
+                                    ExecutionContext& ctx) const {
   const int n_sample = bottom.cols();
-  top.resize(dim_out, n_sample);
-  top = weight.transpose() * bottom;
-  top.colwise() += bias;
+  ctx.parallel_for((n_sample + kFcBlock - 1) / kFcBlock, [&](int k, int tid) {
+    int first = k * kFcBlock;
+    int n = std::min(kFcBlock, n_sample - first);
+    float* scratch = reinterpret_cast<float*>(
+        ctx.scratch(tid, (size_t)dim_in * CsrWeights::kBlock * sizeof(float)));
+    sparse.multiply(bottom, first, n, top, scratch);
+    bias_activate(top, first, n);
+  });
+}
+
+// Weights and bias are uploaded once, then the batch goes through in chunks
+// of at most kFcDeviceBytes of input.
+void FullyConnected::forward_opencl(const ConstMatrixRef& bottom,
+                                    MatrixRef top,
+                                    ExecutionContext& ctx) const {
+  OpenCLInterface openclInterface;
+  openclInterface.opencl = ctx.opencl ? ctx.opencl : opencl;
+  const int n_sample = bottom.cols();
+  const int chunk = std::max<int>(1, kFcDeviceBytes / (dim_in * sizeof(float)));
+  cl_mem w_d, b_d;
+  openclInterface.fc_forward_opencl_prolog(weight.data(), bias.data(), &w_d, &b_d, dim_in, dim_out);
+  for (int first = 0; first < n_sample; first += chunk) {
+    int n = std::min(chunk, n_sample - first);
+    openclInterface.fc_forward_opencl(top.col(first).data(), bottom.col(first).data(), w_d, b_d, n, dim_in, dim_out, activation == kActivationReLU);
+  }
+}
+
+// z = w' * x + b with quantized x and w, accumulated in int32. Samples are
+// processed in blocks so each thread quantizes into its own scratch row.
+void FullyConnected::forward_int8(const ConstMatrixRef& bottom, MatrixRef top,
+                                  ExecutionContext& ctx) const {
+  const int n_sample = bottom.cols();
+  const int row = int8_padded(dim_in);
+  const int block = 64;
+  int n_block = (n_sample + block - 1) / block;
+  ctx.parallel_for(n_block, [&](int k, int tid) {
+    char* scratch = ctx.scratch(tid, row * sizeof(short) + dim_out * sizeof(int));
+    short* x = reinterpret_cast<short*>(scratch);
+    int* acc = reinterpret_cast<int*>(x + row);
+    std::fill(x + dim_in, x + row, 0);
+    int end = std::min(n_sample, (k + 1) * block);
+    for (int i = k * block; i < end; i ++) {
+      quantize_input(bottom.col(i).data(), dim_in, quantized.input_scale, x);
+      dot_rows_int16(x, weight_int8.data(), row, row, dim_out, acc);
+      for (int m = 0; m < dim_out; m ++) {
+        top(m, i) = activate(acc[m] * scale_int8[m] + bias(m), activation);
+      }
+    }
+  });
 }
 
 void FullyConnected::backward(const Matrix& bottom, const Matrix& grad_top) {
@@ -28,15 +129,9 @@ void FullyConnected::backward(const Matrix& bottom, const Matrix& grad_top) {
   grad_bottom = weight * grad_top;
 }
 
-void FullyConnected::update(Optimizer& opt) {
-  Vector::AlignedMapType weight_vec(weight.data(), weight.size());
-  Vector::AlignedMapType bias_vec(bias.data(), bias.size());
-  Vector::ConstAlignedMapType grad_weight_vec(grad_weight.data(),
-                                              grad_weight.size());
-  Vector::ConstAlignedMapType grad_bias_vec(grad_bias.data(), grad_bias.size());
-
-  opt.update(weight_vec, grad_weight_vec);
-  opt.update(bias_vec, grad_bias_vec);
+void FullyConnected::bind_parameters(float* param, float* grad) {
+  bind_weight_bias(param, grad, weight, bias, grad_weight, grad_bias);
+  Vector().swap(storage);
 }
 
 std::vector<float> FullyConnected::get_parameters() const {
@@ -49,10 +144,40 @@ std::vector<float> FullyConnected::get_parameters() const {
 }
 
 void FullyConnected::set_parameters(const std::vector<float>& param) {
-  if (static_cast<int>(param.size()) != weight.size() + bias.size())
+  set_parameters(param.data(), param.size());
+}
+
+void FullyConnected::set_parameters(const float* param, int size) {
+  if (size != weight.size() + bias.size())
       throw std::invalid_argument("Parameter size does not match");
-  std::copy(param.begin(), param.begin() + weight.size(), weight.data());
-  std::copy(param.begin() + weight.size(), param.end(), bias.data());
+  std::copy(param, param + weight.size(), weight.data());
+  std::copy(param + weight.size(), param + size, bias.data());
+  clear_int8();
+  if (!sparse.empty())
+    sparse.build(weight);
+}
+
+// The sparse copy is for inference only; training updates the dense weights.
+void FullyConnected::set_training(bool training) {
+  Layer::set_training(training);
+  if (training)
+    sparse.clear();
+}
+
+bool FullyConnected::sparsify(float max_density) {
+  if (density(weight) > max_density) {
+    sparse.clear();
+    return false;
+  }
+  sparse.build(weight);
+  return true;
+}
+
+void FullyConnected::set_derivatives(const std::vector<float>& deriv) {
+  if (static_cast<int>(deriv.size()) != grad_weight.size() + grad_bias.size())
+      throw std::invalid_argument("Derivative size does not match");
+  std::copy(deriv.begin(), deriv.begin() + grad_weight.size(), grad_weight.data());
+  std::copy(deriv.begin() + grad_weight.size(), deriv.end(), grad_bias.data());
 }
 
 std::vector<float> FullyConnected::get_derivatives() const {
@@ -64,3 +189,35 @@ std::vector<float> FullyConnected::get_derivatives() const {
             res.begin() + grad_weight.size());
   return res;
 }
+
+bool FullyConnected::quantize(float input_min, float input_max) {
+  if (input_min < 0)
+    return false;  // inputs are quantized as uint8
+  quantized.quantize(weight, input_max);
+  prepare_int8();
+  return true;
+}
+
+void FullyConnected::prepare_int8() {
+  std::vector<signed char> packed = quantized.pack(dim_in, int8_padded(dim_in));
+  weight_int8.assign(packed.begin(), packed.end());
+  scale_int8 = quantized.output_scale();
+}
+
+void FullyConnected::clear_int8() {
+  quantized = QuantizedWeights();
+  std::vector<short>().swap(weight_int8);
+  std::vector<float>().swap(scale_int8);
+}
+
+void FullyConnected::get_quantized_parameters(std::vector<signed char>& q,
+                                              std::vector<float>& param) const {
+  q = quantized.q;
+  param = quantized.get_parameters(bias);
+}
+
+void FullyConnected::set_quantized_parameters(const signed char* q, int q_size,
+                                              const float* param, int size) {
+  quantized.set_parameters(dim_in, dim_out, q, q_size, param, size, bias);
+  prepare_int8();
+}
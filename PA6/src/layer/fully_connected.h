@@ -3,31 +3,74 @@
 
 #include <vector>
 #include "../layer.h"
+#include "./quantize.h"
+#include "./sparse.h"
+#include "./custom/opencl.h"
 
 class FullyConnected : public Layer {
  private:
   const int dim_in;
   const int dim_out;
 
-  Matrix weight;  // weight parameter
-  Vector bias;  // bias paramter
-  Matrix grad_weight;  // gradient w.r.t weight
-  Vector grad_bias;  // gradient w.r.t bias
+  MatrixView weight;  // weight parameter
+  VectorView bias;  // bias paramter
+  MatrixView grad_weight;  // gradient w.r.t weight
+  VectorView grad_bias;  // gradient w.r.t bias
+  Vector storage;  // holds the four until bind_parameters
+
+  QuantizedWeights quantized;  // empty unless quantize() was called
+  std::vector<short> weight_int8;  // widened, one padded row per output
+  std::vector<float> scale_int8;  // int32 sum -> float, per output
+
+  CsrWeights sparse;  // empty unless sparsify() found a pruned model
+  Activation activation;  // applied together with the bias (fused ReLU)
 
   void init();
+  void prepare_int8();
+  void clear_int8();  // set_parameters drops the int8 copy of old weights
+  // top(:, first..first+n) += bias, then activation, in one pass
+  void bias_activate(MatrixRef top, int first, int n) const;
+  // the four inference paths, see infer()
+  void forward_dense(const ConstMatrixRef& bottom, MatrixRef top,
+                     ExecutionContext& ctx) const;
+  void forward_sparse(const ConstMatrixRef& bottom, MatrixRef top,
+                      ExecutionContext& ctx) const;
+  void forward_opencl(const ConstMatrixRef& bottom, MatrixRef top,
+                      ExecutionContext& ctx) const;
+  void forward_int8(const ConstMatrixRef& bottom, MatrixRef top,
+                    ExecutionContext& ctx) const;
 
  public:
+  OpenCL* opencl;  // when set, fp32 inference runs fc_forward_kernel on it
+
   FullyConnected(const int dim_in, const int dim_out) :
-                 dim_in(dim_in), dim_out(dim_out)
+                 dim_in(dim_in), dim_out(dim_out),
+                 weight(NULL, 0, 0), bias(NULL, 0), grad_weight(NULL, 0, 0),
+                 grad_bias(NULL, 0),
+                 activation(kActivationNone), opencl(0)
   { init(); }
 
   void forward(const Matrix& bottom);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
-  void update(Optimizer& opt);
   int output_dim() { return dim_out; }
+  void set_training(bool training);
+  bool fuse_activation(Activation a) { activation = a; return true; }
+  bool sparsify(float max_density);
   std::vector<float> get_parameters() const;
   std::vector<float> get_derivatives() const;
+  void set_derivatives(const std::vector<float>& deriv);
+  int parameter_size() const { return weight.size() + bias.size(); }
+  void bind_parameters(float* param, float* grad);
   void set_parameters(const std::vector<float>& param);
+  void set_parameters(const float* param, int size);
+  bool quantize(float input_min, float input_max);
+  bool is_quantized() const { return !quantized.empty(); }
+  void get_quantized_parameters(std::vector<signed char>& q,
+                                std::vector<float>& param) const;
+  void set_quantized_parameters(const signed char* q, int q_size,
+                                const float* param, int size);
 };
 
 #endif  // SRC_LAYER_FULLY_CONNECTED_H_
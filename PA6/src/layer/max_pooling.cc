@@ -1,7 +1,9 @@
 #include "./max_pooling.h"
 #include <math.h>
+#include <algorithm>
 #include <limits>
 #include <iostream>
+#include "../thread_pool.h"
 
 void MaxPooling::init() {
   channel_out = channel_in;
@@ -11,36 +13,66 @@ void MaxPooling::init() {
 }
 
 void MaxPooling::forward(const Matrix& bottom) {
+  ExecutionContext ctx(&ThreadPool::global());
+  top.resize(dim_out, bottom.cols());
+  if (!training) {
+    pool(bottom, top, NULL, ctx);
+    return;
+  }
+  if (static_cast<int>(max_idxs.size()) != bottom.cols())
+    max_idxs.resize(bottom.cols(), std::vector<int>(dim_out, 0));
+  pool(bottom, top, &max_idxs, ctx);
+}
+
+void MaxPooling::set_training(bool training) {
+  Layer::set_training(training);
+  if (!training)
+    std::vector<std::vector<int> >().swap(max_idxs);  // free, not just clear
+}
+
+// Inference does not need the arg-max indices, only backward does.
+void MaxPooling::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                       ExecutionContext& ctx) const {
+  pool(bottom, top, NULL, ctx);
+}
+
+void MaxPooling::pool(const ConstMatrixRef& bottom, MatrixRef top,
+                      std::vector<std::vector<int> >* idxs,
+                      ExecutionContext& ctx) const {
   int n_sample = bottom.cols();
   int hw_in = height_in * width_in;
-  int hw_pool = height_pool * width_pool;
   int hw_out = height_out * width_out;
-  top.resize(dim_out, n_sample);
-  top.setZero(); top.array() += std::numeric_limits<float>::lowest();
-  max_idxs.resize(n_sample, std::vector<int>(dim_out, 0));
-  for (int i = 0; i < n_sample; i ++) {
-    Vector image = bottom.col(i);
-    for (int c = 0; c < channel_in; c ++) {
-      for (int i_out = 0; i_out < hw_out; i_out ++) {
-        int step_h = i_out / width_out;
-        int step_w = i_out % width_out;
-        // left-top idx of window in raw image
-        int start_idx = step_h * width_in * stride + step_w * stride;
-        for (int i_pool = 0; i_pool < hw_pool; i_pool ++) {
-          if (start_idx % width_in + i_pool % width_pool >= width_in ||
-              start_idx / width_in + i_pool / width_pool >= height_in) {
-            continue;  // out of range
-          }
-          int pick_idx = start_idx + (i_pool / width_pool) * width_in
-                         + i_pool % width_pool + c * hw_in;
-          if (image(pick_idx) >= top(c * hw_out + i_out, i)) {  // max pooling
-            top(c * hw_out + i_out, i) = image(pick_idx);
-            max_idxs[i][c * hw_out + i_out] = pick_idx;
+  // one task per (sample, channel) plane, walked with strided loops
+  ctx.parallel_for(n_sample * channel_in, [&](int task, int tid) {
+    int i = task / channel_in;
+    int c = task % channel_in;
+    const float* image = bottom.col(i).data() + c * hw_in;  // c-th channel map
+    float* out = top.col(i).data() + c * hw_out;
+    int* idx = idxs ? (*idxs)[i].data() + c * hw_out : NULL;
+    for (int h = 0; h < height_out; h ++) {
+      // windows hanging off the bottom/right edge are clipped
+      int h_start = h * stride;
+      int h_end = std::min(h_start + height_pool, height_in);
+      for (int w = 0; w < width_out; w ++) {
+        int w_start = w * stride;
+        int w_end = std::min(w_start + width_pool, width_in);
+        float max_val = std::numeric_limits<float>::lowest();
+        int max_idx = 0;
+        for (int r = h_start; r < h_end; r ++) {
+          const float* row = image + r * width_in;
+          for (int s = w_start; s < w_end; s ++) {
+            if (row[s] >= max_val) {  // max pooling
+              max_val = row[s];
+              max_idx = c * hw_in + r * width_in + s;
+            }
           }
         }
+        out[h * width_out + w] = max_val;
+        if (idx)
+          idx[h * width_out + w] = max_idx;
       }
     }
-  }
+  });
 }
 
 void MaxPooling::backward(const Matrix& bottom, const Matrix& grad_top) {
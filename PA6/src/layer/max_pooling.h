@@ -23,6 +23,9 @@ class MaxPooling : public Layer {
   std::vector<std::vector<int> > max_idxs;  // index of max values
 
   void init();
+  // idx (may be NULL) receives the input index of every maximum
+  void pool(const ConstMatrixRef& bottom, MatrixRef top,
+            std::vector<std::vector<int> >* idx, ExecutionContext& ctx) const;
 
  public:
   MaxPooling(int channel_in, int height_in, int width_in,
@@ -33,6 +36,9 @@ class MaxPooling : public Layer {
   { init(); }
 
   void forward(const Matrix& bottom);
+  void set_training(bool training);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
   int output_dim() { return dim_out; }
 };
@@ -0,0 +1,91 @@
+#include "./quantize.h"
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+void QuantizedWeights::quantize(const ConstMatrixRef& weight, float input_max) {
+  fan_in = weight.rows();
+  channel_out = weight.cols();
+  // an all-zero input range would give a zero scale; any positive value works
+  input_scale = input_max > 0 ? input_max / 255.0f : 1.0f;
+  scale.resize(channel_out);
+  q.resize(weight.size());
+  for (int m = 0; m < channel_out; m ++) {
+    float max_abs = weight.col(m).cwiseAbs().maxCoeff();
+    scale[m] = max_abs > 0 ? max_abs / 127.0f : 1.0f;
+    for (int k = 0; k < fan_in; k ++) {
+      float v = roundf(weight(k, m) / scale[m]);
+      q[m * fan_in + k] = static_cast<signed char>(
+          std::max(-127.0f, std::min(127.0f, v)));
+    }
+  }
+}
+
+std::vector<float> QuantizedWeights::get_parameters(const ConstVectorRef& bias) const {
+  std::vector<float> res(1 + 2 * channel_out);
+  res[0] = input_scale;
+  std::copy(scale.begin(), scale.end(), res.begin() + 1);
+  std::copy(bias.data(), bias.data() + channel_out,
+            res.begin() + 1 + channel_out);
+  return res;
+}
+
+void QuantizedWeights::set_parameters(int fan_in_in, int channel_out_in,
+                                      const signed char* q_in, int q_size,
+                                      const float* param, int size,
+                                      VectorRef bias) {
+  if (q_size != fan_in_in * channel_out_in || size != 1 + 2 * channel_out_in)
+    throw std::invalid_argument("Quantized parameter size does not match");
+  fan_in = fan_in_in;
+  channel_out = channel_out_in;
+  input_scale = param[0];
+  scale.assign(param + 1, param + 1 + channel_out);
+  std::copy(param + 1 + channel_out, param + size, bias.data());
+  q.assign(q_in, q_in + q_size);
+}
+
+std::vector<signed char> QuantizedWeights::pack(int group, int group_pad,
+                                                int row_pad) const {
+  int n_group = fan_in / group;
+  int row = std::max(n_group * group_pad, row_pad);
+  std::vector<signed char> res(static_cast<size_t>(row) * channel_out, 0);
+  for (int m = 0; m < channel_out; m ++) {
+    for (int g = 0; g < n_group; g ++) {
+      std::copy(q.begin() + m * fan_in + g * group,
+                q.begin() + m * fan_in + (g + 1) * group,
+                res.begin() + m * row + g * group_pad);
+    }
+  }
+  return res;
+}
+
+std::vector<float> QuantizedWeights::output_scale() const {
+  std::vector<float> res(channel_out);
+  for (int m = 0; m < channel_out; m ++) {
+    res[m] = input_scale * scale[m];
+  }
+  return res;
+}
+
+template <typename T>
+static void quantize_input_to(const float* x, int n, float input_scale,
+                              T* xq) {
+  const float inv = 1.0f / input_scale;
+  for (int i = 0; i < n; i ++) {
+    float v = x[i] * inv + 0.5f;
+    xq[i] = static_cast<T>(static_cast<int>(std::max(0.0f, std::min(255.0f, v))));
+  }
+}
+
+void quantize_input(const float* x, int n, float input_scale,
+                    unsigned char* xq) {
+  quantize_input_to(x, n, input_scale, xq);
+}
+
+void quantize_input(const float* x, int n, float input_scale, short* xq) {
+  quantize_input_to(x, n, input_scale, xq);
+}
+
+void quantize_input(const float* x, int n, float input_scale, float* xq) {
+  quantize_input_to(x, n, input_scale, xq);
+}
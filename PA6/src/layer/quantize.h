@@ -0,0 +1,99 @@
+#ifndef SRC_LAYER_QUANTIZE_H_
+#define SRC_LAYER_QUANTIZE_H_
+
+#include <vector>
+#include "../utils.h"
+
+// Post-training int8 quantization shared by Conv, Conv_Custom and
+// FullyConnected. Weights are symmetric int8 with one scale per output
+// channel. The inputs of these layers are non-negative (pixels, or ReLU and
+// pooling outputs), so they are quantized to uint8 with a single scale
+// calibrated from the largest input seen. Products are accumulated in int32
+// and dequantized once per output.
+class QuantizedWeights {
+ public:
+  int fan_in;
+  int channel_out;
+  float input_scale;  // real value of one uint8 input step
+  std::vector<float> scale;  // weight scale per output channel
+  std::vector<signed char> q;  // fan_in x channel_out, column-major like weight
+
+  QuantizedWeights() : fan_in(0), channel_out(0), input_scale(0) {}
+  bool empty() const { return q.empty(); }
+
+  void quantize(const ConstMatrixRef& weight, float input_max);
+  // The float tensor stored next to q in a weight file:
+  // [input_scale, scale[channel_out], bias[channel_out]]
+  std::vector<float> get_parameters(const ConstVectorRef& bias) const;
+  // Inverse of get_parameters; also restores bias. Throws
+  // std::invalid_argument if the sizes do not fit fan_in x channel_out.
+  void set_parameters(int fan_in, int channel_out, const signed char* q_in,
+                      int q_size, const float* param, int size, VectorRef bias);
+  // q transposed to one row per output channel, with every run of `group`
+  // inputs zero-padded to group_pad so rows can be read in whole vectors,
+  // and each row then padded to row_pad (0 = no extra padding).
+  std::vector<signed char> pack(int group, int group_pad,
+                                int row_pad = 0) const;
+  // input_scale * scale[m], the factor turning an int32 sum into a float
+  std::vector<float> output_scale() const;
+};
+
+// Inner products are taken over blocks of this many values, so rows are
+// padded to a multiple of it.
+static const int kInt8Block = 16;
+
+inline int int8_padded(int n) {
+  return (n + kInt8Block - 1) / kInt8Block * kInt8Block;
+}
+
+// x[i] -> round(x[i] / input_scale) saturated to [0, 255]. The int16 version
+// feeds the CPU kernels below, the uint8 one the OpenCL kernel and the float
+// one the native backend.
+void quantize_input(const float* x, int n, float input_scale,
+                    unsigned char* xq);
+void quantize_input(const float* x, int n, float input_scale, short* xq);
+void quantize_input(const float* x, int n, float input_scale, float* xq);
+
+// CPU inner products. The operands are int8/uint8 values widened to int16:
+// summed in fixed blocks of kInt8Block the compiler turns this into packed
+// 16-bit multiply-adds (e.g. pmaddwd) even at -O2, which it does not do for
+// mixed 8-bit operands. n must be a multiple of kInt8Block.
+inline int dot_int16(const short* x, const short* w, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i += kInt8Block) {
+    for (int j = 0; j < kInt8Block; j++) {
+      acc += x[i + j] * w[i + j];
+    }
+  }
+  return acc;
+}
+
+// x against four weight rows ld apart, sharing the loads of x.
+inline void dot4_int16(const short* x, const short* w, int ld, int n,
+                       int* acc) {
+  int a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+  for (int i = 0; i < n; i += kInt8Block) {
+    for (int j = 0; j < kInt8Block; j++) a0 += x[i + j] * w[i + j];
+    for (int j = 0; j < kInt8Block; j++) a1 += x[i + j] * w[ld + i + j];
+    for (int j = 0; j < kInt8Block; j++) a2 += x[i + j] * w[2 * ld + i + j];
+    for (int j = 0; j < kInt8Block; j++) a3 += x[i + j] * w[3 * ld + i + j];
+  }
+  acc[0] = a0;
+  acc[1] = a1;
+  acc[2] = a2;
+  acc[3] = a3;
+}
+
+// acc[m] = dot of x with row m of w (rows ld apart) for m < n_row.
+inline void dot_rows_int16(const short* x, const short* w, int ld, int n,
+                           int n_row, int* acc) {
+  int m = 0;
+  for (; m + 4 <= n_row; m += 4) {
+    dot4_int16(x, w + (size_t)m * ld, ld, n, acc + m);
+  }
+  for (; m < n_row; m ++) {
+    acc[m] = dot_int16(x, w + (size_t)m * ld, n);
+  }
+}
+
+#endif  // SRC_LAYER_QUANTIZE_H_
@@ -5,6 +5,11 @@ void ReLU::forward(const Matrix& bottom) {
   top = bottom.cwiseMax(0.0);
 }
 
+void ReLU::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                 ExecutionContext& ctx) const {
+  top = bottom.cwiseMax(0.0);
+}
+
 void ReLU::backward(const Matrix& bottom, const Matrix& grad_top) {
   // d(L)/d(z_i) = d(L)/d(a_i) * d(a_i)/d(z_i)
   //             = d(L)/d(a_i) * 1*(z_i>0)
@@ -6,7 +6,10 @@
 class ReLU : public Layer {
  public:
   void forward(const Matrix& bottom);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
+  Activation as_activation() const { return kActivationReLU; }
 };
 
 #endif  // SRC_LAYER_RELU_H_
@@ -5,6 +5,11 @@ void Sigmoid::forward(const Matrix& bottom) {
   top.array() = 1.0 / (1.0 + (-bottom).array().exp());
 }
 
+void Sigmoid::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                    ExecutionContext& ctx) const {
+  top.array() = 1.0 / (1.0 + (-bottom).array().exp());
+}
+
 void Sigmoid::backward(const Matrix& bottom, const Matrix& grad_top) {
   // d(L)/d(z_i) = d(L)/d(a_i) * d(a_i)/d(z_i)
   // d(a_i)/d(z_i) = a_i * (1-a_i)
@@ -6,6 +6,8 @@
 class Sigmoid : public Layer {
  public:
   void forward(const Matrix& bottom);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
 };
 
@@ -1,10 +1,20 @@
 #include "./softmax.h"
 
 void Softmax::forward(const Matrix& bottom) {
-  // a = exp(z) / \sum{ exp(z) }
-  top.array() = (bottom.rowwise() - bottom.colwise().maxCoeff()).array().exp();
-  RowVector z_exp_sum = top.colwise().sum();  // \sum{ exp(z) }
-  top.array().rowwise() /= z_exp_sum;
+  ExecutionContext ctx;
+  top.resize(bottom.rows(), bottom.cols());
+  infer(bottom, top, ctx);
+}
+
+void Softmax::infer(const ConstMatrixRef& bottom, MatrixRef top,
+                    ExecutionContext& ctx) const {
+  // a = exp(z) / \sum{ exp(z) }, a sample at a time so that no temporary
+  // row of sums is needed: one pass for the statistics, one to write
+  for (int i = 0; i < bottom.cols(); i ++) {
+    float z_max, sum;
+    online_softmax(bottom.col(i).data(), bottom.rows(), z_max, sum);
+    top.col(i).array() = (bottom.col(i).array() - z_max).exp() * (1 / sum);
+  }
 }
 
 void Softmax::backward(const Matrix& bottom, const Matrix& grad_top) {
@@ -1,12 +1,32 @@
 #ifndef SRC_LAYER_SOFTMAX_H_
 #define SRC_LAYER_SOFTMAX_H_
 
+#include <cmath>
 #include "../layer.h"
 
+// Online softmax statistics of z[0..n): one pass keeps the running maximum
+// z_max and rescales the running sum of exp(z - z_max) whenever the maximum
+// moves, so softmax(z) = exp(z - z_max) / sum is left as a single write pass
+// and log(sum) + z_max is the log-partition, with nothing ever overflowing.
+inline void online_softmax(const float* z, int n, float& z_max, float& sum) {
+  z_max = -INFINITY;
+  sum = 0;
+  for (int i = 0; i < n; i ++) {
+    if (z[i] > z_max) {
+      sum *= std::exp(z_max - z[i]);
+      z_max = z[i];
+    }
+    sum += std::exp(z[i] - z_max);
+  }
+}
+
 class Softmax: public Layer {
  public:
   void forward(const Matrix& bottom);
+  void infer(const ConstMatrixRef& bottom, MatrixRef top,
+             ExecutionContext& ctx) const;
   void backward(const Matrix& bottom, const Matrix& grad_top);
+  bool is_softmax() const { return true; }
 };
 
 #endif  // SRC_LAYER_SOFTMAX_H_
@@ -0,0 +1,62 @@
+#include "./sparse.h"
+#include <algorithm>
+
+void CsrWeights::clear() {
+  n_col = 0;
+  std::vector<int>().swap(row_start);
+  std::vector<int>().swap(col);
+  std::vector<float>().swap(val);
+}
+
+void CsrWeights::build(const ConstMatrixRef& weight) {
+  const int n_row = weight.cols();
+  n_col = weight.rows();
+  row_start.assign(1, 0);
+  col.clear();
+  val.clear();
+  for (int r = 0; r < n_row; r++) {
+    const float* w = weight.col(r).data();
+    for (int c = 0; c < n_col; c++) {
+      if (w[c] != 0) {
+        col.push_back(c);
+        val.push_back(w[c]);
+      }
+    }
+    row_start.push_back(col.size());
+  }
+}
+
+void CsrWeights::multiply(const ConstMatrixRef& x, int first, int n,
+                          MatrixRef y, float* scratch) const {
+  const int n_row = rows();
+  float acc[kBlock];
+  for (int s0 = first; s0 < first + n; s0 += kBlock) {
+    const int b = std::min(kBlock, first + n - s0);
+    // scratch[c * kBlock + j] = x(c, s0 + j), zero for missing samples
+    for (int j = 0; j < kBlock; j ++) {
+      const float* xs = j < b ? x.col(s0 + j).data() : NULL;
+      for (int c = 0; c < n_col; c ++) {
+        scratch[c * kBlock + j] = xs ? xs[c] : 0.0f;
+      }
+    }
+    for (int r = 0; r < n_row; r ++) {
+      std::fill(acc, acc + kBlock, 0.0f);
+      for (int e = row_start[r]; e < row_start[r + 1]; e ++) {
+        const float v = val[e];
+        const float* xc = scratch + col[e] * kBlock;
+        for (int j = 0; j < kBlock; j ++) {
+          acc[j] += v * xc[j];
+        }
+      }
+      for (int j = 0; j < b; j ++) {
+        y(r, s0 + j) = acc[j];
+      }
+    }
+  }
+}
+
+float density(const ConstMatrixRef& m) {
+  if (m.size() == 0)
+    return 0;
+  return float((m.array() != 0).count()) / m.size();
+}
@@ -0,0 +1,38 @@
+#ifndef SRC_LAYER_SPARSE_H_
+#define SRC_LAYER_SPARSE_H_
+
+#include <vector>
+#include "../utils.h"
+
+// Compressed sparse row copy of a pruned weight matrix for inference. Row r
+// holds the non-zero weights of output r: values val[row_start[r] ..
+// row_start[r+1]) at input indices col[...]. With most weights zero, a
+// sparse x dense product reads only the surviving weights.
+class CsrWeights {
+ public:
+  int n_col;
+  std::vector<int> row_start;  // n_row + 1 entries
+  std::vector<int> col;
+  std::vector<float> val;
+
+  CsrWeights() : n_col(0) {}
+  bool empty() const { return row_start.empty(); }
+  int rows() const { return row_start.empty() ? 0 : row_start.size() - 1; }
+  void clear();
+
+  // Keeps the non-zero entries of weight, whose column r is output r (the
+  // FullyConnected layout), so row r here is column r there.
+  void build(const ConstMatrixRef& weight);
+  // y(r, s) = dot(row r, x.col(s)) for the samples s in [first, first + n).
+  // Samples are taken kBlock at a time and interleaved into scratch (room
+  // for n_col * kBlock floats), so each weight is read once per block and
+  // multiplies kBlock contiguous inputs, which vectorizes.
+  static const int kBlock = 8;
+  void multiply(const ConstMatrixRef& x, int first, int n, MatrixRef y,
+                float* scratch) const;
+};
+
+// Fraction of entries of m that are not zero
+float density(const ConstMatrixRef& m);
+
+#endif  // SRC_LAYER_SPARSE_H_
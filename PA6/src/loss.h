@@ -12,6 +12,10 @@ class Loss {
   virtual ~Loss() {}
 
   virtual void evaluate(const Matrix& pred, const Matrix& target) = 0;
+  // A loss that takes logits evaluates on the input of a trailing Softmax
+  // layer and applies the softmax itself, so back_gradient() is with respect
+  // to the logits and Network skips that layer while training.
+  virtual bool takes_logits() const { return false; }
   virtual float output() { return loss; }
   virtual const Matrix& back_gradient() { return grad_bottom; }
 };
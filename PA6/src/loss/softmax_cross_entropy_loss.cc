@@ -0,0 +1,37 @@
+#include "./softmax_cross_entropy_loss.h"
+#include "../layer/softmax.h"
+#include "../layer/custom/opencl-new-forward.h"
+
+void SoftmaxCrossEntropy::evaluate(const Matrix& logits,
+                                   const Matrix& target) {
+  const int n_class = logits.rows();
+  const int n = logits.cols();
+  grad_bottom.resize(n_class, n);
+  if (opencl) {
+    OpenCLInterface opencl_interface;
+    opencl_interface.opencl = opencl;
+    sample_loss.resize(n);
+    opencl_interface.softmax_xent_opencl(grad_bottom.data(), sample_loss.data(),
+                                         logits.data(), target.data(), n,
+                                         n_class);
+    double sum = 0;
+    for (int i = 0; i < n; i ++) {
+      sum += sample_loss[i];
+    }
+    loss = sum / n;
+    return;
+  }
+  double sum = 0;
+  for (int i = 0; i < n; i ++) {
+    float z_max, exp_sum;
+    online_softmax(logits.col(i).data(), n_class, z_max, exp_sum);
+    // forward: L_i = \sum{ y_j * (log(\sum{ exp(z) }) - z_j) }
+    const float log_z = z_max + std::log(exp_sum);
+    sum += log_z * target.col(i).sum() - target.col(i).dot(logits.col(i));
+    // backward: d(L)/d(z_j) = (softmax(z)_j - y_j) / n
+    grad_bottom.col(i).array() =
+        ((logits.col(i).array() - z_max).exp() * (1 / exp_sum)
+         - target.col(i).array()) / n;
+  }
+  loss = sum / n;
+}
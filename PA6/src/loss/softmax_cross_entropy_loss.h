@@ -0,0 +1,25 @@
+#ifndef SRC_LOSS_SOFTMAX_CROSS_ENTROPY_LOSS_H_
+#define SRC_LOSS_SOFTMAX_CROSS_ENTROPY_LOSS_H_
+
+#include <vector>
+#include "../loss.h"
+#include "../layer/custom/opencl.h"
+
+// Softmax followed by CrossEntropy in one step on the logits z. The loss is
+// computed as log-softmax, L = \sum{ y_i * (log(\sum{ exp(z) }) - z_i) } / n,
+// so it needs no eps and cannot overflow, and the gradient comes out
+// directly as (softmax(z) - y) / n instead of through -y/p and the softmax
+// Jacobian. Each sample takes two passes over its logits and no temporaries.
+class SoftmaxCrossEntropy: public Loss {
+ private:
+  std::vector<float> sample_loss;  // per sample, from the OpenCL kernel
+
+ public:
+  OpenCL* opencl;  // when set, evaluate runs softmax_xent_kernel on it
+
+  SoftmaxCrossEntropy() : opencl(0) {}
+  void evaluate(const Matrix& logits, const Matrix& target);
+  bool takes_logits() const { return true; }
+};
+
+#endif  // SRC_LOSS_SOFTMAX_CROSS_ENTROPY_LOSS_H_
@@ -0,0 +1,42 @@
+#include "./mapped_file.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open(const std::string& filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    ::close(fd);
+    errno = EINVAL;
+    return false;
+  }
+  void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int mmap_errno = errno;
+  ::close(fd);  // the mapping keeps the file alive
+  if (ptr == MAP_FAILED) {
+    errno = mmap_errno;
+    return false;
+  }
+  map = ptr;
+  map_size = st.st_size;
+  // callers read the whole file right away, so start paging it in
+  madvise(map, map_size, MADV_WILLNEED);
+  return true;
+}
+
+void MappedFile::close() {
+  if (map != NULL)
+    munmap(map, map_size);
+  map = NULL;
+  map_size = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SRC_MAPPED_FILE_H_
+#define SRC_MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping is page aligned, so
+// any offset that is a multiple of 64 in the file is 64-byte aligned in memory.
+class MappedFile {
+ private:
+  void* map;
+  size_t map_size;
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+ public:
+  MappedFile() : map(NULL), map_size(0) {}
+  ~MappedFile() { close(); }
+
+  // Maps filename. Returns false with errno set if it cannot be opened or is
+  // empty (EINVAL).
+  bool open(const std::string& filename);
+  void close();
+  bool is_open() const { return map != NULL; }
+
+  const unsigned char* data() const {
+    return static_cast<const unsigned char*>(map);
+  }
+  size_t size() const { return map_size; }
+};
+
+#endif  // SRC_MAPPED_FILE_H_
@@ -1,72 +1,137 @@
 #include "./mnist.h"
+#include <errno.h>
+#include <string.h>
+#include "./thread_pool.h"
 
-int ReverseInt(int i) {
-  unsigned char ch1, ch2, ch3, ch4;
-  ch1 = i & 255;
-  ch2 = (i >> 8) & 255;
-  ch3 = (i >> 16) & 255;
-  ch4 = (i >> 24) & 255;
-  return ((int)ch1 << 24) + ((int)ch2 << 16) + ((int)ch3 << 8) + ch4;
+static int read_be_int(const unsigned char* p) {
+  return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
 }
 
-void MNIST::read_mnist_data(std::string filename, Matrix& data, int batch_size) {
-  std::ifstream file(filename, std::ios::binary);
-  // std::cout<<"Reading: "<<filename<<std::endl;
-  if (file.is_open()) {
-    int magic_number = 0;
-    int number_of_images = 0;
-    int n_rows = 0;
-    int n_cols = 0;
-    unsigned char label;
-    file.read((char*)&magic_number, sizeof(magic_number));
-    file.read((char*)&number_of_images, sizeof(number_of_images));
-    file.read((char*)&n_rows, sizeof(n_rows));
-    file.read((char*)&n_cols, sizeof(n_cols));
-    //magic_number = ReverseInt(magic_number);
-    //number_of_images = ReverseInt(number_of_images);
-    //n_rows = ReverseInt(n_rows);
-    //n_cols = ReverseInt(n_cols);
+static int read_le_int(const unsigned char* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
 
-    if (batch_size > 0 && batch_size < number_of_images){
-      number_of_images = batch_size;
-    }
+bool IdxFile::open(const std::string& filename, int n_dim) {
+  close();
+  if (!file.open(filename)) {
+    if (errno != ENOENT)
+      std::cerr<<filename<<": "<<strerror(errno)<<std::endl;
+    return false;
+  }
+  const size_t header = 4 * (1 + n_dim);
+  if (file.size() < header) {
+    std::cerr<<filename<<": file too small for an IDX header"<<std::endl;
+    close();
+    return false;
+  }
+
+  const unsigned char* bytes = file.data();
+  bool big_endian;
+  if (bytes[0] == 0 && bytes[1] == 0 && bytes[2] == 0x08 && bytes[3] == n_dim) {
+    big_endian = true;  // standard IDX, unsigned byte data
+  } else if (read_le_int(bytes) == 0) {
+    big_endian = false;  // this project's little-endian variant
+  } else {
+    std::cerr<<filename<<": bad IDX magic number"<<std::endl;
+    close();
+    return false;
+  }
 
-    // std::cout<<number_of_images<<","<<n_rows<<","<<n_cols<<std::endl;
-    data.resize(n_cols * n_rows, number_of_images);
-    for (int i = 0; i < number_of_images; i++) {
-      for (int r = 0; r < n_rows; r++) {
-        for (int c = 0; c < n_cols; c++) {
-          unsigned char image = 0;
-          file.read((char*)&image, sizeof(image));
-          data(r * n_cols + c, i) = (float)image;
-        }
-      }
+  dims.resize(n_dim);
+  size_t n_bytes = 1;
+  for (int d = 0; d < n_dim; d++) {
+    const unsigned char* p = bytes + 4 * (1 + d);
+    dims[d] = big_endian ? read_be_int(p) : read_le_int(p);
+    if (dims[d] < 0) {
+      std::cerr<<filename<<": negative dimension in IDX header"<<std::endl;
+      close();
+      return false;
     }
+    n_bytes *= dims[d];
+  }
+  if (header + n_bytes > file.size()) {
+    std::cerr<<filename<<": header promises "<<n_bytes<<" bytes, file has "
+             <<file.size() - header<<std::endl;
+    close();
+    return false;
   }
+  payload = bytes + header;
+  return true;
 }
 
-void MNIST::read_mnist_label(std::string filename, Matrix& labels, int batch_size) {
-  std::ifstream file(filename, std::ios::binary);
-  // std::cout<<"Reading: "<<filename<<std::endl;
-  if (file.is_open()) {
-    int magic_number = 0;
-    int number_of_images = 0;
-    file.read((char*)&magic_number, sizeof(magic_number));
-    file.read((char*)&number_of_images, sizeof(number_of_images));
-    //magic_number = ReverseInt(magic_number);
-    //number_of_images = ReverseInt(number_of_images);
+void IdxFile::close() {
+  file.close();
+  payload = NULL;
+  dims.clear();
+}
+
+int IdxFile::item_size() const {
+  int size = 1;
+  for (size_t d = 1; d < dims.size(); d++) {
+    size *= dims[d];
+  }
+  return size;
+}
+
+// Converts one item to float; the Eigen expression is vectorized.
+static void convert_item(const unsigned char* src, int size, float* dst,
+                         float scale, float shift) {
+  typedef Eigen::Array<unsigned char, Eigen::Dynamic, 1> ByteArray;
+  Eigen::Map<const ByteArray> in(src, size);
+  Eigen::Map<Eigen::ArrayXf> out(dst, size);
+  out = in.cast<float>() * scale + shift;
+}
+
+// One task per block of items keeps the per-task overhead small while still
+// giving every thread several blocks.
+static const int kConvertBlock = 64;
+
+void IdxFile::to_float(int start, int n, Matrix& out,
+                       float scale, float shift) const {
+  n = std::max(0, std::min(n, count() - start));
+  const int size = item_size();
+  out.resize(size, n);
+  const int n_block = (n + kConvertBlock - 1) / kConvertBlock;
+  ThreadPool::global().parallel_for(n_block, [&](int b, int tid) {
+    int end = std::min(n, (b + 1) * kConvertBlock);
+    for (int j = b * kConvertBlock; j < end; j++) {
+      convert_item(item(start + j), size, out.col(j).data(), scale, shift);
+    }
+  });
+}
+
+void IdxFile::to_float(const int* index, int n, Matrix& out,
+                       float scale, float shift) const {
+  const int size = item_size();
+  out.resize(size, n);
+  const int n_block = (n + kConvertBlock - 1) / kConvertBlock;
+  ThreadPool::global().parallel_for(n_block, [&](int b, int tid) {
+    int end = std::min(n, (b + 1) * kConvertBlock);
+    for (int j = b * kConvertBlock; j < end; j++) {
+      convert_item(item(index[j]), size, out.col(j).data(), scale, shift);
+    }
+  });
+}
 
+void MNIST::read_mnist_data(std::string filename, Matrix& data, int batch_size) {
+  IdxFile file;
+  if (file.open(filename, 3)) {
+    int number_of_images = file.count();
     if (batch_size > 0 && batch_size < number_of_images){
       number_of_images = batch_size;
     }
+    file.to_float(0, number_of_images, data);
+  }
+}
 
-    // std::cout<<number_of_images<<std::endl;
-    labels.resize(1, number_of_images);
-    for (int i = 0; i < number_of_images; i++) {
-      unsigned char label = 0;
-      file.read((char*)&label, sizeof(label));
-      labels(0, i) = (float)label;
+void MNIST::read_mnist_label(std::string filename, Matrix& labels, int batch_size) {
+  IdxFile file;
+  if (file.open(filename, 1)) {
+    int number_of_images = file.count();
+    if (batch_size > 0 && batch_size < number_of_images){
+      number_of_images = batch_size;
     }
+    file.to_float(0, number_of_images, labels);
   }
 }
 
@@ -81,3 +146,10 @@ void MNIST::read_test_data(int batch_size) {
   read_mnist_data(data_dir + "t10k-86-images-idx3-ubyte", test_data, batch_size);
   read_mnist_label(data_dir + "t10k-86-labels-idx1-ubyte", test_labels, batch_size);
 }
+
+void MNIST::open() {
+  train_images.open(data_dir + "train-86-images-idx3-ubyte", 3);
+  train_label_file.open(data_dir + "train-86-labels-idx1-ubyte", 1);
+  test_images.open(data_dir + "t10k-86-images-idx3-ubyte", 3);
+  test_label_file.open(data_dir + "t10k-86-labels-idx1-ubyte", 1);
+}
@@ -4,8 +4,51 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
+#include "./mapped_file.h"
 #include "./utils.h"
 
+// Read-only, memory-mapped view of an IDX file of unsigned bytes.
+// Accepts the standard big-endian header (magic 0x0000080N, N = number of
+// dimensions) as well as the little-endian variant with a zero magic number
+// used by the files shipped with this project, in which case the number of
+// dimensions has to be supplied by the caller.
+// Items are exposed as uint8 without copying; to_float converts a batch.
+class IdxFile {
+ private:
+  MappedFile file;
+  const unsigned char* payload;
+  std::vector<int> dims;
+
+  IdxFile(const IdxFile&);
+  IdxFile& operator=(const IdxFile&);
+
+ public:
+  IdxFile() : payload(NULL) {}
+
+  // Maps filename and validates its header against n_dim dimensions.
+  // Returns false (and prints the reason) if the file is missing or malformed.
+  bool open(const std::string& filename, int n_dim);
+  void close();
+  bool is_open() const { return payload != NULL; }
+
+  int count() const { return dims.empty() ? 0 : dims[0]; }
+  // number of bytes in one item, e.g. rows * cols for an image
+  int item_size() const;
+  const std::vector<int>& shape() const { return dims; }
+  const unsigned char* item(int i) const {
+    return payload + static_cast<size_t>(i) * item_size();
+  }
+
+  // out(:, j) = scale * item(start + j) + shift for j in [0, n), converted in
+  // parallel on the global thread pool.
+  void to_float(int start, int n, Matrix& out,
+                float scale = 1.0f, float shift = 0.0f) const;
+  // Same, gathering the items index[0..n) (e.g. a shuffled minibatch).
+  void to_float(const int* index, int n, Matrix& out,
+                float scale = 1.0f, float shift = 0.0f) const;
+};
+
 class MNIST {
  private:
   std::string data_dir;
@@ -16,12 +59,22 @@ class MNIST {
   Matrix test_data;
   Matrix test_labels;
 
+  // uint8 views of the image/label files, filled by open()
+  IdxFile train_images;
+  IdxFile train_label_file;
+  IdxFile test_images;
+  IdxFile test_label_file;
+
   void read_mnist_data(std::string filename, Matrix& data, int batch_size=-1);
   void read_mnist_label(std::string filename, Matrix& labels, int batch_size=-1);
 
   explicit MNIST(std::string data_dir) : data_dir(data_dir) {}
   void read();
-  void read_test_data(int batch_size); 
+  void read_test_data(int batch_size);
+
+  // Maps the four dataset files without converting anything; batches can
+  // then be taken with IdxFile::to_float. Missing files are left closed.
+  void open();
 };
 
 #endif  // SRC_MNIST_H_
@@ -1,16 +1,105 @@
 #include "./network.h"
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include "./weight_file.h"
+
+void Network::training(bool training) {
+  training_mode = training;
+  for (size_t i = 0; i < layers.size(); i++) {
+    layers[i]->set_training(training);
+    layers[i]->fuse_activation(kActivationNone);
+    fused[i] = false;
+  }
+  if (training) {
+    inference_output.resize(0, 0);
+    return;
+  }
+  for (size_t i = 1; i < layers.size(); i++) {
+    Activation a = layers[i]->as_activation();
+    if (a != kActivationNone && !fused[i-1])
+      fused[i] = layers[i-1]->fuse_activation(a);
+  }
+}
+
+int Network::sparsify(float max_density) {
+  int n_sparse = 0;
+  for (size_t i = 0; i < layers.size(); i++) {
+    if (layers[i]->sparsify(max_density))
+      n_sparse++;
+  }
+  return n_sparse;
+}
 
 void Network::forward(const Matrix& input) {
   if (layers.empty())
     return;
+  if (!training_mode) {
+    inference_output = forward(input, context);
+    return;
+  }
+  const int n_run = layers.size() - (softmax_in_loss() ? 1 : 0);
   layers[0]->forward(input);
-  for (int i = 1; i < layers.size(); i++) {
+  for (int i = 1; i < n_run; i++) {
     layers[i]->forward(layers[i-1]->output());
   }
 }
 
+bool Network::softmax_in_loss() const {
+  return loss && loss->takes_logits() && layers.size() > 1 &&
+         layers.back()->is_softmax();
+}
+
+const Matrix& Network::output() {
+  if (!training_mode)
+    return inference_output;
+  // the loss applies the softmax itself, so it only runs when asked for
+  if (softmax_in_loss())
+    layers.back()->forward(layers[layers.size()-2]->output());
+  return layers.back()->output();
+}
+
+Eigen::Map<const Matrix> Network::forward(const Matrix& input,
+                                          ExecutionContext& ctx) const {
+  const int n_layer = layers.size();
+  const int n_sample = input.cols();
+  const int n_output = n_layer - std::count(fused.begin(), fused.end(), true);
+  if (ctx.activations.count() != n_output)
+    plan_activations(input.rows(), ctx.activations);
+  ctx.activations.reserve(n_sample);
+  Eigen::Map<const Matrix> bottom(input.data(), input.rows(), n_sample);
+  for (int i = 0, t = 0; i < n_layer; i++) {
+    if (fused[i])
+      continue;  // already applied by layer i-1
+    Eigen::Map<Matrix> top = ctx.activations.get(t++, n_sample);
+    layers[i]->infer(bottom, top, ctx);
+    new (&bottom) Eigen::Map<const Matrix>(top.data(), top.rows(), n_sample);
+  }
+  return bottom;
+}
+
+void Network::plan_activations(int dim_in, ActivationArena& arena) const {
+  std::vector<int> rows, first, last;
+  int dim = dim_in;
+  for (size_t i = 0; i < layers.size(); i++) {
+    if (fused[i])
+      continue;
+    int out = layers[i]->output_dim();
+    dim = out < 0 ? dim : out;  // -1: same as input
+    if (!last.empty())
+      last.back() = i;  // the previous output is read here
+    rows.push_back(dim);
+    first.push_back(i);
+    last.push_back(i);
+  }
+  arena.plan(rows, first, last);
+}
+
 void Network::backward(const Matrix& input, const Matrix& target) {
-  int n_layer = layers.size();
+  if (!training_mode)
+    throw std::logic_error("Network::backward in inference mode");
+  // a trailing Softmax is left to a loss that takes logits
+  const int n_layer = layers.size() - (softmax_in_loss() ? 1 : 0);
   // 0 layer
   if (n_layer <= 0)
     return;
@@ -29,10 +118,24 @@ void Network::backward(const Matrix& input, const Matrix& target) {
   layers[0]->backward(input, layers[1]->back_gradient());
 }
 
-void Network::update(Optimizer& opt) {
-  for (int i = 0; i < layers.size(); i++) {
-    layers[i]->update(opt);
+void Network::bind_parameters() {
+  int n_param = 0;
+  for (size_t i = 0; i < layers.size(); i++) {
+    n_param += layers[i]->parameter_size();
+  }
+  Vector param(n_param), deriv(n_param);
+  for (size_t i = 0, offset = 0; i < layers.size(); i++) {
+    layers[i]->bind_parameters(param.data() + offset, deriv.data() + offset);
+    offset += layers[i]->parameter_size();
   }
+  parameters.swap(param);  // the old buffers are freed on return
+  derivatives.swap(deriv);
+}
+
+void Network::update(Optimizer& opt) {
+  Vector::AlignedMapType w(parameters.data(), parameters.size());
+  Vector::ConstAlignedMapType dw(derivatives.data(), derivatives.size());
+  opt.update(w, dw);
 }
 
 std::vector<std::vector<float> > Network::get_parameters() const {
@@ -64,6 +167,15 @@ std::vector<std::vector<float> > Network::get_derivatives() const {
   return res;
 }
 
+void Network::set_derivatives(const std::vector< std::vector<float> >& deriv) {
+  const int n_layer = layers.size();
+  if (static_cast<int>(deriv.size()) != n_layer)
+      throw std::invalid_argument("Derivative size does not match");
+  for (int i = 0; i < n_layer; i++) {
+    layers[i]->set_derivatives(deriv[i]);
+  }
+}
+
 void Network::check_gradient(const Matrix& input, const Matrix& target,
                              int n_points, int seed) {
   if (seed > 0)
@@ -111,54 +223,82 @@ void Network::check_gradient(const Matrix& input, const Matrix& target,
   this->set_parameters(param);
 }
 
-void Network::save_parameters(std::string filename) {
-  std::ofstream out;
-  out.open(filename, std::ios::out | std::ios::binary);
+int Network::quantize(const Matrix& calibration_input) {
+  // ranges are taken from the fp32 activations before anything is quantized,
+  // one layer at a time so that this works in either mode
+  std::vector<float> input_min(layers.size()), input_max(layers.size());
+  ExecutionContext ctx(&ThreadPool::global());
+  Matrix in = calibration_input, out;
+  for (size_t i = 0; i < layers.size(); i++) {
+    input_min[i] = in.minCoeff();
+    input_max[i] = in.maxCoeff();
+    if (fused[i])
+      continue;  // applied by layer i-1
+    int dim = layers[i]->output_dim();
+    out.resize(dim < 0 ? in.rows() : dim, in.cols());
+    layers[i]->infer(in, out, ctx);
+    in.swap(out);
+  }
+  int n_quantized = 0;
+  for (size_t i = 0; i < layers.size(); i++) {
+    if (layers[i]->quantize(input_min[i], input_max[i]))
+      n_quantized++;
+  }
+  return n_quantized;
+}
 
+void Network::save_parameters(std::string filename) {
   int n_layer = layers.size();
-  out.write(reinterpret_cast<char*>(&n_layer), sizeof(int));
   std::cout<<"Num Layers: "<<n_layer<<std::endl;
-  std::vector< std::vector<float> > res;
-  res.reserve(n_layer);
-
+  // one float tensor per layer, plus an int8 tensor for quantized layers
+  std::vector< std::vector<float> > param(n_layer);
+  std::vector< std::vector<signed char> > param_int8(n_layer);
+  std::vector<WeightTensor> tensors;
   for (int i = 0; i < n_layer; i++) {
-    std::vector<float> layer_params = layers[i]->get_parameters();
-    int layer_p_size = layer_params.size();
-    std::cout<<"Layer "<<i<<" size: "<<layer_p_size<<std::endl;
-    out.write(reinterpret_cast<char*>(&layer_p_size), sizeof(int));
-
-    for (int j = 0; j < layer_p_size; j++) {
-      out.write(reinterpret_cast<char*>(&layer_params[j]), sizeof(float));
+    if (layers[i]->is_quantized())
+      layers[i]->get_quantized_parameters(param_int8[i], param[i]);
+    else
+      param[i] = layers[i]->get_parameters();
+    std::cout<<"Layer "<<i<<" size: "<<param[i].size() + param_int8[i].size()
+             <<(param_int8[i].empty() ? "" : " (int8)")<<std::endl;
+    WeightTensor t = {i, kWeightFloat32, param[i].data(), param[i].size()};
+    tensors.push_back(t);
+    if (!param_int8[i].empty()) {
+      WeightTensor q = {i, kWeightInt8, param_int8[i].data(),
+                        param_int8[i].size()};
+      tensors.push_back(q);
     }
   }
+  write_weight_file(filename, tensors);
 }
 
 void Network::load_parameters(std::string filename) {
-  std::ifstream in;
-  in.open(filename, std::ios::in | std::ios::binary);
-  std::vector< std::vector<float> > res;
-  
-  int n_layer;
-  int layer_size = 0;
-
-  in.read(reinterpret_cast<char*>(&n_layer), sizeof(int));
-  // std::cout<<"Num Layers: "<<n_layer<<std::endl;
-  res.reserve(n_layer);
-
-  for (int i=0; i<n_layer; i++){
-    in.read(reinterpret_cast<char*>(&layer_size), sizeof(int));
-    // std::cout<<"Layer "<<i<<" size: "<<layer_size<<std::endl;
-    std::vector<float> layer_params;
-    layer_params.reserve(layer_size);
-    for (int j=0; j<layer_size; j++)
-    {
-      float param = 0;
-      in.read(reinterpret_cast<char*>(&param), sizeof(float));
-      layer_params.push_back(param);
-    }
-    res.push_back(layer_params);
+  WeightFile file;
+  file.open(filename);
+  const int n_layer = layers.size();
+  std::vector<int> float_tensor(n_layer, -1), int8_tensor(n_layer, -1);
+  for (int i = 0; i < file.n_tensor(); i++) {
+    int layer = file.tensor_layer(i);
+    if (layer < 0 || layer >= n_layer)
+      throw std::runtime_error(filename + ": tensor for layer "
+                               + std::to_string(layer) + ", network has "
+                               + std::to_string(n_layer) + " layers");
+    if (file.tensor_dtype(i) == kWeightInt8)
+      int8_tensor[layer] = i;
+    else
+      float_tensor[layer] = i;
+  }
+  for (int l = 0; l < n_layer; l++) {
+    int f = float_tensor[l];
+    if (f < 0)
+      throw std::runtime_error(filename + ": no parameters for layer "
+                               + std::to_string(l));
+    int q = int8_tensor[l];
+    if (q >= 0)
+      layers[l]->set_quantized_parameters(file.tensor_int8(q),
+                                          file.tensor_size(q), file.tensor(f),
+                                          file.tensor_size(f));
+    else
+      layers[l]->set_parameters(file.tensor(f), file.tensor_size(f));
   }
-  
-  set_parameters(res);
 }
-
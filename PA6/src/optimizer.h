@@ -1,20 +1,56 @@
 #ifndef SRC_OPTIMIZER_H_
 #define SRC_OPTIMIZER_H_
 
+#include <algorithm>
+#include "./thread_pool.h"
 #include "./utils.h"
 
+// An optimizer step covers every parameter of a network at once: Network
+// keeps them in one flat buffer (Layer::bind_parameters), and per-parameter
+// state such as velocity lives in flat buffers of the same layout, so no
+// tensor is looked up and the update is one pass over memory. The pass is
+// split into chunks that run on ThreadPool::global(); each chunk is small
+// enough that the few array statements of update_chunk re-read it from L1,
+// which fuses them in all but name.
 class Optimizer {
  protected:
   float lr;  // learning rate
   float decay;  // weight decay factor (default: 0)
+  int step;  // steps taken with the current state, from 1
+
+  static const int kChunk = 4096;  // parameters per task
+
+  // (Re)allocate zeroed state for n parameters
+  virtual void reset_state(int n) = 0;
+  // Update w[first, first+n) from dw[first, first+n) and the same range of
+  // the state; called concurrently for disjoint ranges.
+  virtual void update_chunk(int first, int n, float* w, const float* dw) = 0;
 
  public:
   explicit Optimizer(float lr = 0.01, float decay = 0.0) :
-                     lr(lr), decay(decay) {}
+                     lr(lr), decay(decay), step(0), state_size(0) {}
   virtual ~Optimizer() {}
 
-  virtual void update(Vector::AlignedMapType& w,
-                      Vector::ConstAlignedMapType& dw) = 0;
+  // One step on the whole of w (the state is reset when its size changes)
+  void update(Vector::AlignedMapType& w, Vector::ConstAlignedMapType& dw) {
+    const int n = w.size();
+    if (step == 0 || n != state_size) {
+      reset_state(n);
+      state_size = n;
+      step = 0;
+    }
+    step++;
+    float* w_data = w.data();
+    const float* dw_data = dw.data();
+    ThreadPool::global().parallel_for((n + kChunk - 1) / kChunk,
+                                      [&](int c, int tid) {
+      const int first = c * kChunk;
+      update_chunk(first, std::min(kChunk, n - first), w_data, dw_data);
+    });
+  }
+
+ private:
+  int state_size;
 };
 
 #endif  // SRC_OPTIMIZER_H_
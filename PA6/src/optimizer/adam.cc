@@ -0,0 +1,21 @@
+#include "./adam.h"
+#include <cmath>
+
+void Adam::update_chunk(int first, int n, float* w_data, const float* dw_data) {
+  // refer to Adam in PyTorch:
+  // https://github.com/pytorch/pytorch/blob/master/torch/optim/adam.py
+  Eigen::Map<Eigen::ArrayXf> w(w_data + first, n);
+  Eigen::Map<const Eigen::ArrayXf> dw(dw_data + first, n);
+  Eigen::Map<Eigen::ArrayXf> m_chunk(m.data() + first, n);
+  Eigen::Map<Eigen::ArrayXf> v_chunk(v.data() + first, n);
+  float g_data[kChunk];
+  Eigen::Map<Eigen::ArrayXf> g(g_data, n);
+  g = dw + decay * w;
+  m_chunk = beta1 * m_chunk + (1 - beta1) * g;
+  v_chunk = beta2 * v_chunk + (1 - beta2) * g.square();
+  // the bias corrections of m and v folded into the step size and eps:
+  // w -= lr * (m / c1) / (sqrt(v / c2) + eps)
+  const float c1 = 1 - std::pow(beta1, step);
+  const float c2 = std::sqrt(1 - std::pow(beta2, step));
+  w -= (lr * c2 / c1) * m_chunk / (v_chunk.sqrt() + eps * c2);
+}
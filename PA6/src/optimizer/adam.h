@@ -0,0 +1,23 @@
+#ifndef SRC_OPTIMIZER_ADAM_H_
+#define SRC_OPTIMIZER_ADAM_H_
+
+#include "../optimizer.h"
+
+class Adam : public Optimizer {
+ private:
+  float beta1;  // decay of the first moment (default: 0.9)
+  float beta2;  // decay of the second moment (default: 0.999)
+  float eps;  // added to the root of the second moment (default: 1e-8)
+  Vector m;  // first moment, flat like the parameters
+  Vector v;  // second moment
+
+  void reset_state(int n) { m.setZero(n); v.setZero(n); }
+  void update_chunk(int first, int n, float* w, const float* dw);
+
+ public:
+  explicit Adam(float lr = 0.001, float decay = 0.0, float beta1 = 0.9,
+                float beta2 = 0.999, float eps = 1e-8) : Optimizer(lr, decay),
+                beta1(beta1), beta2(beta2), eps(eps) {}
+};
+
+#endif  // SRC_OPTIMIZER_ADAM_H_
@@ -0,0 +1,15 @@
+#include "./rmsprop.h"
+
+void RMSProp::update_chunk(int first, int n, float* w_data,
+                           const float* dw_data) {
+  // refer to RMSprop in PyTorch:
+  // https://github.com/pytorch/pytorch/blob/master/torch/optim/rmsprop.py
+  Eigen::Map<Eigen::ArrayXf> w(w_data + first, n);
+  Eigen::Map<const Eigen::ArrayXf> dw(dw_data + first, n);
+  Eigen::Map<Eigen::ArrayXf> s(square_avg.data() + first, n);
+  float g_data[kChunk];
+  Eigen::Map<Eigen::ArrayXf> g(g_data, n);
+  g = dw + decay * w;
+  s = alpha * s + (1 - alpha) * g.square();
+  w -= lr * g / (s.sqrt() + eps);
+}
@@ -0,0 +1,21 @@
+#ifndef SRC_OPTIMIZER_RMSPROP_H_
+#define SRC_OPTIMIZER_RMSPROP_H_
+
+#include "../optimizer.h"
+
+class RMSProp : public Optimizer {
+ private:
+  float alpha;  // decay of the squared gradient average (default: 0.99)
+  float eps;  // added to its root (default: 1e-8)
+  Vector square_avg;  // flat like the parameters
+
+  void reset_state(int n) { square_avg.setZero(n); }
+  void update_chunk(int first, int n, float* w, const float* dw);
+
+ public:
+  explicit RMSProp(float lr = 0.01, float decay = 0.0, float alpha = 0.99,
+                   float eps = 1e-8) : Optimizer(lr, decay),
+                   alpha(alpha), eps(eps) {}
+};
+
+#endif  // SRC_OPTIMIZER_RMSPROP_H_
@@ -1,20 +1,24 @@
 #include "./sgd.h"
 
-void SGD::update(Vector::AlignedMapType& w,
-                 Vector::ConstAlignedMapType& dw) {
+void SGD::update_chunk(int first, int n, float* w_data, const float* dw_data) {
   // refer to SGD in PyTorch:
   // https://github.com/pytorch/pytorch/blob/master/torch/optim/sgd.py
-  // If v is zero, initialize it
-  Vector& v = v_map[dw.data()];
-  if (v.size() == 0) {
-    v.resize(dw.size());
-    v.setZero();
+  Eigen::Map<Eigen::ArrayXf> w(w_data + first, n);
+  Eigen::Map<const Eigen::ArrayXf> dw(dw_data + first, n);
+  if (momentum == 0) {
+    w -= lr * (dw + decay * w);
+    return;
   }
+  // g = dw + decay * w, computed once even with Nesterov
+  float g_data[kChunk];
+  Eigen::Map<Eigen::ArrayXf> g(g_data, n);
+  Eigen::Map<Eigen::ArrayXf> v(velocity.data() + first, n);
+  g = dw + decay * w;
   // update v
-  v = momentum * v + (dw + decay * w);
+  v = momentum * v + g;
   // update w
   if (nesterov)
-    w -= lr * (momentum * v + (dw + decay * w));
+    w -= lr * (momentum * v + g);
   else
     w -= lr * v;
 }
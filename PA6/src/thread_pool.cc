@@ -0,0 +1,89 @@
+#include "./thread_pool.h"
+#include <stdlib.h>
+
+// Set while a thread is executing parallel_for work, so nested calls run inline.
+static thread_local bool in_parallel_region = false;
+
+ThreadPool::ThreadPool(int n_threads) :
+    job(NULL), job_size(0), next_index(0), busy_workers(0), generation(0),
+    stopping(false) {
+  if (n_threads <= 0) {
+    const char* env = getenv("NUM_THREADS");
+    n_threads = env ? atoi(env) : 0;
+  }
+  if (n_threads <= 0)
+    n_threads = std::thread::hardware_concurrency();
+  if (n_threads <= 0)
+    n_threads = 1;
+  for (int i = 1; i < n_threads; i++) {
+    workers.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  job_ready.notify_all();
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+void ThreadPool::run_job(int tid) {
+  in_parallel_region = true;
+  for (int i = next_index++; i < job_size; i = next_index++) {
+    (*job)(i, tid);
+  }
+  in_parallel_region = false;
+}
+
+void ThreadPool::worker_loop(int tid) {
+  unsigned long seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      job_ready.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+    run_job(tid);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--busy_workers == 0)
+        job_done.notify_one();
+    }
+  }
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int, int)>& fn) {
+  if (n <= 0)
+    return;
+  if (workers.empty() || n == 1 || in_parallel_region) {
+    for (int i = 0; i < n; i++) {
+      fn(i, 0);
+    }
+    return;
+  }
+  std::lock_guard<std::mutex> submit(submit_mutex);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &fn;
+    job_size = n;
+    next_index = 0;
+    busy_workers = workers.size();
+    generation++;
+  }
+  job_ready.notify_all();
+  run_job(0);
+  std::unique_lock<std::mutex> lock(mutex);
+  job_done.wait(lock, [&] { return busy_workers == 0; });
+  job = NULL;
+}
+
+ThreadPool& ThreadPool::global() {
+  static ThreadPool pool;
+  return pool;
+}
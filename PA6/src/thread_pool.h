@@ -0,0 +1,48 @@
+#ifndef SRC_THREAD_POOL_H_
+#define SRC_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads used by the CPU layers.
+// parallel_for(n, fn) calls fn(i, tid) for every i in [0, n), where tid in
+// [0, size()) identifies the thread running the call so that callers can keep
+// per-thread scratch buffers. The calling thread takes part as tid 0.
+// A parallel_for issued from inside a worker runs serially on that worker, so
+// nested parallel regions never deadlock.
+class ThreadPool {
+ private:
+  std::vector<std::thread> workers;
+  std::mutex submit_mutex;  // one job at a time
+  std::mutex mutex;
+  std::condition_variable job_ready;
+  std::condition_variable job_done;
+
+  const std::function<void(int, int)>* job;
+  int job_size;
+  std::atomic<int> next_index;
+  int busy_workers;
+  unsigned long generation;
+  bool stopping;
+
+  void worker_loop(int tid);
+  void run_job(int tid);
+
+ public:
+  // n_threads <= 0 picks NUM_THREADS from the environment, falling back to
+  // std::thread::hardware_concurrency().
+  explicit ThreadPool(int n_threads = 0);
+  ~ThreadPool();
+
+  int size() const { return static_cast<int>(workers.size()) + 1; }
+  void parallel_for(int n, const std::function<void(int, int)>& fn);
+
+  // Process-wide pool shared by all layers.
+  static ThreadPool& global();
+};
+
+#endif  // SRC_THREAD_POOL_H_
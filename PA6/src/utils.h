@@ -10,6 +10,15 @@
 typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> Matrix;
 typedef Eigen::Matrix<float, Eigen::Dynamic, 1> Vector;
 typedef Eigen::Array<float, 1, Eigen::Dynamic> RowVector;
+// Matrix or a Map over preallocated memory, e.g. an activation arena
+typedef Eigen::Ref<Matrix> MatrixRef;
+typedef Eigen::Ref<const Matrix> ConstMatrixRef;
+typedef Eigen::Ref<Vector> VectorRef;
+typedef Eigen::Ref<const Vector> ConstVectorRef;
+// Layer parameters, which live in a Network's flat buffers (see
+// Layer::bind_parameters)
+typedef Eigen::Map<Matrix> MatrixView;
+typedef Eigen::Map<Vector> VectorView;
 
 static std::default_random_engine generator;
 
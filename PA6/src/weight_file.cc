@@ -0,0 +1,202 @@
+#include "./weight_file.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <fstream>
+#include <stdexcept>
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zeros.
+static std::vector<uint32_t> make_crc_table() {
+  std::vector<uint32_t> table(8 * 256);
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    }
+    table[i] = c;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int k = 1; k < 8; k++) {
+      uint32_t prev = table[(k - 1) * 256 + i];
+      table[k * 256 + i] = table[prev & 0xFF] ^ (prev >> 8);
+    }
+  }
+  return table;
+}
+
+// Standard CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320), eight
+// bytes per step so verifying a large model stays far below page-in cost.
+uint32_t crc32(const void* data, size_t size, uint32_t crc) {
+  static const std::vector<uint32_t> table = make_crc_table();
+  const uint32_t* t = table.data();
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  crc = ~crc;
+  for (; size >= 8; size -= 8, p += 8) {
+    uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24));
+    uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | (uint32_t(p[7]) << 24);
+    crc = t[7 * 256 + (lo & 0xFF)] ^ t[6 * 256 + ((lo >> 8) & 0xFF)]
+        ^ t[5 * 256 + ((lo >> 16) & 0xFF)] ^ t[4 * 256 + (lo >> 24)]
+        ^ t[3 * 256 + (hi & 0xFF)] ^ t[2 * 256 + ((hi >> 8) & 0xFF)]
+        ^ t[1 * 256 + ((hi >> 16) & 0xFF)] ^ t[hi >> 24];
+  }
+  for (; size > 0; size--, p++) {
+    crc = t[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static uint64_t align_up(uint64_t x) {
+  return (x + kWeightFileAlign - 1) / kWeightFileAlign * kWeightFileAlign;
+}
+
+static size_t element_size(uint32_t dtype) {
+  return dtype == kWeightInt8 ? 1 : sizeof(float);
+}
+
+void write_weight_file(const std::string& filename,
+                       const std::vector<WeightTensor>& tensors) {
+  const uint32_t n_tensor = tensors.size();
+  std::vector<TensorDesc> desc(n_tensor);
+  uint64_t offset = align_up(sizeof(WeightFileHeader)
+                             + n_tensor * sizeof(TensorDesc));
+  for (uint32_t i = 0; i < n_tensor; i++) {
+    const uint64_t bytes = tensors[i].count * element_size(tensors[i].dtype);
+    memset(&desc[i], 0, sizeof(TensorDesc));
+    desc[i].offset = offset;
+    desc[i].count = tensors[i].count;
+    desc[i].dtype = tensors[i].dtype;
+    desc[i].crc = crc32(tensors[i].data, bytes);
+    desc[i].layer = tensors[i].layer;
+    offset = align_up(offset + bytes);
+  }
+
+  WeightFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kWeightFileMagic, sizeof(header.magic));
+  header.version = kWeightFileVersion;
+  header.n_tensor = n_tensor;
+  header.file_size = offset;
+  header.desc_crc = crc32(desc.data(), n_tensor * sizeof(TensorDesc));
+
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+  if (!out.is_open())
+    throw std::runtime_error(filename + ": " + strerror(errno));
+  static const char zeros[kWeightFileAlign] = {0};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(desc.data()),
+            n_tensor * sizeof(TensorDesc));
+  uint64_t pos = sizeof(header) + n_tensor * sizeof(TensorDesc);
+  for (uint32_t i = 0; i < n_tensor; i++) {
+    const uint64_t bytes = desc[i].count * element_size(desc[i].dtype);
+    out.write(zeros, desc[i].offset - pos);
+    out.write(static_cast<const char*>(tensors[i].data), bytes);
+    pos = desc[i].offset + bytes;
+  }
+  out.write(zeros, offset - pos);
+  if (!out.good())
+    throw std::runtime_error(filename + ": write failed");
+}
+
+void write_weight_file(const std::string& filename,
+                       const std::vector<std::vector<float> >& tensors) {
+  std::vector<WeightTensor> list(tensors.size());
+  for (size_t i = 0; i < tensors.size(); i++) {
+    list[i].layer = i;
+    list[i].dtype = kWeightFloat32;
+    list[i].data = tensors[i].data();
+    list[i].count = tensors[i].size();
+  }
+  write_weight_file(filename, list);
+}
+
+void WeightFile::open(const std::string& filename) {
+  close();
+  if (!file.open(filename))
+    throw std::runtime_error(filename + ": " + strerror(errno));
+  if (file.size() >= sizeof(WeightFileHeader)
+      && memcmp(file.data(), kWeightFileMagic, sizeof(kWeightFileMagic)) == 0) {
+    parse_versioned(filename);
+  } else {
+    parse_legacy(filename);
+  }
+}
+
+void WeightFile::parse_versioned(const std::string& filename) {
+  const WeightFileHeader* header =
+      reinterpret_cast<const WeightFileHeader*>(file.data());
+  if (header->version < 1 || header->version > kWeightFileVersion)
+    throw std::runtime_error(filename + ": unsupported weight file version "
+                             + std::to_string(header->version));
+  if (header->file_size != file.size())
+    throw std::runtime_error(filename + ": truncated weight file");
+  const uint64_t desc_bytes = uint64_t(header->n_tensor) * sizeof(TensorDesc);
+  if (sizeof(WeightFileHeader) + desc_bytes > file.size())
+    throw std::runtime_error(filename + ": descriptor table out of range");
+  const TensorDesc* desc = reinterpret_cast<const TensorDesc*>(
+      file.data() + sizeof(WeightFileHeader));
+  if (crc32(desc, desc_bytes) != header->desc_crc)
+    throw std::runtime_error(filename + ": descriptor checksum mismatch");
+
+  legacy = false;
+  tensors.resize(header->n_tensor);
+  for (uint32_t i = 0; i < header->n_tensor; i++) {
+    if (desc[i].dtype != kWeightFloat32 && desc[i].dtype != kWeightInt8)
+      throw std::runtime_error(filename + ": unsupported tensor type");
+    // Layers take their parameter counts as int; every bound is checked
+    // before it is combined so a crafted descriptor cannot wrap around
+    const uint64_t size = element_size(desc[i].dtype);
+    if (desc[i].count > INT_MAX || desc[i].count > file.size() / size)
+      throw std::runtime_error(filename + ": tensor " + std::to_string(i)
+                               + " out of range");
+    const uint64_t bytes = desc[i].count * size;
+    if (desc[i].offset % kWeightFileAlign != 0
+        || desc[i].offset > file.size() - bytes)
+      throw std::runtime_error(filename + ": tensor " + std::to_string(i)
+                               + " out of range");
+    const unsigned char* payload = file.data() + desc[i].offset;
+    if (crc32(payload, bytes) != desc[i].crc)
+      throw std::runtime_error(filename + ": checksum mismatch in tensor "
+                               + std::to_string(i));
+    tensors[i].layer = header->version == 1 ? i : desc[i].layer;
+    tensors[i].dtype = static_cast<WeightDType>(desc[i].dtype);
+    tensors[i].data = payload;
+    tensors[i].count = desc[i].count;
+  }
+}
+
+void WeightFile::parse_legacy(const std::string& filename) {
+  // int n_layer, then per layer: int size, size floats; all 4-byte aligned
+  const unsigned char* p = file.data();
+  const unsigned char* end = p + file.size();
+  int n_layer;
+  if (end - p < static_cast<long>(sizeof(int)))
+    throw std::runtime_error(filename + ": not a weight file");
+  memcpy(&n_layer, p, sizeof(int));
+  p += sizeof(int);
+  if (n_layer < 0 || static_cast<size_t>(n_layer) > file.size() / sizeof(int))
+    throw std::runtime_error(filename + ": not a weight file");
+
+  legacy = true;
+  tensors.resize(n_layer);
+  for (int i = 0; i < n_layer; i++) {
+    int layer_size;
+    if (end - p < static_cast<long>(sizeof(int)))
+      throw std::runtime_error(filename + ": truncated weight file");
+    memcpy(&layer_size, p, sizeof(int));
+    p += sizeof(int);
+    if (layer_size < 0
+        || static_cast<size_t>(end - p) < layer_size * sizeof(float))
+      throw std::runtime_error(filename + ": truncated weight file");
+    tensors[i].layer = i;
+    tensors[i].dtype = kWeightFloat32;
+    tensors[i].data = p;
+    tensors[i].count = layer_size;
+    p += layer_size * sizeof(float);
+  }
+}
+
+void WeightFile::close() {
+  file.close();
+  legacy = false;
+  tensors.clear();
+}
@@ -0,0 +1,102 @@
+#ifndef SRC_WEIGHT_FILE_H_
+#define SRC_WEIGHT_FILE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "./mapped_file.h"
+
+// Versioned container for the parameters of a Network. Every layer has a
+// float32 tensor (empty for layers without parameters); int8-quantized layers
+// add an int8 weight tensor. Layout, little-endian:
+//
+//   WeightFileHeader   64 bytes
+//   TensorDesc         32 bytes per tensor
+//   payloads           each starting at a 64-byte aligned offset
+//
+// Every payload and the descriptor table carry a CRC-32, so a truncated or
+// corrupted file is rejected instead of silently loading garbage.
+// Version 1 files (float32 only, tensor i belonging to layer i) still load.
+
+static const char kWeightFileMagic[8] = {'M', 'D', 'N', 'N', 'W', 'G', 'T', 0};
+static const uint32_t kWeightFileVersion = 2;
+static const uint32_t kWeightFileAlign = 64;
+
+enum WeightDType {
+  kWeightFloat32 = 0,
+  kWeightInt8 = 1,
+};
+
+struct WeightFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t n_tensor;
+  uint64_t file_size;
+  uint32_t desc_crc;  // CRC-32 of the descriptor table
+  uint32_t reserved[9];
+};
+
+struct TensorDesc {
+  uint64_t offset;  // from the start of the file, multiple of kWeightFileAlign
+  uint64_t count;   // number of elements
+  uint32_t dtype;   // WeightDType
+  uint32_t crc;     // CRC-32 of the payload
+  uint32_t layer;   // index of the owning layer (version 2)
+  uint32_t reserved;
+};
+
+// One tensor to be written by write_weight_file.
+struct WeightTensor {
+  int layer;
+  WeightDType dtype;
+  const void* data;
+  size_t count;
+};
+
+static_assert(sizeof(WeightFileHeader) == 64, "WeightFileHeader layout");
+static_assert(sizeof(TensorDesc) == 32, "TensorDesc layout");
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+
+// Writes tensors to filename in the format above. Throws std::runtime_error
+// if the file cannot be written.
+void write_weight_file(const std::string& filename,
+                       const std::vector<WeightTensor>& tensors);
+// Float32 only, tensor i belonging to layer i.
+void write_weight_file(const std::string& filename,
+                       const std::vector<std::vector<float> >& tensors);
+
+// Memory-mapped reader. Also accepts the original unversioned layout
+// (int n_layer, then per layer int size followed by size floats) so that
+// existing weight files keep loading. Tensors point into the mapping and stay
+// valid until the WeightFile is closed or destroyed.
+class WeightFile {
+ private:
+  MappedFile file;
+  bool legacy;
+  std::vector<WeightTensor> tensors;
+
+  void parse_versioned(const std::string& filename);
+  void parse_legacy(const std::string& filename);
+
+ public:
+  WeightFile() : legacy(false) {}
+
+  // Maps and validates filename; throws std::runtime_error on failure.
+  void open(const std::string& filename);
+  void close();
+
+  bool is_legacy() const { return legacy; }
+  int n_tensor() const { return static_cast<int>(tensors.size()); }
+  int tensor_layer(int i) const { return tensors[i].layer; }
+  WeightDType tensor_dtype(int i) const { return tensors[i].dtype; }
+  size_t tensor_size(int i) const { return tensors[i].count; }
+  const float* tensor(int i) const {
+    return static_cast<const float*>(tensors[i].data);
+  }
+  const signed char* tensor_int8(int i) const {
+    return static_cast<const signed char*>(tensors[i].data);
+  }
+};
+
+#endif  // SRC_WEIGHT_FILE_H_
@@ -0,0 +1,154 @@
+#include "ece408net.h"
+
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <string>
+#include "src/optimizer/adam.h"
+#include "src/optimizer/rmsprop.h"
+
+// Data-parallel minibatch training: every batch is split across n_replica
+// copies of the network, one per worker thread. Each replica computes
+// gradients for its slice, the gradients are tree-reduced into replica 0,
+// which takes the optimizer step and broadcasts the new parameters back to
+// the others. Gradients and parameters move as the flat buffers of each
+// network (Network::flat_derivatives), one vector operation per transfer.
+void train(int n_epoch, int batch_size, int n_replica, Optimizer& opt) {
+
+  ThreadPool& pool = ThreadPool::global();
+  if (n_replica <= 0 || n_replica > pool.size())
+    n_replica = pool.size();
+  std::cout<<"Replicas: "<<n_replica<<" (CPU threads: "<<pool.size()<<")"<<std::endl;
+
+  std::cout<<"Loading fashion-mnist data...";
+  // training images stay in the mapped uint8 files; each replica converts
+  // only its slice of the current batch
+  MNIST dataset("./data/");
+  dataset.open();
+  std::cout<<"Done"<<std::endl;
+  const int n_train = std::min(dataset.train_images.count(),
+                               dataset.train_label_file.count());
+  if (n_train == 0) {
+    std::cerr<<"No training data found in ./data/"<<std::endl;
+    return;
+  }
+  Matrix test_data, test_labels;
+  dataset.test_images.to_float(0, dataset.test_images.count(), test_data);
+  dataset.test_label_file.to_float(0, dataset.test_label_file.count(), test_labels);
+  std::vector<int> order(n_train);
+  std::iota(order.begin(), order.end(), 0);
+  std::default_random_engine shuffle_engine(
+      std::chrono::system_clock::now().time_since_epoch().count());
+
+  std::vector<std::unique_ptr<Network> > replicas;
+  for (int r = 0; r < n_replica; r++) {
+    replicas.emplace_back(new Network);
+    buildNetwork_CPU(replicas[r].get());
+  }
+  // start every replica from replica 0's random initialization
+  for (int r = 1; r < n_replica; r++) {
+    replicas[r]->flat_parameters() = replicas[0]->flat_parameters();
+  }
+
+  std::vector<float> losses(n_replica);
+
+  for (int epoch = 0; epoch < n_epoch; epoch++) {
+    std::shuffle(order.begin(), order.end(), shuffle_engine);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    float epoch_loss = 0;
+    int n_batch = 0;
+
+    for (int start = 0; start < n_train; start += batch_size) {
+      const int n = std::min(batch_size, n_train - start);
+      const int n_used = std::min(n_replica, n);
+
+      // forward/backward on each replica's slice of the batch
+      pool.parallel_for(n_used, [&](int r, int tid) {
+        int first = start + n * r / n_used;
+        int count = start + n * (r + 1) / n_used - first;
+        Matrix x, labels;
+        dataset.train_images.to_float(&order[first], count, x);
+        dataset.train_label_file.to_float(&order[first], count, labels);
+        Matrix y = one_hot_encode(labels, 10);
+        replicas[r]->forward(x);
+        replicas[r]->backward(x, y);
+        // each replica's loss/gradient is a mean over its slice; weight it
+        // by the slice size so the reduction yields the batch mean
+        float scale = float(count) / n;
+        replicas[r]->flat_derivatives() *= scale;
+        losses[r] = replicas[r]->get_loss() * scale;
+      });
+
+      // tree reduction: log2(n_used) rounds of pairwise sums
+      for (int step = 1; step < n_used; step *= 2) {
+        int n_pair = (n_used - step + 2 * step - 1) / (2 * step);
+        pool.parallel_for(n_pair, [&](int k, int tid) {
+          int dst = k * 2 * step;
+          replicas[dst]->flat_derivatives() +=
+              replicas[dst + step]->flat_derivatives();
+          losses[dst] += losses[dst + step];
+        });
+      }
+
+      replicas[0]->update(opt);
+      pool.parallel_for(n_replica - 1, [&](int r, int tid) {
+        replicas[r + 1]->flat_parameters() = replicas[0]->flat_parameters();
+      });
+
+      epoch_loss += losses[0];
+      n_batch++;
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<float, std::milli> duration = (end_time - start_time);
+    std::cout<<"Epoch "<<epoch<<": loss "<<epoch_loss / n_batch
+             <<", time "<<duration.count()<<" ms"<<std::endl;
+
+    if (test_data.cols() > 0) {
+      replicas[0]->forward(test_data);
+      float acc = compute_accuracy(replicas[0]->output(), test_labels);
+      std::cout<<"Test Accuracy: "<<acc<<std::endl;
+    }
+  }
+
+  replicas[0]->save_parameters("./build/weights-86-trained.bin");
+}
+
+int main(int argc, char* argv[]) {
+
+  int n_epoch = 5;
+  int batch_size = 128;
+  int n_replica = 0;  // one per pool thread
+  float lr = 0;  // the optimizer's default
+  std::string optimizer = "sgd";
+
+  if (argc > 1)
+    n_epoch = atoi(argv[1]);
+  if (argc > 2)
+    batch_size = atoi(argv[2]);
+  if (argc > 3)
+    n_replica = atoi(argv[3]);
+  if (argc > 4)
+    lr = atof(argv[4]);
+  if (argc > 5)
+    optimizer = argv[5];
+
+  std::unique_ptr<Optimizer> opt;
+  if (optimizer == "adam") {
+    opt.reset(new Adam(lr > 0 ? lr : 0.001, 5e-4));
+  } else if (optimizer == "rmsprop") {
+    opt.reset(new RMSProp(lr > 0 ? lr : 0.001, 5e-4));
+  } else if (optimizer == "sgd") {
+    opt.reset(new SGD(lr > 0 ? lr : 0.01, 5e-4, 0.9, true));
+  } else {
+    std::cerr<<"Unknown optimizer "<<optimizer
+             <<" (expected sgd, adam or rmsprop)"<<std::endl;
+    return 1;
+  }
+
+  std::cout<<"Epochs: "<<n_epoch<<", batch size: "<<batch_size
+           <<", optimizer: "<<optimizer<<std::endl;
+  train(n_epoch, batch_size, n_replica, *opt);
+
+  return 0;
+}
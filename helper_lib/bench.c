@@ -0,0 +1,505 @@
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "bench.h"
+
+static OclBenchOp bench_ops[OCL_BENCH_MAX_OPS];
+static unsigned int bench_num_ops = 0;
+static const char *bench_device = NULL;
+
+cl_int OclBenchRegister(const char *name,
+                        cl_int (*setup)(void *user, const char *dataset, void **state,
+                                        double *ops, double *bytes),
+                        cl_int (*run)(void *user, void *state),
+                        void (*teardown)(void *user, void *state), void *user)
+{
+    if (bench_num_ops == OCL_BENCH_MAX_OPS)
+    {
+        return CL_OUT_OF_RESOURCES;
+    }
+
+    OclBenchOp *op = &bench_ops[bench_num_ops++];
+    op->name = name;
+    op->setup = setup;
+    op->run = run;
+    op->teardown = teardown;
+    op->user = user;
+
+    return CL_SUCCESS;
+}
+
+void OclBenchSetDevice(const char *name)
+{
+    bench_device = name;
+}
+
+int OclBenchDatasetHas(const char *dataset, const char *file)
+{
+    char path[4096];
+    struct stat info;
+
+    snprintf(path, sizeof(path), "%s/%s", dataset, file);
+    return stat(path, &info) == 0;
+}
+
+static double NowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+static int CompareDoubles(const void *a, const void *b)
+{
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+cl_int OclBenchMeasure(const OclBenchOp *op, void *state, double ops, double bytes,
+                       unsigned int warmup, unsigned int reps, OclBenchStats *stats,
+                       double *samples)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (reps == 0)
+    {
+        return CL_INVALID_VALUE;
+    }
+
+    double *times = (double *)malloc(sizeof(double) * reps);
+    if (times == NULL)
+    {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+
+    for (unsigned int i = 0; i < warmup && err == CL_SUCCESS; i++)
+    {
+        err = op->run(op->user, state);
+    }
+
+    // A sample of a few microseconds is mostly clock and scheduler noise, so
+    // double the runs per sample until one lasts OCL_BENCH_MIN_SAMPLE_MS
+    unsigned int batch = 1;
+    while (err == CL_SUCCESS && batch < OCL_BENCH_MAX_BATCH)
+    {
+        const double start = NowMs();
+        for (unsigned int k = 0; k < batch && err == CL_SUCCESS; k++)
+        {
+            err = op->run(op->user, state);
+        }
+        if (NowMs() - start >= OCL_BENCH_MIN_SAMPLE_MS)
+        {
+            break;
+        }
+        batch *= 2;
+    }
+
+    for (unsigned int i = 0; i < reps && err == CL_SUCCESS; i++)
+    {
+        const double start = NowMs();
+        for (unsigned int k = 0; k < batch && err == CL_SUCCESS; k++)
+        {
+            err = op->run(op->user, state);
+        }
+        times[i] = (NowMs() - start) / batch;
+    }
+
+    if (err == CL_SUCCESS && samples != NULL)
+    {
+        memcpy(samples, times, sizeof(double) * reps);
+    }
+
+    if (err == CL_SUCCESS)
+    {
+        double sum = 0, squares = 0;
+        for (unsigned int i = 0; i < reps; i++)
+        {
+            sum += times[i];
+        }
+        const double mean = sum / reps;
+        for (unsigned int i = 0; i < reps; i++)
+        {
+            squares += (times[i] - mean) * (times[i] - mean);
+        }
+
+        qsort(times, reps, sizeof(double), CompareDoubles);
+
+        stats->reps = reps;
+        stats->batch = batch;
+        stats->min_ms = times[0];
+        stats->median_ms =
+            reps % 2 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+        stats->mean_ms = mean;
+        // Nearest rank: the smallest time at least 95% of the runs are within
+        stats->p95_ms = times[(unsigned int)ceil(0.95 * reps) - 1];
+        stats->stddev_ms = reps > 1 ? sqrt(squares / (reps - 1)) : 0;
+        stats->gops = stats->median_ms > 0 ? ops / stats->median_ms / 1e6 : 0;
+        stats->gbs = stats->median_ms > 0 ? bytes / stats->median_ms / 1e6 : 0;
+    }
+
+    free(times);
+
+    return err;
+}
+
+// Datasets are numbered, so compare runs of digits by value
+static int NaturalCompare(const void *a, const void *b)
+{
+    const char *x = *(char *const *)a, *y = *(char *const *)b;
+
+    while (*x && *y)
+    {
+        if (*x >= '0' && *x <= '9' && *y >= '0' && *y <= '9')
+        {
+            char *x_end, *y_end;
+            const unsigned long i = strtoul(x, &x_end, 10), j = strtoul(y, &y_end, 10);
+            if (i != j)
+            {
+                return i < j ? -1 : 1;
+            }
+            x = x_end;
+            y = y_end;
+        }
+        else if (*x != *y)
+        {
+            return (unsigned char)*x - (unsigned char)*y;
+        }
+        else
+        {
+            x++;
+            y++;
+        }
+    }
+
+    return (unsigned char)*x - (unsigned char)*y;
+}
+
+/**
+ * @brief A growable array of strings, the datasets found so far.
+ */
+typedef struct _BenchList
+{
+    char **items;
+    unsigned int count;
+    unsigned int capacity;
+} BenchList;
+
+static int BenchListAppend(BenchList *list, const char *item)
+{
+    if (list->count == list->capacity)
+    {
+        unsigned int capacity = list->capacity ? 2 * list->capacity : 16;
+        char **items = (char **)realloc(list->items, sizeof(char *) * capacity);
+        if (items == NULL)
+        {
+            return 0;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    char *copy = (char *)malloc(strlen(item) + 1);
+    if (copy == NULL)
+    {
+        return 0;
+    }
+    strcpy(copy, item);
+    list->items[list->count++] = copy;
+
+    return 1;
+}
+
+static void BenchListFree(BenchList *list)
+{
+    for (unsigned int i = 0; i < list->count; i++)
+    {
+        free(list->items[i]);
+    }
+    free(list->items);
+}
+
+// Appends dir if it has no subdirectories, otherwise the datasets below it,
+// in natural order
+static int FindDatasets(const char *dir, BenchList *datasets)
+{
+    BenchList children = { NULL, 0, 0 };
+    char path[4096];
+    struct stat info;
+    struct dirent *entry;
+    int ok = 1;
+
+    DIR *handle = opendir(dir);
+    if (handle == NULL)
+    {
+        fprintf(stderr, "Cannot open dataset directory %s\n", dir);
+        return 0;
+    }
+
+    while (ok && (entry = readdir(handle)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (stat(path, &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            ok = BenchListAppend(&children, path);
+        }
+    }
+    closedir(handle);
+
+    if (ok && children.count == 0)
+    {
+        ok = BenchListAppend(datasets, dir);
+    }
+    else if (ok)
+    {
+        qsort(children.items, children.count, sizeof(char *), NaturalCompare);
+        for (unsigned int i = 0; i < children.count && ok; i++)
+        {
+            ok = FindDatasets(children.items[i], datasets);
+        }
+    }
+
+    BenchListFree(&children);
+
+    return ok;
+}
+
+// Rates of operations that report no work are printed as n/a
+static void PrintRate(FILE *out, double rate, const char *format)
+{
+    if (rate > 0)
+    {
+        fprintf(out, format, rate);
+    }
+    else
+    {
+        fprintf(out, "%10s", "n/a");
+    }
+}
+
+static void PrintJsonString(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            fputc('\\', out);
+        }
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void Usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s --bench [--warmup N] [--reps N] [--filter TEXT] [--csv FILE] "
+            "[--json FILE] DIR...\n",
+            program);
+}
+
+int OclBenchMain(int argc, char *argv[])
+{
+    unsigned int warmup = OCL_BENCH_DEFAULT_WARMUP, reps = OCL_BENCH_DEFAULT_REPS;
+    const char *filter = NULL, *csv_path = NULL, *json_path = NULL;
+    BenchList datasets = { NULL, 0, 0 };
+    FILE *csv = NULL, *json = NULL;
+    double *samples = NULL;
+    unsigned int rows = 0;
+    int failed = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const int has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--bench"))
+        {
+            continue;
+        }
+        else if (!strcmp(argv[i], "--warmup") && has_value)
+        {
+            warmup = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--reps") && has_value)
+        {
+            reps = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--filter") && has_value)
+        {
+            filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--csv") && has_value)
+        {
+            csv_path = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--json") && has_value)
+        {
+            json_path = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            Usage(argv[0]);
+            BenchListFree(&datasets);
+            return 1;
+        }
+        else if (!FindDatasets(argv[i], &datasets))
+        {
+            BenchListFree(&datasets);
+            return 1;
+        }
+    }
+
+    if (datasets.count == 0 || reps == 0)
+    {
+        Usage(argv[0]);
+        BenchListFree(&datasets);
+        return 1;
+    }
+
+    samples = (double *)malloc(sizeof(double) * reps);
+    if (samples == NULL)
+    {
+        BenchListFree(&datasets);
+        return 1;
+    }
+
+    if (csv_path != NULL && (csv = fopen(csv_path, "w")) == NULL)
+    {
+        fprintf(stderr, "Cannot write %s\n", csv_path);
+        free(samples);
+        BenchListFree(&datasets);
+        return 1;
+    }
+    if (json_path != NULL && (json = fopen(json_path, "w")) == NULL)
+    {
+        fprintf(stderr, "Cannot write %s\n", json_path);
+        if (csv != NULL)
+        {
+            fclose(csv);
+        }
+        free(samples);
+        BenchListFree(&datasets);
+        return 1;
+    }
+
+    if (bench_device != NULL)
+    {
+        printf("Device: %s\n", bench_device);
+    }
+    printf("%u warm-up and %u timed samples of at least %g ms per dataset; times in ms per run, "
+           "rates at the median\n\n",
+           warmup, reps, OCL_BENCH_MIN_SAMPLE_MS);
+    printf("%-16s %-28s %9s %9s %9s %9s %9s %10s %10s\n", "Operation", "Dataset", "Min",
+           "Median", "Mean", "P95", "Stddev", "GOPS", "GB/s");
+    if (csv != NULL)
+    {
+        fprintf(csv, "operation,dataset,reps,min_ms,median_ms,mean_ms,p95_ms,stddev_ms,gops,gbs\n");
+    }
+    if (json != NULL)
+    {
+        fputs("{\n  \"device\": ", json);
+        if (bench_device != NULL)
+        {
+            PrintJsonString(json, bench_device);
+        }
+        else
+        {
+            fputs("null", json);
+        }
+        fprintf(json, ",\n  \"warmup\": %u,\n  \"reps\": %u,\n  \"results\": [", warmup, reps);
+    }
+
+    // A failure or skip is reported and the sweep goes on with the next dataset
+    for (unsigned int i = 0; i < bench_num_ops; i++)
+    {
+        const OclBenchOp *op = &bench_ops[i];
+        if (filter != NULL && strstr(op->name, filter) == NULL)
+        {
+            continue;
+        }
+
+        for (unsigned int j = 0; j < datasets.count; j++)
+        {
+            const char *dataset = datasets.items[j];
+            void *state = NULL;
+            double ops = 0, bytes = 0;
+            OclBenchStats stats;
+
+            cl_int err = op->setup(op->user, dataset, &state, &ops, &bytes);
+            if (err == CL_SUCCESS)
+            {
+                err = OclBenchMeasure(op, state, ops, bytes, warmup, reps, &stats, samples);
+            }
+            if (state != NULL && op->teardown != NULL)
+            {
+                op->teardown(op->user, state);
+            }
+            if (err == OCL_BENCH_SKIPPED)
+            {
+                printf("%-16s %-28s skipped: missing inputs\n", op->name, dataset);
+                continue;
+            }
+            if (err != CL_SUCCESS)
+            {
+                fprintf(stderr, "%s on %s failed: %d\n", op->name, dataset, err);
+                failed = 1;
+                continue;
+            }
+
+            printf("%-16s %-28s %9.3f %9.3f %9.3f %9.3f %9.3f ", op->name, dataset, stats.min_ms,
+                   stats.median_ms, stats.mean_ms, stats.p95_ms, stats.stddev_ms);
+            PrintRate(stdout, stats.gops, "%10.2f");
+            putchar(' ');
+            PrintRate(stdout, stats.gbs, "%10.2f");
+            putchar('\n');
+
+            if (csv != NULL)
+            {
+                fprintf(csv, "%s,%s,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n", op->name, dataset,
+                        stats.reps, stats.min_ms, stats.median_ms, stats.mean_ms, stats.p95_ms,
+                        stats.stddev_ms, stats.gops, stats.gbs);
+            }
+            if (json != NULL)
+            {
+                fputs(rows ? ",\n    {\"operation\": " : "\n    {\"operation\": ", json);
+                PrintJsonString(json, op->name);
+                fputs(", \"dataset\": ", json);
+                PrintJsonString(json, dataset);
+                fprintf(json,
+                        ", \"reps\": %u, \"batch\": %u, \"min_ms\": %.6f, \"median_ms\": %.6f, "
+                        "\"mean_ms\": %.6f, \"p95_ms\": %.6f, \"stddev_ms\": %.6f, "
+                        "\"gops\": %.6f, \"gbs\": %.6f, \"times_ms\": [",
+                        stats.reps, stats.batch, stats.min_ms, stats.median_ms, stats.mean_ms,
+                        stats.p95_ms, stats.stddev_ms, stats.gops, stats.gbs);
+                for (unsigned int k = 0; k < reps; k++)
+                {
+                    fprintf(json, k ? ", %.6f" : "%.6f", samples[k]);
+                }
+                fputs("]}", json);
+            }
+            rows++;
+        }
+    }
+
+    if (json != NULL)
+    {
+        fputs(rows ? "\n  ]\n}\n" : "]\n}\n", json);
+        fclose(json);
+    }
+    if (csv != NULL)
+    {
+        fclose(csv);
+    }
+    free(samples);
+    BenchListFree(&datasets);
+
+    return failed;
+}
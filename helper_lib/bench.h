@@ -0,0 +1,126 @@
+#pragma once
+
+#include "device.h"
+
+#define OCL_BENCH_MAX_OPS 32
+#define OCL_BENCH_DEFAULT_WARMUP 3
+#define OCL_BENCH_DEFAULT_REPS 20
+#define OCL_BENCH_MIN_SAMPLE_MS 1.0
+#define OCL_BENCH_MAX_BATCH (1u << 20)
+#define OCL_BENCH_SKIPPED 1 // from setup: the dataset lacks the operation's inputs
+
+/**
+ * @brief An operation the benchmark harness can time on a dataset directory.
+ * setup loads the dataset into a new state and reports the work of one run;
+ * run performs one repetition and returns only once its results are back on
+ * the host; teardown frees the state, also one a failed setup left behind.
+ * setup returns OCL_BENCH_SKIPPED for a dataset without the files it reads,
+ * and the sweep reports the dataset as skipped rather than failed.
+ */
+typedef struct _OclBenchOp
+{
+    const char *name;
+    cl_int (*setup)(void *user, const char *dataset, void **state, double *ops, double *bytes);
+    cl_int (*run)(void *user, void *state);
+    void (*teardown)(void *user, void *state);
+    void *user;
+} OclBenchOp;
+
+/**
+ * @brief Timing statistics of one operation on one dataset, in milliseconds,
+ * with the rates at the median time (0 when the operation reports no work).
+ */
+typedef struct _OclBenchStats
+{
+    unsigned int reps;
+    unsigned int batch; // runs timed together in each of the reps samples
+    double min_ms;
+    double median_ms;
+    double mean_ms;
+    double p95_ms;
+    double stddev_ms;
+    double gops; // 10^9 operations (flops, or int operations) per second
+    double gbs;  // 10^9 bytes of global memory traffic per second
+} OclBenchStats;
+
+/**
+ * @brief Adds an operation to the harness. Each assignment registers its
+ * operations and hands its arguments to OclBenchMain.
+ *
+ * @param name The operation's name in reports, e.g. "gemm_tiled".
+ * @param setup Loads a dataset directory; ops and bytes receive the
+ * operations and global memory bytes of one run, 0 if unknown.
+ * @param run Runs the operation once, blocking until it is done.
+ * @param teardown Frees what setup made; may be NULL.
+ * @param user Passed to the three callbacks, e.g. an OclRuntime.
+ *
+ * @return CL_SUCCESS if and only if the operation is added;
+ * CL_OUT_OF_RESOURCES past OCL_BENCH_MAX_OPS.
+ */
+cl_int OclBenchRegister(const char *name,
+                        cl_int (*setup)(void *user, const char *dataset, void **state,
+                                        double *ops, double *bytes),
+                        cl_int (*run)(void *user, void *state),
+                        void (*teardown)(void *user, void *state), void *user);
+
+/**
+ * @brief Names the device the operations run on in the reports, so results
+ * from different devices are not compared by mistake.
+ *
+ * @param name The device name, e.g. runtime->device->name; must stay valid
+ * until OclBenchMain returns.
+ */
+void OclBenchSetDevice(const char *name);
+
+/**
+ * @brief Whether a dataset directory has a file, for setup to tell a dataset
+ * it cannot use from one that fails to load.
+ *
+ * @param dataset The dataset directory.
+ * @param file The file's name in it, e.g. "input0.raw".
+ *
+ * @return 1 if dataset/file exists, 0 otherwise.
+ */
+int OclBenchDatasetHas(const char *dataset, const char *file);
+
+/**
+ * @brief Times run warmup times untimed and then in reps samples, and
+ * summarizes the samples: the median and 95th percentile (nearest rank), mean
+ * and sample standard deviation. A sample runs the operation back to back as
+ * often as it takes to last OCL_BENCH_MIN_SAMPLE_MS, a power of two times up
+ * to OCL_BENCH_MAX_BATCH, and counts its time divided by the runs.
+ *
+ * @param op The operation.
+ * @param state Its state from setup.
+ * @param ops Operations of one run, for stats->gops.
+ * @param bytes Bytes of one run, for stats->gbs.
+ * @param warmup Untimed runs first.
+ * @param reps Timed samples, at least 1.
+ * @param stats The destination for the statistics.
+ * @param samples NULL, or the destination for the reps times in ms per run, in
+ * the order they ran.
+ *
+ * @return CL_SUCCESS if and only if every run succeeds.
+ */
+cl_int OclBenchMeasure(const OclBenchOp *op, void *state, double ops, double bytes,
+                       unsigned int warmup, unsigned int reps, OclBenchStats *stats,
+                       double *samples);
+
+/**
+ * @brief The harness's command line: times every registered operation on
+ * every dataset and prints a table, optionally also writing CSV and JSON.
+ *
+ *     [--warmup N] [--reps N] [--filter TEXT] [--csv FILE] [--json FILE] DIR...
+ *
+ * A DIR with subdirectories is swept: each directory below it without
+ * subdirectories of its own is a dataset, in natural order (Dataset/2 before
+ * Dataset/10). --filter keeps the operations whose names contain TEXT. The
+ * CSV and JSON files get one row or object per operation and dataset; the
+ * JSON also has the device and every timed sample, for utils/bench_compare.py.
+ *
+ * @param argc The number of arguments, argv[0] included.
+ * @param argv The arguments; argv[0] names the program in the usage message.
+ *
+ * @return 0 if every operation ran on every dataset, 1 otherwise.
+ */
+int OclBenchMain(int argc, char *argv[]);
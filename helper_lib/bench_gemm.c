@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_gemm.h"
+#include "matrix.h"
+
+cl_int OclBenchGemmSetup(OclTranspose trans_a, const char *dataset, void **state, double *ops,
+                         double *bytes)
+{
+    if (!OclBenchDatasetHas(dataset, "input0.raw") || !OclBenchDatasetHas(dataset, "input1.raw"))
+    {
+        return OCL_BENCH_SKIPPED;
+    }
+
+    OclBenchGemm *gemm = (OclBenchGemm *)calloc(1, sizeof(OclBenchGemm));
+    char path[4096];
+    cl_int err;
+
+    *state = gemm;
+    if (gemm == NULL)
+    {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+
+    snprintf(path, sizeof(path), "%s/input0.raw", dataset);
+    err = LoadMatrix(path, &gemm->a);
+    if (err == CL_SUCCESS)
+    {
+        snprintf(path, sizeof(path), "%s/input1.raw", dataset);
+        err = LoadMatrix(path, &gemm->b);
+    }
+    if (err == CL_SUCCESS)
+    {
+        const double m = gemm->a.shape[trans_a ? 1 : 0], k = gemm->a.shape[trans_a ? 0 : 1];
+        const double n = gemm->b.shape[1];
+        gemm->c.shape[0] = gemm->a.shape[trans_a ? 1 : 0];
+        gemm->c.shape[1] = gemm->b.shape[1];
+        gemm->c.data = (int *)malloc(sizeof(int) * gemm->c.shape[0] * gemm->c.shape[1]);
+        if (gemm->c.data == NULL)
+        {
+            return CL_OUT_OF_HOST_MEMORY;
+        }
+        *ops = 2 * m * n * k;
+        *bytes = sizeof(int) * (m * k + k * n + m * n);
+    }
+
+    return err;
+}
+
+void OclBenchGemmTeardown(void *user, void *state)
+{
+    OclBenchGemm *gemm = (OclBenchGemm *)state;
+    free(gemm->a.data);
+    free(gemm->b.data);
+    free(gemm->c.data);
+    free(gemm);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "bench.h"
+#include "gemm.h"
+
+/**
+ * @brief A GEMM benchmark's data, C = op(A) B: A and B as loaded from a
+ * dataset directory and C allocated for the product.
+ */
+typedef struct _OclBenchGemm
+{
+    Matrix a;
+    Matrix b;
+    Matrix c;
+} OclBenchGemm;
+
+/**
+ * @brief The setup of a GEMM operation, loaded and allocated once and used by
+ * every run: A from input0.raw and B from input1.raw in dataset, and C. ops
+ * and bytes are those of the classical product (2 m n k, and A, B and C
+ * each moved once), whatever the algorithm, so the rates of different GEMM
+ * operations on a dataset compare as their times do.
+ *
+ * @param trans_a Whether the operation reads A transposed, for C's shape.
+ * @param dataset The dataset directory.
+ * @param state The destination for a new OclBenchGemm; free it with
+ * OclBenchGemmTeardown, also when this fails.
+ * @param ops The destination for the operations of one run.
+ * @param bytes The destination for the bytes of one run.
+ *
+ * @return CL_SUCCESS if and only if A and B are loaded and C is allocated;
+ * OCL_BENCH_SKIPPED when dataset has no input0.raw or input1.raw;
+ * CL_OUT_OF_HOST_MEMORY when an allocation fails.
+ */
+cl_int OclBenchGemmSetup(OclTranspose trans_a, const char *dataset, void **state, double *ops,
+                         double *bytes);
+
+/**
+ * @brief The teardown of a GEMM operation: frees an OclBenchGemm and its
+ * matrices.
+ *
+ * @param user Unused.
+ * @param state The OclBenchGemm.
+ */
+void OclBenchGemmTeardown(void *user, void *state);
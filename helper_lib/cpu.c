@@ -0,0 +1,1227 @@
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OCL_CPU_X86 1
+#include <immintrin.h>
+#define OCL_CPU_AVX2_TARGET __attribute__((target("avx2,fma")))
+#define OCL_CPU_AVX512_TARGET __attribute__((target("avx512f")))
+#endif
+
+#define OCL_CPU_MAX_THREADS 256
+#define OCL_CPU_CACHELINE 64
+
+// Elementwise programs: instructions, stack depth and elements per block
+#define OCL_CPU_MAX_CODE 256
+#define OCL_CPU_MAX_DEPTH 16
+#define OCL_CPU_BLOCK 512
+
+// GEMM blocking: MR x NR register tiles, MC x NC tiles of C per task, and
+// KC deep panels, so a packed A block (64 KB) and B block (128 KB) stay in L2
+#define OCL_CPU_MR 8
+#define OCL_CPU_NR 16
+#define OCL_CPU_MC 64
+#define OCL_CPU_NC 128
+#define OCL_CPU_KC 256
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static OclCpuIsa isa = OCL_CPU_SCALAR;
+
+static void DetectIsa(void)
+{
+    OclCpuIsa cap = OCL_CPU_AVX512;
+    const char *name = getenv("OCL_CPU_ISA");
+
+    if (name && strcmp(name, "scalar") == 0)
+        cap = OCL_CPU_SCALAR;
+    else if (name && strcmp(name, "avx2") == 0)
+        cap = OCL_CPU_AVX2;
+
+#ifdef OCL_CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        isa = OCL_CPU_AVX512;
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        isa = OCL_CPU_AVX2;
+#endif
+    if (isa > cap)
+        isa = cap;
+}
+
+OclCpuIsa OclCpuGetIsa(void)
+{
+    pthread_once(&isa_once, DetectIsa);
+    return isa;
+}
+
+/* ----------------------------------------------------------------------------
+ * Thread pool
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief One thread's share of the iterations of a loop, on a cache line of
+ * its own; the owner takes from the front and thieves from the back.
+ */
+typedef struct _OclCpuShare
+{
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+    char padding[OCL_CPU_CACHELINE];
+} OclCpuShare;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static unsigned int pool_num_threads = 1;
+static pthread_t *pool_threads = NULL;
+static OclCpuShare *pool_shares = NULL;
+static pthread_mutex_t pool_loop_lock = PTHREAD_MUTEX_INITIALIZER; // one loop at a time
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;      // guards what follows
+static pthread_cond_t pool_work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_work_done = PTHREAD_COND_INITIALIZER;
+static unsigned long pool_generation = 0;
+static unsigned int pool_busy = 0;
+static int pool_shutdown = 0;
+static OclCpuTask pool_task;
+static void *pool_arg;
+static size_t pool_grain;
+static __thread int pool_in_task = 0;
+static __thread unsigned int pool_slot = 0; // this thread's share in the running loop
+
+static int PoolTake(OclCpuShare *share, size_t *begin, size_t *end)
+{
+    int taken = 0;
+
+    pthread_mutex_lock(&share->lock);
+    if (share->begin < share->end)
+    {
+        *begin = share->begin;
+        *end = share->end - share->begin > pool_grain ? share->begin + pool_grain : share->end;
+        share->begin = *end;
+        taken = 1;
+    }
+    pthread_mutex_unlock(&share->lock);
+
+    return taken;
+}
+
+// Takes the back half of the largest share into the thief's own, and its
+// first grain into [begin, end)
+static int PoolSteal(unsigned int self, size_t *begin, size_t *end)
+{
+    for (;;)
+    {
+        unsigned int victim = 0;
+        size_t largest = 0;
+        for (unsigned int i = 0; i < pool_num_threads; i++)
+        {
+            pthread_mutex_lock(&pool_shares[i].lock);
+            size_t remaining = pool_shares[i].end - pool_shares[i].begin;
+            pthread_mutex_unlock(&pool_shares[i].lock);
+            if (remaining > largest)
+            {
+                largest = remaining;
+                victim = i;
+            }
+        }
+        if (largest == 0)
+            return 0;
+
+        OclCpuShare *share = &pool_shares[victim];
+        size_t stolen_begin, stolen_end;
+        pthread_mutex_lock(&share->lock);
+        size_t remaining = share->end - share->begin;
+        stolen_end = share->end;
+        stolen_begin = remaining > pool_grain ? share->end - remaining / 2 : share->begin;
+        share->end = stolen_begin;
+        pthread_mutex_unlock(&share->lock);
+        if (stolen_begin == stolen_end)
+            continue; // emptied in the meantime
+
+        *begin = stolen_begin;
+        *end = stolen_end - stolen_begin > pool_grain ? stolen_begin + pool_grain : stolen_end;
+        if (*end < stolen_end)
+        {
+            OclCpuShare *own = &pool_shares[self];
+            pthread_mutex_lock(&own->lock);
+            own->begin = *end;
+            own->end = stolen_end;
+            pthread_mutex_unlock(&own->lock);
+        }
+        return 1;
+    }
+}
+
+static void PoolRun(unsigned int self)
+{
+    size_t begin, end;
+
+    while (PoolTake(&pool_shares[self], &begin, &end) || PoolSteal(self, &begin, &end))
+        pool_task(pool_arg, begin, end);
+}
+
+static void *PoolWorker(void *arg)
+{
+    const unsigned int self = (unsigned int)(size_t)arg;
+    unsigned long seen = 0;
+
+    pool_in_task = 1;
+    pool_slot = self;
+    pthread_mutex_lock(&pool_lock);
+    for (;;)
+    {
+        while (!pool_shutdown && pool_generation == seen)
+            pthread_cond_wait(&pool_work_ready, &pool_lock);
+        if (pool_shutdown)
+            break;
+        seen = pool_generation;
+        pthread_mutex_unlock(&pool_lock);
+
+        PoolRun(self);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--pool_busy == 0)
+            pthread_cond_signal(&pool_work_done);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    return NULL;
+}
+
+static void PoolStop(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    pool_shutdown = 1;
+    pthread_cond_broadcast(&pool_work_ready);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (unsigned int i = 1; i < pool_num_threads; i++)
+        pthread_join(pool_threads[i], NULL);
+    for (unsigned int i = 0; i < pool_num_threads; i++)
+        pthread_mutex_destroy(&pool_shares[i].lock);
+    free(pool_threads);
+    free(pool_shares);
+    pool_threads = NULL;
+    pool_shares = NULL;
+    pool_num_threads = 1;
+}
+
+static void PoolStart(void)
+{
+    const char *threads = getenv("OCL_CPU_THREADS");
+    long n = threads ? atol(threads) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+        n = 1;
+    if (n > OCL_CPU_MAX_THREADS)
+        n = OCL_CPU_MAX_THREADS;
+
+    pool_threads = (pthread_t *)calloc(n, sizeof(pthread_t));
+    pool_shares = (OclCpuShare *)calloc(n, sizeof(OclCpuShare));
+    if (!pool_threads || !pool_shares)
+    {
+        free(pool_threads);
+        free(pool_shares);
+        pool_threads = NULL;
+        pool_shares = NULL;
+        return;
+    }
+    for (long i = 0; i < n; i++)
+        pthread_mutex_init(&pool_shares[i].lock, NULL);
+
+    // Thread 0 is whoever calls OclCpuParallelFor
+    pool_num_threads = 1;
+    for (long i = 1; i < n; i++)
+    {
+        if (pthread_create(&pool_threads[i], NULL, PoolWorker, (void *)(size_t)i) != 0)
+            break;
+        pool_num_threads++;
+    }
+    atexit(PoolStop);
+}
+
+unsigned int OclCpuThreads(void)
+{
+    pthread_once(&pool_once, PoolStart);
+    return pool_num_threads;
+}
+
+void OclCpuParallelFor(size_t count, size_t grain, OclCpuTask task, void *arg)
+{
+    if (grain == 0)
+        grain = 1;
+
+    if (OclCpuThreads() == 1 || count <= grain || pool_in_task ||
+        pthread_mutex_trylock(&pool_loop_lock) != 0)
+    {
+        // the only thread in this loop, so it takes share 0
+        const unsigned int slot = pool_slot;
+        pool_slot = 0;
+        for (size_t begin = 0; begin < count; begin += grain)
+            task(arg, begin, count - begin > grain ? begin + grain : count);
+        pool_slot = slot;
+        return;
+    }
+
+    for (unsigned int i = 0; i < pool_num_threads; i++)
+    {
+        pool_shares[i].begin = count * i / pool_num_threads;
+        pool_shares[i].end = count * (i + 1) / pool_num_threads;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    pool_task = task;
+    pool_arg = arg;
+    pool_grain = grain;
+    pool_busy = pool_num_threads - 1;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_work_ready);
+    pthread_mutex_unlock(&pool_lock);
+
+    pool_in_task = 1;
+    PoolRun(0);
+    pool_in_task = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    while (pool_busy > 0)
+        pthread_cond_wait(&pool_work_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+
+    pthread_mutex_unlock(&pool_loop_lock);
+}
+
+/* ----------------------------------------------------------------------------
+ * Device properties
+ * ------------------------------------------------------------------------- */
+
+static pthread_once_t device_once = PTHREAD_ONCE_INIT;
+static OclDeviceProp device;
+static char device_name[64];
+
+static void InitDevice(void)
+{
+    static const char *isa_names[] = { "scalar", "AVX2", "AVX-512" };
+    static const cl_uint vector_bytes[] = { 16, 32, 64 };
+    const OclCpuIsa isa = OclCpuGetIsa();
+
+    snprintf(device_name, sizeof(device_name), "Native CPU (%s)", isa_names[isa]);
+    device.name = device_name;
+    device.vendor = (char *)"helper_lib";
+    device.version = (char *)"native";
+    device.driver_version = (char *)"native";
+    device.extensions = (char *)"";
+    device.type = CL_DEVICE_TYPE_CPU;
+    device.max_compute_units = OclCpuThreads();
+    device.global_mem_size =
+        (cl_ulong)sysconf(_SC_PHYS_PAGES) * (cl_ulong)sysconf(_SC_PAGESIZE);
+    device.max_mem_alloc_size = device.global_mem_size;
+    device.global_mem_cacheline_size = OCL_CPU_CACHELINE;
+    device.max_work_item_dimensions = 1;
+    device.max_work_item_sizes[0] = 1;
+    device.max_work_group_size = 1;
+    device.preferred_vector_width_char = vector_bytes[isa];
+    device.preferred_vector_width_int = vector_bytes[isa] / 4;
+    device.preferred_vector_width_float = vector_bytes[isa] / 4;
+    device.preferred_vector_width_double = vector_bytes[isa] / 8;
+    device.device_id = NULL;
+}
+
+const OclDeviceProp *OclCpuDeviceProp(void)
+{
+    pthread_once(&device_once, InitDevice);
+    return &device;
+}
+
+/* ----------------------------------------------------------------------------
+ * Vector primitives: dst = x op y over n elements, and acc += w * x
+ * ------------------------------------------------------------------------- */
+
+enum
+{
+    OCL_CPU_INPUT,
+    OCL_CPU_CONST,
+    OCL_CPU_NEG,
+    OCL_CPU_NOT,
+    OCL_CPU_MUL,
+    OCL_CPU_DIV,
+    OCL_CPU_MOD,
+    OCL_CPU_ADD,
+    OCL_CPU_SUB,
+    OCL_CPU_SHL,
+    OCL_CPU_SHR,
+    OCL_CPU_AND,
+    OCL_CPU_XOR,
+    OCL_CPU_OR
+};
+
+// Signed overflow wraps, as on the device, by computing in unsigned
+static void BinaryScalar(int op, int *dst, const int *x, const int *y, size_t n)
+{
+    size_t i;
+
+    switch (op)
+    {
+    case OCL_CPU_ADD:
+        for (i = 0; i < n; i++)
+            dst[i] = (int)((unsigned int)x[i] + (unsigned int)y[i]);
+        break;
+    case OCL_CPU_SUB:
+        for (i = 0; i < n; i++)
+            dst[i] = (int)((unsigned int)x[i] - (unsigned int)y[i]);
+        break;
+    case OCL_CPU_MUL:
+        for (i = 0; i < n; i++)
+            dst[i] = (int)((unsigned int)x[i] * (unsigned int)y[i]);
+        break;
+    case OCL_CPU_DIV:
+        for (i = 0; i < n; i++)
+            dst[i] = y[i] == 0 ? 0 : y[i] == -1 ? (int)(0u - (unsigned int)x[i]) : x[i] / y[i];
+        break;
+    case OCL_CPU_MOD:
+        for (i = 0; i < n; i++)
+            dst[i] = y[i] == 0 || y[i] == -1 ? 0 : x[i] % y[i];
+        break;
+    case OCL_CPU_SHL:
+        for (i = 0; i < n; i++)
+            dst[i] = (int)((unsigned int)x[i] << (y[i] & 31));
+        break;
+    case OCL_CPU_SHR:
+        for (i = 0; i < n; i++)
+            dst[i] = x[i] >> (y[i] & 31);
+        break;
+    case OCL_CPU_AND:
+        for (i = 0; i < n; i++)
+            dst[i] = x[i] & y[i];
+        break;
+    case OCL_CPU_XOR:
+        for (i = 0; i < n; i++)
+            dst[i] = x[i] ^ y[i];
+        break;
+    case OCL_CPU_OR:
+        for (i = 0; i < n; i++)
+            dst[i] = x[i] | y[i];
+        break;
+    }
+}
+
+static void AxpyIntScalar(int *acc, int w, const int *x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        acc[i] = (int)((unsigned int)acc[i] + (unsigned int)w * (unsigned int)x[i]);
+}
+
+static void AxpyFloatScalar(float *acc, float w, const float *x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        acc[i] += w * x[i];
+}
+
+#ifdef OCL_CPU_X86
+
+#define OCL_CPU_LOOP_AVX2(f)                                                            \
+    for (; i + 8 <= n; i += 8)                                                          \
+        _mm256_storeu_si256((__m256i *)(dst + i),                                       \
+                            f(_mm256_loadu_si256((const __m256i *)(x + i)),             \
+                              _mm256_loadu_si256((const __m256i *)(y + i))))
+
+OCL_CPU_AVX2_TARGET static inline __m256i ShlAvx2(__m256i x, __m256i y)
+{
+    return _mm256_sllv_epi32(x, _mm256_and_si256(y, _mm256_set1_epi32(31)));
+}
+
+OCL_CPU_AVX2_TARGET static inline __m256i ShrAvx2(__m256i x, __m256i y)
+{
+    return _mm256_srav_epi32(x, _mm256_and_si256(y, _mm256_set1_epi32(31)));
+}
+
+// Division and modulo have no vector instruction and stay scalar
+OCL_CPU_AVX2_TARGET static void BinaryAvx2(int op, int *dst, const int *x, const int *y, size_t n)
+{
+    size_t i = 0;
+
+    switch (op)
+    {
+    case OCL_CPU_ADD: OCL_CPU_LOOP_AVX2(_mm256_add_epi32); break;
+    case OCL_CPU_SUB: OCL_CPU_LOOP_AVX2(_mm256_sub_epi32); break;
+    case OCL_CPU_MUL: OCL_CPU_LOOP_AVX2(_mm256_mullo_epi32); break;
+    case OCL_CPU_SHL: OCL_CPU_LOOP_AVX2(ShlAvx2); break;
+    case OCL_CPU_SHR: OCL_CPU_LOOP_AVX2(ShrAvx2); break;
+    case OCL_CPU_AND: OCL_CPU_LOOP_AVX2(_mm256_and_si256); break;
+    case OCL_CPU_XOR: OCL_CPU_LOOP_AVX2(_mm256_xor_si256); break;
+    case OCL_CPU_OR: OCL_CPU_LOOP_AVX2(_mm256_or_si256); break;
+    }
+    BinaryScalar(op, dst + i, x + i, y + i, n - i);
+}
+
+OCL_CPU_AVX2_TARGET static void AxpyIntAvx2(int *acc, int w, const int *x, size_t n)
+{
+    const __m256i weight = _mm256_set1_epi32(w);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i sum = _mm256_loadu_si256((const __m256i *)(acc + i));
+        __m256i product = _mm256_mullo_epi32(weight, _mm256_loadu_si256((const __m256i *)(x + i)));
+        _mm256_storeu_si256((__m256i *)(acc + i), _mm256_add_epi32(sum, product));
+    }
+    AxpyIntScalar(acc + i, w, x + i, n - i);
+}
+
+OCL_CPU_AVX2_TARGET static void AxpyFloatAvx2(float *acc, float w, const float *x, size_t n)
+{
+    const __m256 weight = _mm256_set1_ps(w);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(acc + i,
+                         _mm256_fmadd_ps(weight, _mm256_loadu_ps(x + i), _mm256_loadu_ps(acc + i)));
+    AxpyFloatScalar(acc + i, w, x + i, n - i);
+}
+
+#define OCL_CPU_LOOP_AVX512(f)                                                          \
+    for (; i + 16 <= n; i += 16)                                                        \
+        _mm512_storeu_si512(dst + i, f(_mm512_loadu_si512(x + i), _mm512_loadu_si512(y + i)))
+
+// The zero-masked forms, as g++ warns about the unmasked ones' undefined
+// pass-through operand
+OCL_CPU_AVX512_TARGET static inline __m512i ShlAvx512(__m512i x, __m512i y)
+{
+    return _mm512_maskz_sllv_epi32((__mmask16)-1, x, _mm512_and_si512(y, _mm512_set1_epi32(31)));
+}
+
+OCL_CPU_AVX512_TARGET static inline __m512i ShrAvx512(__m512i x, __m512i y)
+{
+    return _mm512_maskz_srav_epi32((__mmask16)-1, x, _mm512_and_si512(y, _mm512_set1_epi32(31)));
+}
+
+OCL_CPU_AVX512_TARGET static void BinaryAvx512(int op, int *dst, const int *x, const int *y,
+                                               size_t n)
+{
+    size_t i = 0;
+
+    switch (op)
+    {
+    case OCL_CPU_ADD: OCL_CPU_LOOP_AVX512(_mm512_add_epi32); break;
+    case OCL_CPU_SUB: OCL_CPU_LOOP_AVX512(_mm512_sub_epi32); break;
+    case OCL_CPU_MUL: OCL_CPU_LOOP_AVX512(_mm512_mullo_epi32); break;
+    case OCL_CPU_SHL: OCL_CPU_LOOP_AVX512(ShlAvx512); break;
+    case OCL_CPU_SHR: OCL_CPU_LOOP_AVX512(ShrAvx512); break;
+    case OCL_CPU_AND: OCL_CPU_LOOP_AVX512(_mm512_and_si512); break;
+    case OCL_CPU_XOR: OCL_CPU_LOOP_AVX512(_mm512_xor_si512); break;
+    case OCL_CPU_OR: OCL_CPU_LOOP_AVX512(_mm512_or_si512); break;
+    }
+    BinaryScalar(op, dst + i, x + i, y + i, n - i);
+}
+
+OCL_CPU_AVX512_TARGET static void AxpyIntAvx512(int *acc, int w, const int *x, size_t n)
+{
+    const __m512i weight = _mm512_set1_epi32(w);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i product = _mm512_mullo_epi32(weight, _mm512_loadu_si512(x + i));
+        _mm512_storeu_si512(acc + i, _mm512_add_epi32(_mm512_loadu_si512(acc + i), product));
+    }
+    AxpyIntScalar(acc + i, w, x + i, n - i);
+}
+
+OCL_CPU_AVX512_TARGET static void AxpyFloatAvx512(float *acc, float w, const float *x, size_t n)
+{
+    const __m512 weight = _mm512_set1_ps(w);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(acc + i,
+                         _mm512_fmadd_ps(weight, _mm512_loadu_ps(x + i), _mm512_loadu_ps(acc + i)));
+    AxpyFloatScalar(acc + i, w, x + i, n - i);
+}
+
+#endif // OCL_CPU_X86
+
+typedef void (*OclCpuBinaryFn)(int op, int *dst, const int *x, const int *y, size_t n);
+typedef void (*OclCpuAxpyIntFn)(int *acc, int w, const int *x, size_t n);
+typedef void (*OclCpuAxpyFloatFn)(float *acc, float w, const float *x, size_t n);
+
+static OclCpuBinaryFn BinaryFor(OclCpuIsa isa)
+{
+#ifdef OCL_CPU_X86
+    if (isa == OCL_CPU_AVX512)
+        return BinaryAvx512;
+    if (isa == OCL_CPU_AVX2)
+        return BinaryAvx2;
+#endif
+    return BinaryScalar;
+}
+
+static OclCpuAxpyIntFn AxpyIntFor(OclCpuIsa isa)
+{
+#ifdef OCL_CPU_X86
+    if (isa == OCL_CPU_AVX512)
+        return AxpyIntAvx512;
+    if (isa == OCL_CPU_AVX2)
+        return AxpyIntAvx2;
+#endif
+    return AxpyIntScalar;
+}
+
+static OclCpuAxpyFloatFn AxpyFloatFor(OclCpuIsa isa)
+{
+#ifdef OCL_CPU_X86
+    if (isa == OCL_CPU_AVX512)
+        return AxpyFloatAvx512;
+    if (isa == OCL_CPU_AVX2)
+        return AxpyFloatAvx2;
+#endif
+    return AxpyFloatScalar;
+}
+
+/* ----------------------------------------------------------------------------
+ * Elementwise expressions
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief One instruction of a compiled expression, which runs on a stack of
+ * blocks: an input or constant is pushed, an operator replaces its operands.
+ */
+typedef struct _OclCpuInstr
+{
+    int op;
+    int value; // the input index or the constant
+} OclCpuInstr;
+
+typedef struct _OclCpuProgram
+{
+    OclCpuInstr code[OCL_CPU_MAX_CODE];
+    unsigned int length;
+    unsigned int depth;
+    unsigned int max_depth;
+    unsigned int num_inputs;
+    const char *p;
+    int ok;
+} OclCpuProgram;
+
+static void Emit(OclCpuProgram *program, int op, int value)
+{
+    if (program->length == OCL_CPU_MAX_CODE)
+    {
+        program->ok = 0;
+        return;
+    }
+    program->code[program->length].op = op;
+    program->code[program->length].value = value;
+    program->length++;
+
+    if (op == OCL_CPU_INPUT || op == OCL_CPU_CONST)
+        program->depth++;
+    else if (op != OCL_CPU_NEG && op != OCL_CPU_NOT)
+        program->depth--;
+    if (program->depth > program->max_depth)
+        program->max_depth = program->depth;
+}
+
+static void SkipSpaces(OclCpuProgram *program)
+{
+    while (*program->p == ' ' || *program->p == '\t' || *program->p == '\n')
+        program->p++;
+}
+
+// Binary operator at p, with its precedence (C's, higher binds tighter) and
+// length, or -1
+static int PeekOperator(const char *p, int *op, int *length)
+{
+    static const struct
+    {
+        const char *text;
+        int op;
+        int precedence;
+    } operators[] = {
+        { "<<", OCL_CPU_SHL, 3 }, { ">>", OCL_CPU_SHR, 3 }, { "*", OCL_CPU_MUL, 5 },
+        { "/", OCL_CPU_DIV, 5 },  { "%", OCL_CPU_MOD, 5 },  { "+", OCL_CPU_ADD, 4 },
+        { "-", OCL_CPU_SUB, 4 },  { "&", OCL_CPU_AND, 2 },  { "^", OCL_CPU_XOR, 1 },
+        { "|", OCL_CPU_OR, 0 },
+    };
+
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++)
+    {
+        const size_t n = strlen(operators[i].text);
+        if (strncmp(p, operators[i].text, n) == 0)
+        {
+            *op = operators[i].op;
+            *length = (int)n;
+            return operators[i].precedence;
+        }
+    }
+    return -1;
+}
+
+static void ParseExpression(OclCpuProgram *program, int min_precedence);
+
+static void ParseUnary(OclCpuProgram *program)
+{
+    SkipSpaces(program);
+    const char c = *program->p;
+
+    if (c == '(')
+    {
+        program->p++;
+        ParseExpression(program, 0);
+        SkipSpaces(program);
+        if (*program->p != ')')
+            program->ok = 0;
+        else
+            program->p++;
+    }
+    else if (c == '-' || c == '~' || c == '+')
+    {
+        program->p++;
+        ParseUnary(program);
+        if (c != '+')
+            Emit(program, c == '-' ? OCL_CPU_NEG : OCL_CPU_NOT, 0);
+    }
+    else if (c >= '0' && c <= '9')
+    {
+        char *end;
+        const unsigned long value = strtoul(program->p, &end, 0);
+        program->p = end;
+        while (*program->p == 'u' || *program->p == 'U')
+            program->p++;
+        Emit(program, OCL_CPU_CONST, (int)(unsigned int)value);
+    }
+    else if (c >= 'a' && c <= 'z' && !isalnum((unsigned char)program->p[1]) &&
+             program->p[1] != '_' && (unsigned int)(c - 'a') < program->num_inputs)
+    {
+        program->p++;
+        Emit(program, OCL_CPU_INPUT, c - 'a');
+    }
+    else
+    {
+        program->ok = 0;
+    }
+}
+
+// Precedence climbing: operands bind to operators of at least min_precedence
+static void ParseExpression(OclCpuProgram *program, int min_precedence)
+{
+    ParseUnary(program);
+
+    while (program->ok)
+    {
+        int op = 0, length = 0;
+        SkipSpaces(program);
+        const int precedence = PeekOperator(program->p, &op, &length);
+        if (precedence < min_precedence)
+            break;
+        program->p += length;
+        ParseExpression(program, precedence + 1);
+        Emit(program, op, 0);
+    }
+}
+
+static int Compile(OclCpuProgram *program, const char *expr, unsigned int num_inputs)
+{
+    memset(program, 0, sizeof(*program));
+    program->p = expr;
+    program->num_inputs = num_inputs;
+    program->ok = 1;
+
+    ParseExpression(program, 0);
+    SkipSpaces(program);
+
+    return program->ok && *program->p == '\0' && program->depth == 1 &&
+           program->max_depth <= OCL_CPU_MAX_DEPTH;
+}
+
+typedef struct _OclCpuElementwiseJob
+{
+    const OclCpuProgram *program;
+    const int *const *inputs;
+    int *output;
+    size_t n;
+    OclCpuBinaryFn binary;
+} OclCpuElementwiseJob;
+
+static void ElementwiseTask(void *arg, size_t begin, size_t end)
+{
+    const OclCpuElementwiseJob *job = (const OclCpuElementwiseJob *)arg;
+    const OclCpuProgram *program = job->program;
+    int scratch[OCL_CPU_MAX_DEPTH][OCL_CPU_BLOCK];
+    const int *stack[OCL_CPU_MAX_DEPTH];
+
+    for (size_t block = begin; block < end; block++)
+    {
+        const size_t first = block * OCL_CPU_BLOCK;
+        const size_t n = job->n - first < OCL_CPU_BLOCK ? job->n - first : OCL_CPU_BLOCK;
+        int *output = job->output + first;
+        unsigned int sp = 0;
+
+        for (unsigned int pc = 0; pc < program->length; pc++)
+        {
+            const OclCpuInstr *instr = &program->code[pc];
+            // the last instruction writes straight to the output
+            int *dst = pc + 1 == program->length ? output : NULL;
+
+            switch (instr->op)
+            {
+            case OCL_CPU_INPUT:
+                stack[sp++] = job->inputs[instr->value] + first;
+                break;
+            case OCL_CPU_CONST:
+                dst = dst ? dst : scratch[sp];
+                for (size_t i = 0; i < n; i++)
+                    dst[i] = instr->value;
+                stack[sp++] = dst;
+                break;
+            case OCL_CPU_NEG:
+            case OCL_CPU_NOT:
+                dst = dst ? dst : scratch[sp - 1];
+                for (size_t i = 0; i < n; i++)
+                    dst[i] = instr->op == OCL_CPU_NEG ? (int)(0u - (unsigned int)stack[sp - 1][i])
+                                                      : ~stack[sp - 1][i];
+                stack[sp - 1] = dst;
+                break;
+            default:
+                dst = dst ? dst : scratch[sp - 2];
+                job->binary(instr->op, dst, stack[sp - 2], stack[sp - 1], n);
+                stack[sp - 2] = dst;
+                sp--;
+                break;
+            }
+        }
+
+        // an expression that is a single input
+        if (stack[0] != output)
+            memmove(output, stack[0], n * sizeof(int));
+    }
+}
+
+cl_int OclCpuElementwise(const char *expr, const int *const *inputs, unsigned int num_inputs,
+                         int *output, size_t n)
+{
+    OclCpuProgram *program = (OclCpuProgram *)malloc(sizeof(OclCpuProgram));
+    if (!program)
+        return CL_OUT_OF_HOST_MEMORY;
+    if (!Compile(program, expr, num_inputs))
+    {
+        free(program);
+        return CL_INVALID_VALUE;
+    }
+
+    OclCpuElementwiseJob job;
+    job.program = program;
+    job.inputs = inputs;
+    job.output = output;
+    job.n = n;
+    job.binary = BinaryFor(OclCpuGetIsa());
+
+    // 64 blocks (128 KB of each input) per task
+    OclCpuParallelFor((n + OCL_CPU_BLOCK - 1) / OCL_CPU_BLOCK, 64, ElementwiseTask, &job);
+
+    free(program);
+    return CL_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * GEMM
+ * ------------------------------------------------------------------------- */
+
+// acc (MR x NR, row-major) = the product of an A strip (kc x MR, packed by
+// column) and a B strip (kc x NR, packed by row)
+typedef void (*OclCpuMicroKernel)(unsigned int kc, const int *a, const int *b, int *acc);
+
+static void MicroKernelScalar(unsigned int kc, const int *a, const int *b, int *acc)
+{
+    unsigned int sum[OCL_CPU_MR * OCL_CPU_NR] = { 0 };
+
+    for (unsigned int p = 0; p < kc; p++)
+        for (unsigned int r = 0; r < OCL_CPU_MR; r++)
+            for (unsigned int c = 0; c < OCL_CPU_NR; c++)
+                sum[r * OCL_CPU_NR + c] += (unsigned int)a[p * OCL_CPU_MR + r] *
+                                           (unsigned int)b[p * OCL_CPU_NR + c];
+    for (unsigned int i = 0; i < OCL_CPU_MR * OCL_CPU_NR; i++)
+        acc[i] = (int)sum[i];
+}
+
+#ifdef OCL_CPU_X86
+
+// Four rows at a time: 8 accumulators of 8 ints, two loads of B and four
+// broadcasts of A per step
+OCL_CPU_AVX2_TARGET static void MicroKernelAvx2(unsigned int kc, const int *a, const int *b,
+                                                int *acc)
+{
+    for (unsigned int half = 0; half < OCL_CPU_MR; half += 4)
+    {
+        __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+        __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+        __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+        __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+
+        for (unsigned int p = 0; p < kc; p++)
+        {
+            const int *ap = a + p * OCL_CPU_MR + half;
+            const __m256i b0 = _mm256_loadu_si256((const __m256i *)(b + p * OCL_CPU_NR));
+            const __m256i b1 = _mm256_loadu_si256((const __m256i *)(b + p * OCL_CPU_NR + 8));
+            __m256i x = _mm256_set1_epi32(ap[0]);
+            c00 = _mm256_add_epi32(c00, _mm256_mullo_epi32(x, b0));
+            c01 = _mm256_add_epi32(c01, _mm256_mullo_epi32(x, b1));
+            x = _mm256_set1_epi32(ap[1]);
+            c10 = _mm256_add_epi32(c10, _mm256_mullo_epi32(x, b0));
+            c11 = _mm256_add_epi32(c11, _mm256_mullo_epi32(x, b1));
+            x = _mm256_set1_epi32(ap[2]);
+            c20 = _mm256_add_epi32(c20, _mm256_mullo_epi32(x, b0));
+            c21 = _mm256_add_epi32(c21, _mm256_mullo_epi32(x, b1));
+            x = _mm256_set1_epi32(ap[3]);
+            c30 = _mm256_add_epi32(c30, _mm256_mullo_epi32(x, b0));
+            c31 = _mm256_add_epi32(c31, _mm256_mullo_epi32(x, b1));
+        }
+
+        int *out = acc + half * OCL_CPU_NR;
+        _mm256_storeu_si256((__m256i *)(out + 0 * OCL_CPU_NR), c00);
+        _mm256_storeu_si256((__m256i *)(out + 0 * OCL_CPU_NR + 8), c01);
+        _mm256_storeu_si256((__m256i *)(out + 1 * OCL_CPU_NR), c10);
+        _mm256_storeu_si256((__m256i *)(out + 1 * OCL_CPU_NR + 8), c11);
+        _mm256_storeu_si256((__m256i *)(out + 2 * OCL_CPU_NR), c20);
+        _mm256_storeu_si256((__m256i *)(out + 2 * OCL_CPU_NR + 8), c21);
+        _mm256_storeu_si256((__m256i *)(out + 3 * OCL_CPU_NR), c30);
+        _mm256_storeu_si256((__m256i *)(out + 3 * OCL_CPU_NR + 8), c31);
+    }
+}
+
+// All eight rows at once: 8 accumulators of 16 ints, one load of B per step;
+// unrolled by hand so the accumulators stay in registers
+OCL_CPU_AVX512_TARGET static void MicroKernelAvx512(unsigned int kc, const int *a, const int *b,
+                                                    int *acc)
+{
+    __m512i c0 = _mm512_setzero_si512(), c1 = _mm512_setzero_si512();
+    __m512i c2 = _mm512_setzero_si512(), c3 = _mm512_setzero_si512();
+    __m512i c4 = _mm512_setzero_si512(), c5 = _mm512_setzero_si512();
+    __m512i c6 = _mm512_setzero_si512(), c7 = _mm512_setzero_si512();
+
+    for (unsigned int p = 0; p < kc; p++)
+    {
+        const int *ap = a + p * OCL_CPU_MR;
+        const __m512i row = _mm512_loadu_si512(b + p * OCL_CPU_NR);
+        c0 = _mm512_add_epi32(c0, _mm512_mullo_epi32(_mm512_set1_epi32(ap[0]), row));
+        c1 = _mm512_add_epi32(c1, _mm512_mullo_epi32(_mm512_set1_epi32(ap[1]), row));
+        c2 = _mm512_add_epi32(c2, _mm512_mullo_epi32(_mm512_set1_epi32(ap[2]), row));
+        c3 = _mm512_add_epi32(c3, _mm512_mullo_epi32(_mm512_set1_epi32(ap[3]), row));
+        c4 = _mm512_add_epi32(c4, _mm512_mullo_epi32(_mm512_set1_epi32(ap[4]), row));
+        c5 = _mm512_add_epi32(c5, _mm512_mullo_epi32(_mm512_set1_epi32(ap[5]), row));
+        c6 = _mm512_add_epi32(c6, _mm512_mullo_epi32(_mm512_set1_epi32(ap[6]), row));
+        c7 = _mm512_add_epi32(c7, _mm512_mullo_epi32(_mm512_set1_epi32(ap[7]), row));
+    }
+
+    _mm512_storeu_si512(acc + 0 * OCL_CPU_NR, c0);
+    _mm512_storeu_si512(acc + 1 * OCL_CPU_NR, c1);
+    _mm512_storeu_si512(acc + 2 * OCL_CPU_NR, c2);
+    _mm512_storeu_si512(acc + 3 * OCL_CPU_NR, c3);
+    _mm512_storeu_si512(acc + 4 * OCL_CPU_NR, c4);
+    _mm512_storeu_si512(acc + 5 * OCL_CPU_NR, c5);
+    _mm512_storeu_si512(acc + 6 * OCL_CPU_NR, c6);
+    _mm512_storeu_si512(acc + 7 * OCL_CPU_NR, c7);
+}
+
+#endif // OCL_CPU_X86
+
+typedef struct _OclCpuGemmJob
+{
+    int trans_a, trans_b;
+    unsigned int m, n, k;
+    int alpha, beta;
+    const int *a, *b;
+    unsigned int lda, ldb, ldc;
+    int *c;
+    unsigned int tiles_n; // tiles per row of C
+    OclCpuMicroKernel kernel;
+    int *packed;          // packing space of every thread of the loop, packed_size ints each
+    size_t packed_size;
+    unsigned int mc, kc;  // largest A block, mc x kc, within packed_size
+} OclCpuGemmJob;
+
+// Rows i0 to i0 + mc - 1 and columns p0 to p0 + kc - 1 of op(A), in strips of
+// MR rows stored column by column, zero-padded to a whole strip
+static void PackA(const OclCpuGemmJob *job, unsigned int i0, unsigned int mc, unsigned int p0,
+                  unsigned int kc, int *dst)
+{
+    for (unsigned int s = 0; s < mc; s += OCL_CPU_MR)
+    {
+        for (unsigned int p = 0; p < kc; p++)
+        {
+            for (unsigned int r = 0; r < OCL_CPU_MR; r++)
+            {
+                const size_t i = i0 + s + r, q = p0 + p;
+                if (s + r >= mc)
+                    dst[r] = 0;
+                else if (job->trans_a)
+                    dst[r] = job->a[q * job->lda + i];
+                else
+                    dst[r] = job->a[i * job->lda + q];
+            }
+            dst += OCL_CPU_MR;
+        }
+    }
+}
+
+// Rows p0 to p0 + kc - 1 and columns j0 to j0 + nc - 1 of op(B), in strips of
+// NR columns stored row by row, zero-padded to a whole strip
+static void PackB(const OclCpuGemmJob *job, unsigned int p0, unsigned int kc, unsigned int j0,
+                  unsigned int nc, int *dst)
+{
+    for (unsigned int t = 0; t < nc; t += OCL_CPU_NR)
+    {
+        const unsigned int width = nc - t < OCL_CPU_NR ? nc - t : OCL_CPU_NR;
+        for (unsigned int p = 0; p < kc; p++)
+        {
+            const size_t q = p0 + p, j = j0 + t;
+            if (!job->trans_b)
+            {
+                memcpy(dst, job->b + q * job->ldb + j, width * sizeof(int));
+            }
+            else
+            {
+                for (unsigned int c = 0; c < width; c++)
+                    dst[c] = job->b[(j + c) * job->ldb + q];
+            }
+            for (unsigned int c = width; c < OCL_CPU_NR; c++)
+                dst[c] = 0;
+            dst += OCL_CPU_NR;
+        }
+    }
+}
+
+// Computes tiles of C: each packs its A block and B block per panel of k and
+// runs the micro-kernel over every pair of strips
+static void GemmTask(void *arg, size_t begin, size_t end)
+{
+    const OclCpuGemmJob *job = (const OclCpuGemmJob *)arg;
+    int *packed_a = job->packed + pool_slot * job->packed_size;
+    int *packed_b = packed_a + (size_t)job->mc * job->kc;
+    int acc[OCL_CPU_MR * OCL_CPU_NR];
+
+    for (size_t tile = begin; tile < end; tile++)
+    {
+        const unsigned int i0 = (unsigned int)(tile / job->tiles_n) * OCL_CPU_MC;
+        const unsigned int j0 = (unsigned int)(tile % job->tiles_n) * OCL_CPU_NC;
+        const unsigned int mc = job->m - i0 < OCL_CPU_MC ? job->m - i0 : OCL_CPU_MC;
+        const unsigned int nc = job->n - j0 < OCL_CPU_NC ? job->n - j0 : OCL_CPU_NC;
+
+        for (unsigned int p0 = 0; p0 < job->k; p0 += OCL_CPU_KC)
+        {
+            const unsigned int kc = job->k - p0 < OCL_CPU_KC ? job->k - p0 : OCL_CPU_KC;
+            PackA(job, i0, mc, p0, kc, packed_a);
+            PackB(job, p0, kc, j0, nc, packed_b);
+
+            for (unsigned int s = 0; s < mc; s += OCL_CPU_MR)
+            {
+                for (unsigned int t = 0; t < nc; t += OCL_CPU_NR)
+                {
+                    job->kernel(kc, packed_a + s * kc, packed_b + t * kc, acc);
+
+                    // C = alpha * acc + beta * C on the first panel, += after
+                    const unsigned int rows = mc - s < OCL_CPU_MR ? mc - s : OCL_CPU_MR;
+                    const unsigned int cols = nc - t < OCL_CPU_NR ? nc - t : OCL_CPU_NR;
+                    for (unsigned int r = 0; r < rows; r++)
+                    {
+                        int *c = job->c + (size_t)(i0 + s + r) * job->ldc + j0 + t;
+                        for (unsigned int j = 0; j < cols; j++)
+                        {
+                            unsigned int value = (unsigned int)job->alpha *
+                                                 (unsigned int)acc[r * OCL_CPU_NR + j];
+                            if (p0 > 0)
+                                value += (unsigned int)c[j];
+                            else if (job->beta != 0)
+                                value += (unsigned int)job->beta * (unsigned int)c[j];
+                            c[j] = (int)value;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+cl_int OclCpuGemm(int trans_a, int trans_b, unsigned int m, unsigned int n, unsigned int k,
+                  int alpha, const int *a, unsigned int lda, const int *b, unsigned int ldb,
+                  int beta, int *c, unsigned int ldc)
+{
+    if (m == 0 || n == 0)
+        return CL_SUCCESS;
+
+    if (k == 0 || alpha == 0)
+    {
+        for (unsigned int i = 0; i < m; i++)
+            for (unsigned int j = 0; j < n; j++)
+                c[(size_t)i * ldc + j] =
+                    beta == 0 ? 0 : (int)((unsigned int)beta * (unsigned int)c[(size_t)i * ldc + j]);
+        return CL_SUCCESS;
+    }
+
+    OclCpuGemmJob job;
+    job.trans_a = trans_a;
+    job.trans_b = trans_b;
+    job.m = m;
+    job.n = n;
+    job.k = k;
+    job.alpha = alpha;
+    job.beta = beta;
+    job.a = a;
+    job.b = b;
+    job.c = c;
+    job.lda = lda;
+    job.ldb = ldb;
+    job.ldc = ldc;
+    job.tiles_n = (n + OCL_CPU_NC - 1) / OCL_CPU_NC;
+    job.kernel = MicroKernelScalar;
+#ifdef OCL_CPU_X86
+    if (OclCpuGetIsa() == OCL_CPU_AVX512)
+        job.kernel = MicroKernelAvx512;
+    else if (OclCpuGetIsa() == OCL_CPU_AVX2)
+        job.kernel = MicroKernelAvx2;
+#endif
+
+    // Packing space for every thread that may take a tile, allocated here so
+    // that running out of memory is an error rather than a failed task; a
+    // call from inside a task runs serially, on one thread. Blocks are no
+    // larger than the whole of op(A) and op(B), rounded up to whole strips.
+    const size_t tiles = (size_t)((m + OCL_CPU_MC - 1) / OCL_CPU_MC) * job.tiles_n;
+    const unsigned int threads = pool_in_task ? 1 : OclCpuThreads();
+    const unsigned int strips_m = (m + OCL_CPU_MR - 1) / OCL_CPU_MR * OCL_CPU_MR;
+    const unsigned int strips_n = (n + OCL_CPU_NR - 1) / OCL_CPU_NR * OCL_CPU_NR;
+    const unsigned int nc = strips_n < OCL_CPU_NC ? strips_n : OCL_CPU_NC;
+    job.mc = strips_m < OCL_CPU_MC ? strips_m : OCL_CPU_MC;
+    job.kc = k < OCL_CPU_KC ? k : OCL_CPU_KC;
+    job.packed_size = (size_t)(job.mc + nc) * job.kc;
+    job.packed = (int *)malloc(sizeof(int) * job.packed_size * threads);
+    if (!job.packed)
+        return CL_OUT_OF_HOST_MEMORY;
+
+    OclCpuParallelFor(tiles, 1, GemmTask, &job);
+    free(job.packed);
+
+    return CL_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Convolutions
+ * ------------------------------------------------------------------------- */
+
+typedef struct _OclCpuConvolutionJob
+{
+    const int *input;
+    unsigned int width, channels;
+    const int *mask;
+    unsigned int mask_size, stride;
+    int *output;
+    unsigned int out_width;
+    OclCpuAxpyIntFn axpy;
+} OclCpuConvolutionJob;
+
+static void ConvolutionTask(void *arg, size_t begin, size_t end)
+{
+    const OclCpuConvolutionJob *job = (const OclCpuConvolutionJob *)arg;
+    const size_t row_size = (size_t)job->out_width * job->channels;
+    const size_t in_row_size = (size_t)job->width * job->channels;
+
+    for (size_t r = begin; r < end; r++)
+    {
+        int *out = job->output + r * row_size;
+        memset(out, 0, row_size * sizeof(int));
+
+        for (unsigned int i = 0; i < job->mask_size; i++)
+        {
+            const int *in = job->input + (r * job->stride + i) * in_row_size;
+            for (unsigned int j = 0; j < job->mask_size; j++)
+            {
+                const int w = job->mask[i * job->mask_size + j];
+                if (job->stride == 1)
+                {
+                    // pixel c of the output row takes pixel c + j of the input
+                    // row, all channels alike
+                    job->axpy(out, w, in + (size_t)j * job->channels, row_size);
+                    continue;
+                }
+                for (unsigned int c = 0; c < job->out_width; c++)
+                {
+                    const int *pixel = in + ((size_t)c * job->stride + j) * job->channels;
+                    for (unsigned int ch = 0; ch < job->channels; ch++)
+                        out[c * job->channels + ch] =
+                            (int)((unsigned int)out[c * job->channels + ch] +
+                                  (unsigned int)w * (unsigned int)pixel[ch]);
+                }
+            }
+        }
+    }
+}
+
+void OclCpuConvolution2D(const int *input, unsigned int width, unsigned int channels,
+                         const int *mask, unsigned int mask_size, unsigned int stride,
+                         int *output, unsigned int out_height, unsigned int out_width)
+{
+    OclCpuConvolutionJob job;
+    job.input = input;
+    job.width = width;
+    job.channels = channels;
+    job.mask = mask;
+    job.mask_size = mask_size;
+    job.stride = stride;
+    job.output = output;
+    job.out_width = out_width;
+    job.axpy = AxpyIntFor(OclCpuGetIsa());
+
+    OclCpuParallelFor(out_height, 4, ConvolutionTask, &job);
+}
+
+typedef struct _OclCpuConvForwardJob
+{
+    float *y;
+    const float *x, *k;
+    int M, C, H, W, K;
+    OclCpuAxpyFloatFn axpy;
+} OclCpuConvForwardJob;
+
+static void ConvForwardTask(void *arg, size_t begin, size_t end)
+{
+    const OclCpuConvForwardJob *job = (const OclCpuConvForwardJob *)arg;
+    const int H_out = job->H - job->K + 1, W_out = job->W - job->K + 1;
+
+    for (size_t bm = begin; bm < end; bm++)
+    {
+        const size_t b = bm / job->M, m = bm % job->M;
+        float *y = job->y + bm * H_out * W_out;
+        memset(y, 0, sizeof(float) * H_out * W_out);
+
+        for (int c = 0; c < job->C; c++)
+        {
+            const float *x = job->x + (b * job->C + c) * job->H * job->W;
+            const float *k = job->k + (m * job->C + c) * job->K * job->K;
+            for (int p = 0; p < job->K; p++)
+                for (int q = 0; q < job->K; q++)
+                    for (int h = 0; h < H_out; h++)
+                        job->axpy(y + h * W_out, k[p * job->K + q], x + (h + p) * job->W + q,
+                                  W_out);
+        }
+    }
+}
+
+void OclCpuConvForward(float *y, const float *x, const float *k, int B, int M, int C, int H,
+                       int W, int K)
+{
+    OclCpuConvForwardJob job;
+    job.y = y;
+    job.x = x;
+    job.k = k;
+    job.M = M;
+    job.C = C;
+    job.H = H;
+    job.W = W;
+    job.K = K;
+    job.axpy = AxpyFloatFor(OclCpuGetIsa());
+
+    OclCpuParallelFor((size_t)B * M, 1, ConvForwardTask, &job);
+}
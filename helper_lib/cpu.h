@@ -0,0 +1,143 @@
+#pragma once
+
+#include "device.h"
+
+#ifndef CL_PLATFORM_NOT_FOUND_KHR
+#define CL_PLATFORM_NOT_FOUND_KHR -1001 // from cl_khr_icd, when no ICD is installed
+#endif
+
+/**
+ * @brief The native backend: the helper_lib operations on the host's own
+ * cores, for hosts without an OpenCL platform and as a fast reference for
+ * checking device results. OclRuntimeCreate switches to it by itself when
+ * there is no OpenCL device (or when $OCL_NATIVE is set), after which
+ * OclElementwise and the host GEMMs run here; the device-buffer functions
+ * are unavailable.
+ *
+ * Every kernel has a scalar version and AVX2 and AVX-512 versions chosen at
+ * run time from what the CPU supports; $OCL_CPU_ISA (scalar, avx2 or avx512)
+ * caps the choice, e.g. to compare them. The work is split over a pool of
+ * one thread per online CPU ($OCL_CPU_THREADS overrides), started on first
+ * use.
+ *
+ * Integer results wrap like those of the OpenCL kernels, so they are
+ * bit-identical to the device's.
+ */
+
+/**
+ * @brief Instruction sets the native kernels are built for.
+ */
+typedef enum _OclCpuIsa
+{
+    OCL_CPU_SCALAR = 0,
+    OCL_CPU_AVX2 = 1,
+    OCL_CPU_AVX512 = 2
+} OclCpuIsa;
+
+/**
+ * @brief The instruction set the native kernels use: the best the CPU
+ * supports, capped by $OCL_CPU_ISA. Decided on the first call.
+ */
+OclCpuIsa OclCpuGetIsa(void);
+
+/**
+ * @brief The number of threads of the pool, the calling thread included.
+ */
+unsigned int OclCpuThreads(void);
+
+/**
+ * @brief Properties of the native backend in the form of an OpenCL device:
+ * a CPU named after its instruction set, with one compute unit per thread,
+ * the host's physical memory as global memory and the vector widths of the
+ * instruction set. device_id is NULL.
+ */
+const OclDeviceProp *OclCpuDeviceProp(void);
+
+/**
+ * @brief A loop body: runs iterations begin to end - 1.
+ */
+typedef void (*OclCpuTask)(void *arg, size_t begin, size_t end);
+
+/**
+ * @brief Runs task over iterations 0 to count - 1 on the pool and returns
+ * when all are done. Each thread starts with an equal share and takes grain
+ * iterations at a time from its front; a thread that runs out steals the
+ * back half of the largest remaining share, so uneven iterations still keep
+ * every thread busy. The caller works as one of the threads. Calls from
+ * inside a task, or while another thread's loop runs, run inline.
+ *
+ * @param count The number of iterations.
+ * @param grain Iterations per call of task, at least 1.
+ * @param task The loop body.
+ * @param arg Passed to task.
+ */
+void OclCpuParallelFor(size_t count, size_t grain, OclCpuTask task, void *arg);
+
+/**
+ * @brief OclElementwiseDevice on host arrays: output[i] = expr(a, b, ...).
+ * The expression is compiled to a short program evaluated over blocks of
+ * elements that stay in L1, so each input is read once and the output
+ * written once. Supports integer literals, the inputs a to z, parentheses,
+ * unary - and ~, and the binary operators * / % + - << >> & ^ |, with the
+ * precedence of C. Division by zero yields 0, and shift counts are taken
+ * modulo 32, as OpenCL does.
+ *
+ * @param expr The expression, e.g. "a + b + c + d".
+ * @param inputs num_inputs arrays of n ints.
+ * @param num_inputs The number of inputs.
+ * @param output An array of n ints; may be one of the inputs.
+ * @param n The number of elements.
+ *
+ * @return CL_SUCCESS if and only if output holds the result;
+ * CL_INVALID_VALUE if expr does not parse or uses an input past num_inputs.
+ */
+cl_int OclCpuElementwise(const char *expr, const int *const *inputs, unsigned int num_inputs,
+                         int *output, size_t n);
+
+/**
+ * @brief OclGemmDevice on host int arrays: C = alpha * op(A) * op(B) + beta *
+ * C, row-major, with the operands and leading dimensions of OclGemmDevice.
+ * Blocks of op(A) and op(B) are packed into panels that fit the caches,
+ * transposed operands included, and multiplied by a register-blocked kernel;
+ * the tiles of C are shared out over the pool. With beta 0, C is not read.
+ *
+ * @param trans_a Non-zero if op(A) is A^T.
+ * @param trans_b Non-zero if op(B) is B^T.
+ *
+ * @return CL_SUCCESS if and only if C holds the result;
+ * CL_OUT_OF_HOST_MEMORY if the packing space cannot be allocated.
+ */
+cl_int OclCpuGemm(int trans_a, int trans_b, unsigned int m, unsigned int n, unsigned int k,
+                  int alpha, const int *a, unsigned int lda, const int *b, unsigned int ldb,
+                  int beta, int *c, unsigned int ldc);
+
+/**
+ * @brief The PA5 convolution on host arrays: output[r][c][ch] = sum over i
+ * and j of mask[i][j] * input[r * stride + i][c * stride + j][ch], for images
+ * stored row by row with channels interleaved. Rows of the output are shared
+ * out over the pool; with stride 1 each row is a sum of shifted input rows,
+ * channels included, which vectorizes fully.
+ *
+ * @param input The height x width x channels input image.
+ * @param width The input width.
+ * @param channels Channels per pixel.
+ * @param mask The mask_size x mask_size mask.
+ * @param mask_size The mask width and height.
+ * @param stride The step between output pixels in the input.
+ * @param output The out_height x out_width x channels output image.
+ * @param out_height Rows of the output.
+ * @param out_width Columns of the output.
+ */
+void OclCpuConvolution2D(const int *input, unsigned int width, unsigned int channels,
+                         const int *mask, unsigned int mask_size, unsigned int stride,
+                         int *output, unsigned int out_height, unsigned int out_width);
+
+/**
+ * @brief The PA6 convolution layer forward on host arrays: y[b][m][h][w] =
+ * sum over c, p and q of x[b][c][h + p][w + q] * k[m][c][p][q], for B
+ * images of C channels of H x W, M maps of K x K weights per channel, and
+ * outputs of (H - K + 1) x (W - K + 1). Each (b, m) output map is a task;
+ * rows are accumulated with fused multiply-adds along the width.
+ */
+void OclCpuConvForward(float *y, const float *x, const float *k, int B, int M, int C, int H,
+                       int W, int K);
@@ -34,7 +34,10 @@ static cl_int OclGetProperty(const cl_platform_id platform_id, const cl_uint pro
 
     status = clGetPlatformInfo(platform_id, prop_name, prop_size, temp_val, NULL);
     if (status != CL_SUCCESS)
+    {
+        free(temp_val);
         return status;
+    }
 
     *val = temp_val;
 
@@ -67,13 +70,117 @@ static cl_int OclGetInfo(const cl_device_id device_id, const cl_device_info para
 
     status = clGetDeviceInfo(device_id, param, param_size, temp_val, NULL);
     if (status != CL_SUCCESS)
+    {
+        free(temp_val);
         return status;
+    }
 
     *val = temp_val;
 
     return CL_SUCCESS;
 }
 
+/**
+ * @brief Reads a fixed-size OpenCL Device property into val, which is zeroed
+ * first so that a property the device cannot report reads as 0.
+ *
+ * @param device_id The target OpenCL device.
+ * @param param The OpenCL Device property to read.
+ * @param val The destination for the property.
+ * @param size The size of the property.
+ *
+ * @return CL_SUCCESS if and only if the device property read is successful.
+ */
+static cl_int OclGetValue(const cl_device_id device_id, const cl_device_info param, void *val,
+                          size_t size)
+{
+    memset(val, 0, size);
+    return clGetDeviceInfo(device_id, param, size, val, NULL);
+}
+
+/**
+ * @brief Reads every property of OclDeviceProp for one device.
+ *
+ * @param device_id The target OpenCL device.
+ * @param device The destination, zeroed first.
+ *
+ * @return CL_SUCCESS if and only if the properties every device has are read;
+ * on failure nothing is left allocated.
+ */
+static cl_int OclGetDeviceProps(const cl_device_id device_id, OclDeviceProp *device)
+{
+    cl_int status;
+
+    memset(device, 0, sizeof(*device));
+    device->device_id = device_id;
+
+    status = OclGetInfo(device_id, CL_DEVICE_NAME, (const void **)&device->name);
+    if (status == CL_SUCCESS)
+        status = OclGetInfo(device_id, CL_DEVICE_VENDOR, (const void **)&device->vendor);
+    if (status == CL_SUCCESS)
+        status = OclGetInfo(device_id, CL_DEVICE_VERSION, (const void **)&device->version);
+    if (status == CL_SUCCESS)
+        status = OclGetInfo(device_id, CL_DRIVER_VERSION, (const void **)&device->driver_version);
+    if (status == CL_SUCCESS)
+        status = OclGetInfo(device_id, CL_DEVICE_EXTENSIONS, (const void **)&device->extensions);
+
+    if (status == CL_SUCCESS)
+    {
+        status |= OclGetValue(device_id, CL_DEVICE_TYPE, &device->type, sizeof(cl_device_type));
+        status |= OclGetValue(device_id, CL_DEVICE_MAX_COMPUTE_UNITS,
+                              &device->max_compute_units, sizeof(cl_uint));
+        status |= OclGetValue(device_id, CL_DEVICE_MAX_CLOCK_FREQUENCY,
+                              &device->max_clock_frequency, sizeof(cl_uint));
+        status |= OclGetValue(device_id, CL_DEVICE_GLOBAL_MEM_SIZE,
+                              &device->global_mem_size, sizeof(cl_ulong));
+        status |= OclGetValue(device_id, CL_DEVICE_GLOBAL_MEM_CACHE_SIZE,
+                              &device->global_mem_cache_size, sizeof(cl_ulong));
+        status |= OclGetValue(device_id, CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE,
+                              &device->global_mem_cacheline_size, sizeof(cl_uint));
+        status |= OclGetValue(device_id, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                              &device->max_mem_alloc_size, sizeof(cl_ulong));
+        status |= OclGetValue(device_id, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE,
+                              &device->max_constant_buffer_size, sizeof(cl_ulong));
+        status |= OclGetValue(device_id, CL_DEVICE_LOCAL_MEM_SIZE,
+                              &device->local_mem_size, sizeof(cl_ulong));
+        status |= OclGetValue(device_id, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS,
+                              &device->max_work_item_dimensions, sizeof(cl_uint));
+        status |= OclGetValue(device_id, CL_DEVICE_MAX_WORK_GROUP_SIZE,
+                              &device->max_work_group_size, sizeof(size_t));
+        status |= OclGetValue(device_id, CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR,
+                              &device->preferred_vector_width_char, sizeof(cl_uint));
+        status |= OclGetValue(device_id, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT,
+                              &device->preferred_vector_width_int, sizeof(cl_uint));
+        status |= OclGetValue(device_id, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT,
+                              &device->preferred_vector_width_float, sizeof(cl_uint));
+        status |= OclGetValue(device_id, CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE,
+                              &device->preferred_vector_width_double, sizeof(cl_uint));
+    }
+
+    // all dimensions are reported at once; keep the first ones
+    if (status == CL_SUCCESS)
+    {
+        size_t *sizes;
+        status = OclGetInfo(device_id, CL_DEVICE_MAX_WORK_ITEM_SIZES, (const void **)&sizes);
+        if (status == CL_SUCCESS)
+        {
+            for (cl_uint d = 0; d < device->max_work_item_dimensions && d < OCL_DEVICE_MAX_DIMENSIONS; d++)
+                device->max_work_item_sizes[d] = sizes[d];
+            free(sizes);
+        }
+    }
+
+#ifdef CL_DEVICE_MAX_NUM_SUB_GROUPS
+    // OpenCL 2.1; older devices fail the query and keep 0
+    OclGetValue(device_id, CL_DEVICE_MAX_NUM_SUB_GROUPS, &device->max_num_sub_groups,
+                sizeof(cl_uint));
+#endif
+
+    if (status != CL_SUCCESS)
+        OclFreeDeviceProp(device);
+    return status;
+}
+
 const char *OclDeviceTypeString(cl_device_type type)
 {
     switch (type)
@@ -98,11 +205,11 @@ cl_int OclGetDeviceWithFallback(cl_device_id* device_id, cl_device_type device_t
 }
 
 cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index, int* device_index, cl_device_type device_type) {
-    OclPlatformProp *platforms = NULL;
+    const OclPlatformProp *platforms = NULL;
     cl_int err;
 
     cl_uint num_platforms;
-    err = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
+    err = OclGetPlatforms(&platforms, &num_platforms);
 
     if (err != CL_SUCCESS)
     {
@@ -135,7 +242,7 @@ cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index
 
         for (int i = 0; i < num_platforms; i++) {
             for (int j = 0; j < platforms[i].num_devices; j++) {
-                if (*platforms[i].devices[j].type == device_type) {
+                if (platforms[i].devices[j].type == device_type) {
                     *platform_index = i;
                     *device_index = j;
                 }
@@ -143,7 +250,8 @@ cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index
         }
     }
 
-    if (*platform_index != -1 && *device_index != -1) {
+    if (*platform_index >= 0 && (cl_uint)*platform_index < num_platforms && *device_index >= 0 &&
+        (cl_uint)*device_index < platforms[*platform_index].num_devices) {
         *device_id = platforms[*platform_index].devices[*device_index].device_id;
         printf("Running on:\n\tPlatform: %s\n\tDevice: %s\n\n", platforms[*platform_index].name, platforms[*platform_index].devices[*device_index].name);
 
@@ -153,11 +261,17 @@ cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index
     printf("\033[33mCould not find a %s or other requested device. Defaulting to first available device...\033[0m\n", OclDeviceTypeString(device_type));
 
     // If we got here, there is not a device which matches the requested device type.  Just return the first device.
-    *device_id = platforms[0].devices[0].device_id;
-    *platform_index = 0;
-    *device_index = 0;
+    for (cl_uint i = 0; i < num_platforms; i++) {
+        if (platforms[i].num_devices > 0) {
+            *device_id = platforms[i].devices[0].device_id;
+            *platform_index = i;
+            *device_index = 0;
 
-    return CL_SUCCESS;
+            return CL_SUCCESS;
+        }
+    }
+
+    return CL_DEVICE_NOT_FOUND;
 }
 
 cl_int OclFindDevices(const cl_platform_id platform_id, const OclDeviceProp **devices,
@@ -167,13 +281,16 @@ cl_int OclFindDevices(const cl_platform_id platform_id, const OclDeviceProp **de
     cl_device_id *device_ids;
     cl_int status;
 
-    // Find number of OpenCL devices
+    *num_devices = 0;
+    *devices = NULL;
+
+    // Find number of OpenCL devices; a platform without any reports not found
     status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, 0, NULL, &num_found_devices);
+    if (status == CL_DEVICE_NOT_FOUND)
+        return CL_SUCCESS;
     if (status != CL_SUCCESS)
         return status;
 
-    *num_devices = num_found_devices;
-
     // Exit early if no devices found
     if (num_found_devices == 0)
         return CL_SUCCESS;
@@ -185,56 +302,35 @@ cl_int OclFindDevices(const cl_platform_id platform_id, const OclDeviceProp **de
     status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, num_found_devices,
                             device_ids, NULL);
     if (status != CL_SUCCESS)
+    {
+        free(device_ids);
         return status;
+    }
 
     OclDeviceProp *temp_devices =
         (OclDeviceProp *)malloc(num_found_devices * sizeof(OclDeviceProp));
     if (!temp_devices)
+    {
+        free(device_ids);
         return CL_OUT_OF_HOST_MEMORY;
+    }
 
     for (cl_uint i = 0; i < num_found_devices; i++)
     {
-        temp_devices[i].device_id = device_ids[i];
-
-        status = OclGetInfo(device_ids[i], CL_DEVICE_NAME,
-                            (const void **)&temp_devices[i].name);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_TYPE,
-                            (const void **)&temp_devices[i].type);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_MAX_COMPUTE_UNITS,
-                            (const void **)&temp_devices[i].max_compute_units);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_GLOBAL_MEM_SIZE,
-                            (const void **)&temp_devices[i].global_mem_size);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE,
-                            (const void **)&temp_devices[i].max_constant_buffer_size);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_LOCAL_MEM_SIZE,
-                            (const void **)&temp_devices[i].local_mem_size);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_MAX_WORK_ITEM_SIZES,
-                            (const void **)&temp_devices[i].max_work_item_sizes);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_MAX_WORK_GROUP_SIZE,
-                            (const void **)&temp_devices[i].max_work_group_size);
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetInfo(device_ids[i], CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS,
-                            (const void **)&temp_devices[i].max_work_item_dimensions);
+        status = OclGetDeviceProps(device_ids[i], &temp_devices[i]);
         if (status != CL_SUCCESS)
+        {
+            for (cl_uint j = 0; j < i; j++)
+                OclFreeDeviceProp(&temp_devices[j]);
+            free(temp_devices);
+            free(device_ids);
             return status;
+        }
     }
 
+    free(device_ids);
     *devices = temp_devices;
+    *num_devices = num_found_devices;
 
     return CL_SUCCESS;
 }
@@ -250,7 +346,8 @@ cl_int OclFindPlatforms(const OclPlatformProp **platforms, cl_uint *num_platform
     if (status != CL_SUCCESS)
         return status;
 
-    *num_platforms = num_found_platforms;
+    *num_platforms = 0;
+    *platforms = NULL;
 
     // Exit early if no platforms found
     if (num_found_platforms == 0)
@@ -262,60 +359,245 @@ cl_int OclFindPlatforms(const OclPlatformProp **platforms, cl_uint *num_platform
 
     status = clGetPlatformIDs(num_found_platforms, platform_ids, NULL);
     if (status != CL_SUCCESS)
+    {
+        free(platform_ids);
         return status;
+    }
 
     OclPlatformProp *temp_platforms =
-        (OclPlatformProp *)malloc(num_found_platforms * sizeof(OclPlatformProp));
+        (OclPlatformProp *)calloc(num_found_platforms, sizeof(OclPlatformProp));
     if (!temp_platforms)
+    {
+        free(platform_ids);
         return CL_OUT_OF_HOST_MEMORY;
+    }
 
-    for (cl_uint i = 0; i < num_found_platforms; i++)
+    for (cl_uint i = 0; i < num_found_platforms && status == CL_SUCCESS; i++)
     {
         temp_platforms[i].platform_id = platform_ids[i];
 
         status = OclGetProperty(platform_ids[i], CL_PLATFORM_NAME,
                                 (const char **)(&temp_platforms[i].name));
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetProperty(platform_ids[i], CL_PLATFORM_VERSION,
-                                (const char **)(&temp_platforms[i].version));
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetProperty(platform_ids[i], CL_PLATFORM_PROFILE,
-                                (const char **)(&temp_platforms[i].profile));
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetProperty(platform_ids[i], CL_PLATFORM_VENDOR,
-                                (const char **)(&temp_platforms[i].vendor));
-        if (status != CL_SUCCESS)
-            return status;
-        status = OclGetProperty(platform_ids[i], CL_PLATFORM_EXTENSIONS,
-                                (const char **)(&temp_platforms[i].extensions));
-        if (status != CL_SUCCESS)
-            return status;
+        if (status == CL_SUCCESS)
+            status = OclGetProperty(platform_ids[i], CL_PLATFORM_VERSION,
+                                    (const char **)(&temp_platforms[i].version));
+        if (status == CL_SUCCESS)
+            status = OclGetProperty(platform_ids[i], CL_PLATFORM_PROFILE,
+                                    (const char **)(&temp_platforms[i].profile));
+        if (status == CL_SUCCESS)
+            status = OclGetProperty(platform_ids[i], CL_PLATFORM_VENDOR,
+                                    (const char **)(&temp_platforms[i].vendor));
+        if (status == CL_SUCCESS)
+            status = OclGetProperty(platform_ids[i], CL_PLATFORM_EXTENSIONS,
+                                    (const char **)(&temp_platforms[i].extensions));
+
+        if (status == CL_SUCCESS)
+            status = OclFindDevices(platform_ids[i],
+                                    (const OclDeviceProp **)&temp_platforms[i].devices,
+                                    &temp_platforms[i].num_devices);
+    }
 
-        status = OclFindDevices(platform_ids[i],
-                                (const OclDeviceProp **)&temp_platforms[i].devices,
-                                &temp_platforms[i].num_devices);
-        if (status != CL_SUCCESS)
-            return status;
+    free(platform_ids);
+    if (status != CL_SUCCESS)
+    {
+        // the platforms are zeroed past the failure, so freeing them all is safe
+        for (cl_uint i = 0; i < num_found_platforms; i++)
+            OclFreePlatformProp(&temp_platforms[i]);
+        free(temp_platforms);
+        return status;
     }
 
     *platforms = temp_platforms;
+    *num_platforms = num_found_platforms;
 
     return CL_SUCCESS;
 }
 
+// The process-wide model of OclGetPlatforms
+static OclPlatformProp *ocl_platforms = NULL;
+static cl_uint ocl_num_platforms = 0;
+static bool ocl_platforms_found = false;
+
+static void OclFreePlatforms(void)
+{
+    for (cl_uint i = 0; i < ocl_num_platforms; i++)
+        OclFreePlatformProp(&ocl_platforms[i]);
+    free(ocl_platforms);
+    ocl_platforms = NULL;
+    ocl_num_platforms = 0;
+    ocl_platforms_found = false;
+}
+
+cl_int OclGetPlatforms(const OclPlatformProp **platforms, cl_uint *num_platforms)
+{
+    if (!ocl_platforms_found)
+    {
+        cl_int status = OclFindPlatforms((const OclPlatformProp **)&ocl_platforms,
+                                         &ocl_num_platforms);
+        if (status != CL_SUCCESS)
+            return status; // try again next time
+        ocl_platforms_found = true;
+        atexit(OclFreePlatforms);
+    }
+
+    *platforms = ocl_platforms;
+    *num_platforms = ocl_num_platforms;
+    return CL_SUCCESS;
+}
+
+const OclDeviceProp *OclGetDeviceProp(cl_device_id device_id)
+{
+    const OclPlatformProp *platforms;
+    cl_uint num_platforms;
+
+    if (OclGetPlatforms(&platforms, &num_platforms) != CL_SUCCESS)
+        return NULL;
+    for (cl_uint i = 0; i < num_platforms; i++)
+    {
+        for (cl_uint j = 0; j < platforms[i].num_devices; j++)
+        {
+            if (platforms[i].devices[j].device_id == device_id)
+                return &platforms[i].devices[j];
+        }
+    }
+    return NULL;
+}
+
+bool OclDeviceHasExtension(const OclDeviceProp *device, const char *extension)
+{
+    // extensions are separated by spaces; match whole names only
+    size_t len = strlen(extension);
+    for (const char *p = device->extensions; p && (p = strstr(p, extension)); p += len)
+    {
+        bool starts = p == device->extensions || p[-1] == ' ';
+        bool ends = p[len] == ' ' || p[len] == '\0';
+        if (starts && ends)
+            return true;
+    }
+    return false;
+}
+
+size_t OclDeviceBuildOptions(const OclDeviceProp *device, char *options, size_t size)
+{
+    return snprintf(options, size,
+                    "-DOCL_DEVICE_COMPUTE_UNITS=%u -DOCL_DEVICE_MAX_WORK_GROUP_SIZE=%zu "
+                    "-DOCL_DEVICE_LOCAL_MEM_SIZE=%llu -DOCL_DEVICE_CACHELINE_SIZE=%u "
+                    "-DOCL_DEVICE_INT_WIDTH=%u -DOCL_DEVICE_FLOAT_WIDTH=%u "
+                    "-DOCL_DEVICE_MAX_SUB_GROUPS=%u%s%s%s",
+                    device->max_compute_units, device->max_work_group_size,
+                    (unsigned long long)device->local_mem_size,
+                    device->global_mem_cacheline_size, device->preferred_vector_width_int,
+                    device->preferred_vector_width_float, device->max_num_sub_groups,
+                    (device->type & CL_DEVICE_TYPE_GPU) ? " -DOCL_DEVICE_GPU"
+                    : (device->type & CL_DEVICE_TYPE_CPU) ? " -DOCL_DEVICE_CPU" : "",
+                    OclDeviceHasExtension(device, "cl_khr_fp64") ? " -DOCL_DEVICE_FP64" : "",
+                    OclDeviceHasExtension(device, "cl_khr_fp16") ? " -DOCL_DEVICE_FP16" : "");
+}
+
+/**
+ * @brief Writes s as a JSON string, quoted and escaped; NULL as null.
+ */
+static void OclPrintJsonString(FILE *out, const char *s)
+{
+    if (!s)
+    {
+        fputs("null", out);
+        return;
+    }
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+void OclPrintPlatformsJson(FILE *out, const OclPlatformProp *platforms, cl_uint num_platforms)
+{
+    fputs("[\n", out);
+    for (cl_uint i = 0; i < num_platforms; i++)
+    {
+        const OclPlatformProp *platform = &platforms[i];
+        fputs("  {\n    \"name\": ", out);
+        OclPrintJsonString(out, platform->name);
+        fputs(",\n    \"vendor\": ", out);
+        OclPrintJsonString(out, platform->vendor);
+        fputs(",\n    \"version\": ", out);
+        OclPrintJsonString(out, platform->version);
+        fputs(",\n    \"profile\": ", out);
+        OclPrintJsonString(out, platform->profile);
+        fputs(",\n    \"extensions\": ", out);
+        OclPrintJsonString(out, platform->extensions);
+        fputs(",\n    \"devices\": [", out);
+        for (cl_uint j = 0; j < platform->num_devices; j++)
+        {
+            const OclDeviceProp *device = &platform->devices[j];
+            fputs(j ? ",\n      {\n" : "\n      {\n", out);
+            fputs("        \"name\": ", out);
+            OclPrintJsonString(out, device->name);
+            fputs(",\n        \"vendor\": ", out);
+            OclPrintJsonString(out, device->vendor);
+            fputs(",\n        \"version\": ", out);
+            OclPrintJsonString(out, device->version);
+            fputs(",\n        \"driver_version\": ", out);
+            OclPrintJsonString(out, device->driver_version);
+            fputs(",\n        \"type\": ", out);
+            OclPrintJsonString(out, OclDeviceTypeString(device->type));
+            fprintf(out,
+                    ",\n        \"max_compute_units\": %u"
+                    ",\n        \"max_clock_frequency_mhz\": %u"
+                    ",\n        \"global_mem_size\": %llu"
+                    ",\n        \"global_mem_cache_size\": %llu"
+                    ",\n        \"global_mem_cacheline_size\": %u"
+                    ",\n        \"max_mem_alloc_size\": %llu"
+                    ",\n        \"max_constant_buffer_size\": %llu"
+                    ",\n        \"local_mem_size\": %llu"
+                    ",\n        \"max_work_item_dimensions\": %u"
+                    ",\n        \"max_work_item_sizes\": [",
+                    device->max_compute_units, device->max_clock_frequency,
+                    (unsigned long long)device->global_mem_size,
+                    (unsigned long long)device->global_mem_cache_size,
+                    device->global_mem_cacheline_size,
+                    (unsigned long long)device->max_mem_alloc_size,
+                    (unsigned long long)device->max_constant_buffer_size,
+                    (unsigned long long)device->local_mem_size,
+                    device->max_work_item_dimensions);
+            for (cl_uint d = 0; d < device->max_work_item_dimensions && d < OCL_DEVICE_MAX_DIMENSIONS; d++)
+                fprintf(out, d ? ", %zu" : "%zu", device->max_work_item_sizes[d]);
+            fprintf(out,
+                    "]"
+                    ",\n        \"max_work_group_size\": %zu"
+                    ",\n        \"preferred_vector_width\": "
+                    "{ \"char\": %u, \"int\": %u, \"float\": %u, \"double\": %u }"
+                    ",\n        \"max_num_sub_groups\": %u"
+                    ",\n        \"extensions\": ",
+                    device->max_work_group_size, device->preferred_vector_width_char,
+                    device->preferred_vector_width_int, device->preferred_vector_width_float,
+                    device->preferred_vector_width_double, device->max_num_sub_groups);
+            OclPrintJsonString(out, device->extensions);
+            fputs("\n      }", out);
+        }
+        fputs(platform->num_devices ? "\n    ]\n  }" : "]\n  }", out);
+        fputs(i + 1 < num_platforms ? ",\n" : "\n", out);
+    }
+    fputs("]\n", out);
+}
+
 cl_int OclFreeDeviceProp(OclDeviceProp *device)
 {
     free(device->name);
-    free(device->max_compute_units);
-    free(device->global_mem_size);
-    free(device->max_constant_buffer_size);
-    free(device->local_mem_size);
-    free(device->max_work_item_sizes);
-    free(device->max_work_group_size);
-    free(device->max_work_item_dimensions);
+    free(device->vendor);
+    free(device->version);
+    free(device->driver_version);
+    free(device->extensions);
+    device->name = device->vendor = device->version = NULL;
+    device->driver_version = device->extensions = NULL;
 
     return CL_SUCCESS;
 }
@@ -332,6 +614,8 @@ cl_int OclFreePlatformProp(OclPlatformProp *platform)
         OclFreeDeviceProp(&platform->devices[i]);
     }
     free(platform->devices);
+    platform->devices = NULL;
+    platform->num_devices = 0;
 
     return CL_SUCCESS;
 }
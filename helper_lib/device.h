@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 #ifdef __APPLE__
@@ -16,22 +17,40 @@
 #define OCL_DEVICE_TYPE CL_DEVICE_TYPE_GPU
 #endif
 
+#define OCL_DEVICE_MAX_DIMENSIONS 3
+
 /**
- * @brief Struct for storing OpenCL Device information.
+ * @brief Struct for storing OpenCL Device information, read once per device
+ * by OclFindDevices: the strings are allocated, everything else is held by
+ * value. Properties a device cannot report (e.g. sub-groups before OpenCL
+ * 2.1) are 0.
  * All device parameters can be found here:
  * https://registry.khronos.org/OpenCL/sdk/3.0/docs/man/html/clGetDeviceInfo.html
  */
 typedef struct _OclDeviceProp
 {
     char *name;
-    cl_device_type *type;
-    cl_uint *max_compute_units;
-    cl_ulong *global_mem_size;
-    cl_ulong *max_constant_buffer_size;
-    cl_ulong *local_mem_size;
-    size_t *max_work_item_sizes;
-    size_t *max_work_group_size;
-    cl_uint *max_work_item_dimensions;
+    char *vendor;
+    char *version;
+    char *driver_version;
+    char *extensions;
+    cl_device_type type;
+    cl_uint max_compute_units;
+    cl_uint max_clock_frequency; // MHz
+    cl_ulong global_mem_size;
+    cl_ulong global_mem_cache_size;
+    cl_uint global_mem_cacheline_size;
+    cl_ulong max_mem_alloc_size;
+    cl_ulong max_constant_buffer_size;
+    cl_ulong local_mem_size;
+    cl_uint max_work_item_dimensions;
+    size_t max_work_item_sizes[OCL_DEVICE_MAX_DIMENSIONS]; // the first dimensions
+    size_t max_work_group_size;
+    cl_uint preferred_vector_width_char;
+    cl_uint preferred_vector_width_int;
+    cl_uint preferred_vector_width_float;
+    cl_uint preferred_vector_width_double; // 0 without double support
+    cl_uint max_num_sub_groups;
     cl_device_id device_id;
 } OclDeviceProp;
 
@@ -54,7 +73,7 @@ typedef struct _OclPlatformProp
 
 /**
  * @brief Finds an OpenCL device matching the specified type.  Falls back to the first returned device if there are no devices of the specified type returned.
- * This function returns CL_DEVICE_NOT_FOUND if no platforms are found.  Internally, OclFindPlatforms is called.
+ * This function returns CL_DEVICE_NOT_FOUND if no platforms are found.  Internally, OclGetPlatforms is called.
  * 
  * @param device_id A pointer to the block of memory to store the device ID for the specified device type or Fallback device.
  * @param device_type The type of device to look for.
@@ -65,7 +84,7 @@ cl_int OclGetDeviceWithFallback(cl_device_id* device_id, cl_device_type device_t
 
 /**
  * @brief Finds an OpenCL device matching the specified type.  Falls back to the first returned device if there are no devices of the specified type returned.
- * This function returns CL_DEVICE_NOT_FOUND if no platforms are found.  Internally, OclFindPlatforms is called.
+ * This function returns CL_DEVICE_NOT_FOUND if no platforms are found.  Internally, OclGetPlatforms is called.
  * 
  * @param device_id A pointer to the block of memory to store the device ID for the specified device type or Fallback device.
  * @param platform_index A pointer to the block of memory to store the platform index for the specified device type or fallback device.
@@ -76,10 +95,72 @@ cl_int OclGetDeviceWithFallback(cl_device_id* device_id, cl_device_type device_t
  */
 cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index, int* device_index, cl_device_type device_type);
 
+/**
+ * @brief Returns the process-wide device model: every OpenCL platform and
+ * device with their properties, found by OclFindPlatforms on the first call
+ * and kept until exit, so later calls (and OclGetDeviceWithFallback) do not
+ * query the driver again. The model is owned by helper_lib; do not free it.
+ * The first call is not thread-safe; make it before starting threads.
+ *
+ * @param platforms The destination for the array of OpenCL Platform properties.
+ * @param num_platforms The number of OpenCL Platforms found.
+ *
+ * @return CL_SUCCESS if and only if the model is available.
+ */
+cl_int OclGetPlatforms(const OclPlatformProp **platforms, cl_uint *num_platforms);
+
+/**
+ * @brief Looks a device up in the model of OclGetPlatforms.
+ *
+ * @param device_id The device.
+ *
+ * @return Its properties, or NULL if the model has no such device.
+ */
+const OclDeviceProp *OclGetDeviceProp(cl_device_id device_id);
+
+/**
+ * @brief Whether a device lists an extension, e.g. "cl_khr_fp64".
+ *
+ * @param device The device properties.
+ * @param extension The extension name.
+ *
+ * @return true if and only if the extension is in device->extensions.
+ */
+bool OclDeviceHasExtension(const OclDeviceProp *device, const char *extension);
+
+/**
+ * @brief Writes the clBuildProgram options that let kernel sources specialize
+ * on the device: -D defines OCL_DEVICE_COMPUTE_UNITS,
+ * OCL_DEVICE_MAX_WORK_GROUP_SIZE, OCL_DEVICE_LOCAL_MEM_SIZE,
+ * OCL_DEVICE_CACHELINE_SIZE, OCL_DEVICE_INT_WIDTH, OCL_DEVICE_FLOAT_WIDTH and
+ * OCL_DEVICE_MAX_SUB_GROUPS to the device's values, OCL_DEVICE_GPU or
+ * OCL_DEVICE_CPU by type, and OCL_DEVICE_FP64 and OCL_DEVICE_FP16 when the
+ * device has those extensions.
+ *
+ * @param device The device properties.
+ * @param options The destination string.
+ * @param size The size of options; the string is truncated to fit.
+ *
+ * @return The length of the full options string, as snprintf.
+ */
+size_t OclDeviceBuildOptions(const OclDeviceProp *device, char *options, size_t size);
+
+/**
+ * @brief Writes platforms and their devices as a JSON array of objects, one
+ * member per property, for tuning scripts to read.
+ *
+ * @param out The stream to write to.
+ * @param platforms The array of OpenCL Platform properties.
+ * @param num_platforms The number of platforms.
+ */
+void OclPrintPlatformsJson(FILE *out, const OclPlatformProp *platforms, cl_uint num_platforms);
+
 /**
  * @brief Finds all OpenCL platforms and devices, and get their respective properties.
- * Internally calls OclFindDevices.
- * The caller is responsible for freeing *platforms.
+ * Internally calls OclFindDevices. This queries the driver on every call;
+ * OclGetPlatforms keeps one copy for the process.
+ * The caller is responsible for freeing *platforms, with OclFreePlatformProp
+ * on each platform and free on the array.
  *
  * @param platforms The array of OpenCL Platform properties.
  * @param num_platforms The number of OpenCL Platforms found.
@@ -90,7 +171,8 @@ cl_int OclFindPlatforms(const OclPlatformProp **platforms, cl_uint *num_platform
 
 /**
  * @brief Finds all OpenCL devices on a platform, and their respective properties.
- * The caller is responsible for freeing *devices.
+ * The caller is responsible for freeing *devices, with OclFreeDeviceProp on
+ * each device and free on the array.
  *
  * @param platform_id The ID for the target platform.
  * @param devices The array of OpenCL Device properties.
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "elementwise.h"
+
+#define OCL_ELEMENTWISE_LOCAL_SIZE 256
+#define OCL_ELEMENTWISE_GROUPS_PER_UNIT 8
+#define OCL_ELEMENTWISE_MAX_CHUNK_BYTES (64 << 20) // keeps the pipeline short
+
+/**
+ * @brief Writes the source of the kernel for expr with num_inputs inputs and
+ * vector width width into a new string; the caller frees it.
+ */
+static char *OclElementwiseSource(const char *expr, unsigned int num_inputs,
+                                  unsigned int width)
+{
+    size_t size = 1024 + 2 * strlen(expr) + 160 * num_inputs;
+    char *source = (char *)malloc(size);
+    if (!source)
+        return NULL;
+
+    size_t len = 0;
+    len += snprintf(source + len, size - len, "__kernel void elementwise(");
+    for (unsigned int k = 0; k < num_inputs; k++)
+        len += snprintf(source + len, size - len, "__global const int *in%u, ", k);
+    len += snprintf(source + len, size - len,
+                    "__global int *out, const unsigned int n)\n"
+                    "{\n"
+                    "    const unsigned int stride = get_global_size(0);\n"
+                    "    const unsigned int n_vec = n / %u;\n"
+                    "    for (unsigned int i = get_global_id(0); i < n_vec; i += stride)\n"
+                    "    {\n",
+                    width);
+    for (unsigned int k = 0; k < num_inputs; k++)
+        len += snprintf(source + len, size - len,
+                        "        const int%u %c = vload%u(i, in%u);\n", width, 'a' + k, width, k);
+    len += snprintf(source + len, size - len,
+                    "        vstore%u((int%u)(%s), i, out);\n"
+                    "    }\n"
+                    "    for (unsigned int i = n_vec * %u + get_global_id(0); i < n; i += stride)\n"
+                    "    {\n",
+                    width, width, expr, width);
+    for (unsigned int k = 0; k < num_inputs; k++)
+        len += snprintf(source + len, size - len,
+                        "        const int %c = in%u[i];\n", 'a' + k, k);
+    len += snprintf(source + len, size - len,
+                    "        out[i] = %s;\n"
+                    "    }\n"
+                    "}\n",
+                    expr);
+    return source;
+}
+
+/**
+ * @brief OclElementwiseDevice on a given queue, after the events in
+ * wait_list; event (if not NULL) receives the kernel's event.
+ */
+static cl_int OclElementwiseEnqueue(OclRuntime *runtime, cl_command_queue queue,
+                                    const char *expr, const cl_mem *inputs,
+                                    unsigned int num_inputs, cl_mem output, unsigned int n,
+                                    cl_uint num_events, const cl_event *wait_list,
+                                    cl_event *event)
+{
+    cl_int err;
+
+    if (num_inputs == 0 || num_inputs > OCL_ELEMENTWISE_MAX_INPUTS)
+        return CL_INVALID_VALUE;
+    // the expression is pasted into the kernel; keep it one expression
+    if (strpbrk(expr, ";{}#\"") != NULL)
+        return CL_INVALID_VALUE;
+    if (n == 0)
+        return clEnqueueMarkerWithWaitList(queue, num_events, wait_list, event);
+
+    const unsigned int width = runtime->int_vector_width;
+    char *source = OclElementwiseSource(expr, num_inputs, width);
+    if (!source)
+        return CL_OUT_OF_HOST_MEMORY;
+
+    cl_kernel kernel;
+    err = OclRuntimeGetKernel(runtime, source, "elementwise", &kernel);
+    free(source);
+    if (err != CL_SUCCESS)
+        return err;
+
+    for (unsigned int k = 0; k < num_inputs; k++)
+        err |= clSetKernelArg(kernel, k, sizeof(cl_mem), &inputs[k]);
+    err |= clSetKernelArg(kernel, num_inputs, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(kernel, num_inputs + 1, sizeof(unsigned int), &n);
+    if (err != CL_SUCCESS)
+        return err;
+
+    // enough groups to fill the device, and no more than the vectors need
+    size_t local_size = OCL_ELEMENTWISE_LOCAL_SIZE;
+    if (local_size > runtime->max_work_group_size)
+        local_size = runtime->max_work_group_size;
+    size_t groups = ((size_t)n / width + local_size - 1) / local_size;
+    size_t max_groups = (size_t)runtime->compute_units * OCL_ELEMENTWISE_GROUPS_PER_UNIT;
+    if (groups > max_groups)
+        groups = max_groups;
+    if (groups == 0)
+        groups = 1;
+    size_t global_size = groups * local_size;
+
+    return clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &local_size,
+                                  num_events, num_events ? wait_list : NULL, event);
+}
+
+cl_int OclElementwiseDevice(OclRuntime *runtime, const char *expr, const cl_mem *inputs,
+                            unsigned int num_inputs, cl_mem output, unsigned int n)
+{
+    return OclElementwiseEnqueue(runtime, runtime->queue, expr, inputs, num_inputs, output, n,
+                                 0, NULL, NULL);
+}
+
+size_t OclElementwiseChunkSize(OclRuntime *runtime, unsigned int num_inputs)
+{
+    // two sets of num_inputs + 1 buffers, in half of the device memory
+    cl_ulong bytes = runtime->global_mem_size / 2 / (2 * (num_inputs + 1));
+    if (bytes > runtime->max_mem_alloc_size)
+        bytes = runtime->max_mem_alloc_size;
+    if (bytes > OCL_ELEMENTWISE_MAX_CHUNK_BYTES)
+        bytes = OCL_ELEMENTWISE_MAX_CHUNK_BYTES;
+    size_t chunk = bytes / sizeof(int) / 8 * 8; // whole int8 vectors
+    return chunk > 0 ? chunk : 8;
+}
+
+/**
+ * @brief Releases *event, if any, and clears it.
+ */
+static void OclReleaseEvent(cl_event *event)
+{
+    if (*event)
+        clReleaseEvent(*event);
+    *event = NULL;
+}
+
+cl_int OclElementwiseStream(OclRuntime *runtime, const char *expr, Matrix **inputs,
+                            unsigned int num_inputs, Matrix *output, size_t chunk_size)
+{
+    cl_int err = CL_SUCCESS;
+    // per slot: device buffers, and the events of its last write, kernel and
+    // read
+    cl_mem device_inputs[2][OCL_ELEMENTWISE_MAX_INPUTS];
+    cl_mem device_output[2] = { NULL, NULL };
+    cl_event written[2] = { NULL, NULL }, computed[2] = { NULL, NULL }, read[2] = { NULL, NULL };
+
+    if (num_inputs == 0 || num_inputs > OCL_ELEMENTWISE_MAX_INPUTS)
+        return CL_INVALID_VALUE;
+    for (unsigned int k = 0; k < num_inputs; k++)
+    {
+        if (inputs[k]->shape[0] != output->shape[0] || inputs[k]->shape[1] != output->shape[1])
+            return CL_INVALID_VALUE;
+    }
+
+    const size_t n = (size_t)output->shape[0] * output->shape[1];
+    if (n == 0)
+        return CL_SUCCESS;
+    if (runtime->native)
+    {
+        const int *data[OCL_ELEMENTWISE_MAX_INPUTS];
+        for (unsigned int k = 0; k < num_inputs; k++)
+            data[k] = inputs[k]->data;
+        return OclCpuElementwise(expr, data, num_inputs, output->data, n);
+    }
+    if (chunk_size == 0)
+        chunk_size = OclElementwiseChunkSize(runtime, num_inputs);
+    if (chunk_size > n)
+        chunk_size = n;
+    const size_t num_chunks = (n + chunk_size - 1) / chunk_size;
+    const unsigned int num_slots = num_chunks > 1 ? 2 : 1;
+
+    memset(device_inputs, 0, sizeof(device_inputs));
+    for (unsigned int s = 0; s < num_slots && err == CL_SUCCESS; s++)
+    {
+        for (unsigned int k = 0; k < num_inputs && err == CL_SUCCESS; k++)
+            device_inputs[s][k] = clCreateBuffer(runtime->context, CL_MEM_READ_ONLY,
+                                                 chunk_size * sizeof(int), NULL, &err);
+        if (err == CL_SUCCESS)
+            device_output[s] = clCreateBuffer(runtime->context, CL_MEM_WRITE_ONLY,
+                                              chunk_size * sizeof(int), NULL, &err);
+    }
+
+    // Chunk c uses slot c % 2. The transfer queue gets the writes of chunk
+    // c + 1 before the read of chunk c, so they run while chunk c computes:
+    //   transfer: W0 W1 R0 W2 R1 W3 R2 ...    compute: K0 K1 K2 ...
+    // A slot is rewritten only after its previous read (read[s]), computed
+    // after its writes (written[s]) and read after its kernel (computed[s]).
+    for (size_t c = 0; c <= num_chunks && err == CL_SUCCESS; c++)
+    {
+        // writes of chunk c
+        if (c < num_chunks)
+        {
+            const unsigned int s = c % num_slots;
+            const size_t first = c * chunk_size;
+            const size_t count = first + chunk_size <= n ? chunk_size : n - first;
+            cl_event after_read = read[s];
+            for (unsigned int k = 0; k < num_inputs && err == CL_SUCCESS; k++)
+            {
+                cl_event event;
+                err = clEnqueueWriteBuffer(runtime->transfer_queue, device_inputs[s][k], CL_FALSE,
+                                           0, count * sizeof(int), inputs[k]->data + first,
+                                           after_read ? 1 : 0, after_read ? &after_read : NULL,
+                                           &event);
+                if (err == CL_SUCCESS)
+                {
+                    OclReleaseEvent(&written[s]); // the queue is in order
+                    written[s] = event;
+                }
+            }
+            if (err == CL_SUCCESS)
+                err = OclElementwiseEnqueue(runtime, runtime->queue, expr, device_inputs[s],
+                                            num_inputs, device_output[s], count,
+                                            1, &written[s], &computed[s]);
+        }
+        // read of chunk c - 1
+        if (c > 0 && err == CL_SUCCESS)
+        {
+            const unsigned int s = (c - 1) % num_slots;
+            const size_t first = (c - 1) * chunk_size;
+            const size_t count = first + chunk_size <= n ? chunk_size : n - first;
+            cl_event event;
+            err = clEnqueueReadBuffer(runtime->transfer_queue, device_output[s], CL_FALSE, 0,
+                                      count * sizeof(int), output->data + first,
+                                      1, &computed[s], &event);
+            if (err == CL_SUCCESS)
+            {
+                OclReleaseEvent(&computed[s]);
+                OclReleaseEvent(&read[s]);
+                read[s] = event;
+            }
+        }
+    }
+
+    // the transfers still use the host memory and buffers; finish either way
+    clFinish(runtime->queue);
+    cl_int finish_err = clFinish(runtime->transfer_queue);
+    if (err == CL_SUCCESS)
+        err = finish_err;
+
+    for (unsigned int s = 0; s < 2; s++)
+    {
+        OclReleaseEvent(&written[s]);
+        OclReleaseEvent(&computed[s]);
+        OclReleaseEvent(&read[s]);
+        for (unsigned int k = 0; k < num_inputs; k++)
+        {
+            if (device_inputs[s][k])
+                clReleaseMemObject(device_inputs[s][k]);
+        }
+        if (device_output[s])
+            clReleaseMemObject(device_output[s]);
+    }
+    return err;
+}
+
+cl_int OclElementwise(OclRuntime *runtime, const char *expr, Matrix **inputs,
+                      unsigned int num_inputs, Matrix *output)
+{
+    return OclElementwiseStream(runtime, expr, inputs, num_inputs, output, 0);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "runtime.h"
+
+#define OCL_ELEMENTWISE_MAX_INPUTS 26
+
+/**
+ * @brief Evaluates an integer expression elementwise over device buffers:
+ * output[i] = expr(a, b, ...), where a is inputs[0][i], b is inputs[1][i] and
+ * so on. One kernel is generated per expression and number of inputs and
+ * cached in the runtime. It reads each input once with intN vector loads
+ * (N = runtime->int_vector_width) in a grid-stride loop sized to the device,
+ * so the work-items stay resident for any n, and writes the output once;
+ * output may be one of the inputs. Use arithmetic and bitwise operators only:
+ * comparisons yield -1 rather than 1 on vectors.
+ *
+ * @param runtime The runtime.
+ * @param expr The expression, e.g. "a + b + c + d".
+ * @param inputs num_inputs device buffers of at least n ints each.
+ * @param num_inputs The number of inputs, 1 to OCL_ELEMENTWISE_MAX_INPUTS.
+ * @param output A device buffer of at least n ints.
+ * @param n The number of elements.
+ *
+ * @return CL_SUCCESS if and only if the kernel is enqueued. The call does not
+ * wait for it.
+ */
+cl_int OclElementwiseDevice(OclRuntime *runtime, const char *expr, const cl_mem *inputs,
+                            unsigned int num_inputs, cl_mem output, unsigned int n);
+
+/**
+ * @brief The default chunk of OclElementwiseStream: the most elements such
+ * that two sets of num_inputs + 1 chunk buffers fit in half of the device's
+ * global memory, no buffer exceeds CL_DEVICE_MAX_MEM_ALLOC_SIZE, and a chunk
+ * is at most 64 MB, so that the pipeline fills and drains quickly.
+ *
+ * @param runtime The runtime.
+ * @param num_inputs The number of inputs of the expression.
+ *
+ * @return The chunk size in elements, a multiple of 8.
+ */
+size_t OclElementwiseChunkSize(OclRuntime *runtime, unsigned int num_inputs);
+
+/**
+ * @brief OclElementwiseDevice on host matrices of any size. The rows * cols
+ * elements are streamed through the device chunk_size at a time, in two sets
+ * of chunk buffers used in turn: the inputs of chunk k + 1 are written on
+ * runtime->transfer_queue while chunk k is computed on runtime->queue, and
+ * chunk k is read back while chunk k + 1 is computed, with events ordering
+ * each buffer's write, kernel and read. Each input element is transferred
+ * once and each output element once. All matrices must have the same shape.
+ * A native runtime evaluates expr with OclCpuElementwise, which supports the
+ * integer operators only.
+ *
+ * @param runtime The runtime.
+ * @param expr The expression, as for OclElementwiseDevice.
+ * @param inputs num_inputs host matrices.
+ * @param num_inputs The number of inputs, 1 to OCL_ELEMENTWISE_MAX_INPUTS.
+ * @param output The host matrix for the result, allocated with its shape set.
+ * @param chunk_size Elements per chunk, or 0 for OclElementwiseChunkSize.
+ *
+ * @return CL_SUCCESS if and only if the output holds the result. The call
+ * returns once every transfer has finished, also on failure.
+ */
+cl_int OclElementwiseStream(OclRuntime *runtime, const char *expr, Matrix **inputs,
+                            unsigned int num_inputs, Matrix *output, size_t chunk_size);
+
+/**
+ * @brief OclElementwiseStream with the default chunk size.
+ *
+ * @return CL_SUCCESS if and only if the output holds the result.
+ */
+cl_int OclElementwise(OclRuntime *runtime, const char *expr, Matrix **inputs,
+                      unsigned int num_inputs, Matrix *output);
@@ -0,0 +1,1037 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "gemm.h"
+
+#define OCL_GEMM_MAX_TILE 16
+#define OCL_GEMM_BATCH_LOCAL_SIZE 64
+#define OCL_GEMM_PANEL_ALIGN 16 // panel sizes are multiples of the largest tile
+
+// Work-item (tx, ty) computes C[row][col], row = tile row + ty and col = tile
+// column + tx, so a work-group's neighbouring work-items (consecutive tx)
+// write neighbouring elements of C. For the loads the roles of tx and ty are
+// chosen so that consecutive tx also read consecutive addresses of A and B:
+// along a stored row of A (or B^T) and along a stored column index of A^T (or
+// B). The tiles are padded by one column so that the transposing stores do
+// not hit one local memory bank.
+static const char *OclGemmKernel =
+    "__kernel void gemm(const unsigned int M, const unsigned int N, const unsigned int K,\n"
+    "                   const T alpha, __global const T *A, const ulong a_offset,\n"
+    "                   const unsigned int lda, __global const T *B, const ulong b_offset,\n"
+    "                   const unsigned int ldb, const T beta, __global T *C,\n"
+    "                   const ulong c_offset, const unsigned int ldc)\n"
+    "{\n"
+    "    __local T a_tile[TILE][TILE + 1]; // a_tile[i][p] = op(A)[row0 + i][k0 + p]\n"
+    "    __local T b_tile[TILE][TILE + 1]; // b_tile[p][j] = op(B)[k0 + p][col0 + j]\n"
+    "    const unsigned int tx = get_local_id(0);\n"
+    "    const unsigned int ty = get_local_id(1);\n"
+    "    const unsigned int row0 = get_group_id(1) * TILE;\n"
+    "    const unsigned int col0 = get_group_id(0) * TILE;\n"
+    "    T sum = 0;\n"
+    "    A += a_offset;\n"
+    "    B += b_offset;\n"
+    "    C += c_offset;\n"
+    "\n"
+    "    for (unsigned int k0 = 0; k0 < K; k0 += TILE)\n"
+    "    {\n"
+    "#if TRANS_A\n"
+    "        // A is K x M: walk its rows with tx\n"
+    "        a_tile[tx][ty] = (row0 + tx < M && k0 + ty < K)\n"
+    "                             ? A[(k0 + ty) * lda + row0 + tx] : 0;\n"
+    "#else\n"
+    "        a_tile[ty][tx] = (row0 + ty < M && k0 + tx < K)\n"
+    "                             ? A[(row0 + ty) * lda + k0 + tx] : 0;\n"
+    "#endif\n"
+    "#if TRANS_B\n"
+    "        // B is N x K: walk its rows with tx\n"
+    "        b_tile[tx][ty] = (k0 + tx < K && col0 + ty < N)\n"
+    "                             ? B[(col0 + ty) * ldb + k0 + tx] : 0;\n"
+    "#else\n"
+    "        b_tile[ty][tx] = (k0 + ty < K && col0 + tx < N)\n"
+    "                             ? B[(k0 + ty) * ldb + col0 + tx] : 0;\n"
+    "#endif\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "        for (unsigned int p = 0; p < TILE; p++)\n"
+    "            sum += a_tile[ty][p] * b_tile[p][tx];\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "    }\n"
+    "\n"
+    "    const unsigned int row = row0 + ty;\n"
+    "    const unsigned int col = col0 + tx;\n"
+    "    if (row < M && col < N)\n"
+    "    {\n"
+    "        __global T *c = C + row * ldc + col;\n"
+    "        *c = beta == (T)0 ? alpha * sum : alpha * sum + beta * *c;\n"
+    "    }\n"
+    "}\n";
+
+// Work-group g computes product g; its work-items take the outputs of C in
+// turn, each a dot product read straight from global memory. With FIXED the
+// shape is compiled in (M, N, K) and the operands are found by stride, so a
+// local size of M * N gives one output per work-item and UNROLL asks for the
+// K loop to be unrolled; otherwise the shape and offsets come from the
+// product's descriptor (OclGemmBatchEntry).
+static const char *OclGemmBatchedKernel =
+    "typedef struct { uint m, n, k, a_offset, b_offset, c_offset; } Entry;\n"
+    "\n"
+    "__kernel void gemm_batched(const T alpha, __global const T *A, __global const T *B,\n"
+    "                           const T beta, __global T *C,\n"
+    "#if FIXED\n"
+    "                           const unsigned int stride_a, const unsigned int stride_b,\n"
+    "                           const unsigned int stride_c)\n"
+    "#else\n"
+    "                           __global const Entry *entries)\n"
+    "#endif\n"
+    "{\n"
+    "    const unsigned int g = get_group_id(0);\n"
+    "#if FIXED\n"
+    "    const unsigned int m = M, n = N, k = K;\n"
+    "    A += g * stride_a;\n"
+    "    B += g * stride_b;\n"
+    "    C += g * stride_c;\n"
+    "#else\n"
+    "    const Entry e = entries[g];\n"
+    "    const unsigned int m = e.m, n = e.n, k = e.k;\n"
+    "    A += e.a_offset;\n"
+    "    B += e.b_offset;\n"
+    "    C += e.c_offset;\n"
+    "#endif\n"
+    "\n"
+    "    for (unsigned int idx = get_local_id(0); idx < m * n; idx += get_local_size(0))\n"
+    "    {\n"
+    "        const unsigned int i = idx / n;\n"
+    "        const unsigned int j = idx % n;\n"
+    "        T sum = 0;\n"
+    "#if UNROLL\n"
+    "#pragma unroll\n"
+    "#endif\n"
+    "        for (unsigned int p = 0; p < k; p++)\n"
+    "        {\n"
+    "#if TRANS_A\n"
+    "            const T a = A[p * m + i];\n"
+    "#else\n"
+    "            const T a = A[i * k + p];\n"
+    "#endif\n"
+    "#if TRANS_B\n"
+    "            const T b = B[j * k + p];\n"
+    "#else\n"
+    "            const T b = B[p * n + j];\n"
+    "#endif\n"
+    "            sum += a * b;\n"
+    "        }\n"
+    "        C[idx] = beta == (T)0 ? alpha * sum : alpha * sum + beta * C[idx];\n"
+    "    }\n"
+    "}\n";
+
+// Z = alpha * X + beta * Y on rows x cols blocks, each at an offset into
+// its buffer with its own row stride; the additions of the Strassen driver.
+// Z may be X or Y.
+static const char *OclGemmAxpbyKernel =
+    "__kernel void gemm_axpby(const unsigned int rows, const unsigned int cols,\n"
+    "                         const T alpha, __global const T *X, const ulong x_offset,\n"
+    "                         const unsigned int ldx, const T beta, __global const T *Y,\n"
+    "                         const ulong y_offset, const unsigned int ldy, __global T *Z,\n"
+    "                         const ulong z_offset, const unsigned int ldz)\n"
+    "{\n"
+    "    const unsigned int col = get_global_id(0);\n"
+    "    const unsigned int row = get_global_id(1);\n"
+    "    if (row < rows && col < cols)\n"
+    "        Z[z_offset + row * ldz + col] = alpha * X[x_offset + row * ldx + col]\n"
+    "                                        + beta * Y[y_offset + row * ldy + col];\n"
+    "}\n";
+
+/**
+ * @brief The largest power of two tile, up to OCL_GEMM_MAX_TILE, whose
+ * tile x tile work-group the device can run.
+ */
+static unsigned int OclGemmTile(OclRuntime *runtime)
+{
+    unsigned int tile = OCL_GEMM_MAX_TILE;
+    while (tile > 1 && tile * tile > runtime->max_work_group_size)
+        tile /= 2;
+    return tile;
+}
+
+/**
+ * @brief Sets kernel argument index to value as an int or a float.
+ */
+static cl_int OclGemmSetScalarArg(cl_kernel kernel, cl_uint index, OclDataType type,
+                                  double value)
+{
+    if (type == OCL_INT)
+    {
+        cl_int scalar = (cl_int)value;
+        return clSetKernelArg(kernel, index, sizeof(scalar), &scalar);
+    }
+    cl_float scalar = (cl_float)value;
+    return clSetKernelArg(kernel, index, sizeof(scalar), &scalar);
+}
+
+/**
+ * @brief OclGemmDevice on the matrices starting a_offset, b_offset and
+ * c_offset elements into their buffers, after the events in wait_list;
+ * event (if not NULL) receives the kernel's event.
+ */
+static cl_int OclGemmEnqueue(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                             OclTranspose trans_b, unsigned int m, unsigned int n,
+                             unsigned int k, double alpha, cl_mem a, cl_ulong a_offset,
+                             unsigned int lda, cl_mem b, cl_ulong b_offset, unsigned int ldb,
+                             double beta, cl_mem c, cl_ulong c_offset, unsigned int ldc,
+                             cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (type != OCL_INT && type != OCL_FLOAT)
+        return CL_INVALID_VALUE;
+    if (lda < (trans_a ? m : k) || ldb < (trans_b ? k : n) || ldc < n)
+        return CL_INVALID_VALUE;
+    if (m == 0 || n == 0)
+        return clEnqueueMarkerWithWaitList(runtime->queue, num_events, wait_list, event);
+
+    const unsigned int tile = OclGemmTile(runtime);
+    char source[4096];
+    snprintf(source, sizeof(source), "#define T %s\n#define TILE %u\n#define TRANS_A %d\n"
+             "#define TRANS_B %d\n%s",
+             type == OCL_INT ? "int" : "float", tile, trans_a ? 1 : 0, trans_b ? 1 : 0,
+             OclGemmKernel);
+
+    cl_kernel kernel;
+    err = OclRuntimeGetKernel(runtime, source, "gemm", &kernel);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err |= clSetKernelArg(kernel, 0, sizeof(unsigned int), &m);
+    err |= clSetKernelArg(kernel, 1, sizeof(unsigned int), &n);
+    err |= clSetKernelArg(kernel, 2, sizeof(unsigned int), &k);
+    err |= OclGemmSetScalarArg(kernel, 3, type, alpha);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &a);
+    err |= clSetKernelArg(kernel, 5, sizeof(cl_ulong), &a_offset);
+    err |= clSetKernelArg(kernel, 6, sizeof(unsigned int), &lda);
+    err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &b);
+    err |= clSetKernelArg(kernel, 8, sizeof(cl_ulong), &b_offset);
+    err |= clSetKernelArg(kernel, 9, sizeof(unsigned int), &ldb);
+    err |= OclGemmSetScalarArg(kernel, 10, type, beta);
+    err |= clSetKernelArg(kernel, 11, sizeof(cl_mem), &c);
+    err |= clSetKernelArg(kernel, 12, sizeof(cl_ulong), &c_offset);
+    err |= clSetKernelArg(kernel, 13, sizeof(unsigned int), &ldc);
+    if (err != CL_SUCCESS)
+        return err;
+
+    // dimension 0 runs along the columns of C
+    const size_t local_size[2] = { tile, tile };
+    const size_t global_size[2] = { (size_t)(n + tile - 1) / tile * tile,
+                                    (size_t)(m + tile - 1) / tile * tile };
+    return clEnqueueNDRangeKernel(runtime->queue, kernel, 2, NULL, global_size, local_size,
+                                  num_events, num_events ? wait_list : NULL, event);
+}
+
+cl_int OclGemmDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                     OclTranspose trans_b, unsigned int m, unsigned int n, unsigned int k,
+                     double alpha, cl_mem a, unsigned int lda, cl_mem b, unsigned int ldb,
+                     double beta, cl_mem c, unsigned int ldc)
+{
+    return OclGemmEnqueue(runtime, type, trans_a, trans_b, m, n, k, alpha, a, 0, lda, b, 0, ldb,
+                          beta, c, 0, ldc, 0, NULL, NULL);
+}
+
+/**
+ * @brief OclGemm, through OclGemmStrassenDevice with the given crossover if
+ * strassen is non-zero.
+ */
+static cl_int OclGemmHost(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b,
+                          int alpha, const Matrix *a, const Matrix *b, int beta, Matrix *c,
+                          int strassen, unsigned int crossover)
+{
+    cl_int err;
+    cl_mem device_a = NULL, device_b = NULL, device_c = NULL;
+
+    const unsigned int m = trans_a ? a->shape[1] : a->shape[0];
+    const unsigned int k = trans_a ? a->shape[0] : a->shape[1];
+    const unsigned int k_b = trans_b ? b->shape[1] : b->shape[0];
+    const unsigned int n = trans_b ? b->shape[0] : b->shape[1];
+    if (k != k_b || c->shape[0] != m || c->shape[1] != n)
+        return CL_INVALID_VALUE;
+    if (m == 0 || n == 0)
+        return CL_SUCCESS;
+    if (runtime->native)
+    {
+        return OclCpuGemm(trans_a, trans_b, m, n, k, alpha, a->data, a->shape[1], b->data,
+                          b->shape[1], beta, c->data, n);
+    }
+    // OpenCL buffers cannot be empty
+    if (k == 0)
+    {
+        for (size_t i = 0; i < (size_t)m * n; i++)
+            c->data[i] = beta == 0 ? 0 : beta * c->data[i];
+        return CL_SUCCESS;
+    }
+    // operands the device cannot hold at once go through in panels
+    const cl_ulong size_a = (cl_ulong)m * k * sizeof(int);
+    const cl_ulong size_b = (cl_ulong)k * n * sizeof(int);
+    const cl_ulong size_c = (cl_ulong)m * n * sizeof(int);
+    if (size_a + size_b + size_c > runtime->global_mem_size / 2 ||
+        size_a > runtime->max_mem_alloc_size || size_b > runtime->max_mem_alloc_size ||
+        size_c > runtime->max_mem_alloc_size)
+        return OclGemmOutOfCore(runtime, trans_a, trans_b, alpha, a, b, beta, c, 0);
+
+    err = OclRuntimeUpload(runtime, a, CL_MEM_READ_ONLY, &device_a);
+    if (err == CL_SUCCESS)
+        err = OclRuntimeUpload(runtime, b, CL_MEM_READ_ONLY, &device_b);
+    if (err == CL_SUCCESS && beta != 0)
+        err = OclRuntimeUpload(runtime, c, CL_MEM_READ_WRITE, &device_c);
+    else if (err == CL_SUCCESS)
+        device_c = clCreateBuffer(runtime->context, CL_MEM_WRITE_ONLY,
+                                  (size_t)m * n * sizeof(int), NULL, &err);
+    if (err == CL_SUCCESS && strassen)
+        err = OclGemmStrassenDevice(runtime, OCL_INT, trans_a, trans_b, m, n, k, alpha,
+                                    device_a, a->shape[1], device_b, b->shape[1], beta,
+                                    device_c, n, crossover);
+    else if (err == CL_SUCCESS)
+        err = OclGemmDevice(runtime, OCL_INT, trans_a, trans_b, m, n, k, alpha,
+                            device_a, a->shape[1], device_b, b->shape[1], beta, device_c, n);
+    if (err == CL_SUCCESS)
+        err = OclRuntimeDownload(runtime, device_c, c);
+    else
+        clFinish(runtime->queue); // the uploads still read the host matrices
+
+    if (device_a)
+        clReleaseMemObject(device_a);
+    if (device_b)
+        clReleaseMemObject(device_b);
+    if (device_c)
+        clReleaseMemObject(device_c);
+    return err;
+}
+
+cl_int OclGemm(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b, int alpha,
+               const Matrix *a, const Matrix *b, int beta, Matrix *c)
+{
+    return OclGemmHost(runtime, trans_a, trans_b, alpha, a, b, beta, c, 0, 0);
+}
+
+cl_int OclGemmStrassen(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b,
+                       int alpha, const Matrix *a, const Matrix *b, int beta, Matrix *c,
+                       unsigned int crossover)
+{
+    return OclGemmHost(runtime, trans_a, trans_b, alpha, a, b, beta, c, 1, crossover);
+}
+
+/**
+ * @brief The gemm_batched kernel for type and transposes; fixed is non-zero
+ * for the strided variant of shape m x n x k.
+ */
+static cl_int OclGemmBatchedGetKernel(OclRuntime *runtime, OclDataType type,
+                                      OclTranspose trans_a, OclTranspose trans_b, int fixed,
+                                      unsigned int m, unsigned int n, unsigned int k,
+                                      cl_kernel *kernel)
+{
+    char source[4096];
+    snprintf(source, sizeof(source), "#define T %s\n#define TRANS_A %d\n#define TRANS_B %d\n"
+             "#define FIXED %d\n#define M %uu\n#define N %uu\n#define K %uu\n"
+             "#define UNROLL %d\n%s",
+             type == OCL_INT ? "int" : "float", trans_a ? 1 : 0, trans_b ? 1 : 0, fixed ? 1 : 0,
+             m, n, k, fixed && k <= OCL_GEMM_UNROLL_MAX, OclGemmBatchedKernel);
+    return OclRuntimeGetKernel(runtime, source, "gemm_batched", kernel);
+}
+
+cl_int OclGemmBatchedDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                            OclTranspose trans_b, double alpha, cl_mem a, cl_mem b, double beta,
+                            cl_mem c, cl_mem entries, unsigned int count)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (type != OCL_INT && type != OCL_FLOAT)
+        return CL_INVALID_VALUE;
+    if (count == 0)
+        return CL_SUCCESS;
+
+    cl_kernel kernel;
+    err = OclGemmBatchedGetKernel(runtime, type, trans_a, trans_b, 0, 0, 0, 0, &kernel);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err |= OclGemmSetScalarArg(kernel, 0, type, alpha);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &a);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &b);
+    err |= OclGemmSetScalarArg(kernel, 3, type, beta);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &c);
+    err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &entries);
+    if (err != CL_SUCCESS)
+        return err;
+
+    size_t local_size = OCL_GEMM_BATCH_LOCAL_SIZE;
+    if (local_size > runtime->max_work_group_size)
+        local_size = runtime->max_work_group_size;
+    size_t global_size = (size_t)count * local_size;
+    return clEnqueueNDRangeKernel(runtime->queue, kernel, 1, NULL, &global_size, &local_size,
+                                  0, NULL, NULL);
+}
+
+cl_int OclGemmStridedBatchedDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                                   OclTranspose trans_b, unsigned int m, unsigned int n,
+                                   unsigned int k, double alpha, cl_mem a, unsigned int stride_a,
+                                   cl_mem b, unsigned int stride_b, double beta, cl_mem c,
+                                   unsigned int stride_c, unsigned int count)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (type != OCL_INT && type != OCL_FLOAT)
+        return CL_INVALID_VALUE;
+    if (stride_a < (size_t)m * k || stride_b < (size_t)k * n || stride_c < (size_t)m * n)
+        return CL_INVALID_VALUE;
+    if (count == 0 || m == 0 || n == 0)
+        return CL_SUCCESS;
+
+    cl_kernel kernel;
+    err = OclGemmBatchedGetKernel(runtime, type, trans_a, trans_b, 1, m, n, k, &kernel);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err |= OclGemmSetScalarArg(kernel, 0, type, alpha);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &a);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &b);
+    err |= OclGemmSetScalarArg(kernel, 3, type, beta);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &c);
+    err |= clSetKernelArg(kernel, 5, sizeof(unsigned int), &stride_a);
+    err |= clSetKernelArg(kernel, 6, sizeof(unsigned int), &stride_b);
+    err |= clSetKernelArg(kernel, 7, sizeof(unsigned int), &stride_c);
+    if (err != CL_SUCCESS)
+        return err;
+
+    // one work-item per output when a group holds them all
+    size_t local_size = (size_t)m * n;
+    if (local_size > runtime->max_work_group_size)
+        local_size = OCL_GEMM_BATCH_LOCAL_SIZE < runtime->max_work_group_size
+                         ? OCL_GEMM_BATCH_LOCAL_SIZE : runtime->max_work_group_size;
+    size_t global_size = (size_t)count * local_size;
+    return clEnqueueNDRangeKernel(runtime->queue, kernel, 1, NULL, &global_size, &local_size,
+                                  0, NULL, NULL);
+}
+
+/**
+ * @brief The products of OclGemmBatched on a native runtime.
+ */
+typedef struct _OclGemmNativeBatch
+{
+    OclTranspose trans_a, trans_b;
+    int alpha, beta;
+    const Matrix *a, *b;
+    Matrix *c;
+    const OclGemmBatchEntry *entries;
+    pthread_mutex_t lock; // guards err
+    cl_int err;           // the error of a failed product, if any
+} OclGemmNativeBatch;
+
+static void OclGemmNativeBatchTask(void *arg, size_t begin, size_t end)
+{
+    OclGemmNativeBatch *batch = (OclGemmNativeBatch *)arg;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        const OclGemmBatchEntry *e = &batch->entries[i];
+        cl_int err = OclCpuGemm(batch->trans_a, batch->trans_b, e->m, e->n, e->k, batch->alpha,
+                                batch->a[i].data, batch->a[i].shape[1], batch->b[i].data,
+                                batch->b[i].shape[1], batch->beta, batch->c[i].data, e->n);
+        if (err != CL_SUCCESS)
+        {
+            pthread_mutex_lock(&batch->lock);
+            batch->err = err;
+            pthread_mutex_unlock(&batch->lock);
+        }
+    }
+}
+
+cl_int OclGemmBatched(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b,
+                      int alpha, const Matrix *a, const Matrix *b, int beta, Matrix *c,
+                      unsigned int count)
+{
+    cl_int err = CL_SUCCESS;
+    OclGemmBatchEntry *entries = NULL;
+    int *packed[3] = { NULL, NULL, NULL };
+    cl_mem device[3] = { NULL, NULL, NULL }, device_entries = NULL;
+
+    if (count == 0)
+        return CL_SUCCESS;
+
+    entries = (OclGemmBatchEntry *)malloc(count * sizeof(OclGemmBatchEntry));
+    if (!entries)
+        return CL_OUT_OF_HOST_MEMORY;
+
+    // shapes and offsets in the packed buffers
+    size_t total[3] = { 0, 0, 0 };
+    int uniform = 1;
+    for (unsigned int i = 0; i < count && err == CL_SUCCESS; i++)
+    {
+        OclGemmBatchEntry *e = &entries[i];
+        e->m = trans_a ? a[i].shape[1] : a[i].shape[0];
+        e->k = trans_a ? a[i].shape[0] : a[i].shape[1];
+        e->n = trans_b ? b[i].shape[0] : b[i].shape[1];
+        const unsigned int k_b = trans_b ? b[i].shape[1] : b[i].shape[0];
+        if (k_b != e->k || c[i].shape[0] != e->m || c[i].shape[1] != e->n)
+            err = CL_INVALID_VALUE;
+        uniform = uniform && e->m == entries[0].m && e->n == entries[0].n &&
+                  e->k == entries[0].k;
+
+        e->a_offset = total[0];
+        e->b_offset = total[1];
+        e->c_offset = total[2];
+        total[0] += (size_t)e->m * e->k;
+        total[1] += (size_t)e->k * e->n;
+        total[2] += (size_t)e->m * e->n;
+        if (total[0] > UINT_MAX || total[1] > UINT_MAX || total[2] > UINT_MAX)
+            err = CL_INVALID_VALUE;
+    }
+    if (runtime->native)
+    {
+        // one product per task; each runs on the thread that takes it
+        OclGemmNativeBatch batch;
+        batch.trans_a = trans_a;
+        batch.trans_b = trans_b;
+        batch.alpha = alpha;
+        batch.beta = beta;
+        batch.a = a;
+        batch.b = b;
+        batch.c = c;
+        batch.entries = entries;
+        batch.err = CL_SUCCESS;
+        pthread_mutex_init(&batch.lock, NULL);
+        if (err == CL_SUCCESS)
+        {
+            OclCpuParallelFor(count, 1, OclGemmNativeBatchTask, &batch);
+            err = batch.err;
+        }
+        pthread_mutex_destroy(&batch.lock);
+        free(entries);
+        return err;
+    }
+
+    const Matrix *operands[3] = { a, b, c };
+    for (int t = 0; t < 3 && err == CL_SUCCESS; t++)
+    {
+        // OpenCL buffers cannot be empty
+        packed[t] = (int *)malloc((total[t] ? total[t] : 1) * sizeof(int));
+        if (!packed[t])
+        {
+            err = CL_OUT_OF_HOST_MEMORY;
+            break;
+        }
+        if (t == 2 && beta == 0)
+        {
+            // C is only written
+            device[t] = clCreateBuffer(runtime->context, CL_MEM_WRITE_ONLY,
+                                       (total[t] ? total[t] : 1) * sizeof(int), NULL, &err);
+            continue;
+        }
+        for (unsigned int i = 0, offset = 0; i < count; i++)
+        {
+            size_t size = (size_t)operands[t][i].shape[0] * operands[t][i].shape[1];
+            memcpy(packed[t] + offset, operands[t][i].data, size * sizeof(int));
+            offset += size;
+        }
+        Matrix view = { packed[t], { total[t] ? total[t] : 1, 1 } };
+        err = OclRuntimeUpload(runtime, &view, t == 2 ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY,
+                               &device[t]);
+    }
+
+    if (err == CL_SUCCESS && uniform)
+    {
+        const OclGemmBatchEntry *e = &entries[0];
+        err = OclGemmStridedBatchedDevice(runtime, OCL_INT, trans_a, trans_b, e->m, e->n, e->k,
+                                          alpha, device[0], e->m * e->k, device[1],
+                                          e->k * e->n, beta, device[2], e->m * e->n, count);
+    }
+    else if (err == CL_SUCCESS)
+    {
+        device_entries = clCreateBuffer(runtime->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                        count * sizeof(OclGemmBatchEntry), entries, &err);
+        if (err == CL_SUCCESS)
+            err = OclGemmBatchedDevice(runtime, OCL_INT, trans_a, trans_b, alpha, device[0],
+                                       device[1], beta, device[2], device_entries, count);
+    }
+
+    if (err == CL_SUCCESS)
+    {
+        Matrix view = { packed[2], { total[2] ? total[2] : 1, 1 } };
+        err = OclRuntimeDownload(runtime, device[2], &view);
+    }
+    else
+    {
+        clFinish(runtime->queue); // the uploads still read the packed buffers
+    }
+    if (err == CL_SUCCESS)
+    {
+        for (unsigned int i = 0; i < count; i++)
+            memcpy(c[i].data, packed[2] + entries[i].c_offset,
+                   (size_t)c[i].shape[0] * c[i].shape[1] * sizeof(int));
+    }
+
+    for (int t = 0; t < 3; t++)
+    {
+        if (device[t])
+            clReleaseMemObject(device[t]);
+        free(packed[t]);
+    }
+    if (device_entries)
+        clReleaseMemObject(device_entries);
+    free(entries);
+    return err;
+}
+
+/**
+ * @brief A matrix operand of the Strassen driver: op(X) is the block of the
+ * buffer starting offset elements in, with row stride ld, transposed if
+ * trans.
+ */
+typedef struct _OclGemmOperand
+{
+    cl_mem buffer;
+    cl_ulong offset;
+    unsigned int ld;
+    OclTranspose trans;
+} OclGemmOperand;
+
+/**
+ * @brief Block (i, j) of op(x), blocks being rows x cols; stored
+ * transposed, it is block (j, i) of x.
+ */
+static OclGemmOperand OclGemmBlock(OclGemmOperand x, unsigned int i, unsigned int j,
+                                   unsigned int rows, unsigned int cols)
+{
+    if (x.trans)
+        x.offset += (cl_ulong)j * cols * x.ld + (cl_ulong)i * rows;
+    else
+        x.offset += (cl_ulong)i * rows * x.ld + (cl_ulong)j * cols;
+    return x;
+}
+
+/**
+ * @brief op(z) = alpha * op(x) + beta * op(y) for rows x cols operands that
+ * are all transposed or all not; z may be x or y.
+ */
+static cl_int OclGemmAxpby(OclRuntime *runtime, OclDataType type, unsigned int rows,
+                           unsigned int cols, double alpha, OclGemmOperand x, double beta,
+                           OclGemmOperand y, OclGemmOperand z)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (rows == 0 || cols == 0)
+        return CL_SUCCESS;
+    if (z.trans)
+    {
+        // the same sum on the stored, transposed blocks
+        unsigned int stored_rows = cols;
+        cols = rows;
+        rows = stored_rows;
+    }
+
+    char source[2048];
+    snprintf(source, sizeof(source), "#define T %s\n%s", type == OCL_INT ? "int" : "float",
+             OclGemmAxpbyKernel);
+    cl_kernel kernel;
+    err = OclRuntimeGetKernel(runtime, source, "gemm_axpby", &kernel);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err |= clSetKernelArg(kernel, 0, sizeof(unsigned int), &rows);
+    err |= clSetKernelArg(kernel, 1, sizeof(unsigned int), &cols);
+    err |= OclGemmSetScalarArg(kernel, 2, type, alpha);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &x.buffer);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_ulong), &x.offset);
+    err |= clSetKernelArg(kernel, 5, sizeof(unsigned int), &x.ld);
+    err |= OclGemmSetScalarArg(kernel, 6, type, beta);
+    err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &y.buffer);
+    err |= clSetKernelArg(kernel, 8, sizeof(cl_ulong), &y.offset);
+    err |= clSetKernelArg(kernel, 9, sizeof(unsigned int), &y.ld);
+    err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &z.buffer);
+    err |= clSetKernelArg(kernel, 11, sizeof(cl_ulong), &z.offset);
+    err |= clSetKernelArg(kernel, 12, sizeof(unsigned int), &z.ld);
+    if (err != CL_SUCCESS)
+        return err;
+
+    const size_t global_size[2] = { cols, rows };
+    return clEnqueueNDRangeKernel(runtime->queue, kernel, 2, NULL, global_size, NULL,
+                                  0, NULL, NULL);
+}
+
+/**
+ * @brief OclGemmEnqueue on operands: c = alpha * op(a) * op(b) + beta * c.
+ */
+static cl_int OclGemmOperands(OclRuntime *runtime, OclDataType type, unsigned int m,
+                              unsigned int n, unsigned int k, double alpha, OclGemmOperand a,
+                              OclGemmOperand b, double beta, OclGemmOperand c)
+{
+    return OclGemmEnqueue(runtime, type, a.trans, b.trans, m, n, k, alpha, a.buffer, a.offset,
+                          a.ld, b.buffer, b.offset, b.ld, beta, c.buffer, c.offset, c.ld,
+                          0, NULL, NULL);
+}
+
+/**
+ * @brief A pooled scratch operand for a rows x cols op(X), stored densely and
+ * transposed like x.
+ */
+static cl_int OclGemmScratch(OclRuntime *runtime, OclDataType type, unsigned int rows,
+                             unsigned int cols, OclTranspose trans, OclGemmOperand *x)
+{
+    x->offset = 0;
+    x->ld = trans ? rows : cols;
+    x->trans = trans;
+    return OclRuntimeAcquireBuffer(runtime, (size_t)rows * cols *
+                                   (type == OCL_INT ? sizeof(cl_int) : sizeof(cl_float)),
+                                   &x->buffer);
+}
+
+/**
+ * @brief c = op(a) * op(b), with c not transposed and not overlapping a or b:
+ * one level of Winograd's variant of Strassen on the even part of each
+ * dimension, recursing while every dimension is at least crossover, and the
+ * tiled kernel for the odd row, column and inner index left over.
+ */
+static cl_int OclGemmStrassenLevel(OclRuntime *runtime, OclDataType type, unsigned int m,
+                                   unsigned int n, unsigned int k, OclGemmOperand a,
+                                   OclGemmOperand b, OclGemmOperand c, unsigned int crossover)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (m < crossover || n < crossover || k < crossover || m < 2 || n < 2 || k < 2)
+        return OclGemmOperands(runtime, type, m, n, k, 1, a, b, 0, c);
+
+    const unsigned int hm = m / 2, hn = n / 2, hk = k / 2;
+    OclGemmOperand a11 = OclGemmBlock(a, 0, 0, hm, hk), a12 = OclGemmBlock(a, 0, 1, hm, hk);
+    OclGemmOperand a21 = OclGemmBlock(a, 1, 0, hm, hk), a22 = OclGemmBlock(a, 1, 1, hm, hk);
+    OclGemmOperand b11 = OclGemmBlock(b, 0, 0, hk, hn), b12 = OclGemmBlock(b, 0, 1, hk, hn);
+    OclGemmOperand b21 = OclGemmBlock(b, 1, 0, hk, hn), b22 = OclGemmBlock(b, 1, 1, hk, hn);
+    OclGemmOperand c11 = OclGemmBlock(c, 0, 0, hm, hn), c12 = OclGemmBlock(c, 0, 1, hm, hn);
+    OclGemmOperand c21 = OclGemmBlock(c, 1, 0, hm, hn), c22 = OclGemmBlock(c, 1, 1, hm, hn);
+
+    // S sums of A blocks, T sums of B blocks, stored like A and B; P holds P1
+    OclGemmOperand s1, s2, t1, t2, p;
+    s1.buffer = s2.buffer = t1.buffer = t2.buffer = p.buffer = NULL;
+    err = OclGemmScratch(runtime, type, hm, hk, a.trans, &s1);
+    if (err == CL_SUCCESS)
+        err = OclGemmScratch(runtime, type, hm, hk, a.trans, &s2);
+    if (err == CL_SUCCESS)
+        err = OclGemmScratch(runtime, type, hk, hn, b.trans, &t1);
+    if (err == CL_SUCCESS)
+        err = OclGemmScratch(runtime, type, hk, hn, b.trans, &t2);
+    if (err == CL_SUCCESS)
+        err = OclGemmScratch(runtime, type, hm, hn, OCL_NO_TRANS, &p);
+
+    // 7 products and 15 additions; the C blocks hold partial results:
+    //   P7 = (A11 - A21)(B22 - B12) -> C21    P5 = (A21 + A22)(B12 - B11) -> C22
+    //   P6 = (S1 - A11)(B22 - T1)   -> C12    P1 = A11 B11                -> P
+    //   U2 = P1 + P6 -> C12, U3 = U2 + P7 -> C21, U4 = U2 + P5 -> C12,
+    //   C22 = U3 + P5, P3 = (A12 - S2) B22 -> C11, C12 = U4 + P3,
+    //   P4 = A22 (T2 - B21) -> C11, C21 = U3 - P4,
+    //   P2 = A12 B21 -> C11, C11 = P1 + P2
+#define OCL_STEP(call)            \
+    if (err == CL_SUCCESS)        \
+    err = (call)
+#define OCL_PRODUCT(x, y, z) \
+    OclGemmStrassenLevel(runtime, type, hm, hn, hk, x, y, z, crossover)
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hk, 1, a11, -1, a21, s1));
+    OCL_STEP(OclGemmAxpby(runtime, type, hk, hn, 1, b22, -1, b12, t1));
+    OCL_STEP(OCL_PRODUCT(s1, t1, c21));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hk, 1, a21, 1, a22, s1));
+    OCL_STEP(OclGemmAxpby(runtime, type, hk, hn, 1, b12, -1, b11, t1));
+    OCL_STEP(OCL_PRODUCT(s1, t1, c22));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hk, 1, s1, -1, a11, s2));
+    OCL_STEP(OclGemmAxpby(runtime, type, hk, hn, 1, b22, -1, t1, t2));
+    OCL_STEP(OCL_PRODUCT(s2, t2, c12));
+    OCL_STEP(OCL_PRODUCT(a11, b11, p));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hn, 1, p, 1, c12, c12));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hn, 1, c12, 1, c21, c21));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hn, 1, c12, 1, c22, c12));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hn, 1, c21, 1, c22, c22));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hk, 1, a12, -1, s2, s1));
+    OCL_STEP(OCL_PRODUCT(s1, b22, c11));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hn, 1, c12, 1, c11, c12));
+    OCL_STEP(OclGemmAxpby(runtime, type, hk, hn, 1, t2, -1, b21, t1));
+    OCL_STEP(OCL_PRODUCT(a22, t1, c11));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hn, 1, c21, -1, c11, c21));
+    OCL_STEP(OCL_PRODUCT(a12, b21, c11));
+    OCL_STEP(OclGemmAxpby(runtime, type, hm, hn, 1, p, 1, c11, c11));
+#undef OCL_PRODUCT
+
+    // the odd inner index, column and row
+    const unsigned int m2 = 2 * hm, n2 = 2 * hn, k2 = 2 * hk;
+    if (k2 < k)
+        OCL_STEP(OclGemmOperands(runtime, type, m2, n2, k - k2, 1, OclGemmBlock(a, 0, k2, 1, 1),
+                                 OclGemmBlock(b, k2, 0, 1, 1), 1, c));
+    if (n2 < n)
+        OCL_STEP(OclGemmOperands(runtime, type, m2, n - n2, k, 1, a,
+                                 OclGemmBlock(b, 0, n2, 1, 1), 0, OclGemmBlock(c, 0, n2, 1, 1)));
+    if (m2 < m)
+        OCL_STEP(OclGemmOperands(runtime, type, m - m2, n, k, 1, OclGemmBlock(a, m2, 0, 1, 1), b,
+                                 0, OclGemmBlock(c, m2, 0, 1, 1)));
+#undef OCL_STEP
+
+    OclRuntimeReturnBuffer(runtime, s1.buffer);
+    OclRuntimeReturnBuffer(runtime, s2.buffer);
+    OclRuntimeReturnBuffer(runtime, t1.buffer);
+    OclRuntimeReturnBuffer(runtime, t2.buffer);
+    OclRuntimeReturnBuffer(runtime, p.buffer);
+    return err;
+}
+
+cl_int OclGemmStrassenDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                             OclTranspose trans_b, unsigned int m, unsigned int n,
+                             unsigned int k, double alpha, cl_mem a, unsigned int lda, cl_mem b,
+                             unsigned int ldb, double beta, cl_mem c, unsigned int ldc,
+                             unsigned int crossover)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (type != OCL_INT && type != OCL_FLOAT)
+        return CL_INVALID_VALUE;
+    if (lda < (trans_a ? m : k) || ldb < (trans_b ? k : n) || ldc < n)
+        return CL_INVALID_VALUE;
+    if (crossover == 0)
+        crossover = OCL_GEMM_STRASSEN_CROSSOVER;
+    if (m < crossover || n < crossover || k < crossover)
+        return OclGemmDevice(runtime, type, trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb,
+                             beta, c, ldc);
+
+    OclGemmOperand op_a = { a, 0, lda, trans_a };
+    OclGemmOperand op_b = { b, 0, ldb, trans_b };
+    OclGemmOperand op_c = { c, 0, ldc, OCL_NO_TRANS };
+    if (alpha == 1 && beta == 0)
+        return OclGemmStrassenLevel(runtime, type, m, n, k, op_a, op_b, op_c, crossover);
+
+    // the product goes to scratch, then C = alpha * product + beta * C
+    OclGemmOperand product;
+    err = OclGemmScratch(runtime, type, m, n, OCL_NO_TRANS, &product);
+    if (err != CL_SUCCESS)
+        return err;
+    err = OclGemmStrassenLevel(runtime, type, m, n, k, op_a, op_b, product, crossover);
+    if (err == CL_SUCCESS)
+        err = OclGemmAxpby(runtime, type, m, n, alpha, product, beta, beta == 0 ? product : op_c,
+                           op_c);
+    OclRuntimeReturnBuffer(runtime, product.buffer);
+    return err;
+}
+
+void OclGemmPanelSizes(OclRuntime *runtime, unsigned int m, unsigned int n, unsigned int k,
+                       size_t device_bytes, unsigned int *panel_m, unsigned int *panel_n,
+                       unsigned int *panel_k)
+{
+    if (device_bytes == 0)
+        device_bytes = runtime->global_mem_size / 2;
+    // two A panels, two B panels and two C tiles, in elements
+    const size_t budget = device_bytes / sizeof(int) / 2;
+    const size_t max_alloc = runtime->max_mem_alloc_size / sizeof(int);
+
+    // the largest square panel side whose six buffers fit
+    size_t side = OCL_GEMM_PANEL_ALIGN;
+    while (3 * (2 * side) * (2 * side) <= budget && (2 * side) * (2 * side) <= max_alloc)
+        side *= 2;
+    while (side > 1 && 3 * side * side > budget)
+        side /= 2;
+    size_t pm = m < side ? m : side;
+    size_t pn = n < side ? n : side;
+
+    // the rest of the budget goes to the inner dimension, which matters
+    // when C is narrow
+    size_t pk = budget > pm * pn ? (budget - pm * pn) / (pm + pn) : 1;
+    const size_t max_pk = max_alloc / (pm > pn ? pm : pn);
+    if (pk > max_pk)
+        pk = max_pk;
+    if (pk >= k)
+        pk = k;
+    else if (pk > OCL_GEMM_PANEL_ALIGN)
+        pk -= pk % OCL_GEMM_PANEL_ALIGN;
+    if (pk == 0)
+        pk = 1;
+
+    *panel_m = pm;
+    *panel_n = pn;
+    *panel_k = pk;
+}
+
+/**
+ * @brief Releases *event, if any, and clears it.
+ */
+static void OclReleaseEvent(cl_event *event)
+{
+    if (*event)
+        clReleaseEvent(*event);
+    *event = NULL;
+}
+
+/**
+ * @brief Enqueues a copy between the rows x cols block at (row, col) of a
+ * host matrix with cols_total columns and a device buffer holding it densely.
+ */
+static cl_int OclGemmTransferBlock(cl_command_queue queue, int write, cl_mem buffer,
+                                   int *host, unsigned int cols_total, size_t row, size_t col,
+                                   size_t rows, size_t cols, cl_uint num_events,
+                                   const cl_event *wait_list, cl_event *event)
+{
+    const size_t buffer_origin[3] = { 0, 0, 0 };
+    const size_t host_origin[3] = { col * sizeof(int), row, 0 };
+    const size_t region[3] = { cols * sizeof(int), rows, 1 };
+    if (write)
+        return clEnqueueWriteBufferRect(queue, buffer, CL_FALSE, buffer_origin, host_origin,
+                                        region, cols * sizeof(int), 0,
+                                        (size_t)cols_total * sizeof(int), 0, host,
+                                        num_events, num_events ? wait_list : NULL, event);
+    return clEnqueueReadBufferRect(queue, buffer, CL_FALSE, buffer_origin, host_origin, region,
+                                   cols * sizeof(int), 0, (size_t)cols_total * sizeof(int), 0,
+                                   host, num_events, num_events ? wait_list : NULL, event);
+}
+
+cl_int OclGemmOutOfCore(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b,
+                        int alpha, const Matrix *a, const Matrix *b, int beta, Matrix *c,
+                        size_t device_bytes)
+{
+    cl_int err = CL_SUCCESS;
+    // panel slots and C tile slots, each used by every other panel or tile
+    cl_mem panel_a[2] = { NULL, NULL }, panel_b[2] = { NULL, NULL }, tile_c[2] = { NULL, NULL };
+    cl_event written[2] = { NULL, NULL }, computed[2] = { NULL, NULL };
+
+    const unsigned int m = trans_a ? a->shape[1] : a->shape[0];
+    const unsigned int k = trans_a ? a->shape[0] : a->shape[1];
+    const unsigned int k_b = trans_b ? b->shape[1] : b->shape[0];
+    const unsigned int n = trans_b ? b->shape[0] : b->shape[1];
+    if (k != k_b || c->shape[0] != m || c->shape[1] != n)
+        return CL_INVALID_VALUE;
+    if (m == 0 || n == 0)
+        return CL_SUCCESS;
+    if (runtime->native)
+    {
+        // already out of core: the host matrices are the operands
+        return OclCpuGemm(trans_a, trans_b, m, n, k, alpha, a->data, a->shape[1], b->data,
+                          b->shape[1], beta, c->data, n);
+    }
+    if (k == 0)
+    {
+        for (size_t i = 0; i < (size_t)m * n; i++)
+            c->data[i] = beta == 0 ? 0 : beta * c->data[i];
+        return CL_SUCCESS;
+    }
+
+    unsigned int pm, pn, pk;
+    OclGemmPanelSizes(runtime, m, n, k, device_bytes, &pm, &pn, &pk);
+    for (int s = 0; s < 2 && err == CL_SUCCESS; s++)
+    {
+        panel_a[s] = clCreateBuffer(runtime->context, CL_MEM_READ_ONLY,
+                                    (size_t)pm * pk * sizeof(int), NULL, &err);
+        if (err == CL_SUCCESS)
+            panel_b[s] = clCreateBuffer(runtime->context, CL_MEM_READ_ONLY,
+                                        (size_t)pk * pn * sizeof(int), NULL, &err);
+        if (err == CL_SUCCESS)
+            tile_c[s] = clCreateBuffer(runtime->context, CL_MEM_READ_WRITE,
+                                       (size_t)pm * pn * sizeof(int), NULL, &err);
+    }
+
+    // Panel g is the g-th (C tile, k panel) pair, tiles in row-major order and
+    // k panels within a tile; it uses panel slot g % 2 and its tile uses C
+    // slot (tile index) % 2. The transfer queue gets the writes of panel g + 1
+    // before the read of panel g's tile, so transfers run while panel g
+    // computes:
+    //   transfer: W0 W1 W2 ... Wp R(tile 0) Wp+1 ...    compute: K0 K1 K2 ...
+    // A panel slot is rewritten only after its last kernel (computed[s]) and a
+    // kernel runs after its panel's writes (written[s]). The transfer queue is
+    // in order, so those writes also follow the read of the C slot's previous
+    // tile, and a tile is read after its last kernel.
+    const size_t tiles_m = (m + pm - 1) / pm, tiles_n = (n + pn - 1) / pn;
+    const size_t panels_k = (k + pk - 1) / pk;
+    const size_t num_panels = tiles_m * tiles_n * panels_k;
+    for (size_t g = 0; g <= num_panels && err == CL_SUCCESS; g++)
+    {
+        // writes of panel g, with its C tile first when the tile starts and C is read
+        if (g < num_panels)
+        {
+            const size_t tile = g / panels_k, p = g % panels_k;
+            const size_t i0 = tile / tiles_n * pm, j0 = tile % tiles_n * pn, p0 = p * pk;
+            const size_t rows = m - i0 < pm ? m - i0 : pm;
+            const size_t cols = n - j0 < pn ? n - j0 : pn;
+            const size_t depth = k - p0 < pk ? k - p0 : pk;
+            const unsigned int s = g % 2, cs = tile % 2;
+            cl_event after_kernel = computed[s];
+            cl_event event;
+
+            if (p == 0 && beta != 0)
+            {
+                err = OclGemmTransferBlock(runtime->transfer_queue, 1, tile_c[cs], c->data, n,
+                                           i0, j0, rows, cols, 0, NULL, NULL);
+            }
+            if (err == CL_SUCCESS)
+            {
+                if (trans_a) // A^T panel: rows p0.. and columns i0.. of A
+                    err = OclGemmTransferBlock(runtime->transfer_queue, 1, panel_a[s], a->data,
+                                               a->shape[1], p0, i0, depth, rows,
+                                               after_kernel ? 1 : 0, &after_kernel, NULL);
+                else
+                    err = OclGemmTransferBlock(runtime->transfer_queue, 1, panel_a[s], a->data,
+                                               a->shape[1], i0, p0, rows, depth,
+                                               after_kernel ? 1 : 0, &after_kernel, NULL);
+            }
+            if (err == CL_SUCCESS)
+            {
+                if (trans_b) // B^T panel: rows j0.. and columns p0.. of B
+                    err = OclGemmTransferBlock(runtime->transfer_queue, 1, panel_b[s], b->data,
+                                               b->shape[1], j0, p0, cols, depth,
+                                               after_kernel ? 1 : 0, &after_kernel, &event);
+                else
+                    err = OclGemmTransferBlock(runtime->transfer_queue, 1, panel_b[s], b->data,
+                                               b->shape[1], p0, j0, depth, cols,
+                                               after_kernel ? 1 : 0, &after_kernel, &event);
+            }
+            if (err == CL_SUCCESS)
+            {
+                OclReleaseEvent(&written[s]);
+                written[s] = event;
+            }
+        }
+        // kernel of panel g - 1, then the read of its tile if that was the
+        // tile's last panel
+        if (g > 0 && err == CL_SUCCESS)
+        {
+            const size_t tile = (g - 1) / panels_k, p = (g - 1) % panels_k;
+            const size_t i0 = tile / tiles_n * pm, j0 = tile % tiles_n * pn, p0 = p * pk;
+            const size_t rows = m - i0 < pm ? m - i0 : pm;
+            const size_t cols = n - j0 < pn ? n - j0 : pn;
+            const size_t depth = k - p0 < pk ? k - p0 : pk;
+            const unsigned int s = (g - 1) % 2, cs = tile % 2;
+            cl_event event;
+
+            // the first panel of a tile applies beta, the others accumulate
+            err = OclGemmEnqueue(runtime, OCL_INT, trans_a, trans_b, rows, cols, depth, alpha,
+                                 panel_a[s], 0, trans_a ? rows : depth, panel_b[s], 0,
+                                 trans_b ? depth : cols, p == 0 ? beta : 1, tile_c[cs], 0, cols,
+                                 1, &written[s], &event);
+            if (err == CL_SUCCESS)
+            {
+                OclReleaseEvent(&computed[s]);
+                computed[s] = event;
+            }
+            if (err == CL_SUCCESS && p == panels_k - 1)
+                err = OclGemmTransferBlock(runtime->transfer_queue, 0, tile_c[cs], c->data, n,
+                                           i0, j0, rows, cols, 1, &computed[s], NULL);
+        }
+    }
+
+    // the transfers still use the host matrices and buffers; finish either way
+    clFinish(runtime->queue);
+    cl_int finish_err = clFinish(runtime->transfer_queue);
+    if (err == CL_SUCCESS)
+        err = finish_err;
+
+    for (int s = 0; s < 2; s++)
+    {
+        OclReleaseEvent(&written[s]);
+        OclReleaseEvent(&computed[s]);
+        if (panel_a[s])
+            clReleaseMemObject(panel_a[s]);
+        if (panel_b[s])
+            clReleaseMemObject(panel_b[s]);
+        if (tile_c[s])
+            clReleaseMemObject(tile_c[s]);
+    }
+    return err;
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "runtime.h"
+
+#define OCL_GEMM_UNROLL_MAX 16
+#define OCL_GEMM_STRASSEN_CROSSOVER 1024
+
+/**
+ * @brief Whether a GEMM operand is used as stored or transposed.
+ */
+typedef enum _OclTranspose
+{
+    OCL_NO_TRANS = 0,
+    OCL_TRANS = 1
+} OclTranspose;
+
+/**
+ * @brief Element type of the GEMM operands.
+ */
+typedef enum _OclDataType
+{
+    OCL_INT = 0,
+    OCL_FLOAT = 1
+} OclDataType;
+
+/**
+ * @brief C = alpha * op(A) * op(B) + beta * C on device buffers, where op(X)
+ * is X or X^T. All matrices are row-major: op(A) is m x k, op(B) is k x n and
+ * C is m x n, and A is stored k x m when transposed (B n x k likewise), with
+ * lda, ldb and ldc elements between the starts of consecutive stored rows.
+ *
+ * There is one tiled kernel per type and transpose combination, built once
+ * and cached in the runtime. Each work-group computes a square tile of C and
+ * walks k one tile at a time, staging the tiles of op(A) and op(B) in local
+ * memory. A transposed operand is loaded with the work-items swapped so that
+ * neighbouring work-items still read neighbouring addresses, and is
+ * transposed on its way into local memory; it is never materialized. With
+ * beta 0, C is not read.
+ *
+ * @param runtime The runtime.
+ * @param type The element type of A, B and C.
+ * @param trans_a Whether op(A) is A^T.
+ * @param trans_b Whether op(B) is B^T.
+ * @param m Rows of op(A) and C.
+ * @param n Columns of op(B) and C.
+ * @param k Columns of op(A) and rows of op(B).
+ * @param alpha Scale of the product, converted to type.
+ * @param a Buffer of A.
+ * @param lda Row stride of A, at least its stored number of columns.
+ * @param b Buffer of B.
+ * @param ldb Row stride of B, at least its stored number of columns.
+ * @param beta Scale of C, converted to type.
+ * @param c Buffer of C.
+ * @param ldc Row stride of C, at least n.
+ *
+ * @return CL_SUCCESS if and only if the kernel is enqueued. The call does not
+ * wait for it.
+ */
+cl_int OclGemmDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                     OclTranspose trans_b, unsigned int m, unsigned int n, unsigned int k,
+                     double alpha, cl_mem a, unsigned int lda, cl_mem b, unsigned int ldb,
+                     double beta, cl_mem c, unsigned int ldc);
+
+/**
+ * @brief OclGemmDevice on host int matrices, with the sizes taken from their
+ * shapes: C = alpha * op(A) * op(B) + beta * C. The operands are uploaded,
+ * the product is computed and C is read back before the call returns. A
+ * native runtime computes it with OclCpuGemm, as it does for the Strassen,
+ * batched and out-of-core variants.
+ *
+ * @param runtime The runtime.
+ * @param trans_a Whether op(A) is A^T.
+ * @param trans_b Whether op(B) is B^T.
+ * @param alpha Scale of the product.
+ * @param a The host matrix A.
+ * @param b The host matrix B.
+ * @param beta Scale of C; with 0, C only needs to be allocated.
+ * @param c The host matrix C, allocated with its shape set to op(A) rows x
+ * op(B) columns.
+ *
+ * @return CL_SUCCESS if and only if C holds the result; CL_INVALID_VALUE if
+ * the shapes do not agree.
+ */
+cl_int OclGemm(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b, int alpha,
+               const Matrix *a, const Matrix *b, int beta, Matrix *c);
+
+/**
+ * @brief One product of a batched GEMM: C = alpha * op(A) * op(B) + beta * C
+ * with op(A) m x k, op(B) k x n and C m x n, each stored densely (leading
+ * dimension its stored number of columns) starting the given number of
+ * elements into the shared A, B or C buffer. Matches the layout of the
+ * descriptor the kernel reads.
+ */
+typedef struct _OclGemmBatchEntry
+{
+    cl_uint m, n, k;
+    cl_uint a_offset, b_offset, c_offset;
+} OclGemmBatchEntry;
+
+/**
+ * @brief Runs count independent small products in one launch, one
+ * work-group per product. The operands of every product are packed into the
+ * three buffers a, b and c and described by count OclGemmBatchEntry in the
+ * device buffer entries; the work-items of a group share the m * n outputs of
+ * their product and read A and B straight from global memory, which for
+ * small matrices is cached. Products of one shape are better served by
+ * OclGemmStridedBatchedDevice.
+ *
+ * @param runtime The runtime.
+ * @param type The element type of A, B and C.
+ * @param trans_a Whether op(A) is A^T in every product.
+ * @param trans_b Whether op(B) is B^T in every product.
+ * @param alpha Scale of the products, converted to type.
+ * @param a Buffer with every A.
+ * @param b Buffer with every B.
+ * @param beta Scale of C, converted to type.
+ * @param c Buffer with every C.
+ * @param entries Buffer of count OclGemmBatchEntry.
+ * @param count The number of products.
+ *
+ * @return CL_SUCCESS if and only if the kernel is enqueued. The call does not
+ * wait for it.
+ */
+cl_int OclGemmBatchedDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                            OclTranspose trans_b, double alpha, cl_mem a, cl_mem b, double beta,
+                            cl_mem c, cl_mem entries, unsigned int count);
+
+/**
+ * @brief OclGemmBatchedDevice for count products of the same m x n x k
+ * shape, product i's operands starting i * stride_a, i * stride_b and
+ * i * stride_c elements into a, b and c. No descriptors are read: the sizes
+ * are compiled into a kernel specialized for the shape, with one work-item
+ * per output when the group can hold them all, and the k loop fully unrolled
+ * when k is at most OCL_GEMM_UNROLL_MAX.
+ *
+ * @param runtime The runtime.
+ * @param type The element type of A, B and C.
+ * @param trans_a Whether op(A) is A^T in every product.
+ * @param trans_b Whether op(B) is B^T in every product.
+ * @param m Rows of every op(A) and C.
+ * @param n Columns of every op(B) and C.
+ * @param k Columns of every op(A) and rows of every op(B).
+ * @param alpha Scale of the products, converted to type.
+ * @param a Buffer with every A.
+ * @param stride_a Elements from one A to the next, at least m * k.
+ * @param b Buffer with every B.
+ * @param stride_b Elements from one B to the next, at least k * n.
+ * @param beta Scale of C, converted to type.
+ * @param c Buffer with every C.
+ * @param stride_c Elements from one C to the next, at least m * n.
+ * @param count The number of products.
+ *
+ * @return CL_SUCCESS if and only if the kernel is enqueued. The call does not
+ * wait for it.
+ */
+cl_int OclGemmStridedBatchedDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                                   OclTranspose trans_b, unsigned int m, unsigned int n,
+                                   unsigned int k, double alpha, cl_mem a, unsigned int stride_a,
+                                   cl_mem b, unsigned int stride_b, double beta, cl_mem c,
+                                   unsigned int stride_c, unsigned int count);
+
+/**
+ * @brief count products c[i] = alpha * op(a[i]) * op(b[i]) + beta * c[i] of
+ * host int matrices with one upload of each operand array, one launch and
+ * one read back: the matrices are packed into contiguous buffers, and the
+ * strided kernel is used when every product has the same shape. The runtime
+ * keeps the built kernels, so repeated calls only pay for the transfers.
+ *
+ * @param runtime The runtime.
+ * @param trans_a Whether op(A) is A^T in every product.
+ * @param trans_b Whether op(B) is B^T in every product.
+ * @param alpha Scale of the products.
+ * @param a count host matrices A.
+ * @param b count host matrices B.
+ * @param beta Scale of C; with 0, the C only need to be allocated.
+ * @param c count host matrices C, allocated with their shapes set.
+ * @param count The number of products.
+ *
+ * @return CL_SUCCESS if and only if every C holds its result;
+ * CL_INVALID_VALUE if the shapes of a product do not agree.
+ */
+cl_int OclGemmBatched(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b,
+                      int alpha, const Matrix *a, const Matrix *b, int beta, Matrix *c,
+                      unsigned int count);
+
+/**
+ * @brief OclGemmDevice through Winograd's variant of Strassen's algorithm:
+ * while m, n and k are all at least crossover, the product is split into
+ * 2 x 2 blocks and computed with 7 half-size products and 15 block additions
+ * instead of 8 products, recursively; below it the tiled kernel takes over.
+ * An odd row, column or inner index is peeled off and done by the tiled
+ * kernel. The sums and partial products live in device buffers of the
+ * runtime's pool (OclRuntimeAcquireBuffer), about (m * k + k * n) / 2 +
+ * m * n / 4 elements for the top level and a quarter of that for each level
+ * below, plus m * n unless alpha is 1 and beta 0. The result is exact for
+ * int, wrapping like the tiled kernel; float results round differently and
+ * lose a little accuracy per level.
+ *
+ * @param crossover The smallest dimension to split, or 0 for
+ * OCL_GEMM_STRASSEN_CROSSOVER. Where Strassen starts to pay off depends on
+ * the device; the PA4 solution reports both paths to tune it.
+ *
+ * The other parameters and the return value are those of OclGemmDevice.
+ */
+cl_int OclGemmStrassenDevice(OclRuntime *runtime, OclDataType type, OclTranspose trans_a,
+                             OclTranspose trans_b, unsigned int m, unsigned int n,
+                             unsigned int k, double alpha, cl_mem a, unsigned int lda, cl_mem b,
+                             unsigned int ldb, double beta, cl_mem c, unsigned int ldc,
+                             unsigned int crossover);
+
+/**
+ * @brief OclGemm through OclGemmStrassenDevice.
+ *
+ * @param crossover The smallest dimension to split, or 0 for
+ * OCL_GEMM_STRASSEN_CROSSOVER.
+ *
+ * The other parameters and the return value are those of OclGemm.
+ */
+cl_int OclGemmStrassen(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b,
+                       int alpha, const Matrix *a, const Matrix *b, int beta, Matrix *c,
+                       unsigned int crossover);
+
+/**
+ * @brief Panel sizes of OclGemmOutOfCore: C is computed in tiles of
+ * panel_m x panel_n, each from panels of panel_k columns of op(A) and rows of
+ * op(B), such that two A panels, two B panels and two C tiles fit in
+ * device_bytes and none exceeds CL_DEVICE_MAX_MEM_ALLOC_SIZE. The tiles are
+ * square where the matrices allow, and the inner dimension takes what is
+ * left, so a narrow C gets deep panels.
+ *
+ * @param runtime The runtime.
+ * @param m Rows of op(A) and C.
+ * @param n Columns of op(B) and C.
+ * @param k Columns of op(A) and rows of op(B).
+ * @param device_bytes Device memory to use, or 0 for half of the device's
+ * global memory.
+ * @param panel_m The destination for the tile rows.
+ * @param panel_n The destination for the tile columns.
+ * @param panel_k The destination for the panel depth.
+ */
+void OclGemmPanelSizes(OclRuntime *runtime, unsigned int m, unsigned int n, unsigned int k,
+                       size_t device_bytes, unsigned int *panel_m, unsigned int *panel_n,
+                       unsigned int *panel_k);
+
+/**
+ * @brief OclGemm for matrices that need not fit on the device, or in RAM when
+ * they are mapped from files (MapMatrix). C is computed one tile at a time
+ * and stays on the device while panels of op(A) and op(B) are streamed
+ * through it and accumulated (OclGemmPanelSizes); A and B panels are double
+ * buffered, so the next panel is written on runtime->transfer_queue while
+ * the current one is multiplied on runtime->queue, and so are the C tiles,
+ * so a finished tile is read back while the next one is computed. The panels
+ * are copied straight out of the host matrices with rectangular transfers,
+ * transposed operands included. Each element of C is transferred once each
+ * way (read only with beta non-zero); each element of A is written once per
+ * column of tiles and each element of B once per row of tiles.
+ *
+ * OclGemm and OclGemmStrassen come here by themselves when A, B and C
+ * together take more than half of the device's global memory.
+ *
+ * @param device_bytes Device memory to use, or 0 for half of the device's
+ * global memory.
+ *
+ * The other parameters and the return value are those of OclGemm. The call
+ * returns once every transfer has finished, also on failure.
+ */
+cl_int OclGemmOutOfCore(OclRuntime *runtime, OclTranspose trans_a, OclTranspose trans_b,
+                        int alpha, const Matrix *a, const Matrix *b, int beta, Matrix *c,
+                        size_t device_bytes);
@@ -1,9 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "matrix.h"
 
+#define MATRIX_FILE_HEADER_SIZE 16
+
 cl_int LoadMatrix(const char *path, Matrix *matrix)
 {
     FILE *data_file;
@@ -25,7 +32,7 @@ cl_int LoadMatrix(const char *path, Matrix *matrix)
     matrix->shape[0] = rows;
     matrix->shape[1] = cols;
 
-    matrix->data = malloc(sizeof(int) * rows * cols);
+    matrix->data = (int *)malloc(sizeof(int) * rows * cols);
     if (!matrix->data) // Error mallocing matrix data
         return CL_OUT_OF_HOST_MEMORY;
 
@@ -50,9 +57,9 @@ cl_int SaveMatrix(const char *path, Matrix *matrix)
     if (fprintf(data_file, "# (%u, %u)\n", rows, cols) < 0)
         return CL_INVALID_VALUE; // Error parsing dimensions
     
-    for (int r = 0; r < rows; r++)
+    for (unsigned int r = 0; r < rows; r++)
     {
-        for (int c = 0; c < cols; c++)
+        for (unsigned int c = 0; c < cols; c++)
         {
             if (fprintf(data_file, "%d ", matrix->data[cols * r + c]) < -1)
                 return CL_INVALID_VALUE; // Error parsing dimensions
@@ -104,3 +111,73 @@ void PrintMatrix(Matrix *matrix)
         printf("\n");
     }
 }
+
+/**
+ * @brief Maps size bytes of the open file fd and points matrix at the data
+ * after the header.
+ */
+static cl_int MapMatrixFile(int fd, size_t size, int writable, Matrix *matrix)
+{
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *base = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return CL_OUT_OF_HOST_MEMORY;
+
+    unsigned int header[4];
+    memcpy(header, base, sizeof(header));
+    matrix->shape[0] = header[1];
+    matrix->shape[1] = header[2];
+    matrix->data = (int *)((char *)base + MATRIX_FILE_HEADER_SIZE);
+    return CL_SUCCESS;
+}
+
+cl_int MapMatrix(const char *path, Matrix *matrix, int writable)
+{
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) // Error opening file
+        return CL_INVALID_VALUE;
+
+    unsigned int header[4];
+    struct stat st;
+    if (read(fd, header, sizeof(header)) != sizeof(header) || memcmp(header, "MAT1", 4) != 0 ||
+        fstat(fd, &st) != 0 ||
+        (size_t)st.st_size != MATRIX_FILE_HEADER_SIZE + (size_t)header[1] * header[2] * sizeof(int))
+    {
+        close(fd);
+        return CL_INVALID_VALUE; // Not a binary matrix file
+    }
+
+    cl_int err = MapMatrixFile(fd, st.st_size, writable, matrix);
+    close(fd); // the mapping keeps the file
+    return err;
+}
+
+cl_int CreateMappedMatrix(const char *path, unsigned int rows, unsigned int cols, Matrix *matrix)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) // Error opening file
+        return CL_INVALID_VALUE;
+
+    unsigned int header[4] = { 0, rows, cols, 0 };
+    memcpy(header, "MAT1", 4);
+    size_t size = MATRIX_FILE_HEADER_SIZE + (size_t)rows * cols * sizeof(int);
+    // the file is sparse until written, so this is cheap for any size
+    if (write(fd, header, sizeof(header)) != sizeof(header) || ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return CL_INVALID_VALUE;
+    }
+
+    cl_int err = MapMatrixFile(fd, size, 1, matrix);
+    close(fd);
+    return err;
+}
+
+cl_int UnmapMatrix(Matrix *matrix)
+{
+    size_t size = MATRIX_FILE_HEADER_SIZE + (size_t)matrix->shape[0] * matrix->shape[1] * sizeof(int);
+    if (munmap((char *)matrix->data - MATRIX_FILE_HEADER_SIZE, size) != 0)
+        return CL_INVALID_VALUE;
+    matrix->data = NULL;
+    return CL_SUCCESS;
+}
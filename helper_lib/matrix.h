@@ -17,3 +17,42 @@ cl_int LoadMatrix(const char *path, Matrix *matrix);
 cl_int SaveMatrix(const char *path, Matrix *matrix);
 cl_int CheckMatrix(Matrix *truth, Matrix *student);
 void PrintMatrix(Matrix *matrix);
+
+/**
+ * @brief Maps a binary matrix file into memory instead of reading it: a
+ * 16-byte header (the magic "MAT1", rows and cols as 32-bit unsigned ints,
+ * and 4 reserved bytes) followed by rows * cols 32-bit ints in row-major
+ * order. Pages are read from the file as they are touched, so the matrix may
+ * be larger than RAM; with writable, stores go back to the file.
+ *
+ * @param path The file, e.g. made with CreateMappedMatrix.
+ * @param matrix The destination; release it with UnmapMatrix, not free().
+ * @param writable Non-zero to map the file for writing as well.
+ *
+ * @return CL_SUCCESS if and only if the file is mapped; CL_INVALID_VALUE if
+ * it cannot be opened or is not a binary matrix file of the right size.
+ */
+cl_int MapMatrix(const char *path, Matrix *matrix, int writable);
+
+/**
+ * @brief Creates (or truncates) a binary matrix file of rows x cols zeros, see
+ * MapMatrix, and maps it for reading and writing.
+ *
+ * @param path The file to create.
+ * @param rows The number of rows.
+ * @param cols The number of columns.
+ * @param matrix The destination; release it with UnmapMatrix.
+ *
+ * @return CL_SUCCESS if and only if the file is created and mapped.
+ */
+cl_int CreateMappedMatrix(const char *path, unsigned int rows, unsigned int cols, Matrix *matrix);
+
+/**
+ * @brief Unmaps a matrix of MapMatrix or CreateMappedMatrix, writing back
+ * any changes.
+ *
+ * @param matrix The mapped matrix.
+ *
+ * @return CL_SUCCESS if and only if the mapping is removed.
+ */
+cl_int UnmapMatrix(Matrix *matrix);
@@ -0,0 +1,541 @@
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "roofline.h"
+
+#define OCL_ROOFLINE_BUFFER_BYTES (64 << 20) // well past the caches of any device
+#define OCL_ROOFLINE_REPS 5
+#define OCL_ROOFLINE_LAUNCHES 200
+#define OCL_ROOFLINE_LOCAL_SIZE 256
+#define OCL_ROOFLINE_LOCAL_ITEMS (1 << 16)
+#define OCL_ROOFLINE_LOCAL_ITERS 4096
+#define OCL_ROOFLINE_COMPUTE_ITEMS (1 << 20)
+#define OCL_ROOFLINE_COMPUTE_ITERS 128
+#define OCL_ROOFLINE_COMPUTE_OPS (16 * 4 * 2) // per iteration: 16 multiply-adds of 4 lanes
+
+// One VEC per work-item. The input is zero-filled, so the read kernel never
+// stores; the test only keeps the loads from being optimized away.
+static const char *OclRooflineGlobalKernels =
+    "__kernel void global_read(__global const VEC *in, __global int *out)\n"
+    "{\n"
+    "    const VEC v = in[get_global_id(0)];\n"
+    "#if WIDTH == 1\n"
+    "    if (v == -1)\n"
+    "#else\n"
+    "    if (any(v == (VEC)(-1)))\n"
+    "#endif\n"
+    "        out[0] = 1;\n"
+    "}\n"
+    "\n"
+    "__kernel void global_write(__global VEC *out)\n"
+    "{\n"
+    "    out[get_global_id(0)] = (VEC)((int)get_global_id(0));\n"
+    "}\n"
+    "\n"
+    "__kernel void global_copy(__global const VEC *in, __global VEC *out)\n"
+    "{\n"
+    "    out[get_global_id(0)] = in[get_global_id(0)];\n"
+    "}\n";
+
+// Every work-item walks the group's local array from its own position, so
+// consecutive work-items read consecutive float4 in every step; two sums let
+// the reads overlap.
+static const char *OclRooflineLocalKernel =
+    "__kernel void local_read(__global float *out, const int iters)\n"
+    "{\n"
+    "    __local float4 buf[LOCAL_SIZE];\n"
+    "    const int lid = get_local_id(0);\n"
+    "    buf[lid] = (float4)((float)lid);\n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "    float4 sum0 = 0, sum1 = 0;\n"
+    "    for (int i = 0; i < iters; i += 2)\n"
+    "    {\n"
+    "        sum0 += buf[(lid + i) & (LOCAL_SIZE - 1)];\n"
+    "        sum1 += buf[(lid + i + 1) & (LOCAL_SIZE - 1)];\n"
+    "    }\n"
+    "    const float4 sum = sum0 + sum1;\n"
+    "    out[get_global_id(0)] = sum.x + sum.y + sum.z + sum.w;\n"
+    "}\n";
+
+// Two 4-wide chains that feed each other, x = y * x + y and y = x * y + x,
+// so that the compiler cannot fold the multiply-adds; the work-items supply
+// the parallelism.
+static const char *OclRooflineComputeKernel =
+    "#ifdef HALF\n"
+    "#pragma OPENCL EXTENSION cl_khr_fp16 : enable\n"
+    "#endif\n"
+    "#define MAD2 x = y * x + y; y = x * y + x;\n"
+    "#define MAD16 MAD2 MAD2 MAD2 MAD2 MAD2 MAD2 MAD2 MAD2\n"
+    "\n"
+    "__kernel void compute_peak(__global T *out, const float seed, const int iters)\n"
+    "{\n"
+    "    VEC x = (VEC)((T)seed);\n"
+    "    VEC y = (VEC)((T)get_local_id(0));\n"
+    "    for (int i = 0; i < iters; i++)\n"
+    "    {\n"
+    "        MAD16\n"
+    "    }\n"
+    "    const VEC s = x + y;\n"
+    "    out[get_global_id(0)] = s.s0 + s.s1 + s.s2 + s.s3;\n"
+    "}\n";
+
+static const char *OclRooflineEmptyKernel = "__kernel void empty(void)\n{\n}\n";
+
+/**
+ * @brief Seconds on a monotonic clock.
+ */
+static double OclRooflineNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief The work-group size of the benchmarks: OCL_ROOFLINE_LOCAL_SIZE, or
+ * the largest power of two the device allows below it.
+ */
+static size_t OclRooflineLocalSize(OclRuntime *runtime)
+{
+    size_t local_size = OCL_ROOFLINE_LOCAL_SIZE;
+    while (local_size > runtime->max_work_group_size)
+        local_size /= 2;
+    return local_size;
+}
+
+/**
+ * @brief The best time of OCL_ROOFLINE_REPS runs of kernel, after a warm-up,
+ * each from enqueue to completion.
+ */
+static cl_int OclRooflineTimeKernel(OclRuntime *runtime, cl_kernel kernel, size_t global_size,
+                                    size_t local_size, double *seconds)
+{
+    *seconds = 0;
+    for (int rep = -1; rep < OCL_ROOFLINE_REPS; rep++)
+    {
+        double start = OclRooflineNow();
+        cl_int err = clEnqueueNDRangeKernel(runtime->queue, kernel, 1, NULL, &global_size,
+                                            &local_size, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = clFinish(runtime->queue);
+        if (err != CL_SUCCESS)
+            return err;
+        double elapsed = OclRooflineNow() - start;
+        if (rep == 0 || (rep > 0 && elapsed < *seconds))
+            *seconds = elapsed;
+    }
+    return CL_SUCCESS;
+}
+
+/**
+ * @brief The best time of OCL_ROOFLINE_REPS blocking transfers of bytes
+ * between host and buffer, after a warm-up.
+ */
+static cl_int OclRooflineTimeTransfer(OclRuntime *runtime, int write, cl_mem buffer, void *host,
+                                      size_t bytes, double *seconds)
+{
+    *seconds = 0;
+    for (int rep = -1; rep < OCL_ROOFLINE_REPS; rep++)
+    {
+        double start = OclRooflineNow();
+        cl_int err = write ? clEnqueueWriteBuffer(runtime->queue, buffer, CL_TRUE, 0, bytes, host,
+                                                  0, NULL, NULL)
+                           : clEnqueueReadBuffer(runtime->queue, buffer, CL_TRUE, 0, bytes, host,
+                                                 0, NULL, NULL);
+        if (err != CL_SUCCESS)
+            return err;
+        double elapsed = OclRooflineNow() - start;
+        if (rep == 0 || (rep > 0 && elapsed < *seconds))
+            *seconds = elapsed;
+    }
+    return CL_SUCCESS;
+}
+
+/**
+ * @brief The size of the streaming buffers: OCL_ROOFLINE_BUFFER_BYTES, less
+ * on small devices, in whole groups of int16.
+ */
+static size_t OclRooflineBufferBytes(OclRuntime *runtime)
+{
+    cl_ulong bytes = OCL_ROOFLINE_BUFFER_BYTES;
+    if (bytes > runtime->max_mem_alloc_size)
+        bytes = runtime->max_mem_alloc_size;
+    if (bytes > runtime->global_mem_size / 4)
+        bytes = runtime->global_mem_size / 4;
+    const size_t granule = 16 * sizeof(int) * OclRooflineLocalSize(runtime);
+    return bytes / granule * granule;
+}
+
+static cl_int OclRooflineGlobal(OclRuntime *runtime, OclRoofline *roofline)
+{
+    cl_int err = CL_SUCCESS;
+    const size_t bytes = OclRooflineBufferBytes(runtime);
+    const size_t local_size = OclRooflineLocalSize(runtime);
+    const int zero = 0;
+
+    if (bytes == 0)
+        return CL_INVALID_BUFFER_SIZE;
+    cl_mem in = clCreateBuffer(runtime->context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+    cl_mem out = NULL;
+    if (err == CL_SUCCESS)
+        out = clCreateBuffer(runtime->context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+    if (err == CL_SUCCESS)
+        err = clEnqueueFillBuffer(runtime->queue, in, &zero, sizeof(int), 0, bytes, 0, NULL, NULL);
+
+    for (unsigned int w = 0; w < OCL_ROOFLINE_NUM_WIDTHS && err == CL_SUCCESS; w++)
+    {
+        const unsigned int width = 1u << w;
+        char vec[8] = "int";
+        if (width > 1)
+            snprintf(vec, sizeof(vec), "int%u", width);
+        char source[2048];
+        snprintf(source, sizeof(source), "#define WIDTH %u\n#define VEC %s\n%s", width, vec,
+                 OclRooflineGlobalKernels);
+
+        cl_kernel read, write, copy;
+        err = OclRuntimeGetKernel(runtime, source, "global_read", &read);
+        if (err == CL_SUCCESS)
+            err = OclRuntimeGetKernel(runtime, source, "global_write", &write);
+        if (err == CL_SUCCESS)
+            err = OclRuntimeGetKernel(runtime, source, "global_copy", &copy);
+        if (err != CL_SUCCESS)
+            break;
+
+        err |= clSetKernelArg(read, 0, sizeof(cl_mem), &in);
+        err |= clSetKernelArg(read, 1, sizeof(cl_mem), &out);
+        err |= clSetKernelArg(write, 0, sizeof(cl_mem), &out);
+        err |= clSetKernelArg(copy, 0, sizeof(cl_mem), &in);
+        err |= clSetKernelArg(copy, 1, sizeof(cl_mem), &out);
+        if (err != CL_SUCCESS)
+            break;
+
+        const size_t items = bytes / sizeof(int) / width;
+        double seconds;
+        err = OclRooflineTimeKernel(runtime, read, items, local_size, &seconds);
+        if (err == CL_SUCCESS)
+        {
+            roofline->global_read_gbs[w] = bytes / seconds / 1e9;
+            err = OclRooflineTimeKernel(runtime, write, items, local_size, &seconds);
+        }
+        if (err == CL_SUCCESS)
+        {
+            roofline->global_write_gbs[w] = bytes / seconds / 1e9;
+            err = OclRooflineTimeKernel(runtime, copy, items, local_size, &seconds);
+        }
+        if (err == CL_SUCCESS)
+            roofline->global_copy_gbs[w] = 2.0 * bytes / seconds / 1e9;
+    }
+
+    if (in)
+        clReleaseMemObject(in);
+    if (out)
+        clReleaseMemObject(out);
+    return err;
+}
+
+static cl_int OclRooflineLocal(OclRuntime *runtime, OclRoofline *roofline)
+{
+    cl_int err;
+    const size_t local_size = OclRooflineLocalSize(runtime);
+    const size_t items = OCL_ROOFLINE_LOCAL_ITEMS;
+    const int iters = OCL_ROOFLINE_LOCAL_ITERS;
+
+    char source[2048];
+    snprintf(source, sizeof(source), "#define LOCAL_SIZE %zu\n%s", local_size,
+             OclRooflineLocalKernel);
+    cl_kernel kernel;
+    err = OclRuntimeGetKernel(runtime, source, "local_read", &kernel);
+    if (err != CL_SUCCESS)
+        return err;
+
+    cl_mem out = clCreateBuffer(runtime->context, CL_MEM_WRITE_ONLY, items * sizeof(float), NULL,
+                                &err);
+    if (err != CL_SUCCESS)
+        return err;
+    err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &out);
+    err |= clSetKernelArg(kernel, 1, sizeof(int), &iters);
+
+    double seconds;
+    if (err == CL_SUCCESS)
+        err = OclRooflineTimeKernel(runtime, kernel, items, local_size, &seconds);
+    if (err == CL_SUCCESS)
+        roofline->local_gbs = (double)items * iters * 4 * sizeof(float) / seconds / 1e9;
+
+    clReleaseMemObject(out);
+    return err;
+}
+
+/**
+ * @brief Multiply-add throughput of type ("uint" for int32, whose overflow
+ * is defined, "float" or "half") in 10^9 operations per second.
+ */
+static cl_int OclRooflineCompute(OclRuntime *runtime, const char *type, double *gops)
+{
+    cl_int err;
+    const size_t local_size = OclRooflineLocalSize(runtime);
+    const size_t items = OCL_ROOFLINE_COMPUTE_ITEMS;
+    const int iters = OCL_ROOFLINE_COMPUTE_ITERS;
+    const float seed = 1.0f;
+
+    char source[2048];
+    snprintf(source, sizeof(source), "%s#define T %s\n#define VEC %s4\n%s",
+             strcmp(type, "half") == 0 ? "#define HALF\n" : "", type, type,
+             OclRooflineComputeKernel);
+    cl_kernel kernel;
+    err = OclRuntimeGetKernel(runtime, source, "compute_peak", &kernel);
+    if (err != CL_SUCCESS)
+        return err;
+
+    // half results are written as 2 bytes; 4 per item covers every type
+    cl_mem out = clCreateBuffer(runtime->context, CL_MEM_WRITE_ONLY, items * 4, NULL, &err);
+    if (err != CL_SUCCESS)
+        return err;
+    err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &out);
+    err |= clSetKernelArg(kernel, 1, sizeof(float), &seed);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &iters);
+
+    double seconds;
+    if (err == CL_SUCCESS)
+        err = OclRooflineTimeKernel(runtime, kernel, items, local_size, &seconds);
+    if (err == CL_SUCCESS)
+        *gops = (double)items * iters * OCL_ROOFLINE_COMPUTE_OPS / seconds / 1e9;
+
+    clReleaseMemObject(out);
+    return err;
+}
+
+static cl_int OclRooflineLaunch(OclRuntime *runtime, OclRoofline *roofline)
+{
+    cl_int err;
+    cl_kernel kernel;
+    size_t one = 1;
+
+    err = OclRuntimeGetKernel(runtime, OclRooflineEmptyKernel, "empty", &kernel);
+    for (int i = 0; i < 10 && err == CL_SUCCESS; i++) // warm-up
+    {
+        err = clEnqueueNDRangeKernel(runtime->queue, kernel, 1, NULL, &one, &one, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = clFinish(runtime->queue);
+    }
+
+    double start = OclRooflineNow();
+    for (int i = 0; i < OCL_ROOFLINE_LAUNCHES && err == CL_SUCCESS; i++)
+    {
+        err = clEnqueueNDRangeKernel(runtime->queue, kernel, 1, NULL, &one, &one, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = clFinish(runtime->queue);
+    }
+    if (err == CL_SUCCESS)
+        roofline->launch_latency_us = (OclRooflineNow() - start) / OCL_ROOFLINE_LAUNCHES * 1e6;
+    return err;
+}
+
+static cl_int OclRooflineTransfers(OclRuntime *runtime, OclRoofline *roofline)
+{
+    cl_int err = CL_SUCCESS;
+    const size_t bytes = OclRooflineBufferBytes(runtime);
+    double seconds;
+
+    cl_mem device = clCreateBuffer(runtime->context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+    if (err != CL_SUCCESS)
+        return err;
+
+    // pageable: ordinary host memory, staged by the driver
+    void *pageable = calloc(bytes, 1);
+    if (!pageable)
+        err = CL_OUT_OF_HOST_MEMORY;
+    if (err == CL_SUCCESS)
+        err = OclRooflineTimeTransfer(runtime, 1, device, pageable, bytes, &seconds);
+    if (err == CL_SUCCESS)
+        roofline->h2d_pageable_gbs = bytes / seconds / 1e9;
+    if (err == CL_SUCCESS)
+        err = OclRooflineTimeTransfer(runtime, 0, device, pageable, bytes, &seconds);
+    if (err == CL_SUCCESS)
+        roofline->d2h_pageable_gbs = bytes / seconds / 1e9;
+    free(pageable);
+
+    // pinned: host memory the driver allocates and can transfer directly
+    cl_mem staging = NULL;
+    void *pinned = NULL;
+    if (err == CL_SUCCESS)
+        staging = clCreateBuffer(runtime->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                 bytes, NULL, &err);
+    if (err == CL_SUCCESS)
+        pinned = clEnqueueMapBuffer(runtime->queue, staging, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                    0, bytes, 0, NULL, NULL, &err);
+    if (err == CL_SUCCESS)
+        err = OclRooflineTimeTransfer(runtime, 1, device, pinned, bytes, &seconds);
+    if (err == CL_SUCCESS)
+        roofline->h2d_pinned_gbs = bytes / seconds / 1e9;
+    if (err == CL_SUCCESS)
+        err = OclRooflineTimeTransfer(runtime, 0, device, pinned, bytes, &seconds);
+    if (err == CL_SUCCESS)
+        roofline->d2h_pinned_gbs = bytes / seconds / 1e9;
+    if (pinned)
+    {
+        clEnqueueUnmapMemObject(runtime->queue, staging, pinned, 0, NULL, NULL);
+        clFinish(runtime->queue);
+    }
+    if (staging)
+        clReleaseMemObject(staging);
+
+    clReleaseMemObject(device);
+    return err;
+}
+
+cl_int OclMeasureRoofline(OclRuntime *runtime, OclRoofline *roofline)
+{
+    cl_int err;
+
+    memset(roofline, 0, sizeof(*roofline));
+    err = OclRooflineGlobal(runtime, roofline);
+    if (err == CL_SUCCESS)
+        err = OclRooflineLocal(runtime, roofline);
+    if (err == CL_SUCCESS)
+        err = OclRooflineCompute(runtime, "uint", &roofline->int32_gops);
+    if (err == CL_SUCCESS)
+        err = OclRooflineCompute(runtime, "float", &roofline->fp32_gflops);
+    if (err == CL_SUCCESS && OclDeviceHasExtension(runtime->device, "cl_khr_fp16"))
+        err = OclRooflineCompute(runtime, "half", &roofline->fp16_gflops);
+    if (err == CL_SUCCESS)
+        err = OclRooflineLaunch(runtime, roofline);
+    if (err == CL_SUCCESS)
+        err = OclRooflineTransfers(runtime, roofline);
+    return err;
+}
+
+double OclRooflineBandwidth(const OclRoofline *roofline)
+{
+    double best = 0;
+    for (unsigned int w = 0; w < OCL_ROOFLINE_NUM_WIDTHS; w++)
+    {
+        if (roofline->global_read_gbs[w] > best)
+            best = roofline->global_read_gbs[w];
+        if (roofline->global_copy_gbs[w] > best)
+            best = roofline->global_copy_gbs[w];
+    }
+    return best;
+}
+
+double OclRooflineAttainable(const OclRoofline *roofline, double peak_gops, double ops,
+                             double bytes)
+{
+    if (bytes <= 0)
+        return peak_gops;
+    double memory_gops = ops / bytes * OclRooflineBandwidth(roofline);
+    return memory_gops < peak_gops ? memory_gops : peak_gops;
+}
+
+// The name of each peak in the saved file
+#define OCL_ROOFLINE_FIELD(field) { #field, offsetof(OclRoofline, field) }
+static const struct
+{
+    const char *name;
+    size_t offset;
+} OclRooflineFields[] = {
+    OCL_ROOFLINE_FIELD(global_read_gbs[0]),  OCL_ROOFLINE_FIELD(global_read_gbs[1]),
+    OCL_ROOFLINE_FIELD(global_read_gbs[2]),  OCL_ROOFLINE_FIELD(global_read_gbs[3]),
+    OCL_ROOFLINE_FIELD(global_read_gbs[4]),  OCL_ROOFLINE_FIELD(global_write_gbs[0]),
+    OCL_ROOFLINE_FIELD(global_write_gbs[1]), OCL_ROOFLINE_FIELD(global_write_gbs[2]),
+    OCL_ROOFLINE_FIELD(global_write_gbs[3]), OCL_ROOFLINE_FIELD(global_write_gbs[4]),
+    OCL_ROOFLINE_FIELD(global_copy_gbs[0]),  OCL_ROOFLINE_FIELD(global_copy_gbs[1]),
+    OCL_ROOFLINE_FIELD(global_copy_gbs[2]),  OCL_ROOFLINE_FIELD(global_copy_gbs[3]),
+    OCL_ROOFLINE_FIELD(global_copy_gbs[4]),  OCL_ROOFLINE_FIELD(local_gbs),
+    OCL_ROOFLINE_FIELD(int32_gops),          OCL_ROOFLINE_FIELD(fp32_gflops),
+    OCL_ROOFLINE_FIELD(fp16_gflops),         OCL_ROOFLINE_FIELD(launch_latency_us),
+    OCL_ROOFLINE_FIELD(h2d_pageable_gbs),    OCL_ROOFLINE_FIELD(d2h_pageable_gbs),
+    OCL_ROOFLINE_FIELD(h2d_pinned_gbs),      OCL_ROOFLINE_FIELD(d2h_pinned_gbs),
+};
+#define OCL_ROOFLINE_NUM_FIELDS (sizeof(OclRooflineFields) / sizeof(OclRooflineFields[0]))
+
+void OclRooflinePath(const OclDeviceProp *device, char *path, size_t size)
+{
+    const char *dir = getenv("OCL_ROOFLINE_DIR");
+    if (!dir)
+        dir = getenv("HOME");
+    if (!dir)
+        dir = ".";
+
+    int len = snprintf(path, size, "%s/.ocl_roofline_", dir);
+    // the device name, with anything but letters and digits made '_'
+    for (const char *c = device->name; *c && len >= 0 && (size_t)len + 1 < size; c++)
+        path[len++] = isalnum((unsigned char)*c) ? *c : '_';
+    if (len >= 0 && (size_t)len < size)
+        path[len] = '\0';
+}
+
+cl_int OclSaveRoofline(const OclDeviceProp *device, const OclRoofline *roofline)
+{
+    char path[1024];
+    OclRooflinePath(device, path, sizeof(path));
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return CL_INVALID_VALUE;
+
+    fprintf(file, "# OpenCL roofline of %s\n", device->name);
+    for (size_t i = 0; i < OCL_ROOFLINE_NUM_FIELDS; i++)
+        fprintf(file, "%s %.6g\n", OclRooflineFields[i].name,
+                *(const double *)((const char *)roofline + OclRooflineFields[i].offset));
+    return fclose(file) == 0 ? CL_SUCCESS : CL_INVALID_VALUE;
+}
+
+cl_int OclLoadRoofline(const OclDeviceProp *device, OclRoofline *roofline)
+{
+    char path[1024];
+    OclRooflinePath(device, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return CL_INVALID_VALUE;
+
+    memset(roofline, 0, sizeof(*roofline));
+    char line[256], name[64];
+    double value;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#' || sscanf(line, "%63s %lf", name, &value) != 2)
+            continue;
+        for (size_t i = 0; i < OCL_ROOFLINE_NUM_FIELDS; i++)
+        {
+            if (strcmp(name, OclRooflineFields[i].name) == 0)
+                *(double *)((char *)roofline + OclRooflineFields[i].offset) = value;
+        }
+    }
+    fclose(file);
+    return CL_SUCCESS;
+}
+
+void OclPrintRoofline(FILE *out, const OclRoofline *roofline)
+{
+    const char *widths[OCL_ROOFLINE_NUM_WIDTHS] = { "int", "int2", "int4", "int8", "int16" };
+    fprintf(out, "\t- %-23s", "Global memory (GB/s):");
+    for (unsigned int w = 0; w < OCL_ROOFLINE_NUM_WIDTHS; w++)
+        fprintf(out, " %6s", widths[w]);
+    fprintf(out, "\n");
+    const char *names[3] = { "read", "write", "copy" };
+    const double *rates[3] = { roofline->global_read_gbs, roofline->global_write_gbs,
+                               roofline->global_copy_gbs };
+    for (int i = 0; i < 3; i++)
+    {
+        fprintf(out, "\t    %-21s", names[i]);
+        for (unsigned int w = 0; w < OCL_ROOFLINE_NUM_WIDTHS; w++)
+            fprintf(out, " %6.1f", rates[i][w]);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "\t- Local memory read: %.1f GB/s\n", roofline->local_gbs);
+    fprintf(out, "\t- Compute: int32 %.1f GOPS, fp32 %.1f GFLOPS, ", roofline->int32_gops,
+            roofline->fp32_gflops);
+    if (roofline->fp16_gflops > 0)
+        fprintf(out, "fp16 %.1f GFLOPS\n", roofline->fp16_gflops);
+    else
+        fprintf(out, "fp16 not supported\n");
+    fprintf(out, "\t- Kernel launch latency: %.1f us\n", roofline->launch_latency_us);
+    fprintf(out, "\t- Host to device: %.2f GB/s pageable, %.2f GB/s pinned\n",
+            roofline->h2d_pageable_gbs, roofline->h2d_pinned_gbs);
+    fprintf(out, "\t- Device to host: %.2f GB/s pageable, %.2f GB/s pinned\n",
+            roofline->d2h_pageable_gbs, roofline->d2h_pinned_gbs);
+}
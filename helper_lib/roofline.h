@@ -0,0 +1,107 @@
+#pragma once
+
+#include "runtime.h"
+
+#define OCL_ROOFLINE_NUM_WIDTHS 5 // int, int2, int4, int8 and int16 accesses
+
+/**
+ * @brief Measured peaks of one device, the ceilings of its roofline. Rates
+ * are in units of 10^9 per second; a rate that could not be measured (fp16
+ * without cl_khr_fp16) is 0.
+ */
+typedef struct _OclRoofline
+{
+    // global memory, by access width 1 << i ints; copy counts read + write
+    double global_read_gbs[OCL_ROOFLINE_NUM_WIDTHS];
+    double global_write_gbs[OCL_ROOFLINE_NUM_WIDTHS];
+    double global_copy_gbs[OCL_ROOFLINE_NUM_WIDTHS];
+    double local_gbs;
+    // multiply-adds count as two operations
+    double int32_gops;
+    double fp32_gflops;
+    double fp16_gflops;
+    double launch_latency_us; // enqueue to completion of an empty kernel
+    double h2d_pageable_gbs;
+    double d2h_pageable_gbs;
+    double h2d_pinned_gbs;
+    double d2h_pinned_gbs;
+} OclRoofline;
+
+/**
+ * @brief Runs the microbenchmarks on the runtime's device: streaming reads,
+ * writes and copies of global memory at every access width, reads of local
+ * memory, chains of independent multiply-adds in int32, fp32 and fp16, empty
+ * kernel launches, and blocking transfers from and to pageable (malloc) and
+ * pinned (CL_MEM_ALLOC_HOST_PTR, mapped) host memory. Each is run a few
+ * times after a warm-up and the best time is kept. Takes seconds on a GPU
+ * and longer on a CPU device.
+ *
+ * @param runtime The runtime of the device to measure.
+ * @param roofline The destination for the peaks.
+ *
+ * @return CL_SUCCESS if and only if every benchmark ran.
+ */
+cl_int OclMeasureRoofline(OclRuntime *runtime, OclRoofline *roofline);
+
+/**
+ * @brief The best global memory bandwidth of roofline, over read and copy at
+ * every access width: the slope of the roofline.
+ */
+double OclRooflineBandwidth(const OclRoofline *roofline);
+
+/**
+ * @brief The roof for a kernel: the rate the device can reach for ops
+ * operations on bytes of global memory traffic, the lesser of peak_gops and
+ * the arithmetic intensity ops / bytes times OclRooflineBandwidth.
+ *
+ * @param roofline The measured peaks.
+ * @param peak_gops The compute peak for the kernel's type, e.g.
+ * roofline->int32_gops.
+ * @param ops The operations the kernel performs.
+ * @param bytes The bytes it moves to or from global memory.
+ *
+ * @return The attainable rate in 10^9 operations per second.
+ */
+double OclRooflineAttainable(const OclRoofline *roofline, double peak_gops, double ops,
+                             double bytes);
+
+/**
+ * @brief Writes the file that keeps a device's roofline between runs:
+ * .ocl_roofline_<device name> in $OCL_ROOFLINE_DIR, or in $HOME when that is
+ * not set, so device_query --bench and the assignments find the same file.
+ *
+ * @param device The device.
+ * @param path The destination string.
+ * @param size The size of path; the path is truncated to fit.
+ */
+void OclRooflinePath(const OclDeviceProp *device, char *path, size_t size);
+
+/**
+ * @brief Saves roofline to the device's file (OclRooflinePath) as one
+ * "name value" line per peak.
+ *
+ * @param device The device measured.
+ * @param roofline Its peaks.
+ *
+ * @return CL_SUCCESS if and only if the file is written.
+ */
+cl_int OclSaveRoofline(const OclDeviceProp *device, const OclRoofline *roofline);
+
+/**
+ * @brief Loads the peaks saved for device by OclSaveRoofline.
+ *
+ * @param device The device.
+ * @param roofline The destination; peaks missing from the file are 0.
+ *
+ * @return CL_SUCCESS if and only if the file is read; CL_INVALID_VALUE if the
+ * device has not been measured.
+ */
+cl_int OclLoadRoofline(const OclDeviceProp *device, OclRoofline *roofline);
+
+/**
+ * @brief Prints roofline as a table.
+ *
+ * @param out The stream to write to.
+ * @param roofline The peaks.
+ */
+void OclPrintRoofline(FILE *out, const OclRoofline *roofline);
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "runtime.h"
+
+static char *OclCopyString(const char *s)
+{
+    char *copy = (char *)malloc(strlen(s) + 1);
+    if (copy)
+        strcpy(copy, s);
+    return copy;
+}
+
+static cl_int OclCreateQueue(OclRuntime *runtime, cl_command_queue *queue)
+{
+    cl_int err;
+# if __APPLE__
+    *queue = clCreateCommandQueue(runtime->context, runtime->device_id, 0, &err);
+# else
+    *queue = clCreateCommandQueueWithProperties(runtime->context, runtime->device_id, 0, &err);
+# endif
+    return err;
+}
+
+/**
+ * @brief Sets up runtime for the native backend of cpu.h.
+ */
+static cl_int OclRuntimeCreateNative(OclRuntime *runtime)
+{
+    memset(runtime, 0, sizeof(*runtime));
+    runtime->native = 1;
+    runtime->device = OclCpuDeviceProp();
+    runtime->compute_units = runtime->device->max_compute_units;
+    runtime->max_work_group_size = runtime->device->max_work_group_size;
+    runtime->int_vector_width = runtime->device->preferred_vector_width_int >= 8 ? 8 : 4;
+    runtime->max_mem_alloc_size = runtime->device->max_mem_alloc_size;
+    runtime->global_mem_size = runtime->device->global_mem_size;
+
+    printf("Running on:\n\tPlatform: none\n\tDevice: %s\n\n", runtime->device->name);
+    return CL_SUCCESS;
+}
+
+cl_int OclRuntimeCreate(OclRuntime *runtime, cl_device_type device_type)
+{
+    cl_device_id device_id;
+    cl_int err;
+
+    memset(runtime, 0, sizeof(*runtime));
+
+    if (getenv("OCL_NATIVE"))
+        return OclRuntimeCreateNative(runtime);
+
+    err = OclGetDeviceWithFallback(&device_id, device_type);
+    if (err == CL_DEVICE_NOT_FOUND || err == CL_PLATFORM_NOT_FOUND_KHR)
+        return OclRuntimeCreateNative(runtime);
+    if (err != CL_SUCCESS)
+        return err;
+
+    return OclRuntimeCreateForDevice(runtime, device_id);
+}
+
+cl_int OclRuntimeCreateForDevice(OclRuntime *runtime, cl_device_id device_id)
+{
+    cl_int err;
+
+    memset(runtime, 0, sizeof(*runtime));
+    runtime->device_id = device_id;
+
+    runtime->context = clCreateContext(0, 1, &runtime->device_id, NULL, NULL, &err);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err = OclCreateQueue(runtime, &runtime->queue);
+    if (err == CL_SUCCESS)
+        err = OclCreateQueue(runtime, &runtime->transfer_queue);
+    if (err != CL_SUCCESS)
+    {
+        OclRuntimeRelease(runtime);
+        return err;
+    }
+
+    runtime->device = OclGetDeviceProp(runtime->device_id);
+    if (!runtime->device)
+    {
+        OclRuntimeRelease(runtime);
+        return CL_INVALID_DEVICE;
+    }
+    runtime->compute_units = runtime->device->max_compute_units;
+    runtime->max_work_group_size = runtime->device->max_work_group_size;
+    runtime->int_vector_width = runtime->device->preferred_vector_width_int;
+    runtime->max_mem_alloc_size = runtime->device->max_mem_alloc_size;
+    runtime->global_mem_size = runtime->device->global_mem_size;
+    // GPUs usually prefer scalars, but 16-byte loads still coalesce best
+    runtime->int_vector_width = runtime->int_vector_width >= 8 ? 8 : 4;
+
+    size_t options_size = OclDeviceBuildOptions(runtime->device, NULL, 0) + 1;
+    runtime->build_options = (char *)malloc(options_size);
+    if (!runtime->build_options)
+    {
+        OclRuntimeRelease(runtime);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    OclDeviceBuildOptions(runtime->device, runtime->build_options, options_size);
+
+    return CL_SUCCESS;
+}
+
+cl_int OclRuntimeRelease(OclRuntime *runtime)
+{
+    cl_int err = CL_SUCCESS;
+
+    for (unsigned int i = 0; i < runtime->num_kernels; i++)
+    {
+        OclCachedKernel *cached = &runtime->kernels[i];
+        err |= clReleaseKernel(cached->kernel);
+        err |= clReleaseProgram(cached->program);
+        free(cached->source);
+        free(cached->name);
+    }
+    free(runtime->kernels);
+    runtime->kernels = NULL;
+    runtime->num_kernels = runtime->kernel_capacity = 0;
+
+    for (unsigned int i = 0; i < runtime->num_buffers; i++)
+        err |= clReleaseMemObject(runtime->buffers[i].buffer);
+    free(runtime->buffers);
+    runtime->buffers = NULL;
+    runtime->num_buffers = runtime->buffer_capacity = 0;
+
+    if (runtime->queue)
+        err |= clReleaseCommandQueue(runtime->queue);
+    if (runtime->transfer_queue)
+        err |= clReleaseCommandQueue(runtime->transfer_queue);
+    if (runtime->context)
+        err |= clReleaseContext(runtime->context);
+    runtime->queue = NULL;
+    runtime->transfer_queue = NULL;
+    runtime->context = NULL;
+    free(runtime->build_options);
+    runtime->build_options = NULL;
+
+    return err;
+}
+
+cl_int OclRuntimeGetKernel(OclRuntime *runtime, const char *source, const char *name,
+                           cl_kernel *kernel)
+{
+    cl_int err;
+
+    if (runtime->native)
+        return CL_INVALID_OPERATION;
+
+    for (unsigned int i = 0; i < runtime->num_kernels; i++)
+    {
+        OclCachedKernel *cached = &runtime->kernels[i];
+        if (strcmp(cached->name, name) == 0 && strcmp(cached->source, source) == 0)
+        {
+            *kernel = cached->kernel;
+            return CL_SUCCESS;
+        }
+    }
+
+    if (runtime->num_kernels == runtime->kernel_capacity)
+    {
+        unsigned int capacity = runtime->kernel_capacity ? 2 * runtime->kernel_capacity : 8;
+        OclCachedKernel *kernels = (OclCachedKernel *)realloc(runtime->kernels,
+                                                              capacity * sizeof(OclCachedKernel));
+        if (!kernels)
+            return CL_OUT_OF_HOST_MEMORY;
+        runtime->kernels = kernels;
+        runtime->kernel_capacity = capacity;
+    }
+
+    OclCachedKernel cached;
+    cached.program = clCreateProgramWithSource(runtime->context, 1, &source, NULL, &err);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err = clBuildProgram(cached.program, 1, &runtime->device_id, runtime->build_options,
+                         NULL, NULL);
+    if (err != CL_SUCCESS)
+    {
+        size_t log_size = 0;
+        clGetProgramBuildInfo(cached.program, runtime->device_id, CL_PROGRAM_BUILD_LOG,
+                              0, NULL, &log_size);
+        char *log = (char *)malloc(log_size + 1);
+        if (log)
+        {
+            clGetProgramBuildInfo(cached.program, runtime->device_id, CL_PROGRAM_BUILD_LOG,
+                                  log_size, log, NULL);
+            log[log_size] = '\0';
+            fprintf(stderr, "Building %s failed:\n%s\n", name, log);
+            free(log);
+        }
+        clReleaseProgram(cached.program);
+        return err;
+    }
+
+    cached.kernel = clCreateKernel(cached.program, name, &err);
+    if (err != CL_SUCCESS)
+    {
+        clReleaseProgram(cached.program);
+        return err;
+    }
+
+    cached.source = OclCopyString(source);
+    cached.name = OclCopyString(name);
+    if (!cached.source || !cached.name)
+    {
+        free(cached.source);
+        free(cached.name);
+        clReleaseKernel(cached.kernel);
+        clReleaseProgram(cached.program);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+
+    runtime->kernels[runtime->num_kernels++] = cached;
+    *kernel = cached.kernel;
+    return CL_SUCCESS;
+}
+
+cl_int OclRuntimeUpload(OclRuntime *runtime, const Matrix *matrix, cl_mem_flags flags,
+                        cl_mem *buffer)
+{
+    cl_int err;
+    size_t size = (size_t)matrix->shape[0] * matrix->shape[1] * sizeof(int);
+
+    *buffer = clCreateBuffer(runtime->context, flags, size, NULL, &err);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err = clEnqueueWriteBuffer(runtime->queue, *buffer, CL_FALSE, 0, size, matrix->data,
+                               0, NULL, NULL);
+    if (err != CL_SUCCESS)
+    {
+        clReleaseMemObject(*buffer);
+        *buffer = NULL;
+    }
+    return err;
+}
+
+cl_int OclRuntimeDownload(OclRuntime *runtime, cl_mem buffer, Matrix *matrix)
+{
+    size_t size = (size_t)matrix->shape[0] * matrix->shape[1] * sizeof(int);
+
+    return clEnqueueReadBuffer(runtime->queue, buffer, CL_TRUE, 0, size, matrix->data,
+                               0, NULL, NULL);
+}
+
+cl_int OclRuntimeAcquireBuffer(OclRuntime *runtime, size_t size, cl_mem *buffer)
+{
+    cl_int err;
+
+    // the smallest free buffer that fits
+    OclPooledBuffer *best = NULL;
+    for (unsigned int i = 0; i < runtime->num_buffers; i++)
+    {
+        OclPooledBuffer *pooled = &runtime->buffers[i];
+        if (!pooled->in_use && pooled->size >= size && (!best || pooled->size < best->size))
+            best = pooled;
+    }
+    if (best)
+    {
+        best->in_use = 1;
+        *buffer = best->buffer;
+        return CL_SUCCESS;
+    }
+
+    if (runtime->num_buffers == runtime->buffer_capacity)
+    {
+        unsigned int capacity = runtime->buffer_capacity ? 2 * runtime->buffer_capacity : 8;
+        OclPooledBuffer *buffers = (OclPooledBuffer *)realloc(runtime->buffers,
+                                                              capacity * sizeof(OclPooledBuffer));
+        if (!buffers)
+            return CL_OUT_OF_HOST_MEMORY;
+        runtime->buffers = buffers;
+        runtime->buffer_capacity = capacity;
+    }
+
+    OclPooledBuffer pooled;
+    pooled.buffer = clCreateBuffer(runtime->context, CL_MEM_READ_WRITE, size ? size : 1, NULL,
+                                   &err);
+    if (err != CL_SUCCESS)
+        return err;
+    pooled.size = size;
+    pooled.in_use = 1;
+    runtime->buffers[runtime->num_buffers++] = pooled;
+    *buffer = pooled.buffer;
+    return CL_SUCCESS;
+}
+
+void OclRuntimeReturnBuffer(OclRuntime *runtime, cl_mem buffer)
+{
+    for (unsigned int i = 0; i < runtime->num_buffers; i++)
+    {
+        if (runtime->buffers[i].buffer == buffer)
+            runtime->buffers[i].in_use = 0;
+    }
+}
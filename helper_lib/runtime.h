@@ -0,0 +1,168 @@
+#pragma once
+
+#include "device.h"
+#include "matrix.h"
+
+/**
+ * @brief A kernel built by OclRuntimeGetKernel, kept for the runtime's lifetime.
+ */
+typedef struct _OclCachedKernel
+{
+    char *source;
+    char *name;
+    cl_program program;
+    cl_kernel kernel;
+} OclCachedKernel;
+
+/**
+ * @brief A device buffer of OclRuntimeAcquireBuffer, free for reuse unless
+ * in_use.
+ */
+typedef struct _OclPooledBuffer
+{
+    cl_mem buffer;
+    size_t size;
+    int in_use;
+} OclPooledBuffer;
+
+/**
+ * @brief One device with its context, in-order command queues and the
+ * properties the helper_lib engines size their launches and buffers with
+ * (copied from the device model, see OclGetDeviceProp), plus a cache of the
+ * programs built for it so a kernel is compiled once per process rather than
+ * once per call. Every program is built with build_options, the device's
+ * OclDeviceBuildOptions, so kernel sources can specialize on it. Kernels go
+ * to queue; the streaming engines put host transfers on transfer_queue so
+ * that they overlap with kernels, ordering the two with events.
+ *
+ * Without an OpenCL device the runtime is native instead (see cpu.h): device
+ * describes the host's cores, there is no context, queue or kernel, and the
+ * host-matrix engines (OclElementwise, OclGemm and its variants) compute on
+ * the CPU.
+ */
+typedef struct _OclRuntime
+{
+    cl_device_id device_id;
+    const OclDeviceProp *device;
+    char *build_options;
+    cl_context context;
+    cl_command_queue queue;
+    cl_command_queue transfer_queue;
+    cl_uint compute_units;
+    size_t max_work_group_size;
+    cl_ulong max_mem_alloc_size;
+    cl_ulong global_mem_size;
+    cl_uint int_vector_width; // 4 or 8, from CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT
+    int native;               // non-zero for the native CPU backend
+    OclCachedKernel *kernels;
+    unsigned int num_kernels;
+    unsigned int kernel_capacity;
+    OclPooledBuffer *buffers;
+    unsigned int num_buffers;
+    unsigned int buffer_capacity;
+} OclRuntime;
+
+/**
+ * @brief Finds a device of the given type (see OclGetDeviceWithFallback) and
+ * creates a context and the two command queues for it. If there is no
+ * OpenCL platform or device, or $OCL_NATIVE is set, sets up a native runtime
+ * instead.
+ *
+ * @param runtime The runtime to initialize; release it with OclRuntimeRelease.
+ * @param device_type The type of device to look for.
+ *
+ * @return CL_SUCCESS if and only if the device, context and queue are ready.
+ */
+cl_int OclRuntimeCreate(OclRuntime *runtime, cl_device_type device_type);
+
+/**
+ * @brief OclRuntimeCreate for a given device, e.g. one of the devices of
+ * OclGetPlatforms.
+ *
+ * @param runtime The runtime to initialize; release it with OclRuntimeRelease.
+ * @param device_id The device.
+ *
+ * @return CL_SUCCESS if and only if the context and queues are ready.
+ */
+cl_int OclRuntimeCreateForDevice(OclRuntime *runtime, cl_device_id device_id);
+
+/**
+ * @brief Releases every cached kernel and program, every pooled buffer, the
+ * queues and the context.
+ *
+ * @param runtime A runtime set up by OclRuntimeCreate.
+ *
+ * @return CL_SUCCESS if and only if every object is released.
+ */
+cl_int OclRuntimeRelease(OclRuntime *runtime);
+
+/**
+ * @brief Returns kernel `name` of the program built from source with
+ * runtime->build_options. The program is built on the first request for that
+ * source and name and cached; the kernel stays owned by the runtime, so the
+ * caller must not release it.
+ *
+ * @param runtime The runtime.
+ * @param source OpenCL C source of the program.
+ * @param name The kernel function to take from it.
+ * @param kernel The destination for the kernel.
+ *
+ * @return CL_SUCCESS if and only if the program builds and has the kernel;
+ * CL_INVALID_OPERATION on a native runtime.
+ */
+cl_int OclRuntimeGetKernel(OclRuntime *runtime, const char *source, const char *name,
+                           cl_kernel *kernel);
+
+/**
+ * @brief Creates a device buffer holding all rows * cols elements of matrix.
+ * The write is queued without blocking, so matrix->data must stay valid until
+ * the queue reaches it (a blocking OclRuntimeDownload or clFinish).
+ *
+ * @param runtime The runtime.
+ * @param matrix The host matrix to upload.
+ * @param flags Memory flags of the buffer, e.g. CL_MEM_READ_ONLY.
+ * @param buffer The destination for the buffer; the caller releases it.
+ *
+ * @return CL_SUCCESS if and only if the buffer is created and written.
+ */
+cl_int OclRuntimeUpload(OclRuntime *runtime, const Matrix *matrix, cl_mem_flags flags,
+                        cl_mem *buffer);
+
+/**
+ * @brief Reads all rows * cols elements of matrix back from buffer, blocking
+ * until the queue has finished with it.
+ *
+ * @param runtime The runtime.
+ * @param buffer The device buffer.
+ * @param matrix The host matrix, already allocated with its shape set.
+ *
+ * @return CL_SUCCESS if and only if the read succeeds.
+ */
+cl_int OclRuntimeDownload(OclRuntime *runtime, cl_mem buffer, Matrix *matrix);
+
+/**
+ * @brief Takes a read-write device buffer of at least size bytes from the
+ * runtime's pool, creating one only when no free buffer is large enough, so
+ * that engines needing scratch space on every call (such as the recursive
+ * GEMM) stop allocating once warm. Give it back with OclRuntimeReturnBuffer;
+ * the pool releases it in OclRuntimeRelease.
+ *
+ * Work on runtime->queue is ordered, so a buffer may be returned while
+ * kernels using it are still queued and handed out again to later work on
+ * that queue. Work on other queues must finish first.
+ *
+ * @param runtime The runtime.
+ * @param size The number of bytes needed.
+ * @param buffer The destination for the buffer.
+ *
+ * @return CL_SUCCESS if and only if a buffer is acquired.
+ */
+cl_int OclRuntimeAcquireBuffer(OclRuntime *runtime, size_t size, cl_mem *buffer);
+
+/**
+ * @brief Returns a buffer of OclRuntimeAcquireBuffer to the pool.
+ *
+ * @param runtime The runtime.
+ * @param buffer The buffer; NULL is ignored.
+ */
+void OclRuntimeReturnBuffer(OclRuntime *runtime, cl_mem buffer);
@@ -0,0 +1,234 @@
+#! /usr/bin/python3
+
+import json
+import math
+import statistics
+import sys
+from argparse import ArgumentParser
+from typing import Dict, List, Optional, Tuple
+
+from printer import fail, ok, warning
+
+DEFAULT_ALPHA = 0.01
+DEFAULT_THRESHOLD = 0.05
+EXACT_MAX_SAMPLES = 50  # per side; larger samples use the normal approximation
+
+
+def load(path: str) -> Tuple[Optional[str], Dict[Tuple[str, str], dict]]:
+    """Reads a --bench --json report, or a baseline recorded from several,
+    keyed by operation and dataset. Every result gets run_medians_ms, the
+    medians of the processes it was measured in."""
+    with open(path) as f:
+        report = json.load(f)
+    results = {}
+    for r in report["results"]:
+        r.setdefault("run_medians_ms", [r["median_ms"]])
+        results[(r["operation"], r["dataset"])] = r
+    return report.get("device"), results
+
+
+def merge(paths: List[str]) -> Tuple[Optional[str], Dict[Tuple[str, str], dict]]:
+    """Combines reports of separate runs of one build on one device: each
+    result pools the timed samples and keeps every run's median, and its
+    median is the median of those. Results missing from a run are dropped."""
+    reports = [load(path) for path in paths]
+    devices = {device for device, _ in reports}
+    if len(devices) > 1:
+        fail(f"Runs come from different devices: {', '.join(map(str, devices))}")
+        sys.exit(2)
+    merged = {}
+    for key in reports[0][1]:
+        if any(key not in results for _, results in reports):
+            continue
+        runs = [results[key] for _, results in reports]
+        medians = [m for r in runs for m in r["run_medians_ms"]]
+        merged[key] = {
+            "operation": key[0],
+            "dataset": key[1],
+            "median_ms": statistics.median(medians),
+            "run_medians_ms": medians,
+            "times_ms": [t for r in runs for t in r.get("times_ms", [])],
+        }
+    return reports[0][0], merged
+
+
+def save(path: str, device: Optional[str], results: Dict[Tuple[str, str], dict]) -> None:
+    with open(path, "w") as f:
+        json.dump({"device": device, "results": list(results.values())}, f, indent=2)
+        f.write("\n")
+
+
+def u_statistic(xs: List[float], ys: List[float]) -> Tuple[float, bool]:
+    """Mann-Whitney U of xs: the pairs (x, y) with x > y, ties counting half.
+    Also returns whether there were any ties."""
+    ranked = sorted([(v, 0) for v in xs] + [(v, 1) for v in ys])
+    rank_sum = 0.0
+    ties = False
+    i = 0
+    while i < len(ranked):
+        j = i
+        while j + 1 < len(ranked) and ranked[j + 1][0] == ranked[i][0]:
+            j += 1
+        ties = ties or j > i
+        # 1-based average rank of the tied run i..j
+        rank = (i + j) / 2 + 1
+        rank_sum += rank * sum(1 for k in range(i, j + 1) if ranked[k][1] == 0)
+        i = j + 1
+    n = len(xs)
+    return rank_sum - n * (n + 1) / 2, ties
+
+
+def exact_upper_tail(u: float, m: int, n: int) -> float:
+    """P(U >= u) under the null hypothesis, for samples without ties: the
+    number of orderings of m x's and n y's with each U, counted by the
+    recurrence f(m, n, u) = f(m - 1, n, u - n) + f(m, n - 1, u)."""
+    # counts[j][u] for i x's and j y's, built up over i
+    counts = [[1] for _ in range(n + 1)]
+    for i in range(1, m + 1):
+        row = [[1]]
+        for j in range(1, n + 1):
+            size = i * j + 1
+            dist = [0] * size
+            for k, c in enumerate(row[j - 1]):  # the last element is a y
+                dist[k] += c
+            for k, c in enumerate(counts[j]):  # the last element is an x, above j y's
+                dist[k + j] += c
+            row.append(dist)
+        counts = row
+    dist = counts[n]
+    return sum(dist[math.ceil(u):]) / sum(dist)
+
+
+def normal_upper_tail(u: float, xs: List[float], ys: List[float]) -> float:
+    """P(U >= u) by the normal approximation with tie and continuity
+    corrections."""
+    m, n = len(xs), len(ys)
+    values = sorted(xs + ys)
+    tie_term = 0
+    i = 0
+    while i < len(values):
+        j = i
+        while j + 1 < len(values) and values[j + 1] == values[i]:
+            j += 1
+        t = j - i + 1
+        tie_term += t ** 3 - t
+        i = j + 1
+    N = m + n
+    variance = m * n / 12 * ((N + 1) - tie_term / (N * (N - 1)))
+    if variance <= 0:
+        return 1.0
+    z = (u - 0.5 - m * n / 2) / math.sqrt(variance)
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
+
+def p_greater(xs: List[float], ys: List[float]) -> float:
+    """One-sided Mann-Whitney p-value for xs tending to be greater than ys."""
+    u, ties = u_statistic(xs, ys)
+    if not ties and len(xs) <= EXACT_MAX_SAMPLES and len(ys) <= EXACT_MAX_SAMPLES:
+        return exact_upper_tail(u, len(xs), len(ys))
+    return normal_upper_tail(u, xs, ys)
+
+
+def spread(base: dict) -> float:
+    """The baseline's run-to-run spread: the range of its runs' medians
+    relative to its median, 0 for a baseline of one run."""
+    medians = base["run_medians_ms"]
+    return (max(medians) - min(medians)) / base["median_ms"] if base["median_ms"] > 0 else 0.0
+
+
+def compare(base: dict, current: dict, alpha: float, threshold: float) -> Tuple[str, float, str]:
+    """Returns the verdict (slower, faster or same), the ratio of the median
+    times and the p-value as text. Runs are slower only if the rank test
+    finds them so at alpha and even the fastest current run's median is more
+    than threshold above the slowest baseline run's, so the shift also
+    clears the baseline's spread. The samples of one process share its
+    clocks, placement and caches, so the test alone mistakes the drift
+    between processes of the same build for a change."""
+    xs, ys = current.get("times_ms", []), base.get("times_ms", [])
+    ratio = current["median_ms"] / base["median_ms"] if base["median_ms"] > 0 else 1.0
+    now, then = current["run_medians_ms"], base["run_medians_ms"]
+    if len(xs) < 2 or len(ys) < 2:
+        # no repetitions to test, so the threshold alone decides
+        p_slower = p_faster = 0.0
+        p_text = "-"
+    else:
+        p_slower, p_faster = p_greater(xs, ys), p_greater(ys, xs)
+        p_text = f"{min(p_slower, p_faster):.4f}"
+    if min(now) > max(then) * (1 + threshold) and p_slower < alpha:
+        return "slower", ratio, p_text
+    if max(now) < min(then) * (1 - threshold) and p_faster < alpha:
+        return "faster", ratio, p_text
+    return "same", ratio, p_text
+
+
+if __name__ == "__main__":
+    parser = ArgumentParser(
+        prog="bench_compare",
+        description="Compares --bench --json output of the assignments against a baseline "
+                    "and fails on significant slowdowns.",
+    )
+
+    parser.add_argument('baseline', help="JSON of the reference build, e.g. bench_baseline.json")
+    parser.add_argument('current', nargs='+',
+                        help="JSON of one or more runs of the build under test")
+    parser.add_argument('--record', action="store_true",
+                        help="write the current runs, merged, to baseline instead of comparing")
+    parser.add_argument('--alpha', type=float, default=DEFAULT_ALPHA,
+                        help="significance level of the one-sided Mann-Whitney U test")
+    parser.add_argument('--threshold', type=float, default=DEFAULT_THRESHOLD,
+                        help="smallest relative change between the runs' medians that counts")
+    parser.add_argument('--any-device', action="store_true",
+                        help="compare even if the reports come from different devices")
+    args = parser.parse_args()
+
+    if args.record:
+        device, results = merge(args.current)
+        save(args.baseline, device, results)
+        ok(f"Recorded {len(results)} results from {len(args.current)} run(s) in {args.baseline}")
+        sys.exit(0)
+
+    base_device, baseline = load(args.baseline)
+    current_device, current = merge(args.current)
+    if len(baseline) and all(len(r["run_medians_ms"]) < 2 for r in baseline.values()):
+        warning("The baseline has one run, so drift between runs is not allowed for; "
+                "record it with make bench_baseline.")
+    if base_device != current_device:
+        message = f"Baseline is from \"{base_device}\", current run from \"{current_device}\""
+        if not args.any_device:
+            fail(message + "; rerun on the same device or pass --any-device.")
+            sys.exit(2)
+        warning(message + ".")
+
+    print(f"{'Operation':<16} {'Dataset':<28} {'Base ms':>9} {'Now ms':>9} {'Change':>8} "
+          f"{'Spread':>7} {'p':>7}  Verdict")
+    regressions = 0
+    # in the order the harness ran them, then what it no longer ran
+    for key in list(current) + [k for k in baseline if k not in current]:
+        operation, dataset = key
+        if key not in current:
+            regressions += 1
+            fail(f"{operation:<16} {dataset:<28} {'':>9} {'':>9} {'':>8} {'':>7} {'':>7}  "
+                 f"missing")
+            continue
+        if key not in baseline:
+            print(f"{operation:<16} {dataset:<28} {'':>9} {current[key]['median_ms']:>9.3f} "
+                  f"{'':>8} {'':>7} {'':>7}  new")
+            continue
+
+        verdict, ratio, p_text = compare(baseline[key], current[key], args.alpha, args.threshold)
+        line = (f"{operation:<16} {dataset:<28} {baseline[key]['median_ms']:>9.3f} "
+                f"{current[key]['median_ms']:>9.3f} {100 * (ratio - 1):>+7.1f}% "
+                f"{100 * spread(baseline[key]):>6.1f}% {p_text:>7}  {verdict}")
+        if verdict == "slower":
+            regressions += 1
+            fail(line)
+        elif verdict == "faster":
+            ok(line)
+        else:
+            print(line)
+
+    if regressions:
+        fail(f"{regressions} regression(s) at alpha {args.alpha} and threshold "
+             f"{100 * args.threshold:.0f}% past the baseline's spread")
+        sys.exit(1)
+    ok("No regressions")
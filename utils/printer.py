@@ -13,4 +13,7 @@ def ok(text: str):
     print(f"{bcolors.OKGREEN}{text}{bcolors.ENDC}")
 
 def warning(text: str):
-    print(f"{bcolors.WARNING}{text}{bcolors.ENDC}")
\ No newline at end of file
+    print(f"{bcolors.WARNING}{text}{bcolors.ENDC}")
+
+def fail(text: str):
+    print(f"{bcolors.FAIL}{text}{bcolors.ENDC}")
\ No newline at end of file